@@ -684,6 +684,10 @@ evalcommand(cmd, flags, backcmd)
 			if (pipe(pip) < 0)
 				error("Pipe call failed");
 		}
+		if (mode == 0 && cmdentry.cmdtype == CMDNORMAL
+		 && cmd->ncmd.redirect == NULL && varlist.list == NULL
+		 && spawnshell(jp, cmd, argv, pathval(), cmdentry.u.index) > 0)
+			goto parent;	/* no shell needed to exec it */
 		if (forkshell(jp, cmd, mode) != 0)
 			goto parent;	/* at end of routine */
 		if (flags & EV_BACKCMD) {
@@ -65,6 +65,9 @@ static char rcsid[] = "exec.c,v 1.5 1993/08/01 18:58:17 mycroft Exp";
 #include "error.h"
 #include "init.h"
 #include "mystring.h"
+#include "redir.h"
+#include "trap.h"
+#include <spawn.h>
 #include <sys/types.h>
 #include <stat.h>
 #include <fcntl.h>
@@ -148,6 +151,46 @@ shellexec(argv, envp, path, index)
 }
 
 
+/*
+ * Start a program in a new process, without forking a shell to exec
+ * it.  The new process inherits what it would have from a forked
+ * child.  Returns the process ID, or -1 if it wasn't found or isn't
+ * a program, in which case a forked shell must try it.
+ */
+
+#define MAXSPAWNFD 20
+
+int
+shellspawn(argv, path, index)
+	char **argv;
+	char *path;
+	{
+	struct spawnattr sa;
+	int fds[MAXSPAWNFD];
+	char *cmdname;
+	int pid;
+
+	forksigs(&sa.sa_sigdefault);
+	sa.sa_nclose = scriptfds(fds, MAXSPAWNFD);
+	sa.sa_nclose += savedfds(fds + sa.sa_nclose,
+				 MAXSPAWNFD - sa.sa_nclose);
+	sa.sa_close = fds;
+	if (strchr(argv[0], '/') != NULL)
+		return spawnv(argv[0], argv, &sa);
+	while ((cmdname = padvance(&path, argv[0])) != NULL) {
+		if (--index < 0 && pathopt == NULL) {
+			pid = spawnv(cmdname, argv, &sa);
+			if (pid >= 0 || errno != ENOENT && errno != ENOTDIR) {
+				stunalloc(cmdname);
+				return pid;
+			}
+		}
+		stunalloc(cmdname);
+	}
+	return -1;
+}
+
+
 STATIC void
 tryexec(cmd, argv, envp)
 	char *cmd;
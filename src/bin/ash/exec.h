@@ -57,6 +57,7 @@ extern char *pathopt;		/* set by padvance */
 
 #ifdef __STDC__
 void shellexec(char **, char **, char *, int);
+int shellspawn(char **, char *, int);
 char *padvance(char **, char *);
 void find_command(char *, struct cmdentry *, int);
 int find_builtin(char *);
@@ -66,6 +67,7 @@ void defun(char *, union node *);
 void unsetfunc(char *);
 #else
 void shellexec();
+int shellspawn();
 char *padvance();
 void find_command();
 int find_builtin();
@@ -357,6 +357,27 @@ popfile() {
 }
 
 
+/*
+ * List the file descriptors of files being read, which a forked child
+ * would close with closescript().  Returns the number found.
+ */
+
+int
+scriptfds(fds, max)
+	int *fds;
+	{
+	struct parsefile *pf;
+	int n = 0;
+
+	for (pf = parsefile ; pf && n < max ; pf = pf->prev) {
+		if (pf->fd > 0)
+			fds[n++] = pf->fd;
+	}
+	return n;
+}
+
+
+
 /*
  * Return to top level.
  */
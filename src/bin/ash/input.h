@@ -61,6 +61,7 @@ void setinputstring(char *, int);
 void popfile(void);
 void popallfiles(void);
 void closescript(void);
+int scriptfds(int *, int);
 #else
 char *pfgets();
 int pgetc();
@@ -73,6 +74,7 @@ void setinputstring();
 void popfile();
 void popallfiles();
 void closescript();
+int scriptfds();
 #endif
 
 #define pgetc_macro()	(--parsenleft >= 0? *parsenextc++ : preadbuffer())
@@ -57,6 +57,7 @@ static char rcsid[] = "jobs.c,v 1.7 1993/08/06 21:50:16 mycroft Exp";
 #include "error.h"
 #include "mystring.h"
 #include "redir.h"
+#include "exec.h"
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
@@ -86,6 +87,7 @@ STATIC int procrunning(int);
 STATIC int dowait(int, struct job *);
 STATIC int waitproc(int, int *);
 STATIC char *commandtext(union node *);
+STATIC void forkparent(struct job *, union node *, int, int);
 #else
 STATIC void restartjob();
 STATIC struct job *getjob();
@@ -94,6 +96,7 @@ STATIC int procrunning();
 STATIC int dowait();
 STATIC int waitproc();
 STATIC char *commandtext();
+STATIC void forkparent();
 #endif
 
 
@@ -576,6 +579,52 @@ forkshell(jp, n, mode)
 		}
 		return pid;
 	}
+	forkparent(jp, n, mode, pid);
+	return pid;
+}
+
+
+
+/*
+ * Start a simple command in a new process without forking the shell,
+ * if we can; see shellspawn.  Returns the process ID, or -1 if the
+ * command must be run by forkshell instead.
+ */
+
+int
+spawnshell(jp, n, argv, path, index)
+	union node *n;
+	struct job *jp;
+	char **argv;
+	char *path;
+	{
+	int pid;
+
+	TRACE(("spawnshell(%%%d, 0x%x) called\n", jp - jobtab, (int)n));
+	INTOFF;
+	pid = shellspawn(argv, path, index);
+	if (pid == -1) {
+		TRACE(("Spawn failed, errno=%d\n", errno));
+		INTON;
+		return -1;
+	}
+	forkparent(jp, n, FORK_FG, pid);
+	return pid;
+}
+
+
+
+/*
+ * The parent's side of starting a child process: note it in the job.
+ */
+
+STATIC void
+forkparent(jp, n, mode, pid)
+	union node *n;
+	struct job *jp;
+	{
+	int pgrp;
+
 	if (rootshell && mode != FORK_NOJOB && jflag) {
 		if (jp == NULL || jp->nprocs == 0)
 			pgrp = pid;
@@ -599,7 +648,6 @@ forkshell(jp, n, mode)
 	}
 	INTON;
 	TRACE(("In parent shell:  child = %d\n", pid));
-	return pid;
 }
 
 
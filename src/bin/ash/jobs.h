@@ -85,12 +85,14 @@ void setjobctl(int);
 void showjobs(int);
 struct job *makejob(union node *, int);
 int forkshell(struct job *, union node *, int);
+int spawnshell(struct job *, union node *, char **, char *, int);
 int waitforjob(struct job *);
 #else
 void setjobctl();
 void showjobs();
 struct job *makejob();
 int forkshell();
+int spawnshell();
 int waitforjob();
 #endif
 
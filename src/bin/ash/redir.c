@@ -323,6 +323,30 @@ clearredir() {
 
 
 
+/*
+ * List the saved file descriptors, which a forked child would discard
+ * with clearredir().  Returns the number found.
+ */
+
+int
+savedfds(fds, max)
+	int *fds;
+	{
+	register struct redirtab *rp;
+	int i;
+	int n = 0;
+
+	for (rp = redirlist ; rp ; rp = rp->next) {
+		for (i = 0 ; i < 10 ; i++) {
+			if (rp->renamed[i] >= 0 && n < max)
+				fds[n++] = rp->renamed[i];
+		}
+	}
+	return n;
+}
+
+
+
 /*
  * Copy a file descriptor, like the F_DUPFD option of fcntl.  Returns -1
  * if the source file descriptor is closed, EMPTY if there are no unused
@@ -46,12 +46,14 @@ union node;
 void redirect(union node *, int);
 void popredir(void);
 void clearredir(void);
+int savedfds(int *, int);
 int copyfd(int, int);
 int fd0_redirected_p(void);
 #else
 void redirect();
 void popredir();
 void clearredir();
+int savedfds();
 int copyfd();
 int fd0_redirected_p();
 #endif
@@ -211,6 +211,26 @@ setsignal(signo) {
 }
 
 
+/*
+ * Find the signals the shell ignores which a forked child would set
+ * back to the default (see setsignal), for a child started without
+ * forking.  Those ignored by a trap, or on entry, stay ignored.
+ */
+
+void
+forksigs(set)
+	sigset_t *set;
+	{
+	int signo;
+
+	sigemptyset(set);
+	for (signo = 1 ; signo < _NSIG ; signo++) {
+		if (sigmode[signo] == S_IGN && trap[signo] == NULL)
+			sigaddset(set, signo);
+	}
+}
+
+
 /*
  * Ignore a signal.
  */
@@ -37,12 +37,15 @@
  *	trap.h,v 1.4 1993/08/01 18:58:34 mycroft Exp
  */
 
+#include <signal.h>
+
 extern int pendingsigs;
 
 #ifdef __STDC__
 void clear_traps(void);
 int setsignal(int);
 void ignoresig(int);
+void forksigs(sigset_t *);
 void dotrap(void);
 void setinteractive(int);
 void exitshell(int);
@@ -50,6 +53,7 @@ void exitshell(int);
 void clear_traps();
 int setsignal();
 void ignoresig();
+void forksigs();
 void dotrap();
 void setinteractive();
 void exitshell();
@@ -6,6 +6,8 @@
 #include <sys/ports.h>
 #include <sys/fs.h>
 #include <sys/swap.h>
+#include <sys/sched.h>
+#include <sys/syscall.h>
 
 #define NQIO (4)		/* # parallel qio's */
 
@@ -17,6 +19,24 @@ runqio(void)
 	exit(1);
 }
 
+/*
+ * runzero()
+ *	Keep the kernel's pool of zeroed pages filled
+ *
+ * Only with CPU time nobody else wants.  We can page without it,
+ * so this thread just goes away if it can't start.
+ */
+static void
+runzero(void)
+{
+	if (sched_op(SCHEDOP_SETPRIO, PRI_BG) < 0) {
+		perror("swapd zero priority");
+		return;
+	}
+	zero_pages();
+	perror("swapd zero_pages failed");
+}
+
 main(argc, argv)
 	int argc;
 	char **argv;
@@ -77,6 +97,13 @@ main(argc, argv)
 		}
 	}
 
+	/*
+	 * Launch thread clearing pages ahead of need
+	 */
+	if (tfork(runzero) < 0) {
+		perror("swapd zero fork");
+	}
+
 	/*
 	 * Launch thread dedicated to scanning memory
 	 */
@@ -13,30 +13,13 @@
 #include <sys/msg.h>
 #include <sys/fs.h>
 #include <sys/namer.h>
+#include "timer.h"
 
 #define	MSGCNT	50000
 
 static	port_t swtst_port;		/* swtst communicates thru this */
 static	port_name swtst_port_name;	/*  ...its name */
 
-/*
- * delta_timer - calculate the difference between the current time
- * and the value in 'timer'. Put the result in 'timer'.
- */
-void	delta_timer(timer)
-struct	time *timer;
-{
-	struct time current;
-
-	time_get(&current);
-	if(current.t_usec < timer->t_usec) {
-		current.t_usec += 1000000;
-		current.t_sec--;
-	}
-	timer->t_sec = current.t_sec - timer->t_sec;
-	timer->t_usec = current.t_usec - timer->t_usec;
-}
-
 /*
  * print_timer - print the string corresponding to 'timer' into 'buffer'.
  */
@@ -119,24 +102,29 @@ void	child_thread()
 
 void	usage()
 {
-	fprintf(stderr, "Usage: swtst [-t]\n");
+	fprintf(stderr, "Usage: swtst [-t] [-r]\n");
 	fprintf(stderr,  "\t-t\t\t- use tfork() instead of fork()\n");
+	fprintf(stderr,  "\t-r\t\t- serve with msg_reply_recv()\n");
 	exit(1);
 }
 
 void	main(int argc, char **argv)
 {
 	char	**av;
-	int	ac, pid, count = 0, tflag = 0;
+	int	ac, pid, x, count = 0, tflag = 0, rflag = 0;
 	struct	msg msg;
+	struct	msg_ans ans;
 /*
  * Parse command line arguments.
  */
  	for(ac = 1, av = &argv[1]; ac < argc; ac++) {
  		if(strcmp(*av, "-t") == 0) {
  			tflag++;
+ 		} else if(strcmp(*av, "-r") == 0) {
+ 			rflag++;
  		} else
  			usage();
+ 		av++;
  	}
 /*
  * Register a port for paret/child messaging.
@@ -160,8 +148,20 @@ void	main(int argc, char **argv)
 			child_thread();
 	}
 
+/*
+ * With -r, each answer goes back along with the next receive.
+ */
+	ans.ma_who = 0;
+	ans.ma_msg = &msg;
+	ans.ma_err[0] = '\0';
+	ans.ma_op = 0;
 	for(;;) {
-		if(msg_receive(swtst_port, &msg) < 0) {
+		if(ans.ma_who) {
+			x = msg_reply_recv(swtst_port, &ans, &msg);
+			ans.ma_who = 0;
+		} else
+			x = msg_receive(swtst_port, &msg);
+		if(x < 0) {
 			perror("message receive error");
 			exit(0);
 		}
@@ -173,10 +173,14 @@ void	main(int argc, char **argv)
 		case 10000:
 			msg.m_arg = msg.m_buflen = 0;
 			msg.m_nseg = msg.m_arg1 = 0;
-			msg_reply(msg.m_sender, &msg);
 			if(++count >= MSGCNT) {
+				msg_reply(msg.m_sender, &msg);
 				exit(0);
 			}
+			if(rflag)
+				ans.ma_who = msg.m_sender;
+			else
+				msg_reply(msg.m_sender, &msg);
 			break;
 		default:
 			printf("Unknown message op %d\n", msg.m_op);
@@ -0,0 +1,202 @@
+/*
+ * perf2.c - test request throughput of threads sharing one connection.
+ *
+ * A server with several threads answers requests after a fixed
+ * delay, standing in for a device which can work on several
+ * requests at once.  A client with the same number of threads sends
+ * requests through a single port, either in the usual one-at-a-time
+ * mode or with msg_tagged() so each thread may have one in flight.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <std.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <lock.h>
+#include <sys/syscall.h>
+#include <sys/msg.h>
+#include <sys/fs.h>
+#include <sys/namer.h>
+#include "timer.h"
+
+#define	NTHREAD	4		/* Default # threads on each side */
+#define	MSGCNT	50		/* Default # requests per client thread */
+#define	SVCMS	20		/* Default server delay, milliseconds */
+
+static	port_t perf_port;		/* Server's port */
+static	port_name perf_port_name;	/*  ...its name */
+static	port_t cli_port;		/* Client's shared connection */
+static	int nthread = NTHREAD, msgcnt = MSGCNT, svcms = SVCMS, tflag;
+static	struct time timer;		/* Start of client run */
+static	volatile int ndone;		/* Client threads finished */
+static	volatile lock_t done_lock;	/*  ...mutex for it */
+
+/*
+ * client_thread - send our share of requests through the shared port.
+ * The last thread to finish prints the results.
+ */
+void	client_thread()
+{
+	struct	msg msg;
+	int	i, calls;
+	unsigned long ms;
+
+	for(i = 0; i < msgcnt; i++) {
+		msg.m_op = FS_ABSREAD | M_READ;
+		msg.m_nseg = 0;
+		msg.m_arg = 0;
+		msg.m_arg1 = i;
+		if (msg_send(cli_port, &msg) < 0) {
+			perror("msg_send");
+			exit(1);
+		}
+	}
+
+	p_lock(&done_lock);
+	if (++ndone < nthread) {
+		v_lock(&done_lock);
+		_exit(0);
+	}
+	v_lock(&done_lock);
+
+	delta_timer(&timer);
+	ms = 1000 * timer.t_sec + timer.t_usec / 1000;
+	calls = nthread * msgcnt;
+	printf("%s: %d threads, %d requests in %lu ms, %lu requests/sec\n",
+		tflag ? "tagged" : "serial", nthread, calls, ms,
+		ms ? ((calls * 1000UL) / ms) : 0UL);
+	exit(0);
+}
+
+/*
+ * client - connect once, then share the connection among our threads
+ */
+void	client()
+{
+	port_name pn;
+	int	i;
+
+	pn = namer_find("perf2");
+	if (pn < 0) {
+		perror("namer_find");
+		exit(1);
+	}
+	if((cli_port = msg_connect(pn, ACC_READ)) < 0) {
+		perror("msg_connect");
+		exit(1);
+	}
+	if (tflag && (msg_tagged(cli_port, 1) < 0)) {
+		perror("msg_tagged");
+		exit(1);
+	}
+
+	time_get(&timer);
+	for (i = 1; i < nthread; ++i) {
+		if (tfork(client_thread, 0) < 0) {
+			perror("tfork");
+			exit(1);
+		}
+	}
+	client_thread();
+}
+
+/*
+ * server_thread - answer requests after a delay
+ *
+ * Replies carry no data, so it doesn't matter which of a client's
+ * outstanding requests a reply is matched to.
+ */
+void	server_thread()
+{
+	struct	msg msg;
+
+	for(;;) {
+		if(msg_receive(perf_port, &msg) < 0) {
+			perror("message receive error");
+			exit(1);
+		}
+		switch(msg.m_op & MSG_MASK) {
+		case M_CONNECT:
+			msg_accept(msg.m_sender);
+			break;
+		case M_DISCONNECT:
+			exit(0);
+		case M_DUP:
+		case M_ABORT:
+			msg_reply(msg.m_sender, &msg);
+			break;
+		case FS_ABSREAD:
+			__msleep(svcms);
+			msg.m_arg = msg.m_arg1 = msg.m_nseg = 0;
+			msg_reply(msg.m_sender, &msg);
+			break;
+		default:
+			msg_err(msg.m_sender, EINVAL);
+			break;
+		}
+	}
+}
+
+void	usage()
+{
+	fprintf(stderr,
+		"Usage: perf2 [-t] [-n threads] [-c count] [-d msec]\n");
+	fprintf(stderr, "\t-t\t\t- share the connection with msg_tagged()\n");
+	exit(1);
+}
+
+void	main(int argc, char **argv)
+{
+	int	x, i, pid;
+
+	while ((x = getopt(argc, argv, "tn:c:d:")) > 0) {
+		switch (x) {
+		case 't':
+			tflag = 1;
+			break;
+		case 'n':
+			nthread = atoi(optarg);
+			break;
+		case 'c':
+			msgcnt = atoi(optarg);
+			break;
+		case 'd':
+			svcms = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((nthread < 1) || (msgcnt < 1)) {
+		usage();
+	}
+
+	perf_port = msg_port((port_name)0, &perf_port_name);
+
+	/*
+	 * Our replies carry nothing, so any of them will do for any
+	 * request; that's enough to take tagged clients.
+	 */
+	if (tflag && (msg_tagged(perf_port, 1) < 0)) {
+		perror("msg_tagged");
+		exit(1);
+	}
+	if (namer_register("perf2", perf_port_name) < 0) {
+		perror("namer_register");
+		exit(1);
+	}
+
+	if((pid = fork()) < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if(pid == 0) {
+		client();
+	}
+
+	for (i = 1; i < nthread; ++i) {
+		tfork(server_thread, 0);
+	}
+	server_thread();
+}
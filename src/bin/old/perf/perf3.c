@@ -0,0 +1,126 @@
+/*
+ * perf3.c - measure context switch rate on each CPU.
+ *
+ * Several threads each yield the CPU in a tight loop.  Every yield
+ * puts the thread back on its run queue and runs the next, so the
+ * kernel's per-CPU switch counts (from pstat()) over the run show
+ * how fast each CPU's scheduler can turn over, and how much work
+ * moved between CPUs to keep them all busy.  No port starts a
+ * second CPU yet, so for now it only ever reports on one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <std.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/pstat.h>
+#include <sys/percpu.h>
+
+#define	NTHREAD	4		/* Default # threads yielding */
+#define	SECS	5		/* Default # seconds to run */
+#define	MAXCPUS	32		/* Most CPUs we'll report on */
+
+static	int nthread = NTHREAD, secs = SECS, ncpu;
+static	volatile ulong *yields;	/* Per-thread # yields done */
+static	struct pstat_cpu before[MAXCPUS], after[MAXCPUS];
+
+/*
+ * snap - take a copy of each CPU's scheduling counters
+ */
+void	snap(struct pstat_cpu *psc)
+{
+	int	x;
+
+	for (x = 0; x < ncpu; ++x) {
+		if (pstat(PSTAT_CPU, x, &psc[x], sizeof(psc[x])) < 0) {
+			perror("pstat");
+			exit(1);
+		}
+	}
+}
+
+/*
+ * spinner - yield, forever
+ */
+void	spinner(ulong idx)
+{
+	for (;;) {
+		yield();
+		yields[idx] += 1;
+	}
+}
+
+void	usage()
+{
+	fprintf(stderr, "Usage: perf3 [-n threads] [-s seconds]\n");
+	exit(1);
+}
+
+void	main(int argc, char **argv)
+{
+	struct	pstat_kernel psk;
+	ulong	sw, st, total, ytotal;
+	int	x;
+
+	while ((x = getopt(argc, argv, "n:s:")) > 0) {
+		switch (x) {
+		case 'n':
+			nthread = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((nthread < 1) || (secs < 1)) {
+		usage();
+	}
+
+	if (pstat(PSTAT_KERNEL, 0, &psk, sizeof(psk)) < 0) {
+		perror("pstat");
+		exit(1);
+	}
+	ncpu = psk.psk_ncpu;
+	if (ncpu > MAXCPUS) {
+		ncpu = MAXCPUS;
+	}
+	yields = calloc(nthread, sizeof(ulong));
+
+	/*
+	 * Start the spinners, and let them run
+	 */
+	snap(before);
+	for (x = 0; x < nthread; ++x) {
+		if (tfork(spinner, (ulong)x) < 0) {
+			perror("tfork");
+			exit(1);
+		}
+	}
+	sleep(secs);
+	snap(after);
+
+	/*
+	 * Report, per CPU and in total
+	 */
+	total = 0;
+	for (x = 0; x < ncpu; ++x) {
+		if (!(after[x].psc_flags & CPU_UP)) {
+			continue;
+		}
+		sw = after[x].psc_switches - before[x].psc_switches;
+		st = after[x].psc_steals - before[x].psc_steals;
+		total += sw;
+		printf("cpu %d: %lu switches, %lu/sec, %lu stolen\n",
+			x, sw, sw / secs, st);
+	}
+	ytotal = 0;
+	for (x = 0; x < nthread; ++x) {
+		ytotal += yields[x];
+	}
+	printf("%d threads, %d cpus: %lu switches/sec, %lu yields/sec\n",
+		nthread, ncpu, total / secs, ytotal / secs);
+	exit(0);
+}
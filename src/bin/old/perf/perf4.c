@@ -0,0 +1,180 @@
+/*
+ * perf4.c - measure scheduler fairness and latency under load.
+ *
+ * Hundreds of threads spin, each counting its loops and noting the
+ * longest it went between looks at the clock--which is about the
+ * longest it sat runnable without a CPU.  First the timeshare
+ * threads run for a while, all competing under sched_root; then
+ * they stop and the background threads have the machine to
+ * themselves.  For each group we report how evenly the CPU was
+ * shared, and the worst wait any one thread saw.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <std.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/sched.h>
+#include "timer.h"
+
+#define	NTS	200		/* Default # timeshare threads */
+#define	NBG	100		/* Default # background threads */
+#define	SECS	5		/* Default # seconds for each group */
+#define	CHECK	1024		/* # loops between looks at clock */
+
+/*
+ * Per-thread tallies
+ */
+struct tally {
+	ulong t_loops;		/* Loops done */
+	ulong t_maxgap;		/* Longest between looks, usec */
+	int t_up;		/* Thread under way */
+};
+
+static	int nts = NTS, nbg = NBG, secs = SECS;
+static	struct tally *tallies;
+static	volatile int phase;	/* 1: timeshare threads exit, 2: all do */
+
+/*
+ * spinner - count loops, watching for long gaps
+ */
+void	spinner(ulong idx)
+{
+	struct	tally *t = &tallies[idx];
+	ulong	now, last, gap;
+	int	done;
+	uint	x;
+
+	/*
+	 * Note that we're up before going background; we may not
+	 * get the CPU again for a while.
+	 */
+	done = (idx < nts) ? 1 : 2;
+	t->t_up = 1;
+	if (done == 2) {
+		if (sched_op(SCHEDOP_SETPRIO, PRI_BG) < 0) {
+			perror("sched_op");
+			_exit(1);
+		}
+	}
+	last = usec();
+	for (;;) {
+		for (x = 0; x < CHECK; ++x) {
+			t->t_loops += 1;
+		}
+		if (phase >= done) {
+			_exit(0);
+		}
+		now = usec();
+		gap = now - last;
+		if (gap > t->t_maxgap) {
+			t->t_maxgap = gap;
+		}
+		last = now;
+	}
+}
+
+/*
+ * report - summarize one group of threads
+ */
+void	report(char *what, struct tally *t, int n)
+{
+	ulong	lo, hi, sum, worst;
+	int	x;
+
+	if (n == 0) {
+		return;
+	}
+	lo = hi = t[0].t_loops;
+	sum = worst = 0;
+	for (x = 0; x < n; ++x) {
+		if (t[x].t_loops < lo) {
+			lo = t[x].t_loops;
+		}
+		if (t[x].t_loops > hi) {
+			hi = t[x].t_loops;
+		}
+		if (t[x].t_maxgap > worst) {
+			worst = t[x].t_maxgap;
+		}
+		sum += t[x].t_loops;
+	}
+	printf("%d %s threads: loops min %lu mean %lu max %lu",
+		n, what, lo, sum / n, hi);
+	if (hi) {
+		printf(" (min %lu%% of max)", (lo * 100) / hi);
+	}
+	printf(", worst wait %lu ms\n", worst / 1000);
+}
+
+void	usage()
+{
+	fprintf(stderr,
+		"Usage: perf4 [-n timeshare] [-b background] [-s seconds]\n");
+	exit(1);
+}
+
+void	main(int argc, char **argv)
+{
+	int	x;
+
+	while ((x = getopt(argc, argv, "n:b:s:")) > 0) {
+		switch (x) {
+		case 'n':
+			nts = atoi(optarg);
+			break;
+		case 'b':
+			nbg = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((nts < 0) || (nbg < 0) || ((nts + nbg) < 1) || (secs < 1)) {
+		usage();
+	}
+	tallies = calloc(nts + nbg, sizeof(struct tally));
+
+	/*
+	 * Start them all.  We're real-time, so we get the CPU back
+	 * when we wake, however busy it is.
+	 */
+	if (sched_op(SCHEDOP_SETPRIO, PRI_RT) < 0) {
+		perror("sched_op");
+		exit(1);
+	}
+	for (x = 0; x < nts + nbg; ++x) {
+		if (tfork(spinner, (ulong)x) < 0) {
+			perror("tfork");
+			exit(1);
+		}
+	}
+	for (x = 0; x < nts + nbg; ++x) {
+		while (!tallies[x].t_up) {
+			sleep(1);
+		}
+	}
+
+	/*
+	 * Timeshare first, then background on its own.  The
+	 * background threads sat starved while the others ran;
+	 * their tallies start over once they have the CPU.
+	 */
+	sleep(secs);
+	phase = 1;
+	sleep(1);
+	for (x = nts; x < nts + nbg; ++x) {
+		tallies[x].t_loops = 0;
+		tallies[x].t_maxgap = 0;
+	}
+	sleep(secs);
+
+	report("timeshare", tallies, nts);
+	report("background", tallies + nts, nbg);
+	phase = 2;
+	exit(0);
+}
@@ -0,0 +1,147 @@
+/*
+ * perf5.c - measure what large pages save in TLB misses.
+ *
+ * A big array is scanned a word per page, so nearly every access
+ * wants a TLB entry of its own.  The array is first one anonymous
+ * mapping, which the kernel can cover with 4 Mb pages once told it
+ * will all be used (MADV_WILLNEED), then the same amount of memory
+ * as mappings too small for them.  The difference in time per access
+ * is what the TLB misses on small pages cost; the kernel's count of
+ * large pages made (from pstat()) shows they were used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <std.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/pstat.h>
+#include "timer.h"
+
+#define	MB	(1024 * 1024)
+#define	SIZE	32		/* Default Mb of array */
+#define	PASSES	20		/* Default # times it's scanned */
+#define	PIECE	(2 * MB)	/* Size of mappings too small for large pages */
+
+static	int size = SIZE, passes = PASSES;
+
+/*
+ * vmstat - get kernel paging counters
+ */
+static	void vmstat(struct pstat_vm *psv)
+{
+	if (pstat(PSTAT_VM, 0, psv, sizeof(*psv)) < 0) {
+		perror("pstat");
+		exit(1);
+	}
+}
+
+/*
+ * getmem - get anonymous memory, all of which will be used
+ */
+static	char *getmem(ulong len)
+{
+	char	*p;
+
+	p = mmap(0, len, PROT_READ|PROT_WRITE, MAP_ANON, -1, 0L);
+	if (p == 0) {
+		perror("mmap");
+		exit(1);
+	}
+	if (madvise(p, len, MADV_WILLNEED) < 0) {
+		perror("madvise");
+		exit(1);
+	}
+	return(p);
+}
+
+/*
+ * scan - touch a word in each page of each piece, "passes" times
+ *
+ * The first pass faults it all in, and isn't timed.  Returns
+ * nanoseconds per access.
+ */
+static	ulong scan(char **pieces, int npiece, ulong len)
+{
+	ulong	start, x, sum = 0;
+	int	p, y;
+
+	for (y = 0; y < npiece; ++y) {
+		for (x = 0; x < len; x += NBPG) {
+			pieces[y][x] = 1;
+		}
+	}
+	start = usec();
+	for (p = 0; p < passes; ++p) {
+		for (y = 0; y < npiece; ++y) {
+			for (x = 0; x < len; x += NBPG) {
+				sum += pieces[y][x];
+			}
+		}
+	}
+	if (sum != (ulong)passes * npiece * (len / NBPG)) {
+		fprintf(stderr, "perf5: bad sum\n");
+		exit(1);
+	}
+	return(((usec() - start) * 1000) /
+		((ulong)passes * npiece * (len / NBPG)));
+}
+
+void	usage()
+{
+	fprintf(stderr, "Usage: perf5 [-m megabytes] [-p passes]\n");
+	exit(1);
+}
+
+void	main(int argc, char **argv)
+{
+	struct	pstat_vm before, after;
+	char	*big, **pieces;
+	ulong	nsbig, nssmall;
+	int	x, npiece;
+
+	while ((x = getopt(argc, argv, "m:p:")) > 0) {
+		switch (x) {
+		case 'm':
+			size = atoi(optarg);
+			break;
+		case 'p':
+			passes = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((size < 8) || (passes < 1)) {
+		usage();
+	}
+	npiece = (size * MB) / PIECE;
+
+	/*
+	 * One big mapping
+	 */
+	vmstat(&before);
+	big = getmem((ulong)size * MB);
+	nsbig = scan(&big, 1, (ulong)size * MB);
+	vmstat(&after);
+	munmap(big, (ulong)size * MB);
+	printf("%d Mb as one mapping: %lu ns/page, %lu large pages\n",
+		size, nsbig, after.psv_large - before.psv_large);
+
+	/*
+	 * The same in pieces
+	 */
+	pieces = malloc(npiece * sizeof(char *));
+	for (x = 0; x < npiece; ++x) {
+		pieces[x] = getmem(PIECE);
+	}
+	nssmall = scan(pieces, npiece, PIECE);
+	printf("%d Mb as %d mappings: %lu ns/page\n",
+		size, npiece, nssmall);
+	if (nsbig) {
+		printf("small/large pages: %lu.%02lu\n", nssmall / nsbig,
+			((nssmall % nsbig) * 100) / nsbig);
+	}
+	exit(0);
+}
@@ -0,0 +1,161 @@
+/*
+ * perf6.c - measure the cost of starting a new program.
+ *
+ * A process is started running a trivial program, and waited for,
+ * over and over, three ways: fork() then execv(), vfork() then
+ * execv(), and spawnv().  The program is this one, run with an
+ * argument telling it to exit at once, so the time per process is
+ * close to all creation, exec and teardown.  The first two build
+ * (or borrow) a copy of our address space only to throw it away;
+ * the difference with spawnv() is what that costs.  A big -m makes
+ * the address space, and the difference, bigger.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <std.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <string.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include "timer.h"
+
+#define	NSTART	200		/* Default # processes each way */
+#define	MB	(1024 * 1024)
+
+static	int nproc = NSTART, mb = 0;
+static	char *prog, *args[3];
+
+/*
+ * reap - wait for a child, which should exit cleanly
+ */
+static	void reap(pid_t pid)
+{
+	int	status;
+
+	if ((waitpid(pid, &status, 0) != pid) || (status != 0)) {
+		fprintf(stderr, "perf6: child %ld failed\n", (long)pid);
+		exit(1);
+	}
+}
+
+/*
+ * byfork - start a child with fork() or vfork(), then execv()
+ */
+static	void byfork(int (*f)(void))
+{
+	pid_t	pid;
+
+	pid = (*f)();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		execv(prog, args);
+		_exit(1);
+	}
+	reap(pid);
+}
+
+/*
+ * byspawn - start a child with spawnv()
+ */
+static	void byspawn(int (*f)(void))
+{
+	pid_t	pid;
+
+	pid = spawnv(prog, args, 0);
+	if (pid < 0) {
+		perror("spawnv");
+		exit(1);
+	}
+	reap(pid);
+}
+
+/*
+ * timeit - time starting nproc children one way, in usec each
+ */
+static	ulong timeit(void (*how)(int (*)(void)), int (*f)(void))
+{
+	ulong	start;
+	int	x;
+
+	start = usec();
+	for (x = 0; x < nproc; ++x) {
+		(*how)(f);
+	}
+	return((usec() - start) / nproc);
+}
+
+void	usage()
+{
+	fprintf(stderr,
+		"Usage: perf6 [-n processes] [-m megabytes] [-p program]\n");
+	exit(1);
+}
+
+void	main(int argc, char **argv)
+{
+	ulong	tf, tv, ts, off;
+	char	*mem;
+	int	x;
+
+	/*
+	 * This is what our children run
+	 */
+	if ((argc == 2) && !strcmp(argv[1], "-z")) {
+		exit(0);
+	}
+
+	prog = argv[0];
+	while ((x = getopt(argc, argv, "n:m:p:")) > 0) {
+		switch (x) {
+		case 'n':
+			nproc = atoi(optarg);
+			break;
+		case 'm':
+			mb = atoi(optarg);
+			break;
+		case 'p':
+			prog = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((nproc < 1) || (mb < 0)) {
+		usage();
+	}
+	args[0] = prog;
+	args[1] = "-z";
+	args[2] = 0;
+
+	/*
+	 * Dirty some memory, so there's more of an address space
+	 * to copy
+	 */
+	if (mb) {
+		mem = malloc(mb * MB);
+		if (mem == 0) {
+			perror("malloc");
+			exit(1);
+		}
+		for (off = 0; off < mb * MB; off += NBPG) {
+			mem[off] = 1;
+		}
+	}
+
+	tf = timeit(byfork, fork);
+	tv = timeit(byfork, vfork);
+	ts = timeit(byspawn, 0);
+	printf("%d processes, %d Mb dirty: fork+exec %lu usec, "
+		"vfork+exec %lu usec, spawn %lu usec\n",
+		nproc, mb, tf, tv, ts);
+	if (ts) {
+		printf("fork+exec/spawn: %lu.%02lu\n", tf / ts,
+			((tf % ts) * 100) / ts);
+	}
+	exit(0);
+}
@@ -0,0 +1,124 @@
+/*
+ * perf8.c - check user semaphores under contention.
+ *
+ * Several threads take a semaphore, count themselves in, yield the
+ * CPU to give the others a chance to pile up behind them, and count
+ * themselves out again.  No more threads than the semaphore's initial
+ * count may ever be inside at once, and every pass must be counted;
+ * either going wrong is reported and fails the run.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <std.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <lock.h>
+#include <sema.h>
+#include <sys/syscall.h>
+
+#define	NTHREAD	4		/* Default # threads contending */
+#define	LOOPS	10000		/* Default # passes per thread */
+
+static	int nthread = NTHREAD, loops = LOOPS, count = 1;
+static	struct sema *sema;		/* Semaphore under test */
+static	volatile int inside;		/* Threads holding it now */
+static	volatile int most;		/*  ...most ever at once */
+static	volatile int bad;		/* Passes which saw too many */
+static	volatile ulong passes;		/* Passes made in all */
+static	volatile lock_t count_lock;	/* Mutex for the counts above */
+static	volatile int ndone;		/* Threads finished */
+
+/*
+ * contender - take and release the semaphore, checking who's inside.
+ * The last thread to finish prints the results.
+ */
+void	contender()
+{
+	int	i, n;
+
+	for (i = 0; i < loops; ++i) {
+		if (p_sema(sema) < 0) {
+			perror("p_sema");
+			exit(1);
+		}
+		p_lock(&count_lock);
+		n = ++inside;
+		if (n > most) {
+			most = n;
+		}
+		if (n > count) {
+			bad += 1;
+		}
+		v_lock(&count_lock);
+
+		yield();
+
+		p_lock(&count_lock);
+		inside -= 1;
+		passes += 1;
+		v_lock(&count_lock);
+		v_sema(sema);
+	}
+
+	p_lock(&count_lock);
+	if (++ndone < nthread) {
+		v_lock(&count_lock);
+		_exit(0);
+	}
+	v_lock(&count_lock);
+
+	printf("%d threads, count %d: %lu passes, at most %d inside\n",
+		nthread, count, passes, most);
+	if (bad || (passes != (ulong)nthread * loops)) {
+		printf("FAILED: %d passes over count, %lu of %lu passes\n",
+			bad, passes, (ulong)nthread * loops);
+		exit(1);
+	}
+	exit(0);
+}
+
+void	usage()
+{
+	fprintf(stderr,
+		"Usage: perf8 [-n threads] [-l loops] [-c count]\n");
+	exit(1);
+}
+
+void	main(int argc, char **argv)
+{
+	int	x;
+
+	while ((x = getopt(argc, argv, "n:l:c:")) > 0) {
+		switch (x) {
+		case 'n':
+			nthread = atoi(optarg);
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 'c':
+			count = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((nthread < 3) || (loops < 1) || (count < 1) ||
+			(count >= nthread)) {
+		usage();
+	}
+
+	init_lock(&count_lock);
+	if ((sema = alloc_sema(count)) == 0) {
+		perror("alloc_sema");
+		exit(1);
+	}
+
+	for (x = 1; x < nthread; ++x) {
+		if (tfork(contender, 0) < 0) {
+			perror("tfork");
+			exit(1);
+		}
+	}
+	contender();
+}
@@ -0,0 +1,33 @@
+/*
+ * timer.c - timing routines shared by the performance tests.
+ */
+#include "timer.h"
+
+/*
+ * delta_timer - calculate the difference between the current time
+ * and the value in 'timer'. Put the result in 'timer'.
+ */
+void	delta_timer(timer)
+struct	time *timer;
+{
+	struct time current;
+
+	time_get(&current);
+	if(current.t_usec < timer->t_usec) {
+		current.t_usec += 1000000;
+		current.t_sec--;
+	}
+	timer->t_sec = current.t_sec - timer->t_sec;
+	timer->t_usec = current.t_usec - timer->t_usec;
+}
+
+/*
+ * usec - current time, in microseconds
+ */
+ulong	usec(void)
+{
+	struct	time t;
+
+	time_get(&t);
+	return(t.t_sec * 1000000 + t.t_usec);
+}
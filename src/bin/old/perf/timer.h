@@ -0,0 +1,14 @@
+#ifndef _PERF_TIMER_H
+#define _PERF_TIMER_H
+/*
+ * timer.h
+ *	Timing routines shared by the performance tests
+ */
+#include <sys/types.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+extern void delta_timer(struct time *);
+extern ulong usec(void);
+
+#endif /* _PERF_TIMER_H */
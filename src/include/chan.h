@@ -0,0 +1,54 @@
+#ifndef _CHAN_H
+#define _CHAN_H
+/*
+ * chan.h
+ *	Shared memory channels between a server and one client
+ *
+ * A channel is a ring of fixed-size slots in memory shared by a
+ * producer and a consumer, with a count of slots filled and one of
+ * slots emptied.  The server allocates it, and hands it to a client
+ * which asks with FS_SHMAP; from then on data moves through the ring
+ * with no messages at all.  The producer only goes into the kernel
+ * when the consumer has gone to sleep on an empty ring, to wake it.
+ *
+ * Each side of a channel must be a single thread, or do its own
+ * locking.
+ */
+#include <sys/types.h>
+#include <sys/msg.h>
+
+#define CHAN_MAGIC (0x4368616e)	/* Tells it's a channel */
+
+/*
+ * Header at the start of the shared memory.  The slots follow,
+ * each a length and then c_slotsize bytes of data.
+ */
+struct chan {
+	ulong c_magic;		/* CHAN_MAGIC */
+	uint c_size;		/* Bytes of shared memory */
+	uint c_nslot;		/* # slots, a power of two */
+	uint c_slotsize;	/* Bytes of data in each */
+	volatile uint c_head;	/* Slots filled, ever */
+	volatile uint c_tail;	/* Slots emptied, ever */
+	volatile uint c_sleeping; /* Consumer waiting on c_head */
+	volatile ulong c_dropped; /* Puts refused for a full ring */
+};
+
+/*
+ * Routines in -lusr.  The server side...
+ */
+extern struct chan *chan_alloc(uint nslot, uint slotsize);
+extern int chan_reply(struct chan *, long sender);
+extern void *chan_slot(struct chan *);
+extern void chan_push(struct chan *, uint len);
+extern int chan_put(struct chan *, void *buf, uint len);
+extern void chan_free(struct chan *);
+
+/*
+ * ...and the client's
+ */
+extern struct chan *chan_open(port_t port, long arg);
+extern int chan_get(struct chan *, void *buf, uint len, int wait);
+extern void chan_close(struct chan *);
+
+#endif /* _CHAN_H */
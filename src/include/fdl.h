@@ -22,6 +22,7 @@ struct port {
 	uint p_refs;		/* # FD's mapping to this port # */
 	ulong p_pos;		/* Absolute byte offset in file */
 	ulong p_iocount;	/* I/O count, for select() */
+	uint p_tagged;		/* Switched to msg_tagged() for async I/O */
 };
 
 /*
@@ -30,6 +31,8 @@ struct port {
 extern uint __fdl_size(void);
 extern void __fdl_save(char *, ulong);
 extern char *__fdl_restore(char *);
+extern void __fdl_drop(char *, int);
+extern uint __fdl_ports(char *, port_t *, uint);
 extern port_t __fd_port(int);
 extern int __fd_alloc(port_t);
 extern struct port *__port(int);
@@ -37,4 +40,9 @@ extern ulong __fd_iocount(int);
 extern void __fd_set_iocount(int, ulong);
 extern int __fd_readcount(int);
 
+/*
+ * Asynchronous I/O; completions are collected with msg_reap()
+ */
+extern int read_async(int, void *, uint);
+
 #endif /* _FDL_H */
@@ -2,19 +2,36 @@
 #define _LOCK_H
 /*
  * lock.h
- *	User-level spinlocks
+ *	User-level locks
+ *
+ * A lock is 0 when free, 1 when held, and 2 when held with someone
+ * (perhaps) asleep waiting for it.  Taking and releasing it without
+ * contention stays in user space; only a thread which finds it held
+ * goes into the kernel, to sleep in mutex_wait() until the holder's
+ * v_lock() sees the 2 and calls mutex_wake().
  */
 #include <sys/types.h>
 
 typedef unsigned int lock_t;
 
+extern int mutex_wait(void *, int);
+extern int mutex_wake(void *, int);
+
 /*
  * Inline
  */
 inline extern void
 v_lock(volatile lock_t *lp)
 {
-	*lp = 0;
+	lock_t old;
+
+	__asm__ __volatile__(
+		"xchgl %0,%1\n\t"
+		: "=r" (old), "=m" (*lp)
+		: "0" (0), "m" (*lp));
+	if (old == 2) {
+		(void)mutex_wake((void *)lp, 1);
+	}
 }
 inline extern void
 init_lock(volatile lock_t *lp)
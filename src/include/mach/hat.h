@@ -12,6 +12,7 @@ struct hatvas {
 	ulong h_cr3;
 	struct rmap *h_map;	/* Map of vaddr's free */
 	ulong h_l1segs;		/* Bit map of which L1 slots used */
+	pte_t *h_large;		/* L2PT behind each PT_PS L1 entry */
 };
 
 struct hatpview {
@@ -23,5 +24,10 @@ struct hatpset {
 };
 
 #define H_L1SEGS (32)		/* # parts L1 PTE's broken into */
+#define H_LARGE (NPTPG)		/* # pages in a large page, if hat_large */
+
+#ifdef KERNEL
+extern int hat_large;		/* Large pages can be used */
+#endif
 
 #endif /* _MACHHAT_H */
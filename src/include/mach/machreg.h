@@ -107,6 +107,12 @@ struct fpu {
 #define CR0_CD BIT(30)	/* Cache disable */
 #define CR0_PG BIT(31)	/* Paging--use PTEs/CR3 */
 
+/*
+ * Bits in CR4, and in the feature flags returned by CPUID
+ */
+#define CR4_PSE BIT(4)	/* Page size extension--4 Mb L1 PTEs */
+#define CPUID_PSE BIT(3)	/* CPU supports CR4_PSE */
+
 #ifdef KERNEL
 extern void fpu_enable(struct fpu *), fpu_disable(struct fpu *),
 	fpu_maskexcep(void);
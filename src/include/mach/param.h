@@ -15,6 +15,11 @@
 #define btop(x) ((ulong)(x) >> PGSHIFT)
 #define btorp(x) (((ulong)(x) + (NBPG-1)) >> PGSHIFT)
 
+/*
+ * Top of the memory ISA DMA can reach (the low 24 bits)
+ */
+#define DMA_LIM (16 * 1024 * 1024)
+
 /*
  * How often our clock "ticks"
  */
@@ -19,6 +19,11 @@
  */
 #define CMD_SQR_WAVE 0x34
 
+/*
+ * Command to set one-shot mode (interrupt on terminal count)
+ */
+#define CMD_ONESHOT 0x30
+
 /*
  * Command to latch the timer registers
  */
@@ -34,4 +39,17 @@
  */
 #define PIT_LATCH ((PIT_TICK + (HZ / 2)) / HZ)
 
+/*
+ * Bounds on a one-shot count: the shortest worth the interrupt
+ * (about 50 usec), and the most the 16-bit counter holds
+ */
+#define PIT_MIN 60
+#define PIT_MAX 0xFFFF
+
+/*
+ * Counts which go by between latching the old count and loading
+ * a new one
+ */
+#define PIT_GAP 4
+
 #endif /* _MACHPIT_H */
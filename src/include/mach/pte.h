@@ -11,10 +11,12 @@ typedef unsigned long pte_t;
 #define	PT_U	0x004		/* user accessible */
 #define PT_R	0x020		/* accessed */
 #define PT_M	0x040		/* dirty */
+#define PT_PS	0x080		/* L1 only: maps a 4 Mb page, no L2 */
 #define PT_PFN	0xFFFFF000	/* PFN goes here */
 #define PT_PFNSHIFT 12		/* # bits over to plug in PFN */
 
 #define NPTPG (NBPG/sizeof(pte_t))
+#define PT_PSPFN 0xFFC00000	/* PFN bits of a PT_PS L1 entry */
 
 /*
  * For picking apart the bits which index each level
@@ -39,6 +39,7 @@ extern void init_mount(char *);
 extern ulong __mount_size(void);
 extern void __mount_save(char *);
 extern char *__mount_restore(char *);
+extern uint __mount_ports(port_t *, uint);
 extern void __get_mntinfo(int *, struct mnttab **);
 
 #endif /* _MNTTAB_H */
@@ -17,8 +17,8 @@
 typedef struct sema {
 	lock_t s_locked;	/* Mutex lock on this struct */
 	int s_val;		/* Semaphore count */
-	port_t s_port,		/* Sempahore server when sleeping */
-		s_portmaster;
+	volatile int s_seq;	/* Sleepers wait on this */
+	int s_wakeups;		/* Wakeups not yet taken */
 } sema_t;
 
 /*
@@ -5,8 +5,15 @@
 #ifndef _SERVER_H
 #define _SERVER_H
 #include <sys/perm.h>
+#include <sys/msg.h>
 
 extern int valid_fname(char *, int);
 extern char *perm_print(struct prot *);
 
+/*
+ * Answers held over to go with the next receive; see lib/srv/reply.c
+ */
+extern void srv_reply(long, struct msg *), srv_err(long, char *);
+extern int srv_receive(port_t, struct msg *);
+
 #endif /* _SERVER_H */
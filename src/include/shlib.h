@@ -0,0 +1,34 @@
+#ifndef _SHLIB_H
+#define _SHLIB_H
+/*
+ * shlib.h
+ *	Prelink table of the shared libraries
+ *
+ * mkshlib -l writes this as it lays out the libraries, and it's
+ * installed beside them in /vsta/lib.  It tells where each library
+ * sits and how big it is, so the loader in each program can map one
+ * directly--without bringing in ld.shl, or reading the library's
+ * own header first.  The header mapped with the text must still
+ * match the table's copy; if it doesn't, the library was rebuilt
+ * without the table, and the full path through ld.shl is taken.
+ */
+#include <sys/types.h>
+#include <mach/aout.h>
+
+#define SHT_NAME "shlib.tab"	/* File in /vsta/lib */
+#define SHT_MAGIC (0x53487442)	/* Tells it's a table */
+#define SHT_NAMELEN (32)	/* Room for library filename */
+#define SHT_MAX (16)		/* Most libraries listed */
+
+struct shlib_ent {
+	char se_name[SHT_NAMELEN];	/* Library, as linked against */
+	struct aout se_aout;		/* Its header */
+};
+
+struct shlib_tab {
+	ulong st_magic;		/* SHT_MAGIC */
+	uint st_count;		/* # in st_ent[] */
+	struct shlib_ent st_ent[SHT_MAX];
+};
+
+#endif /* _SHLIB_H */
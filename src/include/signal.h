@@ -116,6 +116,7 @@ extern const char *strsignal(int);
  */
 extern void __signal_save(char *);
 extern char *__signal_restore(char *);
+extern void __signal_default(char *, sigset_t *);
 extern int __signal_size(void), __strtosig(const char *);
 
 #endif /* _SIGNAL_H */
@@ -0,0 +1,21 @@
+#ifndef _SPAWN_H
+#define _SPAWN_H
+/*
+ * spawn.h
+ *	Starting a process running another program, in one step
+ */
+#include <sys/types.h>
+#include <signal.h>
+
+/*
+ * Optional changes to what the new process inherits
+ */
+struct spawnattr {
+	sigset_t sa_sigdefault;	/* Signals to start at SIG_DFL */
+	uint sa_nclose;		/* # file descriptors in sa_close */
+	int *sa_close;		/*  ...not to be passed on */
+};
+
+extern pid_t spawnv(const char *, char * const *, struct spawnattr *);
+
+#endif /* _SPAWN_H */
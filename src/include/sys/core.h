@@ -11,18 +11,22 @@
  */
 struct core {
 	uchar c_flags;		/* Flags */
-	uchar c_dummy1;
+	uchar c_order;		/* log2(# pages) when C_FREE, */
+				/*  else pageout's age of the page */
 	ushort c_psidx;		/* Index into pset */
 	union {
 		struct pset	/* Pset page is used under */
 			*_c_pset;
 		ulong _c_word;	/* Word of storage when C_SYS */
-		struct core	/* Free list link when free */
-			*_c_free;
+		struct {	/* Free list links when C_FREE */
+			struct core *_c_next, *_c_prev;
+		} _c_l;
 	} _c_u;
 #define c_pset _c_u._c_pset
 #define c_word _c_u._c_word
-#define c_free _c_u._c_free
+#define c_free _c_u._c_l._c_next
+#define c_prev _c_u._c_l._c_prev
+#define c_age c_order
 };
 
 /*
@@ -32,6 +36,19 @@ struct core {
 #define C_SYS 2		/* Page wired down for kernel use */
 #define C_WIRED 4	/* Wired for physical I/O */
 #define C_ALLOC 8	/* Allocated from free list */
+#define C_SLAB 16	/* Part of a malloc() slab; c_word points to it */
+#define C_FREE 32	/* First page of a free block of 2^c_order pages */
+#define C_ACTIVE 64	/* In use and referenced lately; see vm_steal.c */
+
+/*
+ * Ages for pageout.  A page starts active at AGE_INIT (AGE_HOT if its
+ * pset is PF_HOT), gains AGE_ADV each time pageout finds it referenced,
+ * and goes inactive once it decays to 0.
+ */
+#define AGE_INIT 4
+#define AGE_HOT 8
+#define AGE_ADV 3
+#define AGE_MAX 32
 
 #ifdef KERNEL
 
@@ -36,9 +36,10 @@ struct mapfile {
 
 #ifndef KERNEL
 /*
- * The exec() system call
+ * The exec() and spawn() system calls
  */
 extern int exec(port_t, struct mapfile *, void *);
+extern pid_t spawn(port_t, struct mapfile *, void *, port_t *, uint);
 #endif
 
 /*
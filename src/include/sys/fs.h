@@ -28,6 +28,27 @@
 #define FS_BLKWRITE 156		/*  to permit disk size > 4 gigabytes */
 				/*  Otherwise much like ABS{READ,WRITE} */
 
+/*
+ * An FS_FID reply has the file's ID in m_arg and its size in pages
+ * in m_arg1.  A server may also stamp the reply's m_op with
+ * FID_STAMP() of something which changes with the file's contents--
+ * a revision count, or the modification time--so a file rewritten in
+ * place isn't mistaken for the copy the kernel has cached.  The
+ * stamp keeps clear of the op number and flag bits.  It shares the
+ * M_TAG bits, though, so a server which has called msg_tagged()
+ * must hand back the request's tag instead, and go unstamped.
+ */
+#define FID_STAMP(s) (((((ulong)(s)) << 12) & 0x3FFFF000) | FS_FID)
+#define FID_GETSTAMP(op) ((((ulong)(op)) >> 12) & 0x3FFFF)
+
+/*
+ * An FS_SHMAP reply carries one segment, of memory the server has
+ * mapped MAP_SHARED.  Rather than copying it, the kernel maps it into
+ * the client, writable, and msg_send() returns its address.  Both
+ * sides then see the same pages until they munmap() them.
+ */
+#define FS_SHMAP 157		/* Map server's shared memory into client */
+
 /*
  * Used for tunneling an error code within a struct msg
  */
@@ -29,6 +29,12 @@ extern void hat_initvas(struct vas *);
  */
 extern void hat_addtrans(struct pview *pv, void *vaddr, uint pfn, int write);
 
+/*
+ * hat_addlarge()
+ *	Add a translation for H_LARGE pages, contiguous and aligned
+ */
+extern int hat_addlarge(struct pview *pv, void *vaddr, uint pfn, int write);
+
 /*
  * hat_deletetrans()
  *	Delete a translation
@@ -53,6 +59,12 @@ extern void hat_detach(struct pview *pv);
  */
 extern void hat_fork(struct vas *, struct vas *);
 
+/*
+ * hat_switch()
+ *	Run on a vas's translations, on this CPU
+ */
+extern void hat_switch(struct vas *);
+
 /*
  * hat_getbits()
  *	Get bits from mapping, clear bits from HAT layer simultaneously
@@ -45,51 +45,91 @@ extern void free(void *);
 #define MT_FPU (23)		/* FPU save state */
 #define MT_OPENPORT (24)	/* FOD pset data structure */
 #define MT_PVIEW_VALID (25)	/* pview valid page map */
+#define MT_MAPCACHE (26)	/* Mapped file cache entry */
+#define MT_WAITADDR (27)	/* User address being slept on */
 
-#define MALLOCTYPES (26)	/* UPDATE when you add values above */
+#define MALLOCTYPES (28)	/* UPDATE when you add values above */
 				/* ALSO check n_allocname[] */
 
 /*
- * Our per-storage-size information
+ * A per-CPU stack of free objects for one cache.  A CPU allocates
+ * from and frees to its own magazines without taking any lock.
  */
-struct bucket {
-	void *b_mem;	/* List of chunks of memory */
-	uint b_elems;	/* # chunks available in this bucket */
-	uint b_pages;	/* # pages used for this bucket size */
-	uint b_size;	/* Size of this kind of chunk */
-	lock_t b_lock;	/* Lock for manipulating this bucket */
+#define MAGSIZE (15)
+struct magazine {
+	uint m_rounds;		/* # objects held */
+	void *m_obj[MAGSIZE];	/*  ...the objects */
 };
-extern struct bucket buckets[];
-#define MIN_BUCKET 4	/* At least 16 bytes allocated */
 
 /*
- * BUCKET()
- *	Convert size to a bucket index
- *
- * Works for constants (the compiler flattens the expression out to
- * a bucket index constant) and dynamic values (it's an O(log(n))
- * search).
+ * An object cache.  All its objects are one size, carved from slabs
+ * of c_slabpgs pages apiece.
  */
-#define BUCKET(x) \
-  ((x <= 1024) ? \
-    ((x <= 128) ? \
-      ((x <= 32) ?  ((x <= 16) ? 4 : 5) : ((x <= 64) ? 6 : 7)) \
-    : \
-      ((x <= 256) ? 8 : ((x <= 512) ? 9 : 10))) \
-  : \
-    ((x <= 8192) ? \
-      ((x <= 2048) ? 11 : ((x <= 4096) ? 12 : 13)) \
-    : \
-      ((x <= 16384) ? 14 : 15)))
+struct cache {
+	char *c_name;		/* Type name, if it has its own cache */
+	uint c_size;		/* Size of each object */
+	uint c_perslab;		/* # objects in a slab */
+	uint c_slabpgs;		/*  ...# pages in a slab */
+	struct slab *c_partial;	/* Slabs with objects free */
+	struct slab *c_empty;	/* A slab with all free, kept in reserve */
+	uint c_slabs;		/* # slabs, including c_empty */
+	uint c_inuse;		/* # objects out of slabs, incl. magazines */
+	lock_t c_lock;		/* Lock for the slabs */
+};
+extern struct cache caches[];
 
 /*
- * MALLOC/FREE interface.  For DEBUG, always call the procedure which
- * tallies memory type usage.  Otherwise grab blocks inline.
+ * The caches are first one per size class, then one per type which
+ * gets a cache of its own.  Types without their own cache are handed
+ * the smallest size class which fits.  Above 32 bytes the classes
+ * step by no more than half, so at most a third of an object is wasted.
  */
-#ifdef DEBUG
+#define NSIZECACHE (14)		/* 16 through NBPG/2 bytes */
+#define NTYPECACHE (5)		/* See typecaches[] in malloc.c */
+#define NCACHE (NSIZECACHE + NTYPECACHE)
+#define SIZEIDX(size) (((size) + 15) >> 4)
+extern uchar size_cache[];	/* SIZEIDX(size) -> cache index */
+extern uchar mt_cache[];	/* MT_* -> cache index + 1, or 0 */
+
+/*
+ * cache_idx()
+ *	Give index of cache used for MALLOC(size, type)
+ */
+inline extern uint
+cache_idx(uint size, uint type)
+{
+	uint x;
+
+	x = mt_cache[type];
+	if (x && (size <= caches[x-1].c_size)) {
+		return(x-1);
+	}
+	return(size_cache[SIZEIDX(size)]);
+}
+
+/*
+ * A slab.  Its header lives in the last bytes of its own memory,
+ * and the core entry for each of its pages (flagged C_SLAB) points
+ * to it.
+ */
+struct slab {
+	struct slab *sl_next,	/* Partial slabs of the cache */
+		*sl_prev;
+	void *sl_mem;		/* Free objects */
+	uint sl_inuse;		/* # objects not free */
+	char *sl_base;		/* First byte of slab memory */
+	struct cache *sl_cache;	/* Cache slab belongs to */
+};
+#define MAXSLABPGS (4)		/* Most pages a slab grows to */
 
 extern void *_malloc(uint, uint), _free(void *, uint);
 
+/*
+ * MALLOC/FREE interface.  For DEBUG, always call the procedure which
+ * tallies memory type usage.  Otherwise try our magazine inline.
+ */
+#ifdef DEBUG
+
 #define MALLOC(size, type) _malloc(size, type);
 #define FREE(ptr, type) _free(ptr, type);
 
@@ -98,41 +138,42 @@ extern void *_malloc(uint, uint), _free(void *, uint);
 inline extern void *
 MALLOC(uint size, uint type)
 {
-	struct bucket *b;
+	struct magazine *m;
 	void *v;
 
 	if (size > (NBPG/2)) {
 		return(malloc(size));
 	}
-	b = &buckets[BUCKET(size)];
-	p_lock_void(&b->b_lock, SPL0_SAME);
-	v = b->b_mem;
-	if (v) {
-		b->b_mem = *(void **)v;
-	}
-	v_lock(&b->b_lock, SPL0_SAME);
-	if (v) {
+	NO_PREEMPT();
+	m = &cpu.pc_mags[cache_idx(size, type)];
+	if (m->m_rounds) {
+		v = m->m_obj[--(m->m_rounds)];
+		PREEMPT_OK();
 		return(v);
 	}
-	return(malloc(size));
+	PREEMPT_OK();
+	return(_malloc(size, type));
 }
 
 inline extern void
 FREE(void *ptr, uint type)
 {
-	struct bucket *b;
-	uint size;
-
-	size = PAGE_GETVAL(btop(vtop(ptr)));
-	if (size >= PGSHIFT) {
-		free(ptr);
-		return;
+	struct core *c;
+	struct magazine *m;
+
+	c = &core[btop(vtop(ptr))];
+	if (c->c_flags & C_SLAB) {
+		NO_PREEMPT();
+		m = &cpu.pc_mags[((struct slab *)(c->c_word))->sl_cache -
+			caches];
+		if (m->m_rounds < MAGSIZE) {
+			m->m_obj[(m->m_rounds)++] = ptr;
+			PREEMPT_OK();
+			return;
+		}
+		PREEMPT_OK();
 	}
-	b = &buckets[size];
-	p_lock_void(&b->b_lock, SPL0_SAME);
-	*(void **)ptr = b->b_mem;
-	b->b_mem = ptr;
-	v_lock(&b->b_lock, SPL0_SAME);
+	_free(ptr, type);
 }
 
 #endif /* !DEBUG */
@@ -22,9 +22,11 @@ typedef char *caddr_t;
 extern void *mmap(caddr_t vaddr, ulong len, int prot, int flags,
 	int fd, ulong offset);
 extern int munmap(caddr_t vaddr, ulong len);
+extern int madvise(caddr_t vaddr, ulong len, int advice);
 #ifdef KERNEL
 extern struct pview *add_map(struct vas *,
 	struct portref *, caddr_t, ulong, ulong, int);
+extern int trim_maps(int);
 extern char *mach_page_wire(uint flags, struct pview *pv,
 	struct perpage *pp, void *va, uint idx);
 #endif /* KERNEL */
@@ -47,6 +49,14 @@ extern char *mach_page_wire(uint flags, struct pview *pv,
 #define MAP_PHYS (32)		/* talk to physical memory */
 #define MAP_NODEST (64)		/* leave memory segment across exec() */
 
+/*
+ * Values for madvise()
+ */
+#define MADV_NORMAL (0)		/* Read ahead as faults show a pattern */
+#define MADV_RANDOM (1)		/* No read-ahead or fault-around */
+#define MADV_SEQUENTIAL (2)	/* Always read ahead all we can */
+#define MADV_WILLNEED (3)	/* All will be used; may use large pages */
+
 /*
  * Physical DMA support stuff
  */
@@ -50,8 +50,15 @@ struct msg {
  */
 struct sysmsg_seg {
 	struct seg *sm_seg[MSGSEGS];
+	struct seg **sm_xseg;	/* All of them, when more than MSGSEGS */
 };
 
+/*
+ * Vector of a sysmsg's segments, wherever they're kept
+ */
+#define SM_SEGV(sm) (((sm)->sm_nseg > MSGSEGS) ? \
+	(sm)->sm_xseg : (sm)->sm_seg)
+
 struct sysmsg_err {
 	char sm_err[ERRLEN];
 };
@@ -65,9 +72,32 @@ struct sysmsg {
 	int sm_nseg;			/* Segments: count & base/len */
 	struct sysmsg_seg sm_segs;
 #define sm_seg sm_segs.sm_seg
+#define sm_xseg sm_segs.sm_xseg
 	struct sysmsg *sm_next;		/* For building a queue of msgs */
 	struct sysmsg_err sm_errs;	/* Error returned for op */
 #define sm_err sm_errs.sm_err
+	seg_t *sm_sgl;			/* Copy of sender's M_SGL list */
+
+	/*
+	 * The rest are only used for messages sent through a
+	 * PF_TAGGED portref.  Each such message carries its own
+	 * completion state in place of the portref's.
+	 */
+	uchar sm_state;			/* PS_* state of this message */
+	sema_t sm_iowait;		/* Where sender sleeps for reply */
+	sema_t sm_svwait;		/*  ...server, while client copies out */
+	struct sysmsg *sm_abort;	/* M_ABORT: message being aborted */
+	int sm_tag;			/* Names it to the server; see M_TAG */
+	struct segref sm_mapped;	/* Segments mapped into server */
+
+	/*
+	 * ...and these only for those from msg_send_async()
+	 */
+	struct proc *sm_proc;		/* Sender to be told, or 0 */
+	long sm_ticket;			/*  ...what to tell him */
+	ulong sm_gen;			/*  ...p_asyncgen when sent */
+	char *sm_kbuf;			/* Copy of reply data */
+	uint sm_klen;			/*  ...its length */
 };
 
 /*
@@ -80,9 +110,45 @@ extern int copyoutsegs(struct sysmsg *);
  */
 extern void lqueue_msg(struct port *, struct sysmsg *),
 	queue_msg(struct port *, struct sysmsg *, spl_t);
+extern int tag_reply(struct portref *, struct sysmsg *);
+extern void tag_complete(struct portref *, struct sysmsg *),
+	async_abort(struct portref *, struct proc *);
+extern int m_to_sm(struct vas *, struct sysmsg *);
+extern int get_sgl(struct sysmsg *);
+extern void put_sgl(struct sysmsg *);
+extern int err_reply(long, char *, int);
+
+/*
+ * Asynchronous message completion, in msgasync.c
+ */
+extern void async_snap(struct sysmsg *, struct sysmsg *),
+	async_post(struct sysmsg *), async_flush(struct proc *),
+	async_wait(struct proc *);
 
 #endif /* KERNEL */
 
+/*
+ * Completion record handed back by msg_reap()
+ */
+struct msg_done {
+	long md_ticket;		/* Value returned by msg_send_async() */
+	long md_ret;		/* What msg_send() would have returned */
+	long md_arg1;		/* m_arg1 of the reply */
+	char md_err[ERRLEN];	/* Error string, when md_ret is -1 */
+};
+
+/*
+ * One answer in a msg_reply_batch().  If ma_err[] holds a string the
+ * client gets that error, as for msg_errtag() with ma_op; otherwise
+ * ma_msg is the reply, as for msg_reply().
+ */
+struct msg_ans {
+	long ma_who;		/* m_sender of the request */
+	msg_t *ma_msg;		/* Reply to it */
+	char ma_err[ERRLEN];	/*  ...or error, if ma_err[0] != 0 */
+	int ma_op;		/*  ...and m_op of the request, for M_TAG */
+};
+
 port_t msg_port(port_name, port_name *); /* Create new port */
 port_t msg_connect(port_name, uint);	/* Connect to port */
 int msg_accept(long);			/* Accept M_CONNECT */
@@ -94,8 +160,15 @@ int msg_disconnect(port_t);		/* All done with port */
 int msg_err(long, const char *, int);	/* Request had error */
 #else
 int msg_err(long, const char *);	/* Stub does the strlen() */
+int msg_errtag(long, int, const char *); /*  ...for a tagged request */
 #endif
 int msg_portname(port_t);		/* Get port_name for port */
+int msg_tagged(port_t, int);		/* Allow many requests at once */
+int msg_send_async(port_t, msg_t *);	/* Send, don't wait for reply */
+int msg_reap(struct msg_done *, int, int); /* Collect async replies */
+int msg_receive_batch(port_t, msg_t *, int); /* Receive several */
+int msg_reply_batch(struct msg_ans *, int); /* Answer several */
+int msg_reply_recv(port_t, struct msg_ans *, msg_t *); /* Answer, then receive */
 
 /*
  * Extended descriptions for routines
@@ -128,6 +201,38 @@ int msg_portname(port_t);		/* Get port_name for port */
  * M_DISCONNECT sends a message to the server, and waits for the
  *  server to reply.
  *
+ * msg_tagged() switches a port reference between the classic mode,
+ *  where one msg_send() at a time may be outstanding, and a tagged
+ *  mode where each thread sharing the reference may have its own
+ *  request in flight.  A server receives the requests as usual,
+ *  all carrying the same m_sender, but with a tag in the M_TAG bits
+ *  of m_op naming each.  It must hand the tag back in the m_op of
+ *  its reply, or to msg_errtag() for an error; an M_ABORT carries
+ *  the tag of the request it aborts.  A server able to do this says
+ *  so by calling msg_tagged() on its own port.  Until it does,
+ *  clients' calls fail.  It returns the previous mode.
+ *
+ * msg_send_async() queues a message through a tagged port reference
+ *  and returns at once with a ticket (a positive number) naming it.
+ *  The buffers of the message must be left alone until it completes.
+ *  msg_reap() collects up to its count of completions for any of the
+ *  process' asynchronous messages, filling in a struct msg_done for
+ *  each; reply data is copied into the buffers given to
+ *  msg_send_async() as it is reaped.  If its last argument is non-zero
+ *  it sleeps until at least one completion is available, unless none
+ *  are outstanding.  It returns the number of records filled in.
+ *
+ * msg_receive_batch() waits for a message as msg_receive() does, then
+ *  takes any others already queued, up to the count given.  It
+ *  returns the number of messages received.  msg_reply_batch() hands
+ *  back a set of answers with one system call, carrying on past any
+ *  which fail; it returns -1 if any did.
+ *
+ * msg_reply_recv() gives one answer, as for msg_reply_batch(), then
+ *  receives as msg_receive() does.  The client answered gets the CPU
+ *  as we go to sleep.  A failed answer returns -1 with nothing
+ *  received; a null answer (or one with ma_who zero) is skipped.
+ *
  * M_ABORT is generated by the kernel on interrupted operations.
  *  Further operations on the port will sleep until the server
  *  turns around the abort.  As operations are blocking, and a port
@@ -143,6 +248,18 @@ int msg_portname(port_t);		/* Get port_name for port */
  *  is a client request; the client may either be sending data or receiving
  *  data.  In this sense, msg_send() should be client_request().  The
  *  M_READ states which direction data to the named buffer flows.
+ *
+ * M_SGL is another modifier bit.  With it, m_seg[0].s_buf points to an
+ *  array of seg_t, and m_nseg is the number of entries in that array,
+ *  up to MSGSEGS_SGL rather than MSGSEGS.  Segments are otherwise
+ *  treated just as those in m_seg[].  A receiver willing to take such
+ *  a message sets M_SGL in the msg it passes to msg_receive(), with
+ *  m_seg[0].s_buf naming an array and m_nseg its size; a message with
+ *  more than MSGSEGS segments arrives with M_SGL set, its segments
+ *  listed there.  One which won't fit fails back to its sender with
+ *  E2BIG, and msg_receive() fails likewise.  A reply's m_op has never
+ *  needed setting, so M_SGL counts there only with an m_nseg above
+ *  MSGSEGS.
  */
 #define M_CONNECT 1		/* Someone has connected */
 #define M_DISCONNECT 2		/* Someone has disconnected */
@@ -152,6 +269,8 @@ int msg_portname(port_t);		/* Get port_name for port */
 #define M_RESVD 99		/* This and below reserved */
 
 #define M_READ 0x80000000	/* Buffer is destination, not source */
+#define M_SGL 0x40000000	/* Segments in a list, m_seg[0] names it */
+#define M_TAG 0x3FFFF000	/* Names a request from a tagged client */
 #define MSG_MASK (0xFFF)	/* Bits used for actual message op # */
 
 /*
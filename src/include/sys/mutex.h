@@ -80,7 +80,7 @@ typedef uint pri_t;
  */
 extern int p_sema(sema_t *, pri_t);
 extern int cp_sema(sema_t *);
-extern void v_sema(sema_t *);
+extern void v_sema(sema_t *), v_sema_handoff(sema_t *);
 extern void vall_sema(sema_t *);
 extern int p_sema_v_lock(sema_t *, pri_t, lock_t *);
 #define sema_count(s) ((s)->s_count)
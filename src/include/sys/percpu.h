@@ -6,6 +6,16 @@
  */
 #include <sys/types.h>
 
+/*
+ * Most CPUs the kernel's built to handle.  Only one is started
+ * today, SMP or not.
+ */
+#ifdef SMP
+#define MAXCPU (8)
+#else
+#define MAXCPU (1)
+#endif
+
 struct percpu {
 	struct thread *pc_thread;	/* Thread CPU's running */
 	uint pc_locks;			/* # locks held by CPU */
@@ -14,8 +24,12 @@ struct percpu {
 	uchar pc_num;			/* Sequential CPU ID */
 	uchar pc_preempt;		/* Flag that preemption needed */
 	uchar pc_nopreempt;		/* > 0, preempt held off */
-	ulong pc_time[2];		/* HZ and seconds counting */
+	ulong pc_tick;			/* Last clock tick billed */
 	ulong pc_ticks;			/* Ticks queued for clock */
+	struct thread *pc_handoff;	/* Thread to run next, if it can */
+	struct magazine *pc_mags;	/* malloc() objects, one per cache */
+	struct pagecache *pc_pages;	/* Free pages kept at hand */
+	struct runq *pc_runq;		/* Threads waiting for this CPU */
 	struct percpu *pc_next;		/* Next in list--circular */
 };
 
@@ -13,9 +13,8 @@ struct port {
 	uchar p_flags;		/* See below */
 	sema_t p_sema;		/* For serializing receivers */
 	sema_t p_wait;		/* For sleeping to receive a message */
-	sema_t p_mapsema;	/* Mutex for p_maps */
-	struct hash		/* Map file-ID -> pset */
-		*p_maps;
+	sema_t p_mapsema;	/* Mutex for mapping files from us */
+	uint p_nmaps;		/* # of our files in the map cache */
 	struct sysmsg		/* FIFO list of messages */
 		*p_hd,
 		*p_tl;
@@ -29,12 +28,13 @@ struct port {
  */
 #define P_CLOSING 1		/* Port is shutting down */
 #define P_ISR 2			/* Port has an ISR vectored to it */
+#define P_TAGGED 4		/* Server takes PF_TAGGED clients */
 
 /*
- * Flag value for struct port's p_map fields indicating that we're not
- * allowing a map hash to be created any more.
+ * Flag value for struct port's p_nmaps indicating that we're not
+ * allowing files to be cached any more.
  */
-#define NO_MAP_HASH ((struct hash *)1)
+#define NO_MAPS ((uint)-1)
 
 /*
  * Per-connected-port structure.  The protocol offered through
@@ -57,6 +57,11 @@ struct portref {
 		*p_prev;
 	struct segref		/* Segments mapped from server's msg_receive */
 		p_segs;
+	ulong p_nio;		/* PF_TAGGED: # messages in flight */
+	sema_t p_drain;		/*  ...where we wait for p_nio to reach 0 */
+	struct sysmsg		/*  ...received by server, not yet answered */
+		*p_tags;
+	int p_tagseq;		/*  ...tag given to the last of them */
 };
 
 /*
@@ -78,10 +83,13 @@ struct portref {
  * Bits in p_flags
  */
 #define PF_NODUP (0x1)	/* Don't allow duplicates (dup/fork/etc) */
+#define PF_TAGGED (0x2)	/* Many messages may be outstanding at once */
 
 #ifdef KERNEL
 extern struct portref *dup_port(struct portref *);
 extern ulong fork_ports(sema_t *, struct portref **, struct portref **, uint);
+extern ulong pass_ports(struct portref **, struct portref **,
+	port_t *, uint);
 extern struct portref *alloc_portref(void);
 extern void shut_client(struct portref *, int);
 extern int shut_server(struct port *);
@@ -90,7 +98,10 @@ extern int kernmsg_send(struct portref *, int, long *);
 extern struct port *alloc_port(void);
 extern void exec_cleanup(struct port *);
 extern struct portref *find_portref(struct proc *, port_t),
+	*share_portref(struct proc *, port_t),
 	*delete_portref(struct proc *, port_t, int);
+extern int drain_portref(struct portref *, int);
+extern void tag_done(struct portref *);
 extern struct port *find_port(struct proc *, port_t),
 	*delete_port(struct proc *, port_t);
 extern void mmap_cleanup(struct port *);
@@ -103,6 +103,16 @@ struct proc {
 		*p_ports[PROCPORTS];
 	struct portref		/* "files" open by this process */
 		*p_open[PROCOPENS];
+	lock_t p_asynclock;	/* Mutex for async completions */
+	struct sysmsg		/* Completed msg_send_async()'s */
+		*p_asynchd, *p_asynctl;
+	sema_t p_asyncwait;	/*  ...counts them, for msg_reap() */
+	uint p_nasync;		/* # sent and not yet reaped */
+	long p_ticket;		/* Last ticket handed out */
+	ulong p_asyncgen;	/* Bumped on exec() */
+	struct proc		/* vfork() parent whose vas we hold */
+		*p_lender;
+	sema_t p_vfwait;	/* vfork() parent waits here for it back */
 #ifdef PROC_DEBUG
 	struct pdbg p_dbg;	/* Who's debugging us (if anybody) */
 	struct dbg_regs		/* Debug register state */
@@ -117,6 +127,9 @@ extern void free_open(struct proc *, int);
 extern void join_pgrp(struct pgrp *, pid_t),
 	leave_pgrp(struct pgrp *, pid_t);
 extern struct pgrp *alloc_pgrp(void);
+extern void vfork_done(struct proc *, int (*)(struct pview *));
+extern struct thread *alloc_child(void);
+extern void start_child(struct thread *);
 
 /*
  * notify() syscall and special value for thread ID to signal whole
@@ -59,7 +59,9 @@ struct perpage {
 
 /*
  * Page set operations.  Used to spare us big gnarly switch
- * statements.
+ * statements.  psop_fillslot is called as (pset, perpage, index,
+ * read-ahead): the last is how many following slots are worth
+ * bringing in too, if the pset type can do it cheaply.
  */
 struct psetops {
 	intfun psop_fillslot,		/* Fill slot with contents */
@@ -110,6 +112,7 @@ struct pset {
  */
 #define PF_SHARED 1	/* All views share (shared memory, etc.) */
 #define PF_BOOT 2	/* Pages in PT_MEM are a bootup process image */
+#define PF_HOT 4	/* Pages costly to lose (program text); age slowly */
 
 #ifdef KERNEL
 extern void lock_slot(struct pset *, struct perpage *),
@@ -126,7 +129,7 @@ extern int delete_atl(struct perpage *, void *, uint);
 extern void cow_write(struct pset *, struct perpage *, uint);
 extern void set_core(uint, struct pset *, uint);
 extern struct pset *alloc_pset_cow(struct pset *, uint, uint);
-extern ulong alloc_swap(uint);
+extern ulong alloc_swap(uint, ulong);
 extern void free_swap(ulong, uint);
 extern struct pset *alloc_pset_fod(struct portref *, uint);
 extern void pset_lastref(struct pset *, struct perpage *, uint);
@@ -134,6 +137,7 @@ extern int valid_pset_slots(struct pset *);
 extern void iodone_unlock(struct qio *), iodone_free(struct qio *);
 extern void pset_free(struct pset *);
 extern int pset_writeslot(struct pset *, struct perpage *, uint, voidfun);
+extern int pset_swapin(struct pset *, uint, uint);
 #endif /* KERNEL */
 
 #endif /* _PSET_H */
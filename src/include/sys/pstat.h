@@ -42,6 +42,44 @@ struct pstat_kernel {
 	struct time psk_uptime;	/* How long has the system been up? */
 	uint psk_runnable;	/* Number of runnable threads */
 	uint psk_hz;		/* Clock ticks/second */
+	ulong psk_ticks;	/* Ticks with a clock interrupt */
+	ulong psk_tickskip;	/*  ...and without, running tickless */
+};
+
+/*
+ * per-CPU scheduling status struct
+ */
+struct pstat_cpu {
+	uint psc_num;		/* Sequential CPU ID */
+	uint psc_flags;		/* CPU_* bits from <sys/percpu.h> */
+	uint psc_pri;		/* Priority it's running at */
+	uint psc_nrun;		/* # threads waiting for it */
+	ulong psc_switches;	/* # context switches */
+	ulong psc_steals;	/*  ...to threads taken from other CPUs */
+};
+
+/*
+ * paging status struct
+ */
+struct pstat_vm {
+	ulong psv_freemem;	/* # pages free */
+	ulong psv_active;	/* # in use and referenced lately */
+	ulong psv_inactive;	/*  ...and not */
+	ulong psv_scans;	/* # pages looked at by pageout */
+	ulong psv_deactivated;	/* # aged from active to inactive */
+	ulong psv_reactivated;	/* # inactive found referenced again */
+	ulong psv_steals;	/* # taken away */
+	ulong psv_pushes;	/* # dirty ones written out */
+	ulong psv_passes;	/* # times pageout has woken */
+	uint psv_scanrate;	/* # pages it's looking at each pass */
+	ulong psv_large;	/* # large pages mapped */
+	ulong psv_demoted;	/*  ...broken back into small ones */
+	ulong psv_zeroed;	/* # pages zeroed ahead, waiting for use */
+	ulong psv_zerohits;	/* # zero-filled pages taken from them */
+	ulong psv_zeromisses;	/*  ...and cleared on the spot */
+	ulong psv_maphits;	/* # mapped files found cached */
+	ulong psv_mapmisses;	/*  ...and not */
+	ulong psv_maptrims;	/* # dropped from cache to free memory */
 };
 
 /*
@@ -50,6 +88,8 @@ struct pstat_kernel {
 #define PSTAT_PROC 0
 #define PSTAT_PROCLIST 1
 #define PSTAT_KERNEL 2
+#define PSTAT_CPU 3		/* Argument is the CPU ID */
+#define PSTAT_VM 4
 
 /*
  * pstat()
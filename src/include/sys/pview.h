@@ -18,6 +18,9 @@ struct pview {
 	struct pview		/* For listing under vas */
 		*p_next;
 	uchar p_prot;		/* Protections on view */
+	uchar p_advice;		/* MADV_* for faults in this view */
+	uchar p_rawin;		/*  ...current read-ahead window, pages */
+	uint p_ranext;		/*  ...where a sequential fault lands */
 	struct hatpview p_hat;	/* HAT contribution */
 	uchar *p_valid;		/* If attached to a VAS, flags which */
 				/*  virtual slots have mappings */
@@ -30,6 +33,7 @@ struct pview {
 #define PROT_NOFORK (0x2)	/* Not duplicated by fork() */
 #define PROT_MMAP (0x04)	/* Created by mmap() */
 #define PROT_FORK (0x08)	/* View is in process of fork() */
+#define PROT_LENT (0x10)	/* Lent to a vfork() child */
 
 #ifdef KERNEL
 /*
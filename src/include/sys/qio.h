@@ -5,9 +5,14 @@
  *	Data structures and routine definitions for kernel asynch I/O
  */
 #include <sys/types.h>
+#include <sys/param.h>
 
 /*
- * One of these describes a queued I/O
+ * One of these describes a queued I/O.  A run of up to PAGECLUSTER
+ * pages, neighbours in the pset, may go as one; q_pp is then the
+ * page the I/O was queued for, and q_pps[] lists them all in order.
+ * q_iodone is called for q_pp, and q_moredone for each of the others,
+ * with q_pp set to it.
  */
 struct qio {
 	struct portref *q_port;	/* Port for operation */
@@ -17,6 +22,10 @@ struct qio {
 	off_t q_off;		/* Byte offset in q_port */
 	uint q_cnt;		/* Byte count of operation */
 	voidfun q_iodone;	/* Function to call on I/O done */
+	voidfun q_moredone;	/*  ...for the rest of a cluster */
+	uint q_npg;		/* # pages in q_pps[] */
+	struct perpage		/* Pages, in order, when clustered */
+		*q_pps[PAGECLUSTER];
 	struct qio *q_next;	/* For linking qios */
 };
 
@@ -13,10 +13,20 @@
  * with a priority value of 20 each would get 50/50 CPU time.  A
  * 5:20 ratio would give the first 1/5 of the time, and the other
  * 4/5 of the time.
+ *
+ * The split is made by stride scheduling.  Each node has a "pass",
+ * its virtual time, which advances by its stride--inversely
+ * proportional to its priority--each time it wins.  The winner at
+ * each level is the runnable child with the lowest pass, kept at
+ * the top of a heap in its parent.
  */
 #include <sys/param.h>
 #include <sys/types.h>
 #include <llist.h>
+#ifdef KERNEL
+#include <sys/mutex.h>
+#include <sys/percpu.h>
+#endif
 
 /*
  * Number of ticks allowed to run before having to go back into scheduler
@@ -38,6 +48,12 @@
  */
 #define PRIO_DEFAULT (50)
 
+/*
+ * A node's pass advances by STRIDE1 / its priority each time it runs
+ */
+#define STRIDE1 (1L << 20)
+#define STRIDE(s) (STRIDE1 / (s)->s_prio)
+
 /*
  * Values for "priority"; it only differentiates among classes
  */
@@ -71,20 +87,61 @@ struct sched {
 #define s_thread s_u._s_thread
 #define s_down s_u._s_down
 	struct sched *s_up;	/* Our parent node */
-	struct sched		/* For internal node, first node below us */
-		*s_hd, *s_tl;	/*  ...for leaf, forward and back pointers */
+	struct sched		/* For FIFO queue head, first node on it */
+		*s_hd, *s_tl;	/*  ...for member, forward and back pointers */
 	uint s_prio;		/* This node's priority */
-		uint s_nrun;		/* # processes runnable below this node */
+	uint s_nrun;		/* # processes runnable below this node */
 	uint s_leaf;		/* Internal node or leaf? */
 	uint s_refs;		/* # references to this node */
+	ulong s_pass;		/* Virtual time; lag behind parent's if idle */
+	uint s_heapidx;		/* Our slot in parent's s_heap[] */
+	struct sched		/* For internal node, runnable children */
+		**s_heap;	/*  ...as a heap on s_pass */
+	uint s_nheap,		/*  ...# in it */
+		s_heapmax,	/*  ...# it has room for */
+		s_nkids;	/*  ...# children which may need room */
+	ulong s_vtime;		/* Pass of the child we last picked */
 };
 
+/*
+ * Each CPU has its own run queue, with its own lock.  Internal nodes
+ * of the tree are allocated as an array, one per CPU; element N is
+ * queued under element N of its parent, and its tree is the one
+ * rooted at sched_root[N].  A thread's leaf is queued under the
+ * element for the run queue it's waiting on.
+ */
+struct runq {
+	lock_t rq_lock;		/* Mutex for this run queue */
+	struct sched
+		rq_rt,		/* Real-time queue */
+		rq_cheated,	/* Low-CPU processes given preference */
+		rq_bg,		/* Background (lowest priority) queue */
+		*rq_root;	/* Our part of the main tree */
+	uint rq_nrun;		/* # threads waiting here */
+	struct percpu *rq_cpu;	/* CPU we feed */
+	ulong rq_switches;	/* # context switches */
+	ulong rq_steals;	/*  ...# of them to a thread from elsewhere */
+};
+extern struct runq runqs[];
+extern struct sched sched_root[];
+
+/*
+ * The run queue a thread waits on is that of the CPU it last ran on,
+ * or the boot CPU's for a new thread.  Its state may only change with
+ * this run queue locked, and it only moves to another while both are
+ * locked; see lock_runq().
+ */
+#define RUNQ(t) ((t)->t_eng ? (t)->t_eng->pc_runq : runqs)
+
 extern struct sched *sched_thread(struct sched *, struct thread *),
 	*sched_node(struct sched *);
 extern void setrun( /* struct thread * */ ), swtch(void);
 extern void free_sched_node(struct sched *);
+extern void cancel_handoff(struct thread *);
+extern spl_t lock_runq(struct thread *);
+extern void unlock_runq(struct thread *, spl_t);
 
-extern uint num_run;
+extern uint num_run, num_queued;
 #endif
 
 extern int sched_op(int, int);
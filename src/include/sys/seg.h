@@ -63,6 +63,9 @@ struct seg {
 struct segref {
 	struct seg
 		*s_refs[MSGSEGS];
+	struct seg		/* All of them, if more than MSGSEGS */
+		**s_xrefs;
+	uint s_nxrefs;		/*  ...# in s_xrefs */
 };
 
 /*
@@ -72,6 +75,7 @@ extern void free_seg(struct seg *);
 extern struct seg *make_seg(struct vas *, void *, uint);
 extern attach_seg(struct vas *, struct seg *);
 extern void detach_seg(struct seg *);
+extern void *share_seg(struct vas *, struct seg *);
 extern struct seg *kern_mem(void *, uint);
 /* copyoutsegs() defined in <sys/msg.h> */
 
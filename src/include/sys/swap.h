@@ -20,7 +20,7 @@
 /*
  * Extra functions this manager provides
  */
-#define SWAP_ALLOC (301)	/* Allocate swap space */
+#define SWAP_ALLOC (301)	/* Allocate swap space (m_arg1: near block) */
 #define SWAP_FREE (302)		/* Free previously allocated space */
 #define SWAP_ADD (303)		/* Add space for swap */
 
@@ -51,6 +51,10 @@ struct swapmap {
 	ulong s_len;
 	port_t s_port;		/* Port blocks served via */
 	ulong s_off;		/*  ...offset on that port */
+	ulong s_free;		/* # blocks free */
+	ulong s_rotor;		/* Where to look next, relative to s_block */
+	ulong *s_map;		/* Bit per block, set when free */
+	ulong *s_sum;		/* Bit per s_map word, set when any free */
 };
 
 #endif /* _SWAP_H */
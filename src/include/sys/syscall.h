@@ -48,7 +48,19 @@
 #define S_SCHED_OP 38
 #define S_SETSID 39
 #define S_MUTEX_THREAD 40
-#define S_HIGH S_MUTEX_THREAD
+#define S_MSG_TAGGED 41
+#define S_MSG_SEND_ASYNC 42
+#define S_MSG_REAP 43
+#define S_MSG_RECEIVE_BATCH 44
+#define S_MSG_REPLY_BATCH 45
+#define S_MSG_REPLY_RECV 46
+#define S_MADVISE 47
+#define S_VFORK 48
+#define S_SPAWN 49
+#define S_ZERO_PAGES 50
+#define S_MUTEX_WAIT 51
+#define S_MUTEX_WAKE 52
+#define S_HIGH S_MUTEX_WAKE
 
 /*
  * Some syscall prototypes
@@ -67,6 +79,9 @@ extern int set_swapdev(port_t arg_port);
 extern void run_qio(void);
 extern int set_cmd(char *arg_cmd);
 extern int pageout(void);
+extern int zero_pages(void);
+extern int mutex_wait(void *, int);
+extern int mutex_wake(void *, int);
 extern int unhash(port_t arg_port, long arg_fid);
 extern int time_set(struct time *arg_time);
 extern int ptrace(pid_t pid, port_name name);
@@ -32,7 +32,9 @@ extern struct pview *find_ivew(struct vas *, void *);
 extern void free_vas(struct vas *);
 extern void *alloc_zfod(struct vas *, uint, uint),
 	*alloc_zfod_vaddr(struct vas *, uint, void *);
-extern void fork_vas(struct vas *, struct vas *);
+extern void fork_vas(struct vas *, struct vas *, int);
+extern void lend_vas(struct vas *, struct vas *),
+	return_vas(struct vas *, struct vas *, int (*)(struct pview *));
 extern int overlapping_pview(struct vas *, void *, uint);
 #endif /* KERNEL */
 
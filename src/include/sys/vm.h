@@ -26,14 +26,26 @@ struct memseg {
 extern struct memseg memsegs[];
 extern int nmemsegs;
 
+/*
+ * Zones of physical memory.  A request for a zone may be met from any
+ * zone below it, but never above.
+ */
+#define Z_DMA 0		/* Reachable by ISA DMA; below DMA_LIM */
+#define Z_NORMAL 1	/* All the rest */
+#define NZONE 2
+
 /*
  * Utility routines
  */
 extern void lock_page(uint), unlock_page(uint);
 extern int clock_page(uint);
-extern uint alloc_page(void);
+extern uint alloc_page(void), alloc_zpage(void);
 extern void free_page(uint);
+extern int alloc_contig(uint, uint, uint *);
+extern void free_contig(uint, uint);
 extern void *alloc_pages(uint), free_pages(void *, uint);
 extern int vm_unvirt(struct perpage *);
+extern int pageio_cluster(uint *, uint, struct portref *, ulong, int);
+extern int pageio_run(uint, struct portref *, ulong, uint);
 
 #endif /* _VM_H */
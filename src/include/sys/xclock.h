@@ -6,14 +6,17 @@
  */
 
 /*
- * List of processes waiting for a certain time to pass
+ * A thread waiting for a certain time to pass.  It sits in the slot
+ * of the timer wheel for its clock tick, e_tick.
  */
 struct eventq {
 	ulong e_tid;		/* PID of thread */
 	struct time e_time;	/* What time to wake */
-	struct eventq *e_next;	/* List of sleepers */
+	ulong e_tick;		/*  ...as a clock tick since boot */
+	struct eventq *e_next,	/* List of sleepers in slot */
+		**e_prev;	/*  ...and what points to us */
 	sema_t e_sema;		/* Semaphore to sleep on */
-	int e_onlist;		/* Flag that still in eventq list */
+	int e_onlist;		/* Flag that still in timer wheel */
 };
 
 #endif /* _XCLOCK_H */
@@ -0,0 +1,243 @@
+/*
+ * chan.c
+ *	Shared memory channels
+ *
+ * See <chan.h>.  c_head is only written by the producer, and c_tail
+ * only by the consumer.  A consumer which finds the ring empty sets
+ * c_sleeping, then sleeps in mutex_wait() unless c_head has moved
+ * on; a producer which advances c_head and finds c_sleeping set
+ * clears it and calls mutex_wake().  Both flag and head are changed
+ * with xchg, whose implied fence keeps either side from missing the
+ * other's store.
+ */
+#include <sys/fs.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <chan.h>
+#include <std.h>
+
+/*
+ * Offset of the first slot, and the distance between them
+ */
+#define HDRSIZE ((sizeof(struct chan) + 15) & ~15)
+#define STRIDE(c) ((sizeof(uint) + (c)->c_slotsize + 3) & ~3)
+
+/*
+ * SLOT()
+ *	Get the slot for a head or tail count
+ */
+#define SLOT(c, n) ((uint *)((char *)(c) + HDRSIZE + \
+	((n) & ((c)->c_nslot - 1)) * STRIDE(c)))
+
+/*
+ * swap()
+ *	Exchange a value into a word, returning the old one
+ */
+inline static uint
+swap(volatile uint *p, uint val)
+{
+	__asm__ __volatile__(
+		"xchgl %0,%1\n\t"
+		: "=r" (val), "=m" (*p)
+		: "0" (val), "m" (*p));
+	return(val);
+}
+
+/*
+ * chan_alloc()
+ *	Create a new channel, to be given to a client
+ *
+ * "nslot" is rounded up to a power of two.
+ */
+struct chan *
+chan_alloc(uint nslot, uint slotsize)
+{
+	struct chan *c;
+	uint n, size;
+
+	if ((nslot == 0) || (slotsize == 0)) {
+		__seterr(EINVAL);
+		return(0);
+	}
+	for (n = 1; n < nslot; n <<= 1)
+		;
+	size = HDRSIZE + n * ((sizeof(uint) + slotsize + 3) & ~3);
+	c = mmap(0, size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_SHARED,
+		-1, 0L);
+	if (c == 0) {
+		return(0);
+	}
+	c->c_size = size;
+	c->c_nslot = n;
+	c->c_slotsize = slotsize;
+	c->c_head = c->c_tail = 0;
+	c->c_sleeping = 0;
+	c->c_dropped = 0;
+	c->c_magic = CHAN_MAGIC;
+	return(c);
+}
+
+/*
+ * chan_reply()
+ *	Answer a client's FS_SHMAP with the channel
+ */
+int
+chan_reply(struct chan *c, long sender)
+{
+	struct msg m;
+
+	m.m_op = 0;
+	m.m_buf = c;
+	m.m_buflen = c->c_size;
+	m.m_nseg = 1;
+	m.m_arg = m.m_arg1 = 0;
+	return(msg_reply(sender, &m));
+}
+
+/*
+ * chan_slot()
+ *	Get the next free slot, to be filled in place
+ *
+ * Returns a pointer to c_slotsize bytes, or 0 if the ring is full.
+ * Once filled, chan_push() passes it to the consumer.
+ */
+void *
+chan_slot(struct chan *c)
+{
+	uint head = c->c_head;
+
+	if ((head - c->c_tail) >= c->c_nslot) {
+		c->c_dropped += 1;
+		return(0);
+	}
+	return(SLOT(c, head) + 1);
+}
+
+/*
+ * chan_push()
+ *	Pass the slot from chan_slot() to the consumer
+ */
+void
+chan_push(struct chan *c, uint len)
+{
+	uint head = c->c_head;
+
+	*SLOT(c, head) = len;
+	(void)swap(&c->c_head, head + 1);
+	if (c->c_sleeping && swap(&c->c_sleeping, 0)) {
+		(void)mutex_wake((void *)&c->c_head, 1);
+	}
+}
+
+/*
+ * chan_put()
+ *	Copy data into the channel
+ *
+ * Returns 0, or -1 if the ring is full.
+ */
+int
+chan_put(struct chan *c, void *buf, uint len)
+{
+	void *p;
+
+	if (len > c->c_slotsize) {
+		__seterr(EINVAL);
+		return(-1);
+	}
+	if ((p = chan_slot(c)) == 0) {
+		__seterr(EAGAIN);
+		return(-1);
+	}
+	bcopy(buf, p, len);
+	chan_push(c, len);
+	return(0);
+}
+
+/*
+ * chan_free()
+ *	Release the server's view of a channel
+ *
+ * A client with it mapped keeps the memory until it lets go.
+ */
+void
+chan_free(struct chan *c)
+{
+	munmap((void *)c, c->c_size);
+}
+
+/*
+ * chan_open()
+ *	Get the channel a server offers through a port
+ *
+ * "arg" is passed to the server in m_arg, to tell which channel
+ * it is the client wants, should it have more than one.
+ */
+struct chan *
+chan_open(port_t port, long arg)
+{
+	struct msg m;
+	struct chan *c;
+
+	m.m_op = FS_SHMAP;
+	m.m_arg = arg;
+	m.m_arg1 = 0;
+	m.m_nseg = 0;
+	c = (struct chan *)msg_send(port, &m);
+	if (c == (struct chan *)-1) {
+		return(0);
+	}
+	if (c->c_magic != CHAN_MAGIC) {
+		munmap((void *)c, NBPG);
+		__seterr(EINVAL);
+		return(0);
+	}
+	return(c);
+}
+
+/*
+ * chan_get()
+ *	Take the next slot's data out of the channel
+ *
+ * Returns the number of bytes copied to "buf", which is as much of
+ * the slot as fits.  With "wait" zero, returns -1 if the ring is
+ * empty; otherwise sleeps until it isn't.  Also returns -1 if
+ * interrupted.
+ */
+int
+chan_get(struct chan *c, void *buf, uint len, int wait)
+{
+	uint tail = c->c_tail, *slot;
+
+	while (c->c_head == tail) {
+		if (!wait) {
+			__seterr(EAGAIN);
+			return(-1);
+		}
+
+		/*
+		 * Tell the producer we're going to sleep, then do
+		 * so unless it's put something in the meantime.
+		 */
+		(void)swap(&c->c_sleeping, 1);
+		if (mutex_wait((void *)&c->c_head, (int)tail) < 0) {
+			return(-1);
+		}
+	}
+	slot = SLOT(c, tail);
+	if (len > *slot) {
+		len = *slot;
+	}
+	bcopy(slot + 1, buf, len);
+	(void)swap(&c->c_tail, tail + 1);
+	return(len);
+}
+
+/*
+ * chan_close()
+ *	Let go of a channel from chan_open()
+ */
+void
+chan_close(struct chan *c)
+{
+	munmap((void *)c, c->c_size);
+}
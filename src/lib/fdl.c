@@ -21,6 +21,7 @@
 #include <std.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/param.h>
 
 extern char *rstat(port_t, char *);
 static off_t do_seek(struct port *, long, int);
@@ -101,6 +102,7 @@ __fd_clone(int fd)
 		return(-1);
 	}
 	port->p_port = newport;
+	port->p_tagged = 0;
 	return(newport);
 }
 
@@ -586,6 +588,7 @@ __fd_alloc(port_t portnum)
 	port->p_port = portnum;
 	port->p_data = 0;
 	port->p_refs = 1;
+	port->p_tagged = 0;
 	__do_open(port);
 	return(x);
 }
@@ -687,6 +690,47 @@ read(int fd, void *buf, uint nbyte)
 	return((*(port->p_read))(port, buf, nbyte));
 }
 
+/*
+ * read_async()
+ *	Start a read, to be collected later through msg_reap()
+ *
+ * Only connections using the generic read handler can do this; the
+ * emulated types need their reads done in this process.  The first
+ * one switches the port to tagged mode, which fails unless the
+ * server takes tagged clients; so far only the pipe server does.
+ * Returns the ticket under which msg_reap() will report the read,
+ * or -1.  The server keeps the file position as the reads complete,
+ * so p_pos is not advanced; mixing these with lseek(SEEK_CUR) is not
+ * supported.
+ */
+int
+read_async(int fd, void *buf, uint nbyte)
+{
+	struct port *port;
+	struct msg m;
+
+	if ((port = __port(fd)) == 0) {
+		return(__seterr(EBADF));
+	}
+	if ((port->p_read != do_read) || (nbyte == 0)) {
+		return(__seterr(EINVAL));
+	}
+	if (!port->p_tagged) {
+		if (msg_tagged(port->p_port, 1) < 0) {
+			return(-1);
+		}
+		port->p_tagged = 1;
+	}
+	m.m_op = FS_READ | M_READ;
+	m.m_buf = buf;
+	m.m_buflen = nbyte;
+	m.m_arg = nbyte;
+	m.m_arg1 = 0;
+	m.m_nseg = 1;
+	port->p_iocount += 1;
+	return(msg_send_async(port->p_port, &m));
+}
+
 /*
  * write()
  *	Do a write() "syscall"
@@ -820,6 +864,7 @@ __fdl_restore(char *p)
 		port->p_port = s->s_port;
 		port->p_data = 0;
 		port->p_refs = 1;
+		port->p_tagged = 0;
 		port->p_pos = s->s_pos;
 
 		/*
@@ -923,6 +968,62 @@ __fdl_size(void)
 	return(plen);
 }
 
+/*
+ * __fdl_drop()
+ *	Leave a file descriptor out of saved fdl state
+ *
+ * Its entry is kept, but marked as __fdl_restore() marks duplicates
+ * it has already done.  The port is invalidated too, so it can't
+ * be taken for a duplicate of any other.
+ */
+void
+__fdl_drop(char *p, int fd)
+{
+	char *endp;
+	struct save_fdl *s;
+
+	endp = p + *(ulong *)p;
+	p += sizeof(ulong);
+	for (s = (struct save_fdl *)p; (char *)s < endp; ++s) {
+		if (s->s_fd == fd) {
+			s->s_fd = -1;
+			s->s_port = -1;
+		}
+	}
+}
+
+/*
+ * __fdl_ports()
+ *	Add the ports named in saved fdl state to a list
+ *
+ * The list holds "nport" already, and has room for PROCOPENS; a
+ * port isn't added twice.  Returns the new count.
+ */
+uint
+__fdl_ports(char *p, port_t *ports, uint nport)
+{
+	char *endp;
+	struct save_fdl *s;
+	uint x;
+
+	endp = p + *(ulong *)p;
+	p += sizeof(ulong);
+	for (s = (struct save_fdl *)p; (char *)s < endp; ++s) {
+		if (s->s_fd == -1) {
+			continue;
+		}
+		for (x = 0; x < nport; ++x) {
+			if (ports[x] == s->s_port) {
+				break;
+			}
+		}
+		if ((x == nport) && (nport < PROCOPENS)) {
+			ports[nport++] = s->s_port;
+		}
+	}
+	return(nport);
+}
+
 /*
  * tallyfdl()
  *	Check to see if this is the highest valued fd, record if so
@@ -11,19 +11,36 @@
 #include <sys/param.h>
 #include <fdl.h>
 #include <mnttab.h>
+#include <signal.h>
+#include <spawn.h>
 
 /*
- * execv()
- *	Execute a file with some arguments
+ * What load() sets up for exec() or spawn()
  */
-execv(const char *file, char * const *argv)
+struct image {
+	port_t i_port;		/* Open on the file */
+	struct mapfile i_map;	/*  ...how it's mapped */
+	char *i_args;		/* Argument area */
+	uint i_len;		/*  ...its length */
+	char *i_fdl;		/*  ...its fdl state */
+	char *i_sig;		/*  ...its signal state */
+};
+
+/*
+ * load()
+ *	Open a file to run, and pack up arguments and state for it
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+load(const char *file, char * const *argv, struct image *im)
 {
 	int fd, x;
 	uint plen, fdl_len, mnt_len, cwd_len, sig_len;
 	ulong narg;
 	struct aout a;
-	struct mapfile mf;
-	char *p, *args;
+	struct mapfile *mf = &im->i_map;
+	char *p;
 	port_t port;
 
 	/*
@@ -55,31 +72,31 @@ execv(const char *file, char * const *argv)
 	/*
 	 * Fill in the mapfile description from the a.out header
 	 */
-	bzero(&mf, sizeof(mf));
+	bzero(mf, sizeof(*mf));
 
 	/* Text */
-	mf.m_map[0].m_vaddr = (void *)0x1000;
-	mf.m_map[0].m_off = 0;
-	mf.m_map[0].m_len = btorp(a.a_text + sizeof(a));
-	mf.m_map[0].m_flags = M_RO;
+	mf->m_map[0].m_vaddr = (void *)0x1000;
+	mf->m_map[0].m_off = 0;
+	mf->m_map[0].m_len = btorp(a.a_text + sizeof(a));
+	mf->m_map[0].m_flags = M_RO;
 
 	/* Data */
-	mf.m_map[1].m_vaddr = (void *)roundup(
-		(ulong)(mf.m_map[0].m_vaddr) + ptob(mf.m_map[0].m_len),
+	mf->m_map[1].m_vaddr = (void *)roundup(
+		(ulong)(mf->m_map[0].m_vaddr) + ptob(mf->m_map[0].m_len),
 		0x400000);
-	mf.m_map[1].m_off = mf.m_map[0].m_len;
-	mf.m_map[1].m_len = btorp(a.a_data);
-	mf.m_map[1].m_flags = 0;
+	mf->m_map[1].m_off = mf->m_map[0].m_len;
+	mf->m_map[1].m_len = btorp(a.a_data);
+	mf->m_map[1].m_flags = 0;
 
 	/* BSS */
-	mf.m_map[2].m_vaddr = (char *)(mf.m_map[1].m_vaddr) +
+	mf->m_map[2].m_vaddr = (char *)(mf->m_map[1].m_vaddr) +
 		a.a_data;
-	mf.m_map[2].m_off = 0;
-	mf.m_map[2].m_len = btorp(a.a_bss);
-	mf.m_map[2].m_flags = M_ZFOD;
+	mf->m_map[2].m_off = 0;
+	mf->m_map[2].m_len = btorp(a.a_bss);
+	mf->m_map[2].m_flags = M_ZFOD;
 
 	/* Entry point */
-	mf.m_entry = (void *)(a.a_entry);
+	mf->m_entry = (void *)(a.a_entry);
 
 	/*
 	 * Assemble arguments into a counted array
@@ -104,12 +121,15 @@ execv(const char *file, char * const *argv)
 	/*
 	 * Create a shared mmap() area
 	 */
-	args = p = mmap(0, plen, PROT_READ|PROT_WRITE,
+	p = mmap(0, plen, PROT_READ|PROT_WRITE,
 		MAP_ANON|MAP_SHARED|MAP_NODEST, 0, 0L);
 	if (p == 0) {
 		msg_disconnect(port);
 		return(-1);
 	}
+	im->i_port = port;
+	im->i_args = p;
+	im->i_len = plen;
 
 	/*
 	 * Pack our arguments into it
@@ -127,6 +147,7 @@ execv(const char *file, char * const *argv)
 	/*
 	 * Add in our fdl state
 	 */
+	im->i_fdl = p;
 	__fdl_save(p, fdl_len);
 	p += fdl_len;
 
@@ -145,13 +166,74 @@ execv(const char *file, char * const *argv)
 	/*
 	 * And our signal state
 	 */
-	 __signal_save(p);
-	 p += sig_len;
+	im->i_sig = p;
+	__signal_save(p);
+	p += sig_len;
+
+	return(0);
+}
+
+/*
+ * execv()
+ *	Execute a file with some arguments
+ */
+execv(const char *file, char * const *argv)
+{
+	struct image im;
+
+	if (load(file, argv, &im)) {
+		return(-1);
+	}
 
 	/*
 	 * Here we go!
 	 */
-	return(exec(port, &mf, args));
+	return(exec(im.i_port, &im.i_map, im.i_args));
+}
+
+/*
+ * spawnv()
+ *	Start a new process running a file with some arguments
+ *
+ * What the new process inherits is as for fork() then execv(),
+ * but for what "sa" asks.  Only the ports under the file
+ * descriptors and mount table are passed to it.
+ */
+pid_t
+spawnv(const char *file, char * const *argv, struct spawnattr *sa)
+{
+	struct image im;
+	port_t ports[PROCOPENS];
+	uint x, nport;
+	pid_t pid;
+
+	if (load(file, argv, &im)) {
+		return(-1);
+	}
+
+	/*
+	 * Edit the saved state as asked
+	 */
+	if (sa) {
+		for (x = 0; x < sa->sa_nclose; ++x) {
+			__fdl_drop(im.i_fdl, sa->sa_close[x]);
+		}
+		__signal_default(im.i_sig, &sa->sa_sigdefault);
+	}
+
+	/*
+	 * List the ports it needs, and start it.  The argument area
+	 * and the file's port go to the new process; we only have
+	 * them still on failure.
+	 */
+	nport = __fdl_ports(im.i_fdl, ports, 0);
+	nport = __mount_ports(ports, nport);
+	pid = spawn(im.i_port, &im.i_map, im.i_args, ports, nport);
+	if (pid < 0) {
+		(void)munmap(im.i_args, im.i_len);
+		msg_disconnect(im.i_port);
+	}
+	return(pid);
 }
 
 /*
@@ -1,13 +1,27 @@
 /*
  * lock.s
- *	Spinlocks for user level mutexes
+ *	Locks for user level mutexes
+ *
+ * See <lock.h>.  A lock we can't get is marked 2, so its holder
+ * knows to wake us, and we sleep in the kernel until it changes.
  */
 
-	.globl	_p_lock,_yield
+	.globl	_p_lock,_mutex_wait
 _p_lock:
 	movl	4(%esp),%eax
-	bts	$0,(%eax)
-	jc	1f
+	movl	$1,%ecx
+	xchgl	%ecx,(%eax)
+	testl	%ecx,%ecx
+	jnz	1f
 	ret
-1:	call	_yield
-	jmp	_p_lock
+1:	movl	$2,%ecx
+	xchgl	%ecx,(%eax)
+	testl	%ecx,%ecx
+	jnz	2f
+	ret
+2:	pushl	$2
+	pushl	%eax
+	call	_mutex_wait
+	addl	$8,%esp
+	movl	4(%esp),%eax
+	jmp	1b
@@ -167,6 +167,34 @@ ENTRY(pstat, S_PSTAT)
 ENTRY2(sched_op, S_SCHED_OP)
 ENTRY0(setsid, S_SETSID)
 ENTRY1(mutex_thread, S_MUTEX_THREAD)
+ENTRY2(msg_tagged, S_MSG_TAGGED)
+ENTRY2(msg_send_async, S_MSG_SEND_ASYNC)
+ENTRY3(msg_reap, S_MSG_REAP)
+ENTRY3(msg_receive_batch, S_MSG_RECEIVE_BATCH)
+ENTRY2(msg_reply_batch, S_MSG_REPLY_BATCH)
+ENTRY3(msg_reply_recv, S_MSG_REPLY_RECV)
+ENTRY3(madvise, S_MADVISE)
+ENTRY(spawn, S_SPAWN)
+ENTRY0(zero_pages, S_ZERO_PAGES)
+ENTRY2(mutex_wait, S_MUTEX_WAIT)
+ENTRY2(mutex_wake, S_MUTEX_WAKE)
+
+/*
+ * vfork()
+ *	Fork, lending our address space to the child until it exec()'s
+ *
+ * The child runs on our stack, and will have called other routines
+ * over our return address by the time we get to return.  So we keep
+ * it in a register, which the kernel restores for each of us.
+ */
+	.globl	_vfork
+_vfork:	popl	%ecx
+	movl	$(S_VFORK + 0x80),%eax
+	ENTCALL
+	jc	1f
+	jmp	*%ecx
+1:	pushl	%ecx
+	jmp	syserr
 
 /*
  * notify_handler()
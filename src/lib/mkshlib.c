@@ -16,6 +16,7 @@
  *	- LIB.a		Library of stubs to each exported function
  * Auxilary files:
  *	- shlib.o	Bootstrap loader of "ld.shl"
+ *	- shlib.tab	Prelink table of all libraries built (-l)
  *
  * This code uses other utilities and system() whenever possible.
  * Symbol tables are extracted using nm(1); stub .o's are generated
@@ -32,6 +33,7 @@
 #include <mach/vm.h>		/* For SHLIB_BASE */
 #include <mach/aout.h>		/* For sizeof(struct aout) */
 #include <sys/param.h>		/* For roundup() */
+#include <shlib.h>		/* For prelink table */
 #include <stdio.h>
 #include <string.h>
 #include <alloc.h>
@@ -53,6 +55,8 @@ static uint page_size;	/* getpagesize() value */
 static char *progname;	/* argv[0] */
 static int vflag,	/* Verbose operation */
 	stubs, shlib;	/* Generate stubs/shlib */
+static struct shlib_tab	/* Prelink table, for -l */
+	shlib_tab;
 
 static void objfile(char *);
 
@@ -459,6 +463,67 @@ generate_shlib(void)
 	unlink(tabf);
 }
 
+/*
+ * add_table()
+ *	Add the library just generated to the prelink table
+ *
+ * Its header's taken from the .shl itself, so the table holds
+ * exactly what the loader will find there.
+ */
+static void
+add_table(void)
+{
+	struct shlib_ent *se;
+	FILE *fp;
+
+	if (shlib_tab.st_count >= SHT_MAX) {
+		fprintf(stderr, "Error: more than %d libraries\n", SHT_MAX);
+		exit(1);
+	}
+	if (strlen(curoutput) >= SHT_NAMELEN) {
+		fprintf(stderr, "Error: library name %s too long\n",
+			curoutput);
+		exit(1);
+	}
+	se = &shlib_tab.st_ent[shlib_tab.st_count];
+	fp = fopen(curoutput, "rb");
+	if (fp == NULL) {
+		perror(curoutput);
+		exit(1);
+	}
+	if (fread(&se->se_aout, sizeof(struct aout), 1, fp) != 1) {
+		fprintf(stderr, "Error: can't read header of %s\n",
+			curoutput);
+		exit(1);
+	}
+	fclose(fp);
+	strcpy(se->se_name, curoutput);
+	shlib_tab.st_count += 1;
+}
+
+/*
+ * write_table()
+ *	Write out the prelink table of all libraries generated
+ */
+static void
+write_table(void)
+{
+	FILE *fp;
+
+	shlib_tab.st_magic = SHT_MAGIC;
+	unlink(SHT_NAME);
+	fp = fopen(SHT_NAME, "wb");
+	if (fp == NULL) {
+		perror(SHT_NAME);
+		exit(1);
+	}
+	if (fwrite(&shlib_tab, sizeof(shlib_tab), 1, fp) != 1) {
+		perror(SHT_NAME);
+		exit(1);
+	}
+	fclose(fp);
+}
+
 /*
  * usage()
  *	Tell how to use the fool thing
@@ -579,6 +644,7 @@ main(int argc, char **argv)
 		}
 		if (shlib) {
 			generate_shlib();
+			add_table();
 		}
 
 		/*
@@ -594,5 +660,12 @@ main(int argc, char **argv)
 		usage();
 	}
 
+	/*
+	 * With all the libraries laid out, record where they went
+	 */
+	if (shlib) {
+		write_table();
+	}
+
 	return(0);
 }
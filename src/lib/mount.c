@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <sys/fs.h>
 #include <sys/ports.h>
+#include <sys/param.h>
 
 struct mnttab *__mnttab;
 int __nmnttab = 0;
@@ -302,6 +303,34 @@ __mount_save(char *p)
 	}
 }
 
+/*
+ * __mount_ports()
+ *	Add the ports in our mount table to a list
+ *
+ * As for __fdl_ports(), the list has room for PROCOPENS, and holds
+ * "nport" already.  Returns the new count.
+ */
+uint
+__mount_ports(port_t *ports, uint nport)
+{
+	uint x, y;
+	struct mntent *me;
+
+	for (x = 0; x < __nmnttab; ++x) {
+		for (me = __mnttab[x].m_entries; me; me = me->m_next) {
+			for (y = 0; y < nport; ++y) {
+				if (ports[y] == me->m_port) {
+					break;
+				}
+			}
+			if ((y == nport) && (nport < PROCOPENS)) {
+				ports[nport++] = me->m_port;
+			}
+		}
+	}
+	return(nport);
+}
+
 /*
  * __mount_restore()
  *	Restore mount state from byte array
@@ -16,6 +16,7 @@
 #include <std.h>
 #include <fdl.h>
 #include <limits.h>
+#include <sys/syscall.h>
 
 /*
  * This lets us know when we're a new process with a need for new handles
@@ -44,14 +45,26 @@ static struct cache {
 /*
  * just_sleep()
  *	Timed sleep based on timeval value
+ *
+ * The kernel takes the time to the microsecond, so we hand it on
+ * as such.
  */
 static int
 just_sleep(struct timeval *t)
 {
+	struct time tm;
+
 	if (t == 0) {
 		return(0);
 	}
-	return(__msleep(t->tv_sec*1000 + t->tv_usec/1000));
+	time_get(&tm);
+	tm.t_sec += t->tv_sec;
+	tm.t_usec += t->tv_usec;
+	while (tm.t_usec >= 1000000) {
+		tm.t_sec += 1;
+		tm.t_usec -= 1000000;
+	}
+	return(time_sleep(&tm));
 }
 
 /*
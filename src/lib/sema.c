@@ -1,8 +1,13 @@
 /*
  * sema.c
  *	User-level semaphores
+ *
+ * The count is kept here, and a thread only goes into the kernel to
+ * sleep when it must wait, or to wake a sleeper when it releases one.
+ * Sleepers wait in mutex_wait() on s_seq, which v_sema() bumps as it
+ * leaves a wakeup for them to take.
  */
-#include <sys/fs.h>
+#include <sys/syscall.h>
 #include <sema.h>
 #include <alloc.h>
 
@@ -14,64 +19,58 @@ struct sema *
 alloc_sema(int init_val)
 {
 	struct sema *s;
-	port_t port;
 
-	/*
-	 * Get data structure
-	 */
 	s = malloc(sizeof(struct sema));
 	if (s == 0) {
 		return(0);
 	}
 	init_lock(&s->s_locked);
 	s->s_val = init_val;
-
-	/*
-	 * Attach to sema server, get two ports
-	 */
-	s->s_port = path_open("fs/sema:clone",
-		ACC_READ | ACC_WRITE | ACC_CREATE);
-	if (s->s_port < 0) {
-		free(s);
-		return(0);
-	}
-	s->s_portmaster = clone(s->s_port);
-
+	s->s_seq = 0;
+	s->s_wakeups = 0;
 	return(s);
 }
 
-/*
- * send()
- *	Send a message without segments
- */
-static int
-send(port_t port, uint op)
-{
-	struct msg m;
-
-	m.m_op = op;
-	m.m_arg = m.m_arg1 = m.m_nseg = 0;
-	return(msg_send(port, &m));
-}
-
 /*
  * p_sema()
  *	Enter semaphore
+ *
+ * Once we've counted ourselves below zero, only a wakeup left by
+ * v_sema() lets us in.  v_sema() raises s_val for us as well, so
+ * looking at s_val again would let us in without using up the
+ * wakeup, and leave it for a thread which hasn't earned it.
  */
 int
 p_sema(struct sema *s)
 {
-	int val;
+	int seq;
 
 	p_lock(&s->s_locked);
-	val = (s->s_val -= 1);
-	v_lock(&s->s_locked);
-	if (val >= 0) {
+	s->s_val -= 1;
+	if (s->s_val >= 0) {
+		v_lock(&s->s_locked);
 		return(0);
 	}
-	if (send(s->s_port, FS_READ)) {
-		return(-1);
+	while (s->s_wakeups == 0) {
+		/*
+		 * Sleep until v_sema() moves s_seq on.  If we're
+		 * interrupted, give back our place in the count.
+		 */
+		seq = s->s_seq;
+		v_lock(&s->s_locked);
+		if (mutex_wait((void *)&s->s_seq, seq) < 0) {
+			p_lock(&s->s_locked);
+			if (s->s_wakeups > 0) {
+				break;
+			}
+			s->s_val += 1;
+			v_lock(&s->s_locked);
+			return(-1);
+		}
+		p_lock(&s->s_locked);
 	}
+	s->s_wakeups -= 1;
+	v_lock(&s->s_locked);
 	return(0);
 }
 
@@ -82,12 +81,17 @@ p_sema(struct sema *s)
 void
 v_sema(struct sema *s)
 {
-	int val;
+	int wake;
 
 	p_lock(&s->s_locked);
-	val = (s->s_val += 1);
+	s->s_val += 1;
+	wake = (s->s_val <= 0);
+	if (wake) {
+		s->s_wakeups += 1;
+		s->s_seq += 1;
+	}
 	v_lock(&s->s_locked);
-	if (val <= 0) {
-		(void)send(s->s_portmaster, FS_SEEK);
+	if (wake) {
+		(void)mutex_wake((void *)&s->s_seq, 1);
 	}
 }
@@ -12,13 +12,28 @@
  * Because this code runs without any other library available, it can
  * call only certain system calls and its own private routines.
  *
+ * Most of the time the second step can be skipped.  The prelink table
+ * (see <shlib.h>) says where each library goes and how big it is, so
+ * we read it once and map a library listed there ourselves.  The root
+ * filesystem is looked up once, too, for all the libraries a program
+ * uses.
+ *
  * On success, it returns the address at which the library was mapped.
  * On failure, it returns 0.
  */
 #include <sys/fs.h>
 #include <sys/ports.h>
 #include <sys/mman.h>
+#include <sys/param.h>
 #include <mach/aout.h>
+#include <shlib.h>
+
+extern void *_mmap_shl();
+
+static port_name rootname;	/* Root filesystem */
+static int have_root;		/*  ...once looked up */
+static struct shlib_tab tab;	/* Prelink table */
+static int have_tab;		/*  ...once we've tried to read it */
 
 /*
  * strlen()
@@ -102,6 +117,180 @@ receive(port_t port, void *buf, int len)
 	return(0);
 }
 
+/*
+ * streq()
+ *	Tell if two strings are the same
+ */
+static int
+streq(char *p, char *q)
+{
+	while (*p == *q) {
+		if (*p == '\0') {
+			return(1);
+		}
+		++p, ++q;
+	}
+	return(0);
+}
+
+/*
+ * open_lib()
+ *	Open a file in vsta/lib on the root filesystem
+ *
+ * Returns the port, or -1.
+ */
+static port_t
+open_lib(char *name)
+{
+	port_t port;
+
+	port = msg_connect_shl(rootname, ACC_READ);
+	if (port < 0) {
+		return(-1);
+	}
+	if (walk(port, "vsta") || walk(port, "lib") || walk(port, name)) {
+		msg_disconnect_shl(port);
+		return(-1);
+	}
+	return(port);
+}
+
+/*
+ * do_mmap()
+ *	Try a kernel mmap, but ignore EEXIST when mapping segments
+ *
+ * "*made" tells whether the mapping is new, and so ours to undo;
+ * one which already existed isn't.
+ */
+static void *
+do_mmap(void *addr, uint len, uint prot, uint flags, int port, ulong off,
+	int *made)
+{
+	void *p;
+	char err[ERRLEN];
+
+	*made = 0;
+	p = _mmap_shl(addr, len, prot, flags, port, off);
+	if (p) {
+		*made = 1;
+		return(p);
+	}
+	strerror_shl(err);
+	if (streq(err, EEXIST)) {
+		return(addr);
+	}
+	return(0);
+}
+
+/*
+ * read_tab()
+ *	Read in the prelink table
+ *
+ * If there isn't one, or it won't do, it's left empty.
+ */
+static void
+read_tab(void)
+{
+	port_t port;
+
+	have_tab = 1;
+	port = open_lib(SHT_NAME);
+	if (port < 0) {
+		return;
+	}
+	if (receive(port, &tab, sizeof(tab)) ||
+			(tab.st_magic != SHT_MAGIC) ||
+			(tab.st_count > SHT_MAX)) {
+		tab.st_count = 0;
+	}
+	msg_disconnect_shl(port);
+}
+
+/*
+ * map_tab()
+ *	Map in a library as the prelink table describes it
+ *
+ * Returns the address of its header, or 0 if it isn't listed or
+ * isn't as the table says.
+ */
+static void *
+map_tab(char *p)
+{
+	struct aout *a;
+	port_t port;
+	char *addr_text;
+	ulong size_text, *hdr;
+	uint x;
+	int made_text, made_data = 0, made_bss;
+
+	/*
+	 * Look it up, and open it
+	 */
+	for (x = 0; x < tab.st_count; ++x) {
+		if (streq(tab.st_ent[x].se_name, p)) {
+			break;
+		}
+	}
+	if (x >= tab.st_count) {
+		return(0);
+	}
+	a = &tab.st_ent[x].se_aout;
+	port = open_lib(p);
+	if (port < 0) {
+		return(0);
+	}
+
+	/*
+	 * Text first.  The header at its start must be the one
+	 * we were told of, or the table's out of date.
+	 */
+	size_text = sizeof(struct aout) + a->a_text;
+	addr_text = do_mmap((void *)(a->a_entry - sizeof(struct aout)),
+		size_text, PROT_READ, MAP_FILE, port, 0L, &made_text);
+	if (addr_text == 0) {
+		goto err;
+	}
+	hdr = (ulong *)addr_text;
+	for (x = 0; x < sizeof(struct aout) / sizeof(ulong); ++x) {
+		if (hdr[x] != ((ulong *)a)[x]) {
+			goto err_text;
+		}
+	}
+
+	/*
+	 * Then copy-on-write data, and zero-fill-on-demand BSS,
+	 * just as ld.shl does it
+	 */
+	if ((a->a_data > 0) && (do_mmap(addr_text + size_text,
+			a->a_data, PROT_READ | PROT_WRITE,
+			MAP_FILE | MAP_PRIVATE, port, size_text,
+			&made_data) == 0)) {
+		goto err_text;
+	}
+	if ((a->a_bss > 0) && (do_mmap(addr_text + size_text + a->a_data,
+			roundup(a->a_bss, NBPG), PROT_READ | PROT_WRITE,
+			MAP_ANON, 0, 0L, &made_bss) == 0)) {
+		goto err_data;
+	}
+	msg_disconnect_shl(port);
+	return(addr_text);
+
+	/*
+	 * Only undo what we mapped; what was there already stays
+	 */
+err_data:
+	if (made_data) {
+		munmap_shl(addr_text + size_text, a->a_data);
+	}
+err_text:
+	if (made_text) {
+		munmap_shl(addr_text, size_text);
+	}
+err:
+	msg_disconnect_shl(port);
+	return(0);
+}
+
 /*
  * _load()
  *	First-level shlib loader
@@ -110,40 +299,52 @@ void *
 _load(char *p)
 {
 	port_t port;
-	port_name rootname;
 	struct aout aout;
 	void *addr, *addr2;
 	char buf[16];
 	int x;
 	void *(*loadfn)();
-	extern void *_mmap_shl();
 
 	/*
 	 * Open /namer/fs/root, get the port_name for the root
-	 * filesystem.
+	 * filesystem.  One lookup does for all our libraries.
 	 */
-	port = msg_connect_shl(PORT_NAMER, ACC_READ);
-	if (port < 0) {
-		return(0);
+	if (!have_root) {
+		port = msg_connect_shl(PORT_NAMER, ACC_READ);
+		if (port < 0) {
+			return(0);
+		}
+		x = walk(port, "fs") || walk(port, "root") ||
+				receive(port, buf, sizeof(buf));
+		msg_disconnect_shl(port);
+		if (x) {
+			return(0);
+		}
+		rootname = (port_name)atoi(buf);
+		have_root = 1;
 	}
-	x = walk(port, "fs") || walk(port, "root") ||
-			receive(port, buf, sizeof(buf));
-	msg_disconnect_shl(port);
-	if (x) {
-		return(0);
+
+	/*
+	 * If the prelink table knows the library, map it straight in
+	 */
+	if (!have_tab) {
+		read_tab();
+	}
+	addr2 = map_tab(p);
+	if (addr2) {
+		return((char *)addr2 + sizeof(aout));
 	}
-	rootname = (port_name)atoi(buf);
 
 	/*
 	 * Open vsta/lib/load.shl from the root filesystem; this is
 	 * our primary shlib loader.  Read the a.out header from it
 	 * to find out how big it is & where it wants to run.
 	 */
-	port = msg_connect_shl(rootname, ACC_READ);
-	x = walk(port, "vsta") || walk(port, "lib") ||
-			walk(port, "ld.shl") ||
-			receive(port, &aout, sizeof(aout));
-	if (x) {
+	port = open_lib("ld.shl");
+	if (port < 0) {
+		return(0);
+	}
+	if (receive(port, &aout, sizeof(aout))) {
 		msg_disconnect_shl(port);
 		return(0);
 	}
@@ -1078,6 +1078,36 @@ __signal_restore(char *p)
 	return(p + _NSIG);
 }
 
+/*
+ * __signal_default()
+ *	Set signals in saved state back to SIG_DFL
+ *
+ * For those a new program shouldn't inherit ignored; whether they
+ * are blocked or pending is kept.
+ */
+void
+__signal_default(char *p, sigset_t *set)
+{
+	int i;
+
+	for (i = 0; i < _NSIG; ++i) {
+		if (!sigismember(set, i)) {
+			continue;
+		}
+		switch (p[i]) {
+		case BL_IGN:
+			p[i] = BL_DFL;
+			break;
+		case BL_IGN_PENDING:
+			p[i] = BL_DFL_PENDING;
+			break;
+		case NOTBL_IGN:
+			p[i] = NOTBL_DFL;
+			break;
+		}
+	}
+}
+
 /*
  * strsignal()
  *	Give string name for signal
@@ -0,0 +1,90 @@
+/*
+ * reply.c
+ *	Deferred replies, for server loops using msg_reply_recv()
+ *
+ * A server's handlers answer with srv_reply() and srv_err() in place
+ * of msg_reply() and msg_err(), and its main loop waits with
+ * srv_receive() rather than msg_receive().  An answer which carries no
+ * segments is held back and handed to the kernel along with the next
+ * receive, in a single msg_reply_recv().  One with segments names
+ * buffers which may not outlive the handler, so it goes at once.
+ *
+ * The held answer is per process, so only the thread which receives
+ * should answer this way.
+ */
+#include <sys/msg.h>
+#include <server.h>
+#include <string.h>
+
+static struct msg_ans ans;	/* Answer waiting to go */
+static struct msg ansmsg;	/*  ...its message, if not an error */
+
+/*
+ * flush()
+ *	Send any answer we've been holding
+ */
+static void
+flush(void)
+{
+	if (ans.ma_who) {
+		(void)msg_reply_batch(&ans, 1);
+		ans.ma_who = 0;
+	}
+}
+
+/*
+ * srv_reply()
+ *	Answer a request, perhaps along with our next receive
+ */
+void
+srv_reply(long who, struct msg *m)
+{
+	flush();
+	if (m->m_nseg) {
+		(void)msg_reply(who, m);
+		return;
+	}
+	ansmsg = *m;
+	ans.ma_who = who;
+	ans.ma_msg = &ansmsg;
+	ans.ma_err[0] = '\0';
+}
+
+/*
+ * srv_err()
+ *	Answer a request with an error, perhaps along with our next receive
+ */
+void
+srv_err(long who, char *errmsg)
+{
+	flush();
+	strncpy(ans.ma_err, errmsg, ERRLEN-1);
+	ans.ma_err[ERRLEN-1] = '\0';
+	ans.ma_op = 0;
+	ans.ma_who = who;
+}
+
+/*
+ * srv_receive()
+ *	Wait for the next request, answering the last if it's still held
+ */
+int
+srv_receive(port_t port, struct msg *m)
+{
+	int x;
+
+	if (ans.ma_who == 0) {
+		return(msg_receive(port, m));
+	}
+	x = msg_reply_recv(port, &ans, m);
+	ans.ma_who = 0;
+
+	/*
+	 * A failed answer leaves us without a message; the client's
+	 * most likely gone, and there's nothing to do but carry on.
+	 */
+	if (x < 0) {
+		x = msg_receive(port, m);
+	}
+	return(x);
+}
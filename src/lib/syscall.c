@@ -31,6 +31,20 @@ msg_err(long port, const char *errmsg)
 	return(_msg_err(port, errmsg, strlen(errmsg)));
 }
 
+/*
+ * msg_errtag()
+ *	Like msg_err(), for a request which may have come tagged
+ *
+ * "op" is the m_op the request arrived with; its tag goes to the
+ * kernel in the spare bits of the length.
+ */
+msg_errtag(long port, int op, const char *errmsg)
+{
+	extern int _msg_err();
+
+	return(_msg_err(port, errmsg, strlen(errmsg) | (op & M_TAG)));
+}
+
 /*
  * notify()
  *	Similarly for notify
@@ -231,19 +245,6 @@ mmap(void *vaddr, ulong len, int prot, int flags, int fd, ulong offset)
 		fd ? __fd_port(fd) : 0, offset));
 }
 
-/*
- * vfork()
- *	Virtual memory efficient fork()
- *
- * Since we're already pretty efficient in this respect, we simply issue
- * a fork() call!
- */
-int
-vfork(void)
-{
-	return(fork());
-}
-
 /*
  * yield()
  *	Yield CPU, remaining runnable
@@ -235,7 +235,7 @@ __usleep(uint usecs)
 
 	time_get(&t);
 	t.t_usec += usecs;
-	while (t.t_usec > 1000000) {
+	while (t.t_usec >= 1000000) {
 		t.t_sec += 1;
 		t.t_usec -= 1000000;
 	}
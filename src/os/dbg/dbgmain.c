@@ -9,7 +9,7 @@
 extern void dump_phys(), dump_virt(), dump_procs(), dump_pset(),
 	dump_instr(), trace(), trapframe(), dump_vas(), dump_port(),
 	dump_pview(), dump_thread(), dump_ref(), reboot(), memleaks(),
-	dump_sysmsg(), dump_core();
+	dump_sysmsg(), dump_core(), dump_malloc();
 extern void dbg_inport(), dbg_outport();
 static void quit(), calc(), set(), set_mem(), help();
 extern int get_num();
@@ -33,6 +33,7 @@ struct {
 	"dv", dump_virt,
 	"help", help,
 	"inport", dbg_inport,
+	"malloc", dump_malloc,
 	"memleaks", memleaks,
 	"outport", dbg_outport,
 	"port", dump_port,
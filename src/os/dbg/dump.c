@@ -502,6 +502,10 @@ dump_ref(char *p)
 	printf(" state %s sysmsg 0x%x next/prev 0x%x/0x%x segs 0x%x\n",
 		prstate(pr->p_state),
 		pr->p_msg, pr->p_next, pr->p_prev, &pr->p_segs);
+	if (pr->p_flags & PF_TAGGED) {
+		printf(" tagged: in flight %d, serving 0x%x\n",
+			pr->p_nio, pr->p_tags);
+	}
 }
 
 /*
@@ -549,7 +553,7 @@ dump_sysmsg(char *p)
 
 		printf(" Segments:");
 		for (x = 0; x < sm->sm_nseg; ++x) {
-			printf(" 0x%x", sm->sm_seg[x]);
+			printf(" 0x%x", SM_SEGV(sm)[x]);
 		}
 		printf("\n");
 	}
@@ -590,13 +594,15 @@ dump_core(char *p)
 		printf("tag %d", c->c_word);
 	} else if (c->c_flags & C_ALLOC) {
 		printf("pset 0x%x+%d", c->c_pset, c->c_psidx);
-	} else {
-		printf("freelink 0x%x", c->c_free);
+	} else if (c->c_flags & C_FREE) {
+		printf("order %d next 0x%x prev 0x%x", c->c_order,
+			c->c_free, c->c_prev);
 	}
-	printf(":%s%s%s%s\n",
+	printf(":%s%s%s%s%s\n",
 		(c->c_flags & C_BAD) ? " bad" : "",
 		(c->c_flags & C_SYS) ? " sys" : "",
 		(c->c_flags & C_WIRED) ? " wired" : "",
-		(c->c_flags & C_ALLOC) ? " alloc" : "");
+		(c->c_flags & C_ALLOC) ? " alloc" : "",
+		(c->c_flags & C_FREE) ? " free" : "");
 }
 #endif /* KDB */
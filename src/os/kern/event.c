@@ -15,26 +15,26 @@
  * the event, it only sees the latest event received.
  *
  * t_wchan is used to get a thread interrupted from a sleep.  Because
- * the runq_lock is already held when the semaphore indicated by t_wchan
+ * the run queue lock is already held when the semaphore indicated by t_wchan
  * needs to be manipulated, a potential deadlock exists.  The delivery
  * code knows how to back out from this situation and retry.
  *
  * Mutexing is accomplished via the destination process' p_sema and
- * the global runq_lock.  p_sema (the field, not the function) is needed
- * to keep the process around while its threads are manipulated.  runq_lock
- * is used to mutex a consistent thread state while delivering the
- * effects of an event.
+ * the lock on each thread's run queue.  p_sema (the field, not the
+ * function) is needed to keep the process around while its threads
+ * are manipulated.  The run queue lock is used to mutex a consistent
+ * thread state while delivering the effects of an event.
  */
 #include <sys/percpu.h>
 #include <sys/proc.h>
 #include <sys/thread.h>
+#include <sys/sched.h>
 #include <sys/fs.h>
 #include <sys/malloc.h>
 #include <hash.h>
 #include <sys/assert.h>
 #include "../mach/mutex.h"
 
-extern lock_t runq_lock;
 extern struct hash *pid_hash;
 extern struct proc *pfind();
 
@@ -62,7 +62,7 @@ signal_thread(struct thread *t, char *event, int is_sys)
 	/*
 	 * Take lock, place event in appropriate place
 	 */
-retry:	p_lock_void(&runq_lock, SPLHI);
+retry:	(void)lock_runq(t);
 	strcpy(evp, event);
 
 	/*
@@ -72,7 +72,7 @@ retry:	p_lock_void(&runq_lock, SPLHI);
 	case TS_SLEEP:		/* Interrupt sleep */
 		if (t->t_nointr == 0) {
 			if (cunsleep(t)) {
-				v_lock(&runq_lock, SPL0);
+				unlock_runq(t, SPL0);
 				goto retry;
 			}
 			lsetrun(t);
@@ -90,7 +90,7 @@ retry:	p_lock_void(&runq_lock, SPLHI);
 	default:
 		ASSERT(0, "signal_thread: unknown state");
 	}
-	v_lock(&runq_lock, SPL0);
+	unlock_runq(t, SPL0);
 	return(0);
 }
 
@@ -248,9 +248,9 @@ selfsig(char *ev)
 	spl_t s;
 
 	ASSERT(curthread, "selfsig: no thread");
-	s = p_lock(&runq_lock, SPLHI);
+	s = lock_runq(curthread);
 	strcpy(curthread->t_evsys, ev);
-	v_lock(&runq_lock, s);
+	unlock_runq(curthread, s);
 }
 
 /*
@@ -291,11 +291,11 @@ check_events(void)
 	/*
 	 * Take next events, act on them
 	 */
-	s = p_lock(&runq_lock, SPLHI);
+	s = lock_runq(t);
 	if (t->t_evsys[0]) {
 		strcpy(event, t->t_evsys);
 		t->t_evsys[0] = '\0';
-		v_lock(&runq_lock, s);
+		unlock_runq(t, s);
 		ptrace_event(t, event);
 		if (event[0]) {
 			sendev(t, event);
@@ -305,14 +305,14 @@ check_events(void)
 	if (t->t_evproc[0]) {
 		strcpy(event, t->t_evproc);
 		t->t_evproc[0] = '\0';
-		v_lock(&runq_lock, s);
+		unlock_runq(t, s);
 		ptrace_event(t, event);
 		if (event[0]) {
 			sendev(t, event);
 		}
 		return;
 	}
-	v_lock(&runq_lock, s);
+	unlock_runq(t, s);
 }
 
 /*
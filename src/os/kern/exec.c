@@ -12,13 +12,32 @@
 #include <sys/param.h>
 #include <sys/exec.h>
 #include <sys/port.h>
+#include <sys/msg.h>
 #include <sys/assert.h>
 #include <sys/misc.h>
+#include <sys/hat.h>
 #include <hash.h>
 #include "../mach/mutex.h"
 #include "../mach/locore.h"
 
-extern void set_execarg(), reset_uregs();
+extern void set_execarg(), reset_uregs(), spawn_regs();
+
+/*
+ * exec_keeps()
+ *	Tell if a view survives exec()
+ *
+ * Only stuff we mmap()'ed as sharable will remain.  Since this is
+ * only used for exec() arguments, ignore sharable I/O physical
+ * mapped regions.
+ */
+static int
+exec_keeps(struct pview *pv)
+{
+	struct pset *ps = pv->p_set;
+
+	return((pv->p_prot & PROT_MMAP) && (ps->p_flags & PF_SHARED) &&
+		(ps->p_type != PT_MEM));
+}
 
 /*
  * discard_vas()
@@ -38,19 +57,8 @@ discard_vas(struct vas *vas)
 
 	for (pv = vas->v_views; pv; pv = pvn) {
 		pvn = pv->p_next;
-
-		/*
-		 * Only stuff we mmap()'ed as sharable will remain.
-		 * Since this is only used for exec() arguments,
-		 * ignore sharable I/O physical mapped regions.
-		 */
-		if (pv->p_prot & PROT_MMAP) {
-			struct pset *ps = pv->p_set;
-
-			if ((ps->p_flags & PF_SHARED) &&
-					(ps->p_type != PT_MEM)) {
-				continue;
-			}
+		if (exec_keeps(pv)) {
+			continue;
 		}
 
 		/*
@@ -169,6 +177,16 @@ exec(uint arg_port, struct mapfile *arg_map, void *arg)
 		return(err(EINVAL));
 	}
 
+	/*
+	 * A vfork() child gives its parent's vas back, keeping
+	 * just its own views which exec() would, and moves onto a
+	 * vas of its own.
+	 */
+	if (p->p_lender) {
+		vfork_done(p, exec_keeps);
+		hat_switch(&p->p_vas);
+	}
+
 	/*
 	 * Tear down most of our vas
 	 */
@@ -197,6 +215,12 @@ exec(uint arg_port, struct mapfile *arg_map, void *arg)
 	p->p_cmd[0] = '\0';
 	p->p_handler = 0;
 
+	/*
+	 * Replies to asynchronous messages would be copied into
+	 * an address space which no longer exists.
+	 */
+	async_flush(p);
+
 	/*
 	 * Pass the argument back in a machine-dependent way
 	 */
@@ -209,3 +233,134 @@ exec(uint arg_port, struct mapfile *arg_map, void *arg)
 	PTRACE_PENDING(p, PD_EXEC, 0);
 	return(0);
 }
+
+/*
+ * take_args()
+ *	Take the view holding exec()-style arguments out of a vas
+ *
+ * It must be one exec() would keep.  Returns the detached view, or
+ * 0 if there's none suitable.
+ */
+static struct pview *
+take_args(struct vas *vas, void *arg)
+{
+	struct pview *pv;
+	struct pset *ps;
+	void *vaddr;
+
+	/*
+	 * As for munmap(), clearing PROT_MMAP under the pset lock
+	 * keeps anybody else from tearing it down underneath us.
+	 */
+	pv = find_pview(vas, arg);
+	if (pv == 0) {
+		return(0);
+	}
+	ps = pv->p_set;
+	if (!exec_keeps(pv)) {
+		v_lock(&ps->p_lock, SPL0_SAME);
+		return(0);
+	}
+	pv->p_prot &= ~PROT_MMAP;
+	vaddr = pv->p_vaddr;
+	v_lock(&ps->p_lock, SPL0_SAME);
+	pv = detach_pview(vas, vaddr);
+	pv->p_prot |= PROT_MMAP;
+	return(pv);
+}
+
+/*
+ * spawn()
+ *	Create a new process running the given file
+ *
+ * This is fork() and exec() in one, but the new process's vas is
+ * built directly from the file, and only the listed open ports are
+ * passed on; a fork() would copy them all, along with the whole
+ * address space, only for the exec() to throw them away.  The
+ * argument is handed over as for exec(), and the view holding it
+ * moves to the new process.  Returns the new PID; on failure the
+ * file's port and the argument are still the caller's.
+ */
+pid_t
+spawn(port_t arg_port, struct mapfile *arg_map, void *arg,
+	port_t *arg_ports, uint arg_nport)
+{
+	struct proc *p = curthread->t_proc, *pnew;
+	struct thread *tnew;
+	struct portref *pr;
+	struct pview *pv;
+	struct mapfile m;
+	port_t ports[PROCOPENS];
+	pid_t npid;
+
+	/*
+	 * Get the description of the file mapping, and the ports
+	 */
+	if (copyin(arg_map, &m, sizeof(m))) {
+		return(err(EFAULT));
+	}
+	if (arg_nport > PROCOPENS) {
+		return(err(EINVAL));
+	}
+	if (copyin(arg_ports, ports, arg_nport * sizeof(port_t))) {
+		return(err(EFAULT));
+	}
+
+	/*
+	 * The view of the argument becomes the new process's, as it
+	 * would on exec(); so too the file's portref.  On failure
+	 * both are left with the caller.
+	 */
+	pv = 0;
+	if (arg && ((pv = take_args(&p->p_vas, arg)) == 0)) {
+		return(err(EINVAL));
+	}
+	pr = delete_portref(p, arg_port, 1);
+	if (pr == 0) {
+		if (pv && (attach_pview(&p->p_vas, pv) == 0)) {
+			free_pview(pv);
+		}
+		return(err(EINVAL));
+	}
+
+	/*
+	 * Get the new process, and build its vas
+	 */
+	tnew = alloc_child();
+	pnew = tnew->t_proc;
+	npid = pnew->p_pid;
+	init_lock(&pnew->p_vas.v_lock);
+	hat_initvas(&pnew->p_vas);
+	if (pv) {
+		pv->p_prot |= PROT_FORK;
+		if (attach_pview(&pnew->p_vas, pv) == 0) {
+			free_pview(pv);
+		} else {
+			pv->p_prot &= ~PROT_FORK;
+		}
+	}
+	add_stack(&pnew->p_vas);
+	add_views(&pnew->p_vas, pr, &m);
+	shut_client(pr, 1);
+
+	/*
+	 * Pass on the open ports asked for
+	 */
+	p_sema(&p->p_sema, PRIHI);
+	pnew->p_nopen = pass_ports(p->p_open, pnew->p_open,
+		ports, arg_nport);
+	v_sema(&p->p_sema);
+
+	/*
+	 * As for exec(), it has no name or handler yet
+	 */
+	pnew->p_cmd[0] = '\0';
+	pnew->p_handler = 0;
+
+	/*
+	 * Start it at the file's entry point
+	 */
+	spawn_regs(tnew, m.m_entry, arg);
+	start_child(tnew);
+	return(npid);
+}
@@ -1,6 +1,19 @@
 /*
  * malloc.c
- *	Power-of-two storage allocator
+ *	Slab storage allocator
+ *
+ * Memory comes from object caches.  Each cache hands out objects of
+ * a single size, carved from slabs of one or more pages.  There is a
+ * cache for each of a range of size classes, and one apiece for the
+ * structures allocated on every message; those are sized exactly, and
+ * their memory is only ever reused for the same type.
+ *
+ * In front of the caches each CPU keeps a magazine per cache, a short
+ * stack of free objects it allocates from and frees to without any
+ * lock.  The cache's lock is only taken when a magazine runs dry or
+ * fills, and then half a magazine's worth of objects moves at once.
+ *
+ * Requests for more than half a page are still given whole pages.
  */
 #include <sys/types.h>
 #include <sys/param.h>
@@ -11,6 +24,8 @@
 #include <sys/proc.h>
 #include <sys/thread.h>
 #include <sys/qio.h>
+#include <sys/seg.h>
+#include <sys/pview.h>
 #include <sys/sched.h>
 #include <sys/xclock.h>
 #include "../mach/vminline.h"
@@ -19,9 +34,44 @@
 #include <sys/core.h>
 
 /*
- * Per-bucket state
+ * All caches, and how to find them
  */
-struct bucket buckets[PGSHIFT];
+struct cache caches[NCACHE];
+uchar size_cache[SIZEIDX(NBPG/2)+1];
+uchar mt_cache[MALLOCTYPES];
+
+/*
+ * Object sizes for the size class caches
+ */
+static uint sizes[NSIZECACHE] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+	768, 1024, 1536, 2048
+};
+
+/*
+ * Types with a cache of their own
+ */
+static struct {
+	uint t_type;	/* MT_* value */
+	uint t_size;	/* Size of its objects */
+	char *t_name;
+} typecaches[NTYPECACHE] = {
+	{MT_SYSMSG, sizeof(struct sysmsg), "sysmsg"},
+	{MT_PORTREF, sizeof(struct portref), "portref"},
+	{MT_PVIEW, sizeof(struct pview), "pview"},
+	{MT_SEG, sizeof(struct seg), "seg"},
+	{MT_QIO, sizeof(struct qio), "qio"},
+};
+
+/*
+ * Magazines for the boot CPU
+ */
+static struct magazine boot_mags[NCACHE];
+
+/*
+ * Slab a slab object lies within
+ */
+#define SLAB(v) ((struct slab *)PAGE_GETVAL(btop(vtop(v))))
 
 #ifdef DEBUG
 /*
@@ -34,119 +84,397 @@ char *n_allocname[MALLOCTYPES] = {
 	"MT_PROC", "MT_THREAD", "MT_KSTACK", "MT_VAS", "MT_PERPAGE",
 	"MT_QIO", "MT_SCHED", "MT_SEG", "MT_EVENTQ", "MT_L1PT",
 	"MT_L2PT", "MT_PGRP", "MT_ATL", "MT_FPU", "MT_OPENPORT",
-	"MT_PVIEW_VALID",
+	"MT_PVIEW_VALID", "MT_MAPCACHE", "MT_WAITADDR",
 };
+
+/*
+ * Tally of use of types: # of each, and bytes they hold
+ */
+ulong n_alloc[MALLOCTYPES];
+ulong n_bytes[MALLOCTYPES];
 #endif /* DEBUG */
 
 /*
- * malloc()
- *	Allocate block of given size
+ * slab_link()
+ *	Put slab on its cache's partial list
  */
-void *
-malloc(uint size)
+static void
+slab_link(struct cache *c, struct slab *sl)
+{
+	sl->sl_prev = 0;
+	sl->sl_next = c->c_partial;
+	if (c->c_partial) {
+		c->c_partial->sl_prev = sl;
+	}
+	c->c_partial = sl;
+}
+
+/*
+ * slab_unlink()
+ *	Take slab off its cache's partial list
+ */
+static void
+slab_unlink(struct cache *c, struct slab *sl)
+{
+	if (sl->sl_prev) {
+		sl->sl_prev->sl_next = sl->sl_next;
+	} else {
+		c->c_partial = sl->sl_next;
+	}
+	if (sl->sl_next) {
+		sl->sl_next->sl_prev = sl->sl_prev;
+	}
+}
+
+/*
+ * new_slab()
+ *	Get memory for another slab, and chop it into objects
+ *
+ * May sleep for memory, so no locks may be held.
+ */
+static struct slab *
+new_slab(struct cache *c)
 {
-	struct bucket *b;
-	void *f;
-	uint bucket;
+	char *mem, *p;
+	struct slab *sl;
+	uint x, pg;
 
 	/*
-	 * For pages and larger, allocate memory in units of
-	 * pages. Power-of-two allocations, so > half page
-	 * also consumes a whole page.
+	 * Single page slabs come straight from the physical
+	 * mapping; larger ones need contiguous virtual space.
 	 */
-	if (size > (NBPG / 2)) {
-		uint pgs;
-		void *mem;
+	if (c->c_slabpgs == 1) {
+		pg = alloc_page();
+		PAGE_SETSYS(pg);
+		mem = ptov(ptob(pg));
+	} else {
+		mem = alloc_pages(c->c_slabpgs);
+	}
 
-		pgs = btorp(size);
-		mem = alloc_pages(pgs);
-		PAGE_SETVAL(btop(vtop(mem)), PGSHIFT + pgs);
-		return(mem);
+	/*
+	 * Header at the end, and each page pointing at it
+	 */
+	sl = (struct slab *)(mem + ptob(c->c_slabpgs) - sizeof(struct slab));
+	for (x = 0; x < c->c_slabpgs; ++x) {
+		pg = btop(vtop(mem + ptob(x)));
+		core[pg].c_flags |= C_SLAB;
+		PAGE_SETVAL(pg, (ulong)sl);
 	}
+	sl->sl_base = mem;
+	sl->sl_cache = c;
+	sl->sl_inuse = 0;
 
 	/*
-	 * Otherwise allocate from one of our buckets
+	 * Parcel out the objects
 	 */
-	bucket = BUCKET(size);
-	b = &buckets[bucket];
+	sl->sl_mem = 0;
+	for (x = 0, p = mem; x < c->c_perslab; ++x, p += c->c_size) {
+		*(void **)p = sl->sl_mem;
+		sl->sl_mem = p;
+	}
+	return(sl);
+}
+
+/*
+ * free_slab()
+ *	Give a slab's memory back
+ */
+static void
+free_slab(struct slab *sl)
+{
+	struct cache *c = sl->sl_cache;
+	char *mem = sl->sl_base;
+	uint x, pg;
+
+	for (x = 0; x < c->c_slabpgs; ++x) {
+		pg = btop(vtop(mem + ptob(x)));
+		core[pg].c_flags &= ~(C_SYS|C_SLAB);
+	}
+	if (c->c_slabpgs == 1) {
+		free_page(btop(vtop(mem)));
+	} else {
+		free_pages(mem, c->c_slabpgs);
+	}
+}
+
+/*
+ * slab_get()
+ *	Take an object from the slabs of a cache
+ *
+ * Called with the cache locked.  Returns 0 if no slab has one free.
+ */
+static void *
+slab_get(struct cache *c)
+{
+	struct slab *sl;
+	void *v;
+
+	sl = c->c_partial;
+	if (sl == 0) {
+		sl = c->c_empty;
+		if (sl == 0) {
+			return(0);
+		}
+		c->c_empty = 0;
+		slab_link(c, sl);
+	}
+	v = sl->sl_mem;
+	sl->sl_mem = *(void **)v;
+	sl->sl_inuse += 1;
+	c->c_inuse += 1;
 
 	/*
-	 * Lock and see if our bucket is empty or not
+	 * Full slabs are on no list; slab_put() finds them again
+	 * through the object.
 	 */
-	p_lock_void(&b->b_lock, SPL0);
-	
+	if (sl->sl_inuse == c->c_perslab) {
+		slab_unlink(c, sl);
+	}
+	return(v);
+}
+
+/*
+ * slab_put()
+ *	Return an object to its slab
+ *
+ * Called with the cache locked.  One wholly free slab is kept
+ * against the next allocation; if this frees up another, it is
+ * returned so the caller can free it once the lock is dropped.
+ */
+static struct slab *
+slab_put(struct cache *c, void *v)
+{
+	struct slab *sl = SLAB(v);
+
+	ASSERT_DEBUG(sl->sl_cache == c, "slab_put: wrong cache");
+#ifdef DEBUG
 	/*
-	 * We now know what bucket to use.  If it appears to be empty,
-	 * grab a page and chop it into appropriately sized pieces
+	 * Slow, but can catch truly horrible bugs.  See if
+	 * this memory is being freed when already free.
 	 */
-	if (b->b_mem == 0) {
-		uint pg;
-		uchar *p;
-		int x;
-		struct core *c;
+	{ void *f;
 
-		/*
-		 * Keep trying until we get a page
-		 */
-		v_lock(&b->b_lock, SPL0_SAME);
-		pg = alloc_page();
-		p_lock_void(&b->b_lock, SPL0_SAME);
+	  for (f = sl->sl_mem; f; f = *(void **)f) {
+		ASSERT(f != v, "free: already on list");
+	  }
+	}
+#endif
+	if (sl->sl_inuse == c->c_perslab) {
+		slab_link(c, sl);
+	}
+	*(void **)v = sl->sl_mem;
+	sl->sl_mem = v;
+	c->c_inuse -= 1;
+	sl->sl_inuse -= 1;
+	if (sl->sl_inuse > 0) {
+		return(0);
+	}
+	slab_unlink(c, sl);
+	if (c->c_empty == 0) {
+		c->c_empty = sl;
+		return(0);
+	}
+	c->c_slabs -= 1;
+	return(sl);
+}
 
-		/*
-		 * Fill in per-page information, flag page as
-		 * consumed for kernel memory.
-		 */
-		PAGE_SETVAL(pg, bucket);
-		PAGE_SETSYS(pg);
+/*
+ * cache_alloc()
+ *	Allocate an object from a cache
+ */
+static void *
+cache_alloc(struct cache *c)
+{
+	struct magazine *m;
+	struct slab *sl;
+	void *v, *v2;
 
-		/*
-		 * Parcel as many chunks as will fit out of the page
-		 */
-		p = ptov(ptob(pg));
-		for (x = 0; x < NBPG; x += b->b_size) {
-			*(void **)(p+x) = b->b_mem;
-			b->b_mem = p+x;
+	/*
+	 * Our own magazine, if it has any
+	 */
+	NO_PREEMPT();
+	m = &cpu.pc_mags[c - caches];
+	if (m->m_rounds) {
+		v = m->m_obj[--(m->m_rounds)];
+		PREEMPT_OK();
+		return(v);
+	}
+	PREEMPT_OK();
+
+	/*
+	 * Otherwise from the slabs, growing the cache if it's
+	 * full up
+	 */
+	p_lock_void(&c->c_lock, SPL0);
+	while ((v = slab_get(c)) == 0) {
+		v_lock(&c->c_lock, SPL0_SAME);
+		sl = new_slab(c);
+		p_lock_void(&c->c_lock, SPL0_SAME);
+		c->c_slabs += 1;
+		slab_link(c, sl);
+	}
+
+	/*
+	 * While we hold the lock, half fill our magazine so the
+	 * next few come for free.  Holding a lock keeps us from
+	 * being preempted, so the magazine is safe to touch; it's
+	 * looked up again, as we may have moved since.
+	 */
+	m = &cpu.pc_mags[c - caches];
+	while (m->m_rounds < MAGSIZE/2) {
+		v2 = slab_get(c);
+		if (v2 == 0) {
+			break;
 		}
+		m->m_obj[(m->m_rounds)++] = v2;
+	}
+	v_lock(&c->c_lock, SPL0_SAME);
+	return(v);
+}
 
-		/*
-		 * Update count of pages consumed by this bucket
-		 */
-		b->b_pages += 1;
+/*
+ * cache_free()
+ *	Free an object to its cache
+ */
+static void
+cache_free(struct cache *c, void *v)
+{
+	struct magazine *m;
+	struct slab *sl, *rel;
+
+	/*
+	 * Into our magazine, if there's room
+	 */
+	NO_PREEMPT();
+	m = &cpu.pc_mags[c - caches];
+#ifdef DEBUG
+	{ uint x;
+
+	  for (x = 0; x < m->m_rounds; ++x) {
+		ASSERT(m->m_obj[x] != v, "free: already in magazine");
+	  }
+	}
+#endif
+	if (m->m_rounds < MAGSIZE) {
+		m->m_obj[(m->m_rounds)++] = v;
+		PREEMPT_OK();
+		return;
+	}
+	PREEMPT_OK();
+
+	/*
+	 * Full; empty half of it back to the slabs
+	 */
+	rel = 0;
+	p_lock_void(&c->c_lock, SPL0);
+	m = &cpu.pc_mags[c - caches];
+	while (m->m_rounds > MAGSIZE/2) {
+		sl = slab_put(c, m->m_obj[--(m->m_rounds)]);
+		if (sl) {
+			sl->sl_next = rel;
+			rel = sl;
+		}
 	}
+	m->m_obj[(m->m_rounds)++] = v;
+	v_lock(&c->c_lock, SPL0_SAME);
 
 	/*
-	 * Take a chunk
+	 * Release any slabs this left unused
 	 */
-	f = b->b_mem;
-	b->b_mem = *(void **)f;
+	while (rel) {
+		sl = rel;
+		rel = sl->sl_next;
+		free_slab(sl);
+	}
+}
 
+/*
+ * malloc()
+ *	Allocate block of given size
+ */
+void *
+malloc(uint size)
+{
 	/*
-	 * Release lock.
+	 * For more than half a page, allocate memory in units of
+	 * pages.  The first page's core entry remembers how many.
 	 */
-	v_lock(&b->b_lock, SPL0_SAME);
+	if (size > (NBPG / 2)) {
+		uint pgs;
+		void *mem;
+
+		pgs = btorp(size);
+		mem = alloc_pages(pgs);
+		PAGE_SETVAL(btop(vtop(mem)), pgs);
+		return(mem);
+	}
 
 	/*
-	 * Return memory
+	 * Otherwise from the cache for its size
 	 */
-	return(f);
+	return(cache_alloc(&caches[size_cache[SIZEIDX(size)]]));
+}
+
+/*
+ * free()
+ *	Free a malloc()'ed memory element
+ */
+void
+free(void *mem)
+{
+	uint pg;
+
+	pg = btop(vtop(mem));
+	if (core[pg].c_flags & C_SLAB) {
+		cache_free(((struct slab *)PAGE_GETVAL(pg))->sl_cache, mem);
+		return;
+	}
+	ASSERT_DEBUG(PAGE_GETVAL(pg) > 0, "free: npgs == 0");
+	free_pages(mem, PAGE_GETVAL(pg));
 }
 
 #ifdef DEBUG
 /*
- * Tally of use of types
+ * msize()
+ *	Tell how many bytes a malloc()'ed element really holds
  */
-ulong n_alloc[MALLOCTYPES];
+static uint
+msize(void *mem)
+{
+	uint pg;
+
+	pg = btop(vtop(mem));
+	if (core[pg].c_flags & C_SLAB) {
+		return(((struct slab *)PAGE_GETVAL(pg))->sl_cache->c_size);
+	}
+	return(ptob(PAGE_GETVAL(pg)));
+}
+#endif /* DEBUG */
 
 /*
  * _malloc()
  *	Allocate with type attribute
+ *
+ * Types with a cache of their own are allocated from it.
  */
 void *
 _malloc(uint size, uint type)
 {
-	ASSERT(type < MALLOCTYPES, "_malloc: bad type");
+	void *mem;
+
+	ASSERT_DEBUG(type < MALLOCTYPES, "_malloc: bad type");
+	if (size > (NBPG / 2)) {
+		mem = malloc(size);
+	} else {
+		mem = cache_alloc(&caches[cache_idx(size, type)]);
+	}
+#ifdef DEBUG
 	ATOMIC_INCL(&n_alloc[type]);
-	return(malloc(size));
+	NO_PREEMPT();
+	n_bytes[type] += msize(mem);
+	PREEMPT_OK();
+#endif
+	return(mem);
 }
 
 /*
@@ -156,62 +484,40 @@ _malloc(uint size, uint type)
 void
 _free(void *ptr, uint type)
 {
-	ASSERT(type < MALLOCTYPES, "_free: bad type");
+	ASSERT_DEBUG(type < MALLOCTYPES, "_free: bad type");
+#ifdef DEBUG
 	ATOMIC_DECL(&n_alloc[type]);
+	NO_PREEMPT();
+	n_bytes[type] -= msize(ptr);
+	PREEMPT_OK();
+#endif
 	free(ptr);
-	return;
 }
-#endif /* DEBUG */
 
 /*
- * free()
- *	Free a malloc()'ed memory element
+ * init_cache()
+ *	Set up a cache for objects of the given size
+ *
+ * Slabs grow from one page until no more than an eighth of one goes
+ * unused.
  */
-void
-free(void *mem)
+static void
+init_cache(struct cache *c, char *name, uint size)
 {
-	uint pg, x;
-	void *f;
-	struct bucket *b;
-
-	/*
-	 * Get page information
-	 */
-	pg = btop(vtop(mem));
-	x = PAGE_GETVAL(pg);
-
-	/*
-	 * If a whole page or more, free directly
-	 */
-	if (x >= PGSHIFT) {
-		ASSERT_DEBUG(x != PGSHIFT, "free: npgs == 0");
-		free_pages(mem, x - PGSHIFT);
-		return;
-	}
-
-	/*
-	 * Get bucket and lock
-	 */
-	b = &buckets[x];
-	p_lock_void(&b->b_lock, SPL0);
+	uint pgs, n;
 
-#ifdef DEBUG
-	/*
-	 * Slow, but can catch truly horrible bugs.  See if
-	 * this memory is being freed when already free.
-	 */
-	for (f = b->b_mem; f; f = *(void **)f) {
-		ASSERT(f != mem, "free: already on list");
+	size = (size + sizeof(long) - 1) & ~(sizeof(long) - 1);
+	for (pgs = 1; pgs < MAXSLABPGS; ++pgs) {
+		n = (ptob(pgs) - sizeof(struct slab)) / size;
+		if ((ptob(pgs) - n*size) <= (ptob(pgs) / 8)) {
+			break;
+		}
 	}
-#endif
-
-	/*
-	 * Free chunk to bucket
-	 */
-	*(void **)mem = b->b_mem;
-	b->b_mem = mem;
-
-	v_lock(&b->b_lock, SPL0_SAME);
+	c->c_name = name;
+	c->c_size = size;
+	c->c_slabpgs = pgs;
+	c->c_perslab = (ptob(pgs) - sizeof(struct slab)) / size;
+	init_lock(&c->c_lock);
 }
 
 /*
@@ -221,15 +527,29 @@ free(void *mem)
 void
 init_malloc(void)
 {
-	int x;
-	struct bucket *b;
+	int x, y;
+
+	/*
+	 * The size classes, and the map from size to class
+	 */
+	for (x = y = 0; x < NSIZECACHE; ++x) {
+		init_cache(&caches[x], 0, sizes[x]);
+		while ((y <= SIZEIDX(NBPG/2)) && ((y << 4) <= sizes[x])) {
+			size_cache[y++] = x;
+		}
+	}
 
 	/*
-	 * Setup the buckets
+	 * Types with their own cache
 	 */
-	for (x = 0; x < PGSHIFT; ++x) {
-		b = &buckets[x];
-		b->b_size = (1 << x);
-		init_lock(&b->b_lock);
+	for (x = 0; x < NTYPECACHE; ++x) {
+		init_cache(&caches[NSIZECACHE + x], typecaches[x].t_name,
+			typecaches[x].t_size);
+		mt_cache[typecaches[x].t_type] = NSIZECACHE + x + 1;
 	}
+
+	/*
+	 * Magazines for the CPU we're booting on
+	 */
+	cpu.pc_mags = boot_mags;
 }
@@ -12,12 +12,44 @@
 #include <sys/fs.h>
 #include <sys/port.h>
 #include <sys/misc.h>
-#include <hash.h>
+#include <sys/malloc.h>
+#include <sys/pstat.h>
 #include "../mach/mutex.h"
 #include "pset.h"
 
-/* Flag that we're not allowing a map hash to be created */
-#define NO_MAP_HASH ((struct hash *)1)
+/*
+ * The cache of mapped files.  Each entry holds a reference to the
+ * pset for a file's contents, under the server's port and the ID it
+ * gave for the file, so mapping it again--most often, running a
+ * program again--finds its pages still in memory.  A server may give
+ * a stamp along with the ID, which must match as well.
+ *
+ * Entries are kept on a list, most recently used first.  The least
+ * recently used one gives way when the cache is full, and pageout()
+ * trims those nobody's using when memory is short.
+ */
+#define NMAPCACHE (128)		/* Most files cached */
+#define NMAPHASH (64)		/* # hash chains; a power of two */
+#define MAPHASH(port, fid) \
+	((((ulong)(port) >> 4) ^ (ulong)(fid)) & (NMAPHASH-1))
+
+struct mapcache {
+	struct mapcache		/* LRU list */
+		*m_next, *m_prev;
+	struct mapcache *m_hash;	/* Hash chain */
+	struct port *m_port;	/* Server */
+	long m_fid;		/* File ID */
+	ulong m_stamp;		/*  ...and stamp */
+	struct pset *m_pset;	/* Its contents */
+};
+
+static struct mapcache *map_hash[NMAPHASH];
+static struct mapcache	/* LRU list, newest first */
+	*map_hd, *map_tl;
+static uint nmapcache;		/* # entries */
+static lock_t map_lock;		/* Spinlock for all the above */
+
+extern struct pstat_vm vmstat;
 
 /*
  * mmap()
@@ -209,6 +241,141 @@ munmap(caddr_t vaddr, ulong len)
 	return(0);
 }
 
+/*
+ * madvise()
+ *	Tell how a mapping will be used
+ *
+ * As with munmap(), the advice covers the whole view found at the
+ * address.  It steers read-ahead and fault-around in vas_fault(),
+ * and whether fresh anonymous memory gets large pages.
+ */
+int
+madvise(caddr_t vaddr, ulong len, int advice)
+{
+	struct vas *vas = &curthread->t_proc->p_vas;
+	struct pview *pv;
+
+	if ((advice != MADV_NORMAL) && (advice != MADV_RANDOM) &&
+			(advice != MADV_SEQUENTIAL) &&
+			(advice != MADV_WILLNEED)) {
+		return(err(EINVAL));
+	}
+	pv = find_pview(vas, vaddr);
+	if (!pv) {
+		return(err(EINVAL));
+	}
+	pv->p_advice = advice;
+	pv->p_rawin = 0;
+	v_lock(&pv->p_set->p_lock, SPL0_SAME);
+	return(0);
+}
+
+/*
+ * map_unlink()
+ *	Take an entry out of the cache
+ *
+ * map_lock is held.  The caller frees the entry, and drops its
+ * reference to the pset, once the lock's released.
+ */
+static void
+map_unlink(struct mapcache *m)
+{
+	struct mapcache **mp;
+
+	for (mp = &map_hash[MAPHASH(m->m_port, m->m_fid)]; *mp != m;
+			mp = &(*mp)->m_hash)
+		;
+	*mp = m->m_hash;
+	if (m->m_prev) {
+		m->m_prev->m_next = m->m_next;
+	} else {
+		map_hd = m->m_next;
+	}
+	if (m->m_next) {
+		m->m_next->m_prev = m->m_prev;
+	} else {
+		map_tl = m->m_prev;
+	}
+	m->m_port->p_nmaps -= 1;
+	nmapcache -= 1;
+}
+
+/*
+ * map_lookup()
+ *	Find a file's entry, making it most recently used
+ *
+ * map_lock is held.
+ */
+static struct mapcache *
+map_lookup(struct port *port, long fid)
+{
+	struct mapcache *m;
+
+	for (m = map_hash[MAPHASH(port, fid)]; m; m = m->m_hash) {
+		if ((m->m_port == port) && (m->m_fid == fid)) {
+			break;
+		}
+	}
+	if (m && m->m_prev) {
+		m->m_prev->m_next = m->m_next;
+		if (m->m_next) {
+			m->m_next->m_prev = m->m_prev;
+		} else {
+			map_tl = m->m_prev;
+		}
+		m->m_prev = 0;
+		m->m_next = map_hd;
+		map_hd->m_prev = m;
+		map_hd = m;
+	}
+	return(m);
+}
+
+/*
+ * map_insert()
+ *	Add an entry as the most recently used
+ *
+ * map_lock is held.
+ */
+static void
+map_insert(struct mapcache *m)
+{
+	struct mapcache **mp;
+
+	mp = &map_hash[MAPHASH(m->m_port, m->m_fid)];
+	m->m_hash = *mp;
+	*mp = m;
+	m->m_prev = 0;
+	m->m_next = map_hd;
+	if (map_hd) {
+		map_hd->m_prev = m;
+	} else {
+		map_tl = m;
+	}
+	map_hd = m;
+	m->m_port->p_nmaps += 1;
+	nmapcache += 1;
+}
+
+/*
+ * map_free()
+ *	Free entries taken out of the cache
+ *
+ * They're chained through m_hash.  Dropping the cache's reference
+ * to a pset nobody else is using frees it, and its pages.
+ */
+static void
+map_free(struct mapcache *m)
+{
+	struct mapcache *mnext;
+
+	for ( ; m; m = mnext) {
+		mnext = m->m_hash;
+		deref_pset(m->m_pset);
+		FREE(m, MT_MAPCACHE);
+	}
+}
+
 /*
  * get_map_pset()
  *	Return pset view of named file
@@ -221,18 +388,20 @@ get_map_pset(struct portref *pr)
 {
 	struct pset *ps;
 	long args[3];
+	ulong stamp;
 	struct port *port;
+	struct mapcache *m, *old;
 
 	/*
 	 * Hold mutex so we're the only one searching/updating the
-	 * cache of mappings.  This also keeps the port from shutting
-	 * on us.
+	 * cache for this server.  This also keeps the port from
+	 * shutting on us.
 	 */
 	p_lock_void(&pr->p_lock, SPL0);
 	port = pr->p_port;
 	if (port) {
 		if ((port->p_flags & P_CLOSING) ||
-				(port->p_maps == NO_MAP_HASH)) {
+				(port->p_nmaps == NO_MAPS)) {
 			v_lock(&pr->p_lock, SPL0_SAME);
 			port = 0;
 		} else {
@@ -243,7 +412,8 @@ get_map_pset(struct portref *pr)
 
 	/*
 	 * Try to get file ID.  This also gets us the file's
-	 * size.  Fail if we get interrupted trying to do the I/O.
+	 * size, and any stamp the server keeps for its contents.
+	 * Fail if we get interrupted trying to do the I/O.
 	 */
 	if (!port) {
 		return(0);
@@ -252,41 +422,55 @@ get_map_pset(struct portref *pr)
 		v_sema(&port->p_mapsema);
 		return(0);
 	}
+	stamp = FID_GETSTAMP(args[2]);
 
 	/*
-	 * If there's a hash already, search it for our ID.  Otherwise
-	 * create a new hash and flag that we didn't find the pset.
+	 * Search the cache.  If the file's changed since it was
+	 * cached, invalidate the old image so we can set up the
+	 * new one.
 	 */
-	if (port->p_maps) {
-		ps = hash_lookup(port->p_maps, args[0]);
-	} else {
-		/*
-		 * New hash table.  Is 32 a good number?  Who knows?
-		 */
-		port->p_maps = hash_alloc(32);
-		ps = 0;
+	old = 0;
+	p_lock_void(&map_lock, SPL0);
+	m = map_lookup(port, args[0]);
+	if (m && ((m->m_stamp != stamp) ||
+			(m->m_pset->p_len != args[1]))) {
+		map_unlink(m);
+		m->m_hash = 0;
+		old = m;
+		m = 0;
 	}
-
-	/*
-	 * If the file's changed size, invalidate the old executable
-	 * cache so we can set up the new one.
-	 */
-	if (ps && (ps->p_len != args[1])) {
-		(void)hash_delete(port->p_maps, args[0]);
-		deref_pset(ps);
-		ps = 0;
+	if (m) {
+		vmstat.psv_maphits += 1;
+		ps = m->m_pset;
+		ref_pset(ps);
+		v_lock(&map_lock, SPL0_SAME);
+		v_sema(&port->p_mapsema);
+		return(ps);
 	}
+	vmstat.psv_mapmisses += 1;
+	v_lock(&map_lock, SPL0_SAME);
+	map_free(old);
 
 	/*
-	 * If no pset, create one and insert it.  The mapping in
-	 * the hash counts as a reference.
+	 * No pset, so create one and insert it.  The entry counts
+	 * as a reference.  Make room by letting the least recently
+	 * used entry go.
 	 */
-	if (ps == 0) {
-		ATOMIC_INCL(&pr->p_refs);
-		ps = alloc_pset_fod(pr, args[1]);
-		(void)hash_insert(port->p_maps, args[0], ps);
-		ref_pset(ps);
+	ATOMIC_INCL(&pr->p_refs);
+	ps = alloc_pset_fod(pr, args[1]);
+	m = MALLOC(sizeof(struct mapcache), MT_MAPCACHE);
+	m->m_port = port;
+	m->m_fid = args[0];
+	m->m_stamp = stamp;
+	m->m_pset = ps;
+	ref_pset(ps);
+	p_lock_void(&map_lock, SPL0);
+	if (nmapcache >= NMAPCACHE) {
+		old = map_tl;
+		map_unlink(old);
+		old->m_hash = 0;
 	}
+	map_insert(m);
 
 	/*
 	 * Leave an extra ref on the pset so it won't go away
@@ -294,6 +478,8 @@ get_map_pset(struct portref *pr)
 	 * this ref once he's done his own refs.
 	 */
 	ref_pset(ps);
+	v_lock(&map_lock, SPL0_SAME);
+	map_free(old);
 
 	/*
 	 * Release sema and return pset
@@ -302,6 +488,44 @@ get_map_pset(struct portref *pr)
 	return(ps);
 }
 
+/*
+ * trim_maps()
+ *	Let go of cached files nobody's using, to free memory
+ *
+ * Called by pageout() when memory's short.  Up to "count" of them
+ * go, least recently used first.  Returns the number dropped.
+ */
+int
+trim_maps(int count)
+{
+	struct mapcache *m, *mprev, *dead;
+	int n;
+
+	dead = 0;
+	n = 0;
+	p_lock_void(&map_lock, SPL0);
+	for (m = map_tl; m && (n < count); m = mprev) {
+		mprev = m->m_prev;
+
+		/*
+		 * In use if anything but our entry holds it.  That's
+		 * only a hint, but a new user has to come through
+		 * the cache, and we hold the lock.
+		 */
+		if (m->m_pset->p_refs > 1) {
+			continue;
+		}
+		map_unlink(m);
+		m->m_hash = dead;
+		dead = m;
+		n += 1;
+	}
+	v_lock(&map_lock, SPL0_SAME);
+	map_free(dead);
+	vmstat.psv_maptrims += n;
+	return(n);
+}
+
 /*
  * add_map()
  *	Add a mmap view of the given file
@@ -374,19 +598,35 @@ add_map(struct vas *vas, struct portref *pr, caddr_t vaddr, ulong len,
 }
 
 /*
- * do_derefport()
- *	Release a cached access to a port
+ * map_unport()
+ *	Take out the cache entries for a file, or all of a port's
+ *
+ * A fid of -1 means all of them.  The port's p_mapsema is held.
  */
-static int
-do_derefport(long keydummy, struct pset *ps, void *dummy)
+static void
+map_unport(struct port *port, long fid)
 {
-	deref_pset(ps);
-	return(0);
+	struct mapcache *m, *mnext, *dead;
+
+	dead = 0;
+	p_lock_void(&map_lock, SPL0);
+	for (m = map_hd; m && port->p_nmaps; m = mnext) {
+		mnext = m->m_next;
+		if ((m->m_port != port) ||
+				((fid != -1) && (m->m_fid != fid))) {
+			continue;
+		}
+		map_unlink(m);
+		m->m_hash = dead;
+		dead = m;
+	}
+	v_lock(&map_lock, SPL0_SAME);
+	map_free(dead);
 }
 
 /*
  * mmap_cleanup()
- *	Clean up mapped file cache, if any
+ *	Clean up mapped file cache for a port that's going away
  */
 void
 mmap_cleanup(struct port *port)
@@ -397,24 +637,13 @@ mmap_cleanup(struct port *port)
 	p_sema(&port->p_mapsema, PRIHI);
 
 	/*
-	 * No cache--nothing to do
+	 * Remove our entries, each dropping its reference to
+	 * its pset.  Then flag port as shutting down.
 	 */
-	if (port->p_maps == 0) {
-		v_sema(&port->p_mapsema);
-		return;
+	if (port->p_nmaps) {
+		map_unport(port, -1);
 	}
-
-	/*
-	 * Remove reference from pset for each entry
-	 * in our cache.
-	 */
-	hash_foreach(port->p_maps, do_derefport, 0);
-
-	/*
-	 * Free the hash storage, flag port as shutting down
-	 */
-	hash_dealloc(port->p_maps);
-	port->p_maps = NO_MAP_HASH;
+	port->p_nmaps = NO_MAPS;
 
 	v_sema(&port->p_mapsema);
 }
@@ -457,16 +686,10 @@ unhash(port_t arg_port, long arg_fid)
 	p_sema_v_lock(&port->p_mapsema, PRIHI, &port->p_lock);
 
 	/*
-	 * If there's a map, delete entry from it
+	 * If it's cached, take it out
 	 */
-	if (port->p_maps && (port->p_maps != NO_MAP_HASH)) {
-		struct pset *ps;
-
-		ps = hash_lookup(port->p_maps, arg_fid);
-		if (ps) {
-			(void)hash_delete(port->p_maps, arg_fid);
-			deref_pset(ps);
-		}
+	if (port->p_nmaps && (port->p_nmaps != NO_MAPS)) {
+		map_unport(port, arg_fid);
 	}
 
 	/*
@@ -475,3 +698,13 @@ unhash(port_t arg_port, long arg_fid)
 	v_sema(&port->p_mapsema);
 	return(0);
 }
+
+/*
+ * init_mmap()
+ *	Set up the cache of mapped files
+ */
+void
+init_mmap(void)
+{
+	init_lock(&map_lock);
+}
@@ -24,6 +24,12 @@
 #include <hash.h>
 #include "msg.h"
 
+static struct sysmsg *tag_find(struct portref *, int, int),
+	*tag_unlink(struct portref *, struct sysmsg *);
+static void tag_enter(struct portref *, struct sysmsg *);
+
+#define TAG_ONE (0x1000)	/* Lowest bit of M_TAG */
+
 /*
  * queue_msg()
  *	Queue a message, external version
@@ -52,9 +58,13 @@ inline void
 freesegs(struct sysmsg *sm)
 {
 	uint x;
+	struct seg **segv = SM_SEGV(sm);
 
 	for (x = 0; x < sm->sm_nseg; ++x) {
-		free_seg(sm->sm_seg[x]);
+		free_seg(segv[x]);
+	}
+	if (sm->sm_nseg > MSGSEGS) {
+		FREE(segv, MT_MSG);
 	}
 	sm->sm_nseg = 0;
 }
@@ -79,37 +89,59 @@ unmapsegs(struct segref *segref)
 		free_seg(s);
 		segref->s_refs[x] = 0;
 	}
+
+	/*
+	 * A message with more than MSGSEGS left us its vector
+	 */
+	if (segref->s_xrefs) {
+		for (x = 0; x < segref->s_nxrefs; ++x) {
+			s = segref->s_xrefs[x];
+			detach_seg(s);
+			free_seg(s);
+		}
+		FREE(segref->s_xrefs, MT_MSG);
+		segref->s_xrefs = 0;
+	}
 }
 
 /*
  * mapsegs()
  *	Map each segment in a message into the user process
  *
- * Records the attachment under the segref structure
+ * Records the attachment under the segref structure.  With more than
+ * MSGSEGS segments, the segref takes over the sysmsg's vector of them.
  */
 static int
 mapsegs(struct proc *p, struct sysmsg *sm, struct segref *segref)
 {
 	uint x;
 	uint cnt = 0;
-	struct seg *s;
+	struct seg *s, **segv = SM_SEGV(sm);
 
 	for (x = 0; x < sm->sm_nseg; ++x) {
-		s = sm->sm_seg[x];
+		s = segv[x];
 		if (attach_seg(&p->p_vas, s)) {
 			uint y;
 
 			for (y = 0; y < x; ++y) {
-				s = sm->sm_seg[y];
-				segref->s_refs[y] = 0;
+				s = segv[y];
+				if (y < MSGSEGS) {
+					segref->s_refs[y] = 0;
+				}
 				detach_seg(s);
 			}
 			return(err(ENOMEM));
 		}
-		segref->s_refs[x] = s;
+		if (x < MSGSEGS) {
+			segref->s_refs[x] = s;
+		}
 		cnt += s->s_len;
 	}
-	if (sm->sm_nseg != MSGSEGS) {
+	if (sm->sm_nseg > MSGSEGS) {
+		segref->s_refs[0] = 0;
+		segref->s_xrefs = segv;
+		segref->s_nxrefs = sm->sm_nseg;
+	} else if (sm->sm_nseg != MSGSEGS) {
 		segref->s_refs[sm->sm_nseg] = 0;
 	}
 	return(cnt);
@@ -120,52 +152,126 @@ mapsegs(struct proc *p, struct sysmsg *sm, struct segref *segref)
  *	Convert sysmsg back into user msg format
  *
  * Primary job is converting the segment information from
- * the sysmsg format to the user-visible msg format
+ * the sysmsg format to the user-visible msg format.  More than
+ * MSGSEGS segments are listed in the receiver's M_SGL array, "ulist".
+ * The segments must have been mapped by mapsegs().  Returns 0, or
+ * sets err() and returns -1.
  */
-static void
-sm_to_m(struct sysmsg *sm)
+static int
+sm_to_m(struct sysmsg *sm, seg_t *ulist)
 {
-	uint x;
-	seg_t *s;
-	struct seg *seg;
+	uint x, nseg = sm->sm_nseg;
+	seg_t *s, *list;
+	struct seg *seg, **segv = SM_SEGV(sm);
 	struct msg *m = &sm->sm_msg;
+	int error = 0;
 
-	m->m_nseg = sm->sm_nseg;
-	for (x = 0, s = m->m_seg; x < sm->sm_nseg; ++x, ++s) {
-		seg = sm->sm_seg[x];
+	if (nseg > MSGSEGS) {
+		s = list = MALLOC(nseg * sizeof(seg_t), MT_MSG);
+	} else {
+		s = m->m_seg;
+	}
+	m->m_nseg = nseg;
+	for (x = 0; x < nseg; ++x, ++s) {
+		seg = segv[x];
 		s->s_buf = (char *)(seg->s_pview.p_vaddr) + seg->s_off;
 		s->s_buflen = seg->s_len;
 	}
+	if (nseg > MSGSEGS) {
+		if (copyout(ulist, list, nseg * sizeof(seg_t))) {
+			error = err(EFAULT);
+		}
+		FREE(list, MT_MSG);
+		m->m_op |= M_SGL;
+		m->m_seg[0].s_buf = ulist;
+	} else {
+		m->m_op &= ~M_SGL;
+	}
 	sm->sm_nseg = 0;
+	return(error);
+}
+
+/*
+ * get_sgl()
+ *	Check the segment count of a message, fetching any M_SGL list
+ *
+ * The list is kept in sm_sgl for m_to_sm() and copyoutsegs(), until
+ * put_sgl() releases it; it's 0 for a message without one.  On error,
+ * sets err() and returns -1.  On success, returns 0.
+ */
+int
+get_sgl(struct sysmsg *sm)
+{
+	struct msg *m = &sm->sm_msg;
+	uint len;
+
+	sm->sm_sgl = 0;
+	if (!(m->m_op & M_SGL)) {
+		if ((uint)m->m_nseg > MSGSEGS) {
+			return(err(EINVAL));
+		}
+		return(0);
+	}
+	if ((uint)m->m_nseg > MSGSEGS_SGL) {
+		return(err(EINVAL));
+	}
+	if (m->m_nseg == 0) {
+		return(0);
+	}
+	len = m->m_nseg * sizeof(seg_t);
+	sm->sm_sgl = MALLOC(len, MT_MSG);
+	if (copyin(m->m_seg[0].s_buf, sm->sm_sgl, len)) {
+		put_sgl(sm);
+		return(err(EFAULT));
+	}
+	return(0);
+}
+
+/*
+ * put_sgl()
+ *	Release the copy of a message's M_SGL list
+ */
+void
+put_sgl(struct sysmsg *sm)
+{
+	if (sm->sm_sgl) {
+		FREE(sm->sm_sgl, MT_MSG);
+		sm->sm_sgl = 0;
+	}
 }
 
 /*
  * m_to_sm()
  *	Convert from user segments (msg format) to sysmsg format
  *
- * Can sleep in make_seg().
+ * Can sleep in make_seg().  get_sgl() must have been called first.
  *
  * On error, sets err() and returns -1.  On success, returns 0.
  */
-static int
+int
 m_to_sm(struct vas *vas, struct sysmsg *sm)
 {
-	uint x;
-	struct seg *seg;
+	uint x, nseg;
+	struct seg *seg, **segv;
 	seg_t *s;
 	struct msg *m = &sm->sm_msg;
 
 	/*
-	 * Sanity check # segments
+	 * get_sgl() has already checked the # segments.  More than
+	 * MSGSEGS need a vector of their own.
 	 */
-	if (m->m_nseg > MSGSEGS) {
-		return(err(EINVAL));
+	nseg = m->m_nseg;
+	if (nseg > MSGSEGS) {
+		segv = MALLOC(nseg * sizeof(struct seg *), MT_MSG);
+	} else {
+		segv = sm->sm_seg;
 	}
 
 	/*
 	 * Walk user segments, construct struct seg's for each part
 	 */
-	for (x = 0, s = m->m_seg; x < m->m_nseg; ++x, ++s) {
+	s = sm->sm_sgl ? sm->sm_sgl : m->m_seg;
+	for (x = 0; x < nseg; ++x, ++s) {
 		/*
 		 * On error, have to go back and clean up the
 		 * segments we've already constructed.  Then
@@ -176,18 +282,169 @@ m_to_sm(struct vas *vas, struct sysmsg *sm)
 			uint y;
 
 			for (y = 0; y < x; ++y) {
-				free_seg(sm->sm_seg[y]);
-				sm->sm_seg[y] = 0;
+				free_seg(segv[y]);
+				segv[y] = 0;
+			}
+			if (nseg > MSGSEGS) {
+				FREE(segv, MT_MSG);
 			}
 			sm->sm_nseg = 0;
 			return(err(EFAULT));
 		}
-		sm->sm_seg[x] = seg;
+		segv[x] = seg;
 	}
-	sm->sm_nseg = m->m_nseg;
+	if (nseg > MSGSEGS) {
+		sm->sm_xseg = segv;
+	}
+	sm->sm_nseg = nseg;
 	return(0);
 }
 
+/*
+ * unqueue_msg()
+ *	Pull a message back out of a port's queue, if it's still there
+ *
+ * Called with the port locked.  Returns 1 if the message was found
+ * and removed, 0 if the server has already taken it.
+ */
+static int
+unqueue_msg(struct port *port, struct sysmsg *sm)
+{
+	struct sysmsg *s;
+
+	/*
+	 * Head of queue--take out.  Tail was either
+	 * this message (queue now empty) or is still
+	 * valid.
+	 */
+	s = port->p_hd;
+	if (s == sm) {
+		port->p_hd = sm->sm_next;
+	} else {
+		/*
+		 * Otherwise hunt it down in the queue and
+		 * remove it.
+		 */
+		while (s) {
+			if (s->sm_next == sm) {
+				s->sm_next = sm->sm_next;
+				if (port->p_tl == sm) {
+					port->p_tl = s;
+				}
+				break;
+			}
+			s = s->sm_next;
+		}
+	}
+	if (s == 0) {
+		return(0);
+	}
+
+	/*
+	 * Adjust semaphore count.  We *know* it's > 0, since
+	 * our message was in the queue unconsumed.  All I/O
+	 * semaphore access is done holding the port lock,
+	 * so we're OK.
+	 */
+	ASSERT_DEBUG(sema_count(&port->p_wait) > 0, "unqueue_msg: qcnt < 1");
+	adj_sema(&port->p_wait, -1);
+	return(1);
+}
+
+/*
+ * tag_send()
+ *	Queue a message on a PF_TAGGED portref and wait for completion
+ *
+ * Called with the portref locked; returns with it released.  The
+ * completion state lives in the sysmsg, so any number of threads
+ * may be here at once for the same portref.  Returns 0 when the
+ * server has answered, or sets err() and returns -1.
+ */
+static int
+tag_send(struct portref *pr, struct port *port, struct sysmsg *sm)
+{
+	struct sysmsg sm2;
+
+	/*
+	 * No new work for a server which is shutting down
+	 */
+	if (port->p_flags & P_CLOSING) {
+		v_lock(&pr->p_lock, SPL0_SAME);
+		return(err(EIO));
+	}
+
+	/*
+	 * Put message on queue, wait for the I/O to finish or
+	 * be interrupted.
+	 */
+	inline_tag_init(sm);
+	inline_send_msg(port, sm);
+	if (!p_sema_v_lock(&sm->sm_iowait, PRICATCH, &pr->p_lock)) {
+		return(0);
+	}
+
+	/*
+	 * Interrupted.  Grapple with the server for control of
+	 * this message, much as msg_send() does for the portref.
+	 */
+	p_lock_void(&pr->p_lock, SPL0_SAME);
+	port = pr->p_port;
+	switch (sm->sm_state) {
+	case PS_IOWAIT:
+		/*
+		 * Server gone--just I/O err
+		 */
+		if (!port) {
+			sm->sm_state = PS_IODONE;
+			v_lock(&pr->p_lock, SPL0_SAME);
+			break;
+		}
+
+		/*
+		 * Not yet dequeued; pull it out and we're done
+		 */
+		p_lock_void(&port->p_lock, SPLHI);
+		if (unqueue_msg(port, sm)) {
+			v_lock(&port->p_lock, SPL0);
+			sm->sm_state = PS_IODONE;
+			v_lock(&pr->p_lock, SPL0_SAME);
+			break;
+		}
+		v_lock(&port->p_lock, SPL0);
+
+		/*
+		 * The server has it.  Send an M_ABORT naming this
+		 * message, and wait for its completion ignoring
+		 * further interrupts.
+		 */
+		sm2.sm_sender = pr;
+		sm2.sm_op = M_ABORT;
+		sm2.sm_nseg = sm2.sm_arg = sm2.sm_arg1 = 0;
+		inline_tag_init(&sm2);
+		sm2.sm_state = sm->sm_state = PS_ABWAIT;
+		sm2.sm_abort = sm;
+		queue_msg(port, &sm2, SPL0);
+		p_sema_v_lock(&sm2.sm_iowait, PRIHI, &pr->p_lock);
+		break;
+
+	case PS_IODONE:
+		/*
+		 * We raced with server completion.  Release the
+		 * server if he's waiting for us to copy out.
+		 */
+		if (blocked_sema(&sm->sm_svwait)) {
+			v_sema(&sm->sm_svwait);
+		}
+		v_lock(&pr->p_lock, SPL0_SAME);
+		break;
+
+	default:
+		ASSERT(0, "tag_send: illegal PS state");
+		break;
+	}
+	return(err(EINTR));
+}
+
 /*
  * msg_send()
  *	Send a message to a port
@@ -206,7 +463,7 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 	struct port *port;
 	struct sysmsg sm;
 	struct proc *p = curthread->t_proc;
-	int error = 0;
+	int error = 0, tagged, op;
 
 	/*
 	 * Get message body
@@ -214,6 +471,7 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 	if (copyin(arg_msg, &sm.sm_msg, sizeof(struct msg))) {
 		return(err(EFAULT));
 	}
+	op = sm.sm_op & MSG_MASK;
 
 	/*
 	 * Protect our reserved messages types.
@@ -227,26 +485,32 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 	 * don't need to convert the message segments here, but
 	 * rather use them once we get a response.
 	 */
+	sm.sm_nseg = 0;
+	if (get_sgl(&sm)) {
+		return(-1);
+	}
 	if (!(sm.sm_op & M_READ)) {
 		if (m_to_sm(&p->p_vas, &sm)) {
-			return(-1);
+			error = -1;
+			goto out2;
 		}
-	} else {
-		sm.sm_nseg = 0;
 	}
 
 	/*
 	 * Validate port ID.  On successful non-poisoned port, the
-	 * semaphore is held for our handle on the port.
+	 * semaphore is held for our handle on the port, unless the
+	 * portref is PF_TAGGED; then we're just one of its messages
+	 * in flight.
 	 */
-	pr = find_portref(p, arg_port);
+	pr = share_portref(p, arg_port);
 	if (pr == 0) {
 		/*
-		 * find_portref() sets err() for us
+		 * share_portref() sets err() for us
 		 */
 		error = -1;
 		goto out2;
 	}
+	tagged = (pr->p_flags & PF_TAGGED);
 
 	/*
 	 * Get the port, I/O error if the server's gone
@@ -254,7 +518,8 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 	port = pr->p_port;
 	if (port == 0) {
 		v_lock(&pr->p_lock, SPL0);
-		return(err(EIO));
+		error = err(EIO);
+		goto out2;
 	}
 
 	/*
@@ -262,6 +527,17 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 	 */
 	sm.sm_sender = pr;
 
+	/*
+	 * Tagged messages carry their own completion state
+	 */
+	if (tagged) {
+		error = tag_send(pr, port, &sm);
+		if (error) {
+			goto out1;
+		}
+		goto done;
+	}
+
 	/*
 	 * Set up our message transfer state
 	 */
@@ -271,7 +547,7 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 	/*
 	 * Put message on queue
 	 */
-	inline_queue_msg(port, &sm, SPL0);
+	inline_send_msg(port, &sm);
 
 	/*
 	 * Now wait for the I/O to finish or be interrupted
@@ -292,7 +568,7 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 		 */
 		switch (pr->p_state) {
 		case PS_IOWAIT: {
-			struct sysmsg sm2, *s;
+			struct sysmsg sm2;
 
 			/*
 			 * Server gone--just I/O err
@@ -305,55 +581,18 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 
 			/*
 			 * If our message has not yet been dequeued,
-			 * pull it out of the queue now.
+			 * pull it out of the queue now.  We found
+			 * ourselves in the queue, so no need to
+			 * interact with the server.
 			 */
 			p_lock_void(&port->p_lock, SPLHI);
-
-			/*
-			 * Head of queue--take out.  Tail was either
-			 * this message (queue now empty) or is still
-			 * valid.
-			 */
-			s = port->p_hd;
-			if (s == &sm) {
-				port->p_hd = sm.sm_next;
-			} else {
-				/*
-				 * Otherwise hunt it down in the queue and
-				 * remove it.
-				 */
-				while (s) {
-					if (s->sm_next == &sm) {
-						s->sm_next = sm.sm_next;
-						if (port->p_tl == &sm) {
-							port->p_tl = s;
-						}
-						break;
-					}
-					s = s->sm_next;
-				}
-			}
-			v_lock(&port->p_lock, SPL0);
-
-			/*
-			 * We found ourselves in the queue, so no need
-			 * to interact with the server.
-			 */
-			if (s) {
-				/*
-				 * Adjust semaphore count.  We *know*
-				 * it's > 0, since our message was
-				 * in the queue unconsumed.  All I/O
-				 * semaphore access is done holding
-				 * the port lock, so we're OK.
-				 */
-				ASSERT_DEBUG(sema_count(&port->p_wait) > 0,
-					"msg_send: qcnt < 1");
-				adj_sema(&port->p_wait, -1);
+			if (unqueue_msg(port, &sm)) {
+				v_lock(&port->p_lock, SPL0);
 				pr->p_state = PS_IODONE;
 				v_lock(&pr->p_lock, SPL0_SAME);
 				break;
 			}
+			v_lock(&port->p_lock, SPL0);
 
 			/*
 			 * Send an M_ABORT and then wait for completion
@@ -399,6 +638,7 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 		goto out1;
 	}
 
+done:
 	/*
 	 * If the server indicates error, set it and leave
 	 */
@@ -407,6 +647,21 @@ msg_send(port_t arg_port, struct msg *arg_msg)
 		goto out1;
 	}
 
+	/*
+	 * Shared memory is mapped for keeps, not copied
+	 */
+	if (op == FS_SHMAP) {
+		void *vaddr;
+
+		vaddr = 0;
+		if (sm.sm_nseg == 1) {
+			vaddr = share_seg(&p->p_vas, sm.sm_seg[0]);
+		}
+		sm.sm_msg.m_nseg = sm.sm_nseg;
+		error = vaddr ? (int)vaddr : err(EINVAL);
+		goto out1;
+	}
+
 	if (sm.sm_nseg) {
 		struct segref segrefs;
 
@@ -452,15 +707,23 @@ out1:
 	/*
 	 * Clean up and return success/failure
 	 */
-	if (sm.sm_msg.m_nseg) {
-		v_sema(&pr->p_svwait);
+	if (tagged) {
+		if (sm.sm_msg.m_nseg) {
+			v_sema(&sm.sm_svwait);
+		}
+		tag_done(pr);
+	} else {
+		if (sm.sm_msg.m_nseg) {
+			v_sema(&pr->p_svwait);
+		}
+		v_sema(&pr->p_sema);
 	}
-	v_sema(&pr->p_sema);
 
 out2:
 	if (sm.sm_nseg) {
 		freesegs(&sm);
 	}
+	put_sgl(&sm);
 	return(error);
 }
 
@@ -521,46 +784,79 @@ receive_isr(int isr, int nintr, struct msg *arg_msg)
 }
 
 /*
- * msg_receive()
- *	Receive next message from queue
+ * sgl_room()
+ *	Tell how many segments a receiver can take
+ *
+ * More than MSGSEGS only if it passed in its msg with M_SGL set,
+ * naming an array for the list of them; this is returned in "listp".
  */
-int
-msg_receive(port_t arg_port, struct msg *arg_msg)
+static uint
+sgl_room(struct msg *arg_msg, seg_t **listp)
+{
+	struct msg m;
+
+	if (copyin(arg_msg, &m, sizeof(struct msg)) ||
+			!(m.m_op & M_SGL) || (m.m_nseg < MSGSEGS)) {
+		return(MSGSEGS);
+	}
+	*listp = m.m_seg[0].s_buf;
+	return(m.m_nseg);
+}
+
+/*
+ * sgl_bounce()
+ *	Fail a message with more segments than its receiver can take
+ *
+ * Called with no locks held, the message having been flagged as
+ * being served.
+ */
+static void
+sgl_bounce(struct portref *pr, struct sysmsg *sm)
 {
 	struct port *port;
-	struct proc *p = curthread->t_proc;
-	struct sysmsg *sm;
-	int error = 0;
-	struct portref *pr;
 
-	/*
-	 * Look up port, become sole process doing I/O through it
-	 */
-	port = find_port(p, arg_port);
-	if (!port) {
-		return(-1);
+	freesegs(sm);
+	if (!(pr->p_flags & PF_TAGGED)) {
+		(void)err_reply((long)pr, E2BIG, 0);
+		return;
 	}
 
 	/*
-	 * Wait for something to arrive for us
+	 * The server never saw this one's tag, so pick it out by
+	 * hand.  If the client's aborting it, the M_ABORT's answer
+	 * will finish it.
 	 */
-	if (p_sema_v_lock(&port->p_wait, PRICATCH, &port->p_lock)) {
-		/*
-		 * Interrupted system call.
-		 */
-		v_sema(&port->p_sema);
-		return(err(EINTR));
+	p_lock_void(&pr->p_lock, SPL0);
+	port = pr->p_port;
+	if (port) {
+		p_lock_void(&port->p_lock, SPLHI);
+		sm = tag_unlink(pr, sm);
+		v_lock(&port->p_lock, SPL0);
+		if (sm && (sm->sm_state == PS_IOWAIT)) {
+			sm->sm_arg = -1;
+			strcpy(sm->sm_err, E2BIG);
+			tag_complete(pr, sm);
+		}
 	}
+	v_lock(&pr->p_lock, SPL0);
+}
 
-	p_lock_void(&port->p_lock, SPLHI);
-	ASSERT_DEBUG(port->p_hd,
-		"msg_receive: p_wait/p_hd disagree");
-
-	/*
-	 * Extract next message, then release port
-	 */
-	sm = port->p_hd;
-	port->p_hd = sm->sm_next;
+/*
+ * recv_one()
+ *	Hand a message just taken off its port's queue to the receiver
+ *
+ * Called with the port locked at SPLHI; returns with it released,
+ * but still holding p_sema.  Returns the number of bytes mapped for
+ * the message, or sets err() and returns -1.
+ */
+static int
+recv_one(struct proc *p, struct port *port, struct sysmsg *sm,
+	struct msg *arg_msg)
+{
+	int error = 0, tag = 0;
+	struct portref *pr;
+	struct segref *segref;
+	seg_t *ulist = 0;
 
 	/*
 	 * With lock held, at SPLHI, check for M_ISR.  These are
@@ -593,10 +889,21 @@ msg_receive(port_t arg_port, struct msg *arg_msg)
 	}
 
 	/*
-	 * Have our message, flag that we're running with it.
+	 * Have our message, flag that we're running with it.  A
+	 * tagged portref may have several; each gets a tag, which
+	 * the server hands back in its reply to say which it's
+	 * answering.  The port lock covers the list of them.
 	 */
 	pr = sm->sm_sender;
-	pr->p_msg = sm;
+	if ((pr->p_flags & PF_TAGGED) && (sm->sm_op != M_CONNECT) &&
+			(sm->sm_op != M_DISCONNECT)) {
+		tag_enter(pr, sm);
+		tag = sm->sm_tag;
+		segref = &sm->sm_mapped;
+	} else {
+		pr->p_msg = sm;
+		segref = &pr->p_segs;
+	}
 
 	/*
 	 * Connect messages are special; the buffer is the array
@@ -631,37 +938,52 @@ msg_receive(port_t arg_port, struct msg *arg_msg)
 		v_lock(&port->p_lock, SPL0);
 	}
 
+	/*
+	 * An M_SGL message may have more segments than the receiver
+	 * is ready to take.
+	 */
+	if ((sm->sm_nseg > MSGSEGS) &&
+			(sgl_room(arg_msg, &ulist) < sm->sm_nseg)) {
+		sgl_bounce(pr, sm);
+		return(err(E2BIG));
+	}
+
 	/*
 	 * We now have a message, and are running under an address space
 	 * into which we now may want to map the parts of the message.
 	 */
 	if (sm->sm_nseg) {
-		if (pr->p_segs.s_refs[0]) {
-			unmapsegs(&pr->p_segs);
+		if (segref->s_refs[0] || segref->s_xrefs) {
+			unmapsegs(segref);
 		}
-		error = mapsegs(p, sm, &pr->p_segs);
+		error = mapsegs(p, sm, segref);
 		if (error == -1) {
 			goto out;
 		}
 	}
-	sm_to_m(sm);
-	if (!copyout(arg_msg, &sm->sm_msg, sizeof(struct msg))) {
-		/*
-		 * All completed successfully - release the
-		 * port semaphore and return
-		 */
-		v_sema(&port->p_sema);
-		return(error);
-	} else {
+	if (sm_to_m(sm, ulist) == 0) {
+		if (!copyout(arg_msg, &sm->sm_msg, sizeof(struct msg))) {
+			int op;
+
+			/*
+			 * The tag rides in the m_op the server sees,
+			 * in place of whatever the client left there
+			 */
+			op = (sm->sm_op & ~M_TAG) | tag;
+			if (!tag || !copyout(&arg_msg->m_op, &op, sizeof(op))) {
+				return(error);
+			}
+		}
 		error = err(EFAULT);
+	} else {
+		error = -1;
 	}
 
 	/*
-	 * All done.  Release the port semaphore and report our
-	 * failure (we've already returned if we were successful
+	 * All done.  Report our failure (we've already returned if
+	 * we were successful).
 	 */
 out:
-	v_sema(&port->p_sema);
 	if (sm && sm->sm_nseg) {
 		freesegs(sm);
 	}
@@ -669,30 +991,505 @@ out:
 }
 
 /*
- * msg_reply()
- *	Reply to a message received through msg_receive()
+ * recv_wait()
+ *	Wait for a message on a port, and receive it
+ *
+ * Called with the port's p_sema and p_lock held, as from find_port();
+ * releases both.
  */
-int
-msg_reply(long arg_who, struct msg *arg_msg)
+static int
+recv_wait(struct proc *p, struct port *port, struct msg *arg_msg)
 {
-	struct proc *p = curthread->t_proc;
-	struct portref *pr;
-	struct sysmsg sm, *om;
-	int error = 0;
+	struct sysmsg *sm;
+	int error;
 
 	/*
-	 * Get a copy of the user's reply message
+	 * Wait for something to arrive for us
 	 */
-	if (copyin(arg_msg, &sm.sm_msg, sizeof(struct msg))) {
-		return(err(EFAULT));
+	if (p_sema_v_lock(&port->p_wait, PRICATCH, &port->p_lock)) {
+		/*
+		 * Interrupted system call.
+		 */
+		v_sema(&port->p_sema);
+		return(err(EINTR));
 	}
 
+	p_lock_void(&port->p_lock, SPLHI);
+	ASSERT_DEBUG(port->p_hd,
+		"msg_receive: p_wait/p_hd disagree");
+
 	/*
-	 * Try to map segments into sysmsg format
+	 * Extract next message, hand it over, then release port
 	 */
-	if (m_to_sm(&p->p_vas, &sm)) {
+	sm = port->p_hd;
+	port->p_hd = sm->sm_next;
+	error = recv_one(p, port, sm, arg_msg);
+	v_sema(&port->p_sema);
+	return(error);
+}
+
+/*
+ * msg_receive()
+ *	Receive next message from queue
+ */
+int
+msg_receive(port_t arg_port, struct msg *arg_msg)
+{
+	struct port *port;
+	struct proc *p = curthread->t_proc;
+
+	/*
+	 * Look up port, become sole process doing I/O through it
+	 */
+	port = find_port(p, arg_port);
+	if (!port) {
+		return(-1);
+	}
+	return(recv_wait(p, port, arg_msg));
+}
+
+/*
+ * msg_receive_batch()
+ *	Receive as many queued messages as will fit, in one go
+ *
+ * Sleeps as msg_receive() does for the first message, then takes
+ * whatever else is already queued, up to arg_max of them.  Returns
+ * the number of messages placed in arg_msgs[], or -1 if not even the
+ * first could be received.
+ */
+int
+msg_receive_batch(port_t arg_port, struct msg *arg_msgs, int arg_max)
+{
+	struct port *port;
+	struct proc *p = curthread->t_proc;
+	struct sysmsg *sm;
+	int n;
+
+	if (arg_max < 1) {
+		return(err(EINVAL));
+	}
+
+	/*
+	 * Get the port and wait for the first, as for msg_receive()
+	 */
+	port = find_port(p, arg_port);
+	if (!port) {
+		return(-1);
+	}
+	if (p_sema_v_lock(&port->p_wait, PRICATCH, &port->p_lock)) {
+		v_sema(&port->p_sema);
+		return(err(EINTR));
+	}
+	p_lock_void(&port->p_lock, SPLHI);
+	ASSERT_DEBUG(port->p_hd,
+		"msg_receive_batch: p_wait/p_hd disagree");
+
+	for (n = 0; ; ) {
+		sm = port->p_hd;
+		port->p_hd = sm->sm_next;
+		if (recv_one(p, port, sm, &arg_msgs[n]) == -1) {
+			/*
+			 * Report the ones we've delivered; the error
+			 * stays set for the caller to find.
+			 */
+			break;
+		}
+		if (++n >= arg_max) {
+			break;
+		}
+
+		/*
+		 * Take the next one only if it's already here.  We
+		 * consume its count in p_wait by hand, as it was
+		 * queued and unconsumed under the lock we hold.
+		 */
+		p_lock_void(&port->p_lock, SPLHI);
+		if (port->p_hd == 0) {
+			v_lock(&port->p_lock, SPL0);
+			break;
+		}
+		ASSERT_DEBUG(sema_count(&port->p_wait) > 0,
+			"msg_receive_batch: qcnt < 1");
+		adj_sema(&port->p_wait, -1);
+	}
+	v_sema(&port->p_sema);
+	return(n ? n : -1);
+}
+
+/*
+ * tag_find()
+ *	Find a message from a portref by its tag
+ *
+ * With "abort" set, it's the M_ABORT naming the message which is
+ * wanted, otherwise the message itself.  Called with the port locked;
+ * returns the message, or 0.
+ */
+static struct sysmsg *
+tag_find(struct portref *pr, int tag, int abort)
+{
+	struct sysmsg *s;
+
+	for (s = pr->p_tags; s; s = s->sm_next) {
+		if ((s->sm_tag == tag) && ((s->sm_op == M_ABORT) == abort)) {
+			return(s);
+		}
+	}
+	return(0);
+}
+
+/*
+ * tag_unlink()
+ *	Remove a message from a portref's list of tagged messages
+ *
+ * Called with the port locked; returns the message, or 0 if it
+ * wasn't on the list.
+ */
+static struct sysmsg *
+tag_unlink(struct portref *pr, struct sysmsg *sm)
+{
+	struct sysmsg **smp, *s;
+
+	for (smp = &pr->p_tags; (s = *smp); smp = &s->sm_next) {
+		if (s == sm) {
+			*smp = s->sm_next;
+			return(s);
+		}
+	}
+	return(0);
+}
+
+/*
+ * tag_enter()
+ *	Tag a message the server's taking, and add it to the portref's list
+ *
+ * Called with the port locked.  A tag is never 0, and no two messages
+ * being served for a portref share one; an M_ABORT carries the tag of
+ * the message it names.  The tag is kept as it appears in m_op.
+ */
+static void
+tag_enter(struct portref *pr, struct sysmsg *sm)
+{
+	struct sysmsg **smp;
+
+	if (sm->sm_op == M_ABORT) {
+		sm->sm_tag = sm->sm_abort->sm_tag;
+	} else {
+		do {
+			pr->p_tagseq = (pr->p_tagseq + TAG_ONE) & M_TAG;
+		} while ((pr->p_tagseq == 0) ||
+				tag_find(pr, pr->p_tagseq, 0) ||
+				tag_find(pr, pr->p_tagseq, 1));
+		sm->sm_tag = pr->p_tagseq;
+	}
+	smp = &pr->p_tags;
+	while (*smp) {
+		smp = &(*smp)->sm_next;
+	}
+	*smp = sm;
+	sm->sm_next = 0;
+}
+
+/*
+ * tag_complete()
+ *	Flag a tagged message done, and tell its sender
+ *
+ * Called with the portref locked.  A msg_send() sleeping on the
+ * message is simply woken.  Nobody waits on one from msg_send_async(),
+ * so it goes onto its process' list of completions instead, and is
+ * counted off the portref here.  Either way the caller must not
+ * touch the message afterwards.
+ */
+void
+tag_complete(struct portref *pr, struct sysmsg *sm)
+{
+	sm->sm_state = PS_IODONE;
+	if (sm->sm_proc == 0) {
+		v_sema_handoff(&sm->sm_iowait);
+		return;
+	}
+
+	/*
+	 * Post before letting go of p_nio; the sending process
+	 * can't be torn down until that reaches 0.
+	 */
+	async_post(sm);
+	ASSERT_DEBUG(pr->p_nio > 0, "tag_complete: p_nio");
+	pr->p_nio -= 1;
+	if (pr->p_nio == 0) {
+		vall_sema(&pr->p_drain);
+	}
+}
+
+/*
+ * async_abort()
+ *	Abort a process' asynchronous messages through a portref
+ *
+ * Used as the process closes the portref or exits.  Nobody is
+ * waiting on these, so those still queued are failed with EINTR
+ * on the spot.  For each one the server has, we send an M_ABORT
+ * in the heap, marked by its sm_proc; tag_reply() fails the message
+ * when that's answered.  Called with the portref locked, returns
+ * with it locked.
+ */
+void
+async_abort(struct portref *pr, struct proc *p)
+{
+	struct port *port;
+	struct sysmsg *sm, *ab = 0;
+
+	while ((port = pr->p_port)) {
+		/*
+		 * Pull any it hasn't yet received back off its queue
+		 */
+		p_lock_void(&port->p_lock, SPLHI);
+		for (sm = port->p_hd; sm; sm = sm->sm_next) {
+			if ((sm->sm_sender == pr) && (sm->sm_proc == p) &&
+					(sm->sm_op != M_ABORT)) {
+				break;
+			}
+		}
+		if (sm) {
+			(void)unqueue_msg(port, sm);
+			v_lock(&port->p_lock, SPL0);
+			if (sm->sm_nseg > 0) {
+				freesegs(sm);
+			}
+			sm->sm_arg1 = sm->sm_arg = -1;
+			strcpy(sm->sm_err, EINTR);
+			tag_complete(pr, sm);
+			continue;
+		}
+
+		/*
+		 * Find one the server holds which isn't yet aborted
+		 */
+		for (sm = pr->p_tags; sm; sm = sm->sm_next) {
+			if ((sm->sm_proc == p) && (sm->sm_op != M_ABORT) &&
+					(sm->sm_state == PS_IOWAIT)) {
+				break;
+			}
+		}
+		if (!sm) {
+			v_lock(&port->p_lock, SPL0);
+			break;
+		}
+
+		/*
+		 * Get an M_ABORT for it.  We can't MALLOC under our
+		 * locks, so go get one and look again.
+		 */
+		if (!ab) {
+			v_lock(&port->p_lock, SPL0);
+			v_lock(&pr->p_lock, SPL0_SAME);
+			ab = MALLOC(sizeof(struct sysmsg), MT_SYSMSG);
+			p_lock_void(&pr->p_lock, SPL0_SAME);
+			continue;
+		}
+		sm->sm_state = PS_ABWAIT;
+		v_lock(&port->p_lock, SPL0);
+		ab->sm_sender = pr;
+		ab->sm_op = M_ABORT;
+		ab->sm_nseg = ab->sm_arg = ab->sm_arg1 = 0;
+		inline_tag_init(ab);
+		ab->sm_state = PS_ABWAIT;
+		ab->sm_abort = sm;
+		ab->sm_proc = p;
+		queue_msg(port, ab, SPL0);
+		ab = 0;
+	}
+
+	if (ab) {
+		v_lock(&pr->p_lock, SPL0_SAME);
+		FREE(ab, MT_SYSMSG);
+		p_lock_void(&pr->p_lock, SPL0_SAME);
+	}
+}
+
+/*
+ * tag_reply()
+ *	Answer a message received through a PF_TAGGED portref
+ *
+ * Called from msg_reply() and msg_err() with the portref locked.
+ * The M_TAG bits of the reply's m_op name the message answered; an
+ * M_ABORT reply answers the M_ABORT carrying that tag.  Always
+ * consumes the segments of "sm" and releases the portref lock.
+ */
+int
+tag_reply(struct portref *pr, struct sysmsg *sm)
+{
+	struct port *port = pr->p_port;
+	struct sysmsg *om, *sm2;
+	struct segref segs;
+	int error = 0, tag = (sm->sm_op & M_TAG);
+
+	/*
+	 * Take the message off the list of those being served
+	 */
+	om = 0;
+	if (port && tag) {
+		p_lock_void(&port->p_lock, SPLHI);
+		om = tag_find(pr, tag, (sm->sm_op & MSG_MASK) == M_ABORT);
+		if (om) {
+			(void)tag_unlink(pr, om);
+			if (om->sm_abort) {
+				(void)tag_unlink(pr, om->sm_abort);
+			}
+		}
+		v_lock(&port->p_lock, SPL0);
+	}
+	if (!om) {
+		error = err(EINVAL);
+		v_lock(&pr->p_lock, SPL0_SAME);
+		goto out;
+	}
+
+	/*
+	 * Drop the server's view of the client's segments.  Once
+	 * off the list, our client can't complete without us--if
+	 * interrupted it will wait on an M_ABORT--so the message
+	 * stays valid while we have the lock released.
+	 */
+	segs = om->sm_mapped;
+	om->sm_mapped.s_refs[0] = 0;
+	om->sm_mapped.s_xrefs = 0;
+	v_lock(&pr->p_lock, SPL0_SAME);
+	unmapsegs(&segs);
+
+	/*
+	 * An asynchronous sender isn't waiting to copy the reply out
+	 * of our address space, so take a copy of it now.
+	 */
+	if (om->sm_proc && (om->sm_op != M_ABORT) && sm->sm_nseg) {
+		async_snap(om, sm);
+	}
+	p_lock_void(&pr->p_lock, SPL0_SAME);
+
+	switch (om->sm_state) {
+	case PS_IOWAIT:
+		if ((om->sm_op == M_DUP) && (sm->sm_arg != -1)) {
+			struct portref *newpr = (struct portref *)
+				(om->sm_arg);
+
+			ASSERT_DEBUG(newpr->p_port == port,
+				"tag_reply: newpr != port");
+			p_lock_void(&port->p_lock, SPLHI);
+			ref_port(port, newpr);
+			v_lock(&port->p_lock, SPL0);
+			tag_complete(pr, om);
+			v_lock(&pr->p_lock, SPL0_SAME);
+			new_client(newpr);
+			break;
+		}
+
+		/*
+		 * Give him the parts of the sysmsg he needs,
+		 * and interlock on any segments as msg_reply() does.
+		 */
+		om->sm_op = sm->sm_op & ~M_TAG;
+		om->sm_arg = sm->sm_arg;
+		om->sm_arg1 = sm->sm_arg1;
+		om->sm_nseg = sm->sm_nseg;
+		om->sm_sender = sm->sm_sender;
+		om->sm_segs = sm->sm_segs;
+		om->sm_errs = sm->sm_errs;
+		sm->sm_nseg = 0;
+
+		/*
+		 * Only a synchronous sender can have segments here;
+		 * async_snap() took those of an asynchronous one.
+		 */
+		if (om->sm_nseg) {
+			tag_complete(pr, om);
+			p_sema_v_lock(&om->sm_svwait, PRIHI, &pr->p_lock);
+		} else {
+			tag_complete(pr, om);
+			v_lock(&pr->p_lock, SPL0_SAME);
+		}
+		return(0);
+
+	case PS_ABWAIT:
+		/*
+		 * The client gave up on this one.  If it's the M_ABORT
+		 * itself, tell him we're done; otherwise the server
+		 * is answering a request which no longer exists.
+		 */
+		if (om->sm_op != M_ABORT) {
+			error = err(EIO);
+			v_lock(&pr->p_lock, SPL0_SAME);
+			break;
+		}
+
+		/*
+		 * One from async_abort(); nobody's waiting, so fail
+		 * the message and throw the M_ABORT away.
+		 */
+		if (om->sm_proc) {
+			sm2 = om->sm_abort;
+			sm2->sm_arg1 = sm2->sm_arg = -1;
+			strcpy(sm2->sm_err, EINTR);
+			tag_complete(pr, sm2);
+			v_lock(&pr->p_lock, SPL0_SAME);
+			FREE(om, MT_SYSMSG);
+			break;
+		}
+		om->sm_abort->sm_state = PS_ABDONE;
+		om->sm_state = PS_ABDONE;
+		v_sema(&om->sm_iowait);
+		v_lock(&pr->p_lock, SPL0_SAME);
+		break;
+
+	default:
+		error = err(EINVAL);
+		v_lock(&pr->p_lock, SPL0_SAME);
+		break;
+	}
+
+out:
+	if (sm->sm_nseg) {
+		freesegs(sm);
+	}
+	return(error);
+}
+
+/*
+ * msg_reply()
+ *	Reply to a message received through msg_receive()
+ */
+int
+msg_reply(long arg_who, struct msg *arg_msg)
+{
+	struct proc *p = curthread->t_proc;
+	struct portref *pr;
+	struct sysmsg sm, *om;
+	int error = 0;
+
+	/*
+	 * Get a copy of the user's reply message
+	 */
+	if (copyin(arg_msg, &sm.sm_msg, sizeof(struct msg))) {
+		return(err(EFAULT));
+	}
+
+	/*
+	 * Servers have never had to set m_op in a reply, and many
+	 * build theirs on the stack, so M_SGL is only believed when
+	 * there are more segments than m_seg[] can hold.
+	 */
+	if ((uint)sm.sm_msg.m_nseg <= MSGSEGS) {
+		sm.sm_op &= ~M_SGL;
+	}
+
+	/*
+	 * Try to map segments into sysmsg format
+	 */
+	sm.sm_nseg = 0;
+	if (get_sgl(&sm)) {
 		return(-1);
 	}
+	if (m_to_sm(&p->p_vas, &sm)) {
+		error = -1;
+		goto out;
+	}
 
 	/*
 	 * Lock down proc and try to map arg_who onto a known
@@ -706,6 +1503,15 @@ msg_reply(long arg_who, struct msg *arg_msg)
 		unmapsegs(&pr->p_segs);
 		p_lock_void(&pr->p_lock, SPL0_SAME);
 		v_sema(&p->p_sema);
+
+		/*
+		 * Messages through a tagged portref are answered
+		 * individually.
+		 */
+		if (pr->p_tags) {
+			error = tag_reply(pr, &sm);
+			goto out;
+		}
 	} else {
 		/*
 		 * If we didn't find the portref, bounce them.
@@ -776,14 +1582,14 @@ msg_reply(long arg_who, struct msg *arg_msg)
 			pr->p_state = PS_IODONE;
 			if (om->sm_nseg) {
 				set_sema(&pr->p_svwait, 0);
-				v_sema(&pr->p_iowait);
+				v_sema_handoff(&pr->p_iowait);
 				p_sema_v_lock(&pr->p_svwait,
 					PRIHI, &pr->p_lock);
 			} else {
-				v_sema(&pr->p_iowait);
+				v_sema_handoff(&pr->p_iowait);
 				v_lock(&pr->p_lock, SPL0_SAME);
 			}
-			return(0);
+			break;
 		}
 		break;
 
@@ -823,5 +1629,111 @@ out:
 	if (sm.sm_nseg) {
 		freesegs(&sm);
 	}
+	put_sgl(&sm);
+	return(error);
+}
+
+/*
+ * answer()
+ *	Give one answer from a msg_ans
+ */
+static int
+answer(struct msg_ans *ma)
+{
+	if (ma->ma_err[0]) {
+		ma->ma_err[ERRLEN-1] = '\0';
+		return(err_reply(ma->ma_who, ma->ma_err, ma->ma_op));
+	}
+	return(msg_reply(ma->ma_who, ma->ma_msg));
+}
+
+/*
+ * msg_reply_batch()
+ *	Answer a batch of messages in one go
+ *
+ * Each entry is handled as msg_err() or msg_reply() would.  A
+ * failure on one doesn't keep the rest from being answered; we
+ * return -1 with its error if any failed, otherwise 0.
+ */
+int
+msg_reply_batch(struct msg_ans *arg_ans, int arg_n)
+{
+	struct msg_ans ma;
+	int x, error = 0;
+
+	if (arg_n < 0) {
+		return(err(EINVAL));
+	}
+	for (x = 0; x < arg_n; ++x) {
+		if (copyin(&arg_ans[x], &ma, sizeof(ma))) {
+			return(err(EFAULT));
+		}
+		if (answer(&ma) < 0) {
+			error = -1;
+		}
+	}
 	return(error);
 }
+
+/*
+ * msg_reply_recv()
+ *	Answer one message and wait for the next, in one system call
+ *
+ * Nearly every server loops on a reply followed by a receive; doing
+ * both here saves a trip in and out of the kernel.  The port is
+ * taken once, before the answer, so no other thread of the server
+ * can receive between the two.  As for any reply, the client is
+ * handed our CPU once we sleep for more work.
+ *
+ * The answer is as for an entry to msg_reply_batch(); a zero
+ * ma_who, or a null arg_ans, skips it.  If it fails, we return that
+ * failure and receive nothing.  An answer with segments holds us
+ * until its client has copied them, which may need another of our
+ * threads to serve a fault, so it's given before taking the port.
+ */
+int
+msg_reply_recv(port_t arg_port, struct msg_ans *arg_ans,
+		struct msg *arg_msg)
+{
+	struct proc *p = curthread->t_proc;
+	struct port *port;
+	struct msg_ans ma;
+	int nseg;
+
+	ma.ma_who = 0;
+	if (arg_ans && copyin(arg_ans, &ma, sizeof(ma))) {
+		return(err(EFAULT));
+	}
+	if (ma.ma_who && !ma.ma_err[0]) {
+		if (copyin(&ma.ma_msg->m_nseg, &nseg, sizeof(nseg))) {
+			return(err(EFAULT));
+		}
+		if (nseg) {
+			if (msg_reply(ma.ma_who, ma.ma_msg) < 0) {
+				return(-1);
+			}
+			ma.ma_who = 0;
+		}
+	}
+
+	/*
+	 * Become the thread receiving, then answer.  Our client
+	 * must hear from us even if we can't have the port.
+	 */
+	port = find_port(p, arg_port);
+	if (!port) {
+		if (ma.ma_who) {
+			(void)answer(&ma);
+		}
+		return(-1);
+	}
+	if (ma.ma_who) {
+		v_lock(&port->p_lock, SPL0);
+		if (answer(&ma) < 0) {
+			v_sema(&port->p_sema);
+			return(-1);
+		}
+		p_lock_void(&port->p_lock, SPLHI);
+	}
+	return(recv_wait(p, port, arg_msg));
+}
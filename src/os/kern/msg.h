@@ -9,11 +9,11 @@
 #include "../mach/mutex.h"
 
 /*
- * inline_lqueue_msg()
- *	Queue a message when port is already locked, inline version
+ * inline_append_msg()
+ *	Put a message at the tail of a locked port's queue
  */
 inline extern void
-inline_lqueue_msg(struct port *port, struct sysmsg *sm)
+inline_append_msg(struct port *port, struct sysmsg *sm)
 {
 	sm->sm_next = 0;
 	if (port->p_hd) {
@@ -30,6 +30,16 @@ inline_lqueue_msg(struct port *port, struct sysmsg *sm)
 		port->p_hd = sm;
 	}
 	port->p_tl = sm;
+}
+
+/*
+ * inline_lqueue_msg()
+ *	Queue a message when port is already locked, inline version
+ */
+inline extern void
+inline_lqueue_msg(struct port *port, struct sysmsg *sm)
+{
+	inline_append_msg(port, sm);
 	v_sema(&port->p_wait);
 }
 
@@ -65,4 +75,38 @@ inline_queue_msg(struct port *port, struct sysmsg *sm, spl_t exit_state)
 	}
 }
 
+/*
+ * inline_send_msg()
+ *	Queue a message for a msg_send() which will wait for its reply
+ *
+ * As inline_queue_msg(port, sm, SPL0), but since the sender's about
+ * to sleep until the server's done, the server is handed its CPU.
+ * Messages from interrupts, the kernel, or msg_send_async() don't
+ * wait, so they go through inline_queue_msg().
+ */
+inline extern void
+inline_send_msg(struct port *port, struct sysmsg *sm)
+{
+	p_lock_void(&port->p_lock, SPLHI);
+	inline_append_msg(port, sm);
+	v_sema_handoff(&port->p_wait);
+	v_lock(&port->p_lock, SPL0);
+}
+
+/*
+ * inline_tag_init()
+ *	Set up the completion state of a message for a PF_TAGGED portref
+ */
+inline extern void
+inline_tag_init(struct sysmsg *sm)
+{
+	sm->sm_state = PS_IOWAIT;
+	init_sema(&sm->sm_iowait); set_sema(&sm->sm_iowait, 0);
+	init_sema(&sm->sm_svwait); set_sema(&sm->sm_svwait, 0);
+	sm->sm_abort = 0;
+	sm->sm_mapped.s_refs[0] = 0;
+	sm->sm_mapped.s_xrefs = 0;
+	sm->sm_proc = 0;
+}
+
 #endif /* SYS_MSG_H */
@@ -0,0 +1,415 @@
+/*
+ * msgasync.c
+ *	Asynchronous message sends, and the reaping of their replies
+ *
+ * msg_send_async() queues a message through a PF_TAGGED portref much
+ * as msg_send() does, but rather than sleeping on the sysmsg it hands
+ * back a ticket.  The sysmsg lives in the heap; when the server
+ * answers it tag_complete() moves it onto the sending process' list
+ * of completions, from which msg_reap() collects them a batch at a
+ * time.
+ *
+ * The sender isn't around to copy out of the server's buffers when
+ * the reply comes, so any reply data is copied into a kernel buffer
+ * at that point, and from there into the sender's buffers as the
+ * completion is reaped.
+ */
+#include <sys/types.h>
+#include <sys/proc.h>
+#include <sys/msg.h>
+#include <sys/fs.h>
+#include <sys/port.h>
+#include <sys/thread.h>
+#include <sys/assert.h>
+#include <sys/malloc.h>
+#include <sys/misc.h>
+#include "msg.h"
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+/*
+ * The user's segments, whether in the msg or an M_SGL list
+ */
+#define SGL(sm) ((sm)->sm_sgl ? (sm)->sm_sgl : (sm)->sm_msg.m_seg)
+
+#define MAXASYNC (256)		/* Max # outstanding per process */
+#define MAXASYNCDATA (64*1024)	/* Max bytes of reply data for one */
+
+extern void freesegs(struct sysmsg *);
+
+/*
+ * free_async()
+ *	Release an asynchronous sysmsg and its reply data
+ */
+static void
+free_async(struct sysmsg *sm)
+{
+	if (sm->sm_kbuf) {
+		FREE(sm->sm_kbuf, MT_MSG);
+	}
+	put_sgl(sm);
+	FREE(sm, MT_SYSMSG);
+}
+
+/*
+ * msg_send_async()
+ *	Send a message to a port, but don't wait for the reply
+ *
+ * The portref must be PF_TAGGED.  Returns a ticket which msg_reap()
+ * will later report the completion under, or -1 on error.
+ */
+int
+msg_send_async(port_t arg_port, struct msg *arg_msg)
+{
+	struct proc *p = curthread->t_proc;
+	struct portref *pr;
+	struct port *port;
+	struct sysmsg *sm;
+	long ticket;
+
+	/*
+	 * Get message body and sanity check it
+	 */
+	sm = MALLOC(sizeof(struct sysmsg), MT_SYSMSG);
+	if (copyin(arg_msg, &sm->sm_msg, sizeof(struct msg))) {
+		FREE(sm, MT_SYSMSG);
+		return(err(EFAULT));
+	}
+	if ((sm->sm_op & MSG_MASK) < M_RESVD) {
+		FREE(sm, MT_SYSMSG);
+		return(err(EINVAL));
+	}
+	if (get_sgl(sm)) {
+		FREE(sm, MT_SYSMSG);
+		return(-1);
+	}
+
+	/*
+	 * As for msg_send(), M_READ segments are used only once
+	 * the reply arrives.
+	 */
+	sm->sm_nseg = 0;
+	if (!(sm->sm_op & M_READ)) {
+		if (m_to_sm(&p->p_vas, sm)) {
+			put_sgl(sm);
+			FREE(sm, MT_SYSMSG);
+			return(-1);
+		}
+	}
+
+	/*
+	 * Count it against our limit, and take a ticket
+	 */
+	p_lock_void(&p->p_asynclock, SPLHI);
+	if (p->p_nasync >= MAXASYNC) {
+		v_lock(&p->p_asynclock, SPL0);
+		err(EAGAIN);
+		goto out;
+	}
+	p->p_nasync += 1;
+	if (++(p->p_ticket) <= 0) {
+		p->p_ticket = 1;
+	}
+	ticket = p->p_ticket;
+	v_lock(&p->p_asynclock, SPL0);
+
+	/*
+	 * Become another message in flight on the portref
+	 */
+	pr = share_portref(p, arg_port);
+	if (pr == 0) {
+		goto uncount;
+	}
+	if (!(pr->p_flags & PF_TAGGED)) {
+		/*
+		 * share_portref() gave us the semaphore
+		 */
+		v_lock(&pr->p_lock, SPL0_SAME);
+		v_sema(&pr->p_sema);
+		err(EINVAL);
+		goto uncount;
+	}
+	port = pr->p_port;
+	if ((port == 0) || (port->p_flags & P_CLOSING)) {
+		v_lock(&pr->p_lock, SPL0_SAME);
+		tag_done(pr);
+		err(EIO);
+		goto uncount;
+	}
+
+	/*
+	 * Queue it, and leave it to tag_complete()
+	 */
+	sm->sm_sender = pr;
+	inline_tag_init(sm);
+	sm->sm_proc = p;
+	sm->sm_ticket = ticket;
+	sm->sm_gen = p->p_asyncgen;
+	sm->sm_kbuf = 0;
+	sm->sm_klen = 0;
+	inline_queue_msg(port, sm, SPL0);
+	v_lock(&pr->p_lock, SPL0_SAME);
+	return(ticket);
+
+uncount:
+	p_lock_void(&p->p_asynclock, SPLHI);
+	p->p_nasync -= 1;
+	v_lock(&p->p_asynclock, SPL0);
+out:
+	if (sm->sm_nseg) {
+		freesegs(sm);
+	}
+	put_sgl(sm);
+	FREE(sm, MT_SYSMSG);
+	return(-1);
+}
+
+/*
+ * async_snap()
+ *	Take a copy of the reply data for an asynchronous message
+ *
+ * Called in the server's context from tag_reply(), with no locks
+ * held.  "om" is the message being answered, "sm" the reply; its
+ * segments are consumed.  If the data can't be had, the reply is
+ * turned into an error.
+ */
+void
+async_snap(struct sysmsg *om, struct sysmsg *sm)
+{
+	uint x, len;
+	seg_t *s;
+	char *buf, *why;
+
+	len = 0;
+	for (x = 0, s = SGL(sm); x < sm->sm_nseg; ++x, ++s) {
+		len += s->s_buflen;
+	}
+	if (len > MAXASYNCDATA) {
+		why = E2BIG;
+		goto bad;
+	}
+	if (len == 0) {
+		freesegs(sm);
+		return;
+	}
+	buf = MALLOC(len, MT_MSG);
+	len = 0;
+	for (x = 0, s = SGL(sm); x < sm->sm_nseg; ++x, ++s) {
+		if (copyin(s->s_buf, buf + len, s->s_buflen)) {
+			FREE(buf, MT_MSG);
+			why = EFAULT;
+			goto bad;
+		}
+		len += s->s_buflen;
+	}
+	om->sm_kbuf = buf;
+	om->sm_klen = len;
+	freesegs(sm);
+	return;
+
+bad:
+	freesegs(sm);
+	sm->sm_arg = -1;
+	strcpy(sm->sm_err, why);
+}
+
+/*
+ * async_post()
+ *	Put a completed asynchronous message on its sender's list
+ *
+ * Called from tag_complete() with the portref locked.
+ */
+void
+async_post(struct sysmsg *sm)
+{
+	struct proc *p = sm->sm_proc;
+	spl_t s;
+
+	s = p_lock(&p->p_asynclock, SPLHI);
+
+	/*
+	 * Sent by a program since replaced by exec(); nobody left
+	 * who cares.
+	 */
+	if (sm->sm_gen != p->p_asyncgen) {
+		p->p_nasync -= 1;
+		if ((p->p_nasync == 0) && blocked_sema(&p->p_asyncwait)) {
+			v_sema(&p->p_asyncwait);
+		}
+		v_lock(&p->p_asynclock, s);
+		free_async(sm);
+		return;
+	}
+
+	sm->sm_next = 0;
+	if (p->p_asynchd) {
+		p->p_asynctl->sm_next = sm;
+	} else {
+		p->p_asynchd = sm;
+	}
+	p->p_asynctl = sm;
+
+	/*
+	 * Kick loose a reaper if one's waiting
+	 */
+	if (blocked_sema(&p->p_asyncwait)) {
+		v_sema(&p->p_asyncwait);
+	}
+	v_lock(&p->p_asynclock, s);
+}
+
+/*
+ * async_copyout()
+ *	Copy reply data out to the buffers named when it was sent
+ *
+ * Returns the number of bytes copied, or -1 on error.
+ */
+static int
+async_copyout(struct sysmsg *sm)
+{
+	uint x, cnt, left = sm->sm_klen;
+	char *from = sm->sm_kbuf;
+	seg_t *s;
+
+	for (x = 0, s = SGL(sm); (x < sm->sm_msg.m_nseg) && left;
+			++x, ++s) {
+		cnt = MIN(left, s->s_buflen);
+		if (copyout(s->s_buf, from, cnt)) {
+			return(-1);
+		}
+		from += cnt;
+		left -= cnt;
+	}
+	return(sm->sm_klen - left);
+}
+
+/*
+ * msg_reap()
+ *	Collect completed asynchronous messages
+ *
+ * Fills in up to arg_max entries of arg_done[], returning the number
+ * filled in.  If arg_wait is set and none are ready, sleeps until one
+ * is, unless there are none outstanding at all.
+ */
+int
+msg_reap(struct msg_done *arg_done, int arg_max, int arg_wait)
+{
+	struct proc *p = curthread->t_proc;
+	struct sysmsg *hd, *sm, *smn;
+	struct msg_done md;
+	int x, n, error = 0;
+
+	if (arg_max <= 0) {
+		return(err(EINVAL));
+	}
+
+	/*
+	 * Wait for something to show up, if we're to
+	 */
+	p_lock_void(&p->p_asynclock, SPLHI);
+	while (p->p_asynchd == 0) {
+		if (!arg_wait || (p->p_nasync == 0)) {
+			v_lock(&p->p_asynclock, SPL0);
+			return(0);
+		}
+		if (p_sema_v_lock(&p->p_asyncwait, PRICATCH,
+				&p->p_asynclock)) {
+			return(err(EINTR));
+		}
+		p_lock_void(&p->p_asynclock, SPLHI);
+	}
+
+	/*
+	 * Take as many as we have room for off the front
+	 */
+	hd = sm = p->p_asynchd;
+	for (n = 1; (n < arg_max) && sm->sm_next; ++n) {
+		sm = sm->sm_next;
+	}
+	p->p_asynchd = sm->sm_next;
+	sm->sm_next = 0;
+	p->p_nasync -= n;
+	v_lock(&p->p_asynclock, SPL0);
+
+	/*
+	 * Report each, copying out reply data as we go.  As for
+	 * msg_send(), the byte count stands in for m_arg when data
+	 * came back.
+	 */
+	for (x = 0, sm = hd; sm; ++x, sm = smn) {
+		smn = sm->sm_next;
+		md.md_ticket = sm->sm_ticket;
+		md.md_arg1 = sm->sm_arg1;
+		md.md_err[0] = '\0';
+		if (sm->sm_arg == -1) {
+			md.md_ret = -1;
+			strcpy(md.md_err, sm->sm_err);
+		} else {
+			md.md_ret = 0;
+			if (sm->sm_kbuf) {
+				md.md_ret = async_copyout(sm);
+				if (md.md_ret == -1) {
+					strcpy(md.md_err, EFAULT);
+				}
+			}
+			if (md.md_ret == 0) {
+				md.md_ret = sm->sm_arg;
+			}
+		}
+		if (copyout(&arg_done[x], &md, sizeof(md))) {
+			error = 1;
+		}
+		free_async(sm);
+	}
+	if (error) {
+		return(err(EFAULT));
+	}
+	return(n);
+}
+
+/*
+ * async_flush()
+ *	Forget about a process' asynchronous messages
+ *
+ * Completions not yet reaped are freed.  Any still in flight will
+ * be freed by async_post() as they complete.  Used on exec(), and
+ * when the process is torn down.
+ */
+void
+async_flush(struct proc *p)
+{
+	struct sysmsg *sm, *smn;
+
+	p_lock_void(&p->p_asynclock, SPLHI);
+	p->p_asyncgen += 1;
+	sm = p->p_asynchd;
+	p->p_asynchd = 0;
+	for (smn = sm; smn; smn = smn->sm_next) {
+		p->p_nasync -= 1;
+	}
+	v_lock(&p->p_asynclock, SPL0);
+	for ( ; sm; sm = smn) {
+		smn = sm->sm_next;
+		free_async(sm);
+	}
+}
+
+/*
+ * async_wait()
+ *	Wait out a process' asynchronous messages still in flight
+ *
+ * Used as the process is torn down, after async_flush().  Closing
+ * its portrefs aborted them all, but one shared with another process
+ * isn't drained, and async_post() still needs the proc until the
+ * last of its messages is answered.
+ */
+void
+async_wait(struct proc *p)
+{
+	p_lock_void(&p->p_asynclock, SPLHI);
+	while (p->p_nasync > 0) {
+		p_sema_v_lock(&p->p_asyncwait, PRIHI, &p->p_asynclock);
+		p_lock_void(&p->p_asynclock, SPLHI);
+	}
+	v_lock(&p->p_asynclock, SPL0);
+}
@@ -14,6 +14,7 @@
 #include <sys/thread.h>
 #include <sys/malloc.h>
 #include <alloc.h>
+#include "msg.h"
 
 #define START_ROTOR (1024)	/* Where we start searching for an open # */
 
@@ -375,10 +376,14 @@ shut_client(struct portref *pr, int sema_held)
 
 	/*
 	 * Decrement the reference count, just return if
-	 * it's not zero yet.
+	 * it's not zero yet.  Our asynchronous messages go
+	 * either way; we won't be around to reap them.
 	 * TBD: consider compare-and-exchange
 	 */
 	p_lock_void(&pr->p_lock, SPL0);
+	if (pr->p_flags & PF_TAGGED) {
+		async_abort(pr, curthread->t_proc);
+	}
 	refs = pr->p_refs;
 	pr->p_refs -= 1;
 	v_lock(&pr->p_lock, SPL0_SAME);
@@ -399,9 +404,17 @@ shut_client(struct portref *pr, int sema_held)
 	sm->sm_arg1 = sm->sm_nseg = 0;
 
 	/*
-	 * If he's closed on us at the same time, no problem.
+	 * Let any tagged messages still in flight finish; the
+	 * server frees the portref on our disconnect.
 	 */
 	p_lock_void(&pr->p_lock, SPL0);
+	if (pr->p_flags & PF_TAGGED) {
+		(void)drain_portref(pr, PRIHI);
+	}
+
+	/*
+	 * If he's closed on us at the same time, no problem.
+	 */
 	if (!(port = pr->p_port)) {
 		v_lock(&pr->p_lock, SPL0_SAME);
 		free_portref(pr);
@@ -430,15 +443,84 @@ shut_client(struct portref *pr, int sema_held)
  * is taken on the portref.  Otherwise zeroes the p_port field of
  * the portref, flagging that the server's gone.  It also removes
  * the portref from the port's list, and finally returns 0.
+ *
+ * Tagged messages the server was still holding are failed with
+ * an I/O error.  Their clients can't leave until they're woken
+ * (p_port is still set, so an interrupted one sends an M_ABORT and
+ * waits), so we can drop our view of their segments first.
  */
 static int
 close_client(struct port *port, struct portref *pr)
 {
 	int err;
+	struct sysmsg *tags, *aborts, *kaborts, *sm, *smn, *s;
 
 	unmapsegs(&pr->p_segs);
 	p_lock_void(&pr->p_lock, SPL0);
 	p_lock_void(&port->p_lock, SPLHI);
+	if (port->p_hd) {
+		v_lock(&port->p_lock, SPL0);
+		v_lock(&pr->p_lock, SPL0_SAME);
+		return(1);
+	}
+	tags = pr->p_tags;
+	pr->p_tags = 0;
+	v_lock(&port->p_lock, SPL0);
+	v_lock(&pr->p_lock, SPL0_SAME);
+	for (sm = tags; sm; sm = sm->sm_next) {
+		unmapsegs(&sm->sm_mapped);
+	}
+
+	/*
+	 * Fail them.  Any M_ABORT goes last, as its sender may leave
+	 * as soon as it's woken.
+	 */
+	p_lock_void(&pr->p_lock, SPL0);
+	p_lock_void(&port->p_lock, SPLHI);
+
+	/*
+	 * An M_ABORT from async_abort() has nobody to wake.  If the
+	 * server already answered the message it names, that message
+	 * is off the list and only the M_ABORT remembers it; fail it
+	 * here.
+	 */
+	for (sm = tags; sm; sm = sm->sm_next) {
+		if ((sm->sm_op != M_ABORT) || !sm->sm_proc) {
+			continue;
+		}
+		for (s = tags; s && (s != sm->sm_abort); s = s->sm_next)
+			;
+		if (!s) {
+			s = sm->sm_abort;
+			s->sm_arg1 = s->sm_arg = -1;
+			strcpy(s->sm_err, EIO);
+			tag_complete(pr, s);
+		}
+	}
+
+	aborts = 0;
+	for (sm = tags; sm; sm = smn) {
+		smn = sm->sm_next;
+		if (sm->sm_op == M_ABORT) {
+			sm->sm_next = aborts;
+			aborts = sm;
+			continue;
+		}
+		sm->sm_arg1 = sm->sm_arg = -1;
+		strcpy(sm->sm_err, EIO);
+		tag_complete(pr, sm);
+	}
+	kaborts = 0;
+	for (sm = aborts; sm; sm = smn) {
+		smn = sm->sm_next;
+		if (sm->sm_proc) {
+			sm->sm_next = kaborts;
+			kaborts = sm;
+			continue;
+		}
+		sm->sm_state = PS_ABDONE;
+		v_sema(&sm->sm_iowait);
+	}
 	if (port->p_hd) {
 		err = 1;
 	} else {
@@ -451,6 +533,10 @@ close_client(struct port *port, struct portref *pr)
 	}
 	v_lock(&port->p_lock, SPL0);
 	v_lock(&pr->p_lock, SPL0_SAME);
+	for (sm = kaborts; sm; sm = smn) {
+		smn = sm->sm_next;
+		FREE(sm, MT_SYSMSG);
+	}
 	return(err);
 }
 
@@ -522,11 +608,29 @@ bounce_msgs(struct port *port)
 			freesegs(sm);
 		}
 
+		/*
+		 * Tagged messages are completed individually.  The
+		 * portref stays connected until close_client(), as
+		 * the server may still hold other messages from it.
+		 * An M_ABORT is handed to close_client() along with
+		 * those, since its sender must not leave while the
+		 * message it aborts is still listed.
+		 */
+		if (pr->p_flags & PF_TAGGED) {
+			if (sm->sm_op == M_ABORT) {
+				sm->sm_next = pr->p_tags;
+				pr->p_tags = sm;
+			} else if (sm->sm_state != PS_ABWAIT) {
+				sm->sm_arg1 = sm->sm_arg = -1;
+				strcpy(sm->sm_err, EIO);
+				tag_complete(pr, sm);
+			}
+
 		/*
 		 * If the client has tried to abort the operation,
 		 * ignore anything but the abort message itself.
 		 */
-		if ((pr->p_state == PS_ABWAIT) &&
+		} else if ((pr->p_state == PS_ABWAIT) &&
 				(sm->sm_op != M_ABORT)) {
 			/* nothing */ ;
 		} else {
@@ -619,7 +723,7 @@ shut_server(struct port *port)
 	 * to fiddle with mappings.
 	 */
 	p_sema(&port->p_mapsema, PRIHI);
-	ASSERT((port->p_maps == 0) || (port->p_maps == NO_MAP_HASH),
+	ASSERT((port->p_nmaps == 0) || (port->p_nmaps == NO_MAPS),
 		"shut_server: maps");
 
 	FREE(port, MT_PORT);
@@ -688,10 +792,15 @@ msg_disconnect(port_t arg_port)
 int
 msg_err(long arg_tran, const char *arg_why, int arg_len)
 {
-	struct portref *pr;
-	struct port *port;
-	struct proc *p = curthread->t_proc;
 	char errmsg[ERRLEN];
+	int op;
+
+	/*
+	 * msg_errtag() passes the request's tag in the M_TAG bits
+	 * of the length
+	 */
+	op = arg_len & M_TAG;
+	arg_len &= ~M_TAG;
 
 	/*
 	 * Validate error string, copy it in.  It's small, so we
@@ -703,6 +812,21 @@ msg_err(long arg_tran, const char *arg_why, int arg_len)
 	if (get_ustr(errmsg, ERRLEN, arg_why, arg_len)) {
 		return(-1);
 	}
+	return(err_reply(arg_tran, errmsg, op));
+}
+
+/*
+ * err_reply()
+ *	Guts of msg_err(), once the error string is in the kernel
+ *
+ * For a tagged portref, the M_TAG bits of "op" name the request.
+ */
+int
+err_reply(long arg_tran, char *errmsg, int op)
+{
+	struct portref *pr;
+	struct port *port;
+	struct proc *p = curthread->t_proc;
 
 	/*
 	 * Validate transaction ID.   If we don't find it, this
@@ -735,6 +859,19 @@ msg_err(long arg_tran, const char *arg_why, int arg_len)
 		v_lock(&pr->p_lock, SPL0);
 		return(err(EIO));
 	}
+	if (pr->p_tags) {
+		struct sysmsg sm;
+
+		/*
+		 * Tagged; fail the message named
+		 */
+		sm.sm_op = op & M_TAG;
+		sm.sm_arg = sm.sm_arg1 = -1;
+		sm.sm_nseg = 0;
+		sm.sm_sender = 0;
+		strcpy(sm.sm_err, errmsg);
+		return(tag_reply(pr, &sm));
+	}
 	if (pr->p_msg == 0) {
 		v_lock(&pr->p_lock, SPL0);
 		return(err(EINVAL));
@@ -755,7 +892,7 @@ msg_err(long arg_tran, const char *arg_why, int arg_len)
 		pr->p_state = PS_IODONE;
 		pr->p_msg->sm_arg = -1;
 		strcpy(pr->p_msg->sm_err, errmsg);
-		v_sema(&pr->p_iowait);
+		v_sema_handoff(&pr->p_iowait);
 		break;
 	case PS_OPENING:
 		/*
@@ -772,7 +909,7 @@ msg_err(long arg_tran, const char *arg_why, int arg_len)
 		 */
 		pr->p_state = PS_ABDONE;
 		strcpy(pr->p_msg->sm_err, errmsg);
-		v_sema(&pr->p_iowait);
+		v_sema_handoff(&pr->p_iowait);
 		break;
 	default:
 		v_lock(&pr->p_lock, SPL0);
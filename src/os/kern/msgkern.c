@@ -6,6 +6,7 @@
 #include <sys/port.h>
 #include <sys/malloc.h>
 #include <sys/assert.h>
+#include "msg.h"
 
 /*
  * kernmsg_send()
@@ -47,25 +48,37 @@ kernmsg_send(struct portref *pr, int op, long *args)
 	}
 
 	/*
-	 * Set up our message transfer state
+	 * A tagged portref keeps the transfer state in the message.
+	 * We hold it exclusively, so nothing else is in flight.
 	 */
-	ASSERT_DEBUG(sema_count(&pr->p_iowait) == 0, "kernmsg_send: p_iowait");
-	pr->p_state = PS_IOWAIT;
+	if (pr->p_flags & PF_TAGGED) {
+		inline_tag_init(&sm);
+		queue_msg(pr->p_port, &sm, SPL0);
+		p_sema_v_lock(&sm.sm_iowait, PRIHI, &pr->p_lock);
+		v_sema(&sm.sm_svwait);
+	} else {
+		/*
+		 * Set up our message transfer state
+		 */
+		ASSERT_DEBUG(sema_count(&pr->p_iowait) == 0,
+			"kernmsg_send: p_iowait");
+		pr->p_state = PS_IOWAIT;
 
-	/*
-	 * Put message on queue
-	 */
-	queue_msg(pr->p_port, &sm, SPL0);
+		/*
+		 * Put message on queue
+		 */
+		queue_msg(pr->p_port, &sm, SPL0);
 
-	/*
-	 * Now wait for the I/O to finish or be interrupted
-	 */
-	p_sema_v_lock(&pr->p_iowait, PRIHI, &pr->p_lock);
+		/*
+		 * Now wait for the I/O to finish or be interrupted
+		 */
+		p_sema_v_lock(&pr->p_iowait, PRIHI, &pr->p_lock);
 
-	/*
-	 * Release the server
-	 */
-	v_sema(&pr->p_svwait);
+		/*
+		 * Release the server
+		 */
+		v_sema(&pr->p_svwait);
+	}
 
 	/*
 	 * If the server indicates error, set it and leave
@@ -127,7 +127,7 @@ page_wire(void *arg_va, void **arg_pa, uint flags)
 	pp = find_pp(ps, idx);
 	lock_slot(ps, pp);
 	if ((pp->pp_flags & PP_V) == 0) {
-		if ((*(ps->p_ops->psop_fillslot))(ps, pp, idx)) {
+		if ((*(ps->p_ops->psop_fillslot))(ps, pp, idx, 0)) {
 			unlock_slot(ps, pp);
 			error = err(EFAULT);
 			goto out;
@@ -13,11 +13,8 @@
 #include "../mach/mutex.h"
 
 /*
- * find_portref()
- *	Find a port given its handle
- *
- * Validate the state of the port also.  This routine handles all
- * of its own locking.
+ * get_portref()
+ *	Common code for find_portref() and share_portref()
  *
  * We take the spinlock on the portref, and then transfer to the
  * semaphore.  This allows us to release the proc lock before
@@ -30,8 +27,8 @@
  * to semaphored portref.  On success both p_sema and p_lock are
  * held.
  */
-struct portref *
-find_portref(struct proc *p, port_t port)
+static struct portref *
+get_portref(struct proc *p, port_t port)
 {
 	struct portref *ptref;
 
@@ -90,6 +87,97 @@ find_portref(struct proc *p, port_t port)
 	return(ptref);
 }
 
+/*
+ * find_portref()
+ *	Find a port given its handle
+ *
+ * Validate the state of the port also.  This routine handles all
+ * of its own locking.  The caller gets exclusive use of the portref;
+ * for a PF_TAGGED one we wait for all tagged messages in flight
+ * to complete.  A server may hold one of those indefinitely (a read
+ * of a pipe, say), so that wait can be interrupted like the wait
+ * for p_sema.
+ *
+ * Sets err() and return 0 on failure; otherwise returns pointer
+ * to semaphored portref.  On success both p_sema and p_lock are
+ * held.
+ */
+struct portref *
+find_portref(struct proc *p, port_t port)
+{
+	struct portref *ptref;
+
+	ptref = get_portref(p, port);
+	if (ptref && (ptref->p_flags & PF_TAGGED)) {
+		if (drain_portref(ptref, PRICATCH)) {
+			v_sema(&ptref->p_sema);
+			err(EINTR);
+			return(0);
+		}
+	}
+	return(ptref);
+}
+
+/*
+ * share_portref()
+ *	Like find_portref(), but allow other tagged I/O to proceed
+ *
+ * If the portref is not PF_TAGGED, this is just find_portref().
+ * Otherwise we count ourselves as another message in flight and
+ * let the semaphore go; the caller must tag_done() when finished.
+ * Either way, p_lock is held on successful return.
+ */
+struct portref *
+share_portref(struct proc *p, port_t port)
+{
+	struct portref *ptref;
+
+	ptref = get_portref(p, port);
+	if (ptref && (ptref->p_flags & PF_TAGGED)) {
+		ptref->p_nio += 1;
+		v_sema(&ptref->p_sema);
+	}
+	return(ptref);
+}
+
+/*
+ * drain_portref()
+ *	Wait for all tagged messages through a portref to complete
+ *
+ * Called with p_lock held.  New tagged senders are held off by
+ * whatever keeps them from the portref; normally, our holding
+ * p_sema.  Returns 0 with p_lock held once they're done.  A sleep
+ * at "pri" of PRICATCH may be interrupted; then we return 1, with
+ * p_lock released.
+ */
+int
+drain_portref(struct portref *pr, int pri)
+{
+	while (pr->p_nio > 0) {
+		if (p_sema_v_lock(&pr->p_drain, pri, &pr->p_lock)) {
+			return(1);
+		}
+		p_lock_void(&pr->p_lock, SPL0_SAME);
+	}
+	return(0);
+}
+
+/*
+ * tag_done()
+ *	Complete a tagged message started under share_portref()
+ */
+void
+tag_done(struct portref *pr)
+{
+	p_lock_void(&pr->p_lock, SPL0);
+	ASSERT_DEBUG(pr->p_nio > 0, "tag_done: p_nio");
+	pr->p_nio -= 1;
+	if (pr->p_nio == 0) {
+		vall_sema(&pr->p_drain);
+	}
+	v_lock(&pr->p_lock, SPL0_SAME);
+}
+
 /*
  * delete_portref()
  *	Like find_portref, except remove from open portref table also
@@ -140,6 +228,12 @@ delete_portref(struct proc *p, port_t port, int take_sema)
 	 */
 	if (take_sema) {
 		p_sema_v_lock(&ptref->p_sema, PRIHI, &ptref->p_lock);
+		if (ptref->p_flags & PF_TAGGED) {
+			p_lock_void(&ptref->p_lock, SPL0_SAME);
+			async_abort(ptref, p);
+			(void)drain_portref(ptref, PRIHI);
+			v_lock(&ptref->p_lock, SPL0_SAME);
+		}
 	} else {
 		v_lock(&ptref->p_lock, SPL0_SAME);
 	}
@@ -260,6 +354,7 @@ alloc_portref(void)
 	init_lock(&pr->p_lock);
 	init_sema(&pr->p_iowait); set_sema(&pr->p_iowait, 0);
 	init_sema(&pr->p_svwait); set_sema(&pr->p_svwait, 0);
+	init_sema(&pr->p_drain); set_sema(&pr->p_drain, 0);
 	pr->p_state = PS_OPENING;
 	pr->p_refs = 1;
 	return(pr);
@@ -332,6 +427,40 @@ fork_ports(sema_t *s, struct portref **old, struct portref **new, uint nport)
 	return(nopen);
 }
 
+/*
+ * pass_ports()
+ *	Like fork_ports(), but only for the listed ports
+ *
+ * Each is given the same port_t in the new process as in the old.
+ * Ports which aren't open, or may not be duplicated, are quietly
+ * left out.  Returns number passed.
+ */
+ulong
+pass_ports(struct portref **old, struct portref **new, port_t *ports,
+	uint nport)
+{
+	uint x;
+	port_t port;
+	struct portref *pr;
+	ulong nopen = 0L;
+
+	for (x = 0; x < nport; ++x) {
+		port = ports[x];
+		if ((port < 0) || (port >= PROCOPENS) || new[port]) {
+			continue;
+		}
+		pr = old[port];
+		if ((pr == 0) || (pr == PORT_RESERVED) ||
+				(pr->p_flags & PF_NODUP)) {
+			continue;
+		}
+		new[port] = pr;
+		ATOMIC_INCL(&pr->p_refs);
+		nopen += 1;
+	}
+	return(nopen);
+}
+
 /*
  * close_ports()
  *	Shut down a server for each open port in the range
@@ -461,6 +590,66 @@ clone(port_t arg_port)
 	}
 }
 
+/*
+ * msg_tagged()
+ *	Switch a portref into or out of tagged mode
+ *
+ * Returns the previous mode.  We take the portref exclusively, so
+ * no messages are in flight under the old mode when we switch.
+ *
+ * Replies to a tagged portref name the message they answer by its
+ * tag (see M_TAG), which a server must know to hand back.  So a
+ * server must say it does, by calling this on its own port; until
+ * then clients can't switch.
+ */
+int
+msg_tagged(port_t arg_port, int arg_on)
+{
+	struct proc *p = curthread->t_proc;
+	struct portref *pr;
+	struct port *port;
+	int was;
+
+	/*
+	 * A server port; PROCOPENS and up, as for find_port()
+	 */
+	if (arg_port >= PROCOPENS) {
+		port = find_port(p, arg_port);
+		if (!port) {
+			return(-1);
+		}
+		was = (port->p_flags & P_TAGGED) ? 1 : 0;
+		if (arg_on) {
+			port->p_flags |= P_TAGGED;
+		} else {
+			port->p_flags &= ~P_TAGGED;
+		}
+		v_lock(&port->p_lock, SPL0);
+		v_sema(&port->p_sema);
+		return(was);
+	}
+
+	pr = find_portref(p, arg_port);
+	if (!pr) {
+		return(-1);
+	}
+	was = (pr->p_flags & PF_TAGGED) ? 1 : 0;
+	if (arg_on) {
+		port = pr->p_port;
+		if (!port || !(port->p_flags & P_TAGGED)) {
+			v_lock(&pr->p_lock, SPL0_SAME);
+			v_sema(&pr->p_sema);
+			return(err(EINVAL));
+		}
+		pr->p_flags |= PF_TAGGED;
+	} else {
+		pr->p_flags &= ~PF_TAGGED;
+	}
+	v_lock(&pr->p_lock, SPL0_SAME);
+	v_sema(&pr->p_sema);
+	return(was);
+}
+
 /*
  * free_portref()
  *	Free a portref
@@ -491,6 +680,6 @@ alloc_port(void)
 	port->p_hd = 0;
 	port->p_flags = 0;
 	port->p_refs = 0;
-	port->p_maps = 0;
+	port->p_nmaps = 0;
 	return(port);
 }
@@ -14,6 +14,7 @@
 #include <sys/param.h>
 #include <hash.h>
 #include <sys/fs.h>
+#include <sys/msg.h>
 #include <sys/malloc.h>
 #include <sys/assert.h>
 #include <sys/misc.h>
@@ -22,8 +23,6 @@
 #include "pset.h"
 
 extern void setrun();
-extern struct sched sched_root;
-extern lock_t runq_lock;
 
 ulong npid_free = ((~0)-1);	/* # PIDs free in pool */
 ulong pid_nextfree = 1L;	/* Next free PID number */
@@ -114,7 +113,10 @@ bootproc(struct boot_task *b)
 	 * Initialize other fields
 	 */
 	init_sema(&p->p_sema);
-	p->p_runq = sched_node(&sched_root);
+	init_lock(&p->p_asynclock);
+	init_sema(&p->p_asyncwait); set_sema(&p->p_asyncwait, 0);
+	init_sema(&p->p_vfwait); set_sema(&p->p_vfwait, 0);
+	p->p_runq = sched_node(sched_root);
 	p->p_pgrp = alloc_pgrp();
 	p->p_children = alloc_exitgrp(p);
 	p->p_parent = alloc_exitgrp(0); ref_exitgrp(p->p_parent);
@@ -383,15 +385,19 @@ init_proc(void)
 }
 
 /*
- * fork()
- *	Fork out an entirely new process
+ * alloc_child()
+ *	Get a proc and thread for a new child of the current process
+ *
+ * The child gets our IDs, protections and process group, and a
+ * place under our scheduling node.  Its vas, open ports and user
+ * registers are left for the caller to fill in; start_child() then
+ * sets it going.
  */
-pid_t
-fork(void)
+struct thread *
+alloc_child(void)
 {
 	struct thread *tnew, *told = curthread;
 	struct proc *pold = told->t_proc, *pnew;
-	pid_t npid;
 
 	/*
 	 * Allocate new structures
@@ -412,11 +418,10 @@ fork(void)
 	set_sema(&tnew->t_mutex, 0);
 
 	/*
-	 * Get new PIDs for process and initial thread.  Insert
-	 * PID into hash.
+	 * Get new PIDs for process and initial thread.
 	 */
 	p_sema(&pid_sema, PRIHI);
-	npid = pnew->p_pid = allocpid();
+	pnew->p_pid = allocpid();
 	tnew->t_pid = allocpid();
 	v_sema(&pid_sema);
 
@@ -427,42 +432,139 @@ fork(void)
 	p_sema(&pold->p_sema, PRIHI);
 	bcopy(pold->p_ids, pnew->p_ids, sizeof(pold->p_ids));
 	init_sema(&pnew->p_sema);
+	init_lock(&pnew->p_asynclock);
+	init_sema(&pnew->p_asyncwait); set_sema(&pnew->p_asyncwait, 0);
+	init_sema(&pnew->p_vfwait); set_sema(&pnew->p_vfwait, 0);
 	pnew->p_prot = pold->p_prot;
 	pnew->p_threads = tnew;
-	fork_vas(&pold->p_vas, &pnew->p_vas);
 	pnew->p_runq = sched_node(pold->p_runq->s_up);
 	tnew->t_runq = sched_thread(pnew->p_runq, tnew);
-	pnew->p_nopen = fork_ports(&pold->p_sema, pold->p_open,
-		pnew->p_open, PROCOPENS);
-	pnew->p_handler = pold->p_handler;
-	pnew->p_pgrp = pold->p_pgrp; join_pgrp(pold->p_pgrp, npid);
+	pnew->p_pgrp = pold->p_pgrp; join_pgrp(pold->p_pgrp, pnew->p_pid);
 	pnew->p_parent = pold->p_children; ref_exitgrp(pnew->p_parent);
 	bcopy(pold->p_cmd, pnew->p_cmd, sizeof(pnew->p_cmd));
 	v_sema(&pold->p_sema);
 	pnew->p_children = alloc_exitgrp(pnew);
 	pnew->p_nthread = 1;
+	return(tnew);
+}
+
+/*
+ * start_child()
+ *	Make a child from alloc_child() known, and leave it runnable
+ */
+void
+start_child(struct thread *t)
+{
+	struct proc *p = t->t_proc;
+
+	p_sema(&pid_sema, PRIHI);
+	hash_insert(pid_hash, p->p_pid, p);
+	add_proclist(p);
+	v_sema(&pid_sema);
+	setrun(t);
+}
+
+/*
+ * do_fork()
+ *	Fork out an entirely new process
+ *
+ * With "lend", the child is handed our address space rather than
+ * a copy of it, and we sleep until it exec()'s or exits.
+ */
+static pid_t
+do_fork(int lend)
+{
+	struct thread *tnew, *told = curthread;
+	struct proc *pold = told->t_proc, *pnew;
+	pid_t npid;
+
+	tnew = alloc_child();
+	pnew = tnew->t_proc;
+	npid = pnew->p_pid;
 
 	/*
-	 * Duplicate stack now that we have a viable thread/proc
-	 * structure.
+	 * Its address space and open ports are ours.  Holding our
+	 * proc keeps us the only thread, if we are, while the address
+	 * space is shared copy-on-write.
 	 */
-	dup_stack(told, tnew, 0, 0);
+	p_sema(&pold->p_sema, PRIHI);
+	if (lend) {
+		lend_vas(&pold->p_vas, &pnew->p_vas);
+		pnew->p_lender = pold;
+	} else {
+		fork_vas(&pold->p_vas, &pnew->p_vas,
+			(pold->p_threads == told) && (told->t_next == 0));
+	}
+	pnew->p_nopen = fork_ports(&pold->p_sema, pold->p_open,
+		pnew->p_open, PROCOPENS);
+	pnew->p_handler = pold->p_handler;
+	v_sema(&pold->p_sema);
 
 	/*
-	 * Now that we're ready, make PID known globally
+	 * Duplicate stack now that we have a viable thread/proc
+	 * structure.
 	 */
-	p_sema(&pid_sema, PRIHI);
-	hash_insert(pid_hash, npid, pnew);
-	add_proclist(pnew);
-	v_sema(&pid_sema);
+	dup_stack(told, tnew, 0, 0);
 
 	/*
-	 * Leave him runnable
+	 * Leave him runnable.  If he has our vas, wait for it back.
 	 */
-	setrun(tnew);
+	start_child(tnew);
+	if (lend) {
+		p_sema(&pold->p_vfwait, PRIHI);
+	}
 	return(npid);
 }
 
+/*
+ * fork()
+ *	Fork out an entirely new process
+ */
+pid_t
+fork(void)
+{
+	return(do_fork(0));
+}
+
+/*
+ * vfork()
+ *	Fork, lending the child our address space until it exec()'s
+ *
+ * The child runs in our memory, on our stack, so it mustn't do
+ * much more than exec() or exit.  It saves building and tearing
+ * down a copy of the address space which exec() would throw away.
+ * Only a lone thread can lend its vas without pulling it out from
+ * under others; otherwise, and for a vfork() child itself, this
+ * is just a fork().
+ */
+pid_t
+vfork(void)
+{
+	struct thread *t = curthread;
+	struct proc *p = t->t_proc;
+	int lend;
+
+	p_sema(&p->p_sema, PRIHI);
+	lend = (p->p_threads == t) && (t->t_next == 0) &&
+		(p->p_lender == 0);
+	v_sema(&p->p_sema);
+	return(do_fork(lend));
+}
+
+/*
+ * vfork_done()
+ *	A vfork() child is finished with its parent's address space
+ *
+ * "keep" is as for return_vas().  The parent is let go.
+ */
+void
+vfork_done(struct proc *p, int (*keep)(struct pview *))
+{
+	return_vas(&p->p_vas, &p->p_lender->p_vas, keep);
+	v_sema(&p->p_lender->p_vfwait);
+	p->p_lender = 0;
+}
+
 /*
  * free_proc()
  *	Routine to tear down and free proc
@@ -475,6 +577,13 @@ free_proc(struct proc *p)
 	 */
 	close_ports(p->p_ports, PROCPORTS);
 	close_portrefs(p->p_open, PROCOPENS);
+
+	/*
+	 * Closing our portrefs aborted any asynchronous messages;
+	 * drop completions we never reaped, and wait for the rest.
+	 */
+	async_flush(p);
+	async_wait(p);
 	if (p->p_prefs) {
 		ASSERT_DEBUG(hash_size(p->p_prefs) == 0,
 			"free_proc: p_prefs not empty");
@@ -507,8 +616,12 @@ free_proc(struct proc *p)
 	leave_pgrp(p->p_pgrp, p->p_pid);
 
 	/*
-	 * Clean our our vas
+	 * Clean our our vas, giving back the part which is our
+	 * vfork() parent's
 	 */
+	if (p->p_lender) {
+		vfork_done(p, 0);
+	}
 	if (p->p_vas.v_flags & VF_DMA) {
 		pages_release(p);
 	}
@@ -630,6 +743,11 @@ do_exit(int code)
 	 */
 	NO_PREEMPT();
 
+	/*
+	 * No CPU may go looking for us once we're gone
+	 */
+	cancel_handoff(t);
+
 	/*
 	 * Clear out thread's t_runq, and proc's if this is the
 	 * last thread.
@@ -664,8 +782,8 @@ do_exit(int code)
 	 */
 	FREE(curthread, MT_THREAD);
 	curthread = 0;
-	p_lock_void(&runq_lock, SPLHI);
-	PREEMPT_OK();	/* Can't preempt now with runq_lock held */
+	p_lock_void(&cpu.pc_runq->rq_lock, SPLHI);
+	PREEMPT_OK();	/* Can't preempt now with run queue held */
 	for (;;) {
 		swtch();
 		ASSERT(0, "do_exit: swtch returned");
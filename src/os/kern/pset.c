@@ -10,11 +10,14 @@
 #include <sys/port.h>
 #include <sys/vm.h>
 #include <sys/malloc.h>
+#include <sys/core.h>
 #include <alloc.h>
 #include "../mach/mutex.h"
 #include "pset.h"
 
 extern struct portref *swapdev;
+extern struct core *core;
+extern uint freemem, desfree;
 
 /*
  * lock_slot()
@@ -85,6 +88,37 @@ unlock_slot(struct pset *ps, struct perpage *pp)
 	v_lock(&ps->p_lock, SPL0_SAME);
 }
 
+/*
+ * clust_slot()
+ *	See if a neighbouring slot can join a push to swap
+ *
+ * It must be valid, dirty, and our own page, not one shared from a
+ * COW master; pages still in active use are left alone, as they're
+ * likely to be dirtied again.  Called and returns with the pset
+ * locked.  Returns 1 if the slot was taken; it's then locked, and
+ * marked as on its way to swap.
+ */
+static int
+clust_slot(struct pset *ps, uint idx)
+{
+	struct perpage *pp;
+
+	pp = find_pp(ps, idx);
+	if ((pp->pp_flags & (PP_V|PP_M|PP_COW|PP_BAD)) != (PP_V|PP_M)) {
+		return(0);
+	}
+	if (core[pp->pp_pfn].c_flags & C_ACTIVE) {
+		return(0);
+	}
+	if (clock_slot(ps, pp)) {
+		return(0);
+	}
+	p_lock_void(&ps->p_lock, SPL0);
+	pp->pp_flags &= ~(PP_M);
+	pp->pp_flags |= PP_SWAPPED;
+	return(1);
+}
+
 /*
  * pset_writeslot()
  *	Generic code for flushing to a swap page
@@ -92,11 +126,17 @@ unlock_slot(struct pset *ps, struct perpage *pp)
  * Shared by COW, ZFOD, and FOD pset types.  For async, page slot will
  * be released on I/O completion.  Otherwise page is synchronously written
  * and slot is still held on return.
+ *
+ * An asynchronous push takes along any dirty neighbours it can, up to
+ * PAGECLUSTER pages in all.  Their swap blocks are contiguous with
+ * this one's, so they go in the same message.  They're only cleaned,
+ * and their slots released, when it completes.
  */
 int
 pset_writeslot(struct pset *ps, struct perpage *pp, uint idx, voidfun iodone)
 {
 	struct qio *q;
+	uint lo, hi, x;
 
 	ASSERT_DEBUG(pp->pp_flags & PP_V, "nof_writeslot: invalid");
 	pp->pp_flags &= ~(PP_M);
@@ -117,17 +157,108 @@ pset_writeslot(struct pset *ps, struct perpage *pp, uint idx, voidfun iodone)
 	 * Asynch I/O
 	 */
 	q = alloc_qio();
+
+	/*
+	 * Gather up what we can on either side
+	 */
+	lo = hi = idx;
+	p_lock_void(&ps->p_lock, SPL0);
+	while ((hi - lo + 1) < PAGECLUSTER) {
+		if (((hi + 1) < ps->p_len) && clust_slot(ps, hi + 1)) {
+			hi += 1;
+		} else if ((lo > 0) && clust_slot(ps, lo - 1)) {
+			lo -= 1;
+		} else {
+			break;
+		}
+	}
+	v_lock(&ps->p_lock, SPL0_SAME);
+	for (x = lo; x <= hi; ++x) {
+		q->q_pps[x - lo] = find_pp(ps, x);
+	}
+
 	q->q_port = swapdev;
 	q->q_op = FS_ABSWRITE;
 	q->q_pset = ps;
 	q->q_pp = pp;
-	q->q_off = ptob(idx + ps->p_swapblk);
-	q->q_cnt = NBPG;
+	q->q_npg = hi - lo + 1;
+	q->q_off = ptob(lo + ps->p_swapblk);
+	q->q_cnt = ptob(q->q_npg);
 	q->q_iodone = iodone;
+	q->q_moredone = iodone_unlock;
 	qio(q);
 	return(0);
 }
 
+/*
+ * pset_swapin()
+ *	Read a slot's page in from swap
+ *
+ * The slot is locked by our caller, who fills it in from "pfn" on
+ * success.  While memory is plentiful, the slots following it which
+ * are also out on swap come in with the same I/O, and are left valid
+ * under a cache reference.  A run of faults through swapped memory
+ * then costs one trip to swap per PAGECLUSTER pages.
+ */
+int
+pset_swapin(struct pset *ps, uint idx, uint pfn)
+{
+	uint pfns[PAGECLUSTER];
+	struct perpage *pp;
+	uint x, n;
+	int error;
+
+	/*
+	 * See how many following slots we can take along
+	 */
+	pfns[0] = pfn;
+	n = 1;
+	if (freemem > desfree) {
+		p_lock_void(&ps->p_lock, SPL0);
+		while ((n < PAGECLUSTER) && ((idx + n) < ps->p_len)) {
+			pp = find_pp(ps, idx + n);
+			if ((pp->pp_flags & (PP_V|PP_BAD|PP_SWAPPED)) !=
+					PP_SWAPPED) {
+				break;
+			}
+			if (clock_slot(ps, pp)) {
+				break;
+			}
+			n += 1;
+			p_lock_void(&ps->p_lock, SPL0);
+		}
+		v_lock(&ps->p_lock, SPL0_SAME);
+	}
+
+	/*
+	 * Get pages for them, and read them all
+	 */
+	for (x = 1; x < n; ++x) {
+		pfns[x] = alloc_page();
+		set_core(pfns[x], ps, idx + x);
+	}
+	error = pageio_cluster(pfns, n, swapdev, ptob(idx + ps->p_swapblk),
+		FS_ABSREAD);
+
+	/*
+	 * Fill in the extra slots, each with a cache reference
+	 */
+	for (x = 1; x < n; ++x) {
+		pp = find_pp(ps, idx + x);
+		if (error) {
+			free_page(pfns[x]);
+		} else {
+			pp->pp_flags |= PP_V;
+			pp->pp_flags &= ~(PP_M|PP_R);
+			pp->pp_pfn = pfns[x];
+			pp->pp_refs = 1;
+			add_atl(pp, ps, idx + x, ATL_CACHE);
+		}
+		unlock_slot(ps, pp);
+	}
+	return(error);
+}
+
 /*
  * deref_pset()
  *	Reduce reference count on pset
@@ -256,8 +387,16 @@ copy_page(uint idx, struct perpage *opp, struct perpage *pp,
 			return;
 		}
 	}
-	pp->pp_flags |= PP_V;
+	pp->pp_flags |= (PP_V|PP_M);
 	pp->pp_pfn = pfn;
+
+	/*
+	 * Nobody maps it yet (see fork_vas()), so hold it with a
+	 * cache reference until someone does.  Its contents are its
+	 * own now, so it's marked to be pushed before it's reclaimed.
+	 */
+	pp->pp_refs = 1;
+	add_atl(pp, ps, idx, ATL_CACHE);
 }
 
 /*
@@ -297,7 +436,7 @@ dup_slots(struct pset *ops, struct pset *ps, uint low, uint cnt)
 				 * on swap to copy--copy_page() handles
 				 * both cases.
 				 */
-				copy_page(x, pp, pp2, ops, ps);
+				copy_page(x + low, pp, pp2, ops, ps);
 			}
 			unlock_slot(ops, pp);
 		}
@@ -354,10 +493,10 @@ copy_pset(struct pset *ops, uint low, uint cnt)
 	bzero(ps->p_perpage, ps->p_len * sizeof(struct perpage));
 
 	/*
-	 * If old copy had swap, get swap for new copy
+	 * If old copy had swap, get swap for new copy, near it
 	 */
 	if (ops->p_swapblk != 0) {
-		ps->p_swapblk = alloc_swap(ps->p_len);
+		ps->p_swapblk = alloc_swap(ps->p_len, ops->p_swapblk);
 	}
 
 	/*
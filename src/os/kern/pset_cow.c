@@ -40,9 +40,11 @@ cow_init(struct pset *ps)
 /*
  * cow_fillslot()
  *	Fill pset slot from the underlying master copy
+ *
+ * Any read-ahead "ra" is passed along to the master.
  */
 static
-cow_fillslot(struct pset *ps, struct perpage *pp, uint idx)
+cow_fillslot(struct pset *ps, struct perpage *pp, uint idx, uint ra)
 {
 	struct perpage *pp2;
 	uint idx2;
@@ -56,12 +58,11 @@ cow_fillslot(struct pset *ps, struct perpage *pp, uint idx)
 	 */
 	if (pp->pp_flags & PP_SWAPPED) {
 		pg = alloc_page();
-		if (pageio(pg, swapdev, ptob(ps->p_swapblk + idx),
-				NBPG, FS_ABSREAD)) {
+		set_core(pg, ps, idx);
+		if (pset_swapin(ps, idx, pg)) {
 			free_page(pg);
 			return(1);
 		}
-		set_core(pg, ps, idx);
 	} else {
 		struct pset *cow = ps->p_cow;
 
@@ -79,7 +80,7 @@ cow_fillslot(struct pset *ps, struct perpage *pp, uint idx)
 		 */
 		if (!(pp2->pp_flags & PP_V)) {
 			if ((*(cow->p_ops->psop_fillslot))
-					(cow, pp2, idx2)) {
+					(cow, pp2, idx2, ra)) {
 				unlock_slot(cow, pp2);
 				return(1);
 			}
@@ -213,9 +214,10 @@ alloc_pset_cow(struct pset *psold, uint off, uint len)
 
 	/*
 	 * Get swap for our pages.  We get all the room we'll need
-	 * if all pages are written.
+	 * if all pages are written, as near the master's as we can.
 	 */
-	swapblk = alloc_swap(len);
+	swapblk = alloc_swap(len,
+		psold->p_swapblk ? (psold->p_swapblk + off) : 0);
 	if (swapblk == 0) {
 		return(0);
 	}
@@ -9,8 +9,12 @@
 #include <sys/port.h>
 #include <sys/assert.h>
 #include <sys/malloc.h>
+#include <sys/vm.h>
+#include "../mach/mutex.h"
 #include "pset.h"
 
+extern uint freemem, desfree;
+
 /*
  * Our pset ops
  */
@@ -52,18 +56,70 @@ fod_free(struct pset *ps)
 /*
  * fod_fillslot()
  *	Fill pset slot from a port
+ *
+ * Up to "ra" following slots which haven't been filled yet come in
+ * with it, while memory's plentiful.  Their pages are taken in a
+ * physically contiguous run, so the whole read goes to the server
+ * as one segment, and one round trip.  Each is left under a cache
+ * reference.
  */
 static int
-fod_fillslot(struct pset *ps, struct perpage *pp, uint idx)
+fod_fillslot(struct pset *ps, struct perpage *pp, uint idx, uint ra)
 {
-	uint pg;
+	struct perpage *pp2;
+	uint pg, n, x;
+	int got;
 
 	ASSERT_DEBUG(!(pp->pp_flags & (PP_V|PP_BAD)),
 		"fod_fillslot: valid");
-	pg = alloc_page();
-	set_core(pg, ps, idx);
-	if (pageio(pg, ps->p_data, ptob(idx+ps->p_off),
-			NBPG, FS_ABSREAD)) {
+
+	/*
+	 * See how many following slots we can take along
+	 */
+	n = 1;
+	if (ra && (freemem > desfree)) {
+		if (ra >= PAGECLUSTER) {
+			ra = PAGECLUSTER - 1;
+		}
+		p_lock_void(&ps->p_lock, SPL0);
+		while ((n <= ra) && ((idx + n) < ps->p_len)) {
+			pp2 = find_pp(ps, idx + n);
+			if (pp2->pp_flags & (PP_V|PP_BAD)) {
+				break;
+			}
+			if (clock_slot(ps, pp2)) {
+				break;
+			}
+			n += 1;
+			p_lock_void(&ps->p_lock, SPL0);
+		}
+		v_lock(&ps->p_lock, SPL0_SAME);
+	}
+
+	/*
+	 * Get memory for them; if there isn't a long enough run
+	 * free, let slots go until there is.
+	 */
+	while ((n > 1) && alloc_contig(n, Z_NORMAL, &pg)) {
+		n -= 1;
+		unlock_slot(ps, find_pp(ps, idx + n));
+	}
+	if (n == 1) {
+		pg = alloc_page();
+	}
+	for (x = 0; x < n; ++x) {
+		set_core(pg + x, ps, idx + x);
+	}
+
+	/*
+	 * Read them in
+	 */
+	got = pageio_run(pg, ps->p_data, ptob(idx+ps->p_off), n);
+	if (got < 0) {
+		for (x = 1; x < n; ++x) {
+			free_page(pg + x);
+			unlock_slot(ps, find_pp(ps, idx + x));
+		}
 		free_page(pg);
 		return(1);
 	}
@@ -82,6 +138,24 @@ fod_fillslot(struct pset *ps, struct perpage *pp, uint idx)
 	 */
 	add_atl(pp, ps, idx, ATL_CACHE);
 
+	/*
+	 * The rest just get a cache reference, if the server sent
+	 * back all of them
+	 */
+	for (x = 1; x < n; ++x) {
+		pp2 = find_pp(ps, idx + x);
+		if (x < got) {
+			pp2->pp_flags |= PP_V;
+			pp2->pp_refs = 1;
+			pp2->pp_flags &= ~(PP_M|PP_R);
+			pp2->pp_pfn = pg + x;
+			add_atl(pp2, ps, idx + x, ATL_CACHE);
+		} else {
+			free_page(pg + x);
+		}
+		unlock_slot(ps, pp2);
+	}
+
 	return(0);
 }
 
@@ -118,6 +192,12 @@ alloc_pset_fod(struct portref *pr, uint pages)
 	ps->p_ops = &psop_fod;
 	ps->p_data = pr;
 
+	/*
+	 * These are program text and libraries, shared by everyone
+	 * running them.  Have pageout favor them.
+	 */
+	ps->p_flags |= PF_HOT;
+
 	return(ps);
 }
 
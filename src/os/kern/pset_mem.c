@@ -39,7 +39,7 @@ mem_free(struct pset *ps)
  *	Fill pset--no action
  */
 static int
-mem_fillslot(struct pset *ps, struct perpage *pp, uint idx)
+mem_fillslot(struct pset *ps, struct perpage *pp, uint idx, uint ra)
 {
 	ASSERT(pp->pp_flags & PP_V, "mem_fillslot: not valid");
 	return(0);
@@ -105,7 +105,7 @@ mem_dup(struct pset *ops, struct pset *ps)
 	ASSERT_DEBUG(ops->p_flags & PF_BOOT, "mem_dup: !PF_BOOT");
 	ps->p_type = PT_ZERO;
 	ps->p_ops = &psop_zfod;
-	ps->p_swapblk = alloc_swap(ps->p_len);
+	ps->p_swapblk = alloc_swap(ps->p_len, 0);
 }
 
 /*
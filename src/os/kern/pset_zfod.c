@@ -31,22 +31,22 @@ zfod_init(struct pset *ps)
  *	Fill pset slot with zeroes
  */
 static
-zfod_fillslot(struct pset *ps, struct perpage *pp, uint idx)
+zfod_fillslot(struct pset *ps, struct perpage *pp, uint idx, uint ra)
 {
 	uint pg;
 
 	ASSERT_DEBUG(!(pp->pp_flags & (PP_V|PP_BAD)),
 		"zfod_fillslot: valid");
-	pg = alloc_page();
-	set_core(pg, ps, idx);
 	if (pp->pp_flags & PP_SWAPPED) {
-		if (pageio(pg, swapdev, ptob(idx+ps->p_swapblk),
-				NBPG, FS_ABSREAD)) {
+		pg = alloc_page();
+		set_core(pg, ps, idx);
+		if (pset_swapin(ps, idx, pg)) {
 			free_page(pg);
 			return(1);
 		}
 	} else {
-		bzero(ptov(ptob(pg)), NBPG);
+		pg = alloc_zpage();
+		set_core(pg, ps, idx);
 	}
 
 	/*
@@ -72,7 +72,7 @@ alloc_pset_zfod(uint pages)
 	/*
 	 * Get backing store first
 	 */
-	if ((swapblk = alloc_swap(pages)) == 0) {
+	if ((swapblk = alloc_swap(pages, 0)) == 0) {
 		return(0);
 	}
 
@@ -7,6 +7,7 @@
 #include <sys/thread.h>
 #include <sys/pstat.h>
 #include <sys/percpu.h>
+#include <sys/sched.h>
 #include <sys/assert.h>
 #include <sys/fs.h>
 #include "../mach/locore.h"
@@ -14,10 +15,12 @@
 extern sema_t pid_sema;
 extern struct proc *allprocs;
 extern uint size_base, size_ext;
-extern uint freemem;
+extern uint freemem, zeromem;
+extern struct pstat_vm vmstat;
 
 extern struct proc *pfind();
 extern void uptime();
+extern ulong ticks_taken, ticks_skipped;
 
 /*
  * get_pstat_proclist()
@@ -168,6 +171,8 @@ get_pstat_kernel(void *pst_info, uint pst_size)
 	uptime(&psk.psk_uptime);
 	psk.psk_runnable = num_run;
 	psk.psk_hz = HZ;
+	psk.psk_ticks = ticks_taken;
+	psk.psk_tickskip = ticks_skipped;
 
 	/*
 	 * Give the info back to the user
@@ -175,6 +180,65 @@ get_pstat_kernel(void *pst_info, uint pst_size)
 	return(copyout((struct pstat_kernel *)pst_info, &psk, pst_size));
 }
 
+/*
+ * get_pstat_vm()
+ *	Get paging statistics
+ */
+static int
+get_pstat_vm(void *pst_info, uint pst_size)
+{
+	struct pstat_vm psv;
+
+	if (pst_size > sizeof(struct pstat_vm)) {
+		pst_size = sizeof(struct pstat_vm);
+	}
+	psv = vmstat;
+	psv.psv_freemem = freemem;
+	psv.psv_zeroed = zeromem;
+	return(copyout((struct pstat_vm *)pst_info, &psv, pst_size));
+}
+
+/*
+ * get_pstat_cpu()
+ *	Get scheduling details for one CPU
+ */
+static int
+get_pstat_cpu(uint cpunum, void *pst_info, uint pst_size)
+{
+	struct pstat_cpu psc;
+	struct percpu *c;
+	struct runq *rq;
+
+	if (pst_size > sizeof(struct pstat_cpu)) {
+		pst_size = sizeof(struct pstat_cpu);
+	}
+
+	/*
+	 * Find the CPU
+	 */
+	c = nextcpu;
+	while (c->pc_num != cpunum) {
+		c = c->pc_next;
+		if (c == nextcpu) {
+			return(err(EINVAL));
+		}
+	}
+
+	/*
+	 * Snapshot its counters.  They're only ever advanced, so
+	 * a racy look is good enough.
+	 */
+	rq = c->pc_runq;
+	psc.psc_num = c->pc_num;
+	psc.psc_flags = c->pc_flags;
+	psc.psc_pri = c->pc_pri;
+	psc.psc_nrun = rq->rq_nrun;
+	psc.psc_switches = rq->rq_switches;
+	psc.psc_steals = rq->rq_steals;
+
+	return(copyout((struct pstat_cpu *)pst_info, &psc, pst_size));
+}
+
 /*
  * pstat()
  *	System call handler
@@ -192,6 +256,10 @@ pstat(uint ps_type, uint ps_arg, void *ps_info, uint ps_size)
 		return(get_pstat_proclist(ps_info, ps_size));
 	case PSTAT_KERNEL:
 		return(get_pstat_kernel(ps_info, ps_size));
+	case PSTAT_CPU:
+		return(get_pstat_cpu(ps_arg, ps_info, ps_size));
+	case PSTAT_VM:
+		return(get_pstat_vm(ps_info, ps_size));
 	default:
 		/*
 		 * We don't understand what we've been asked for
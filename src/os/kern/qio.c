@@ -21,6 +21,7 @@ static struct qio		/* Elements waiting to be run */
 static lock_t qio_lock;		/* Spinlock for run list */
 
 static void free_qio(struct qio *);
+extern void freesegs(struct sysmsg *);
 
 /*
  * qio()
@@ -44,21 +45,36 @@ qio(struct qio *q)
 /*
  * qio_msg_send()
  *	Do a msg_send()'ish operation based on a QIO structure
+ *
+ * Each page of the I/O goes as its own segment of the one message.
  */
 static void
 qio_msg_send(struct qio *q)
 {
-	struct seg *s = 0;
+	struct seg **segv;
 	struct sysmsg sm;
 	struct portref *pr = q->q_port;
+	struct perpage *pp;
 	int error = 0;
+	uint x;
 	extern struct seg *kern_mem();
 
 	/*
 	 * Get our temp buffers
 	 */
-	ASSERT_DEBUG(q->q_cnt == NBPG, "qio: not a page");
-	s = kern_mem(ptov(ptob(q->q_pp->pp_pfn)), NBPG);
+	ASSERT_DEBUG((q->q_npg > 0) && (q->q_npg <= PAGECLUSTER),
+		"qio: bad page count");
+	ASSERT_DEBUG(q->q_cnt == ptob(q->q_npg), "qio: not pages");
+	if (q->q_npg > MSGSEGS) {
+		segv = MALLOC(q->q_npg * sizeof(struct seg *), MT_MSG);
+		sm.sm_xseg = segv;
+	} else {
+		segv = sm.sm_seg;
+	}
+	for (x = 0; x < q->q_npg; ++x) {
+		segv[x] = kern_mem(ptov(ptob(q->q_pps[x]->pp_pfn)), NBPG);
+	}
+	sm.sm_nseg = q->q_npg;
 
 	/*
 	 * Become sole I/O through port
@@ -70,6 +86,7 @@ qio_msg_send(struct qio *q)
 	 * We lose if the server for the port has left
 	 */
 	if (!pr->p_port) {
+		freesegs(&sm);
 		error = 1;
 		goto out;
 	}
@@ -78,10 +95,8 @@ qio_msg_send(struct qio *q)
 	 * Send a seek+r/w
 	 */
 	sm.sm_op = q->q_op;
-	sm.sm_arg = NBPG;
+	sm.sm_arg = q->q_cnt;
 	sm.sm_arg1 = q->q_off;
-	sm.sm_nseg = 1;
-	sm.sm_seg[0] = s;
 	sm.sm_sender = pr;
 	pr->p_state = PS_IOWAIT;
 	ASSERT_DEBUG(sema_count(&pr->p_iowait) == 0, "qio_msg_send: p_iowait");
@@ -109,11 +124,20 @@ out:
 
 	/*
 	 * If q_iodone isn't null, put result in q_cnt and call
-	 * the function.
+	 * the function.  The rest of a cluster are finished
+	 * through q_moredone.
 	 */
-	if (q->q_iodone) {
-		q->q_cnt = error;
-		(*(q->q_iodone))(q);
+	q->q_cnt = error;
+	pp = q->q_pp;
+	for (x = 0; x < q->q_npg; ++x) {
+		if (q->q_pps[x] == pp) {
+			if (q->q_iodone) {
+				(*(q->q_iodone))(q);
+			}
+		} else if (q->q_moredone) {
+			q->q_pp = q->q_pps[x];
+			(*(q->q_moredone))(q);
+		}
 	}
 
 	/*
@@ -7,6 +7,17 @@
  * on a percentage basis under their common parent.  A node which "wins"
  * will either (1) run the process if it's a leaf, or (2) recursively
  * distribute the "won" CPU time among its competing children.
+ *
+ * Each CPU schedules from its own run queue, under its own lock, and
+ * its own copy of the tree.  A thread which wakes goes back on the
+ * queue of the CPU it last ran on.  A CPU with nothing of its own to
+ * run takes work from another's queue; this is the only time two run
+ * queues are locked at once, and the second is only tried for, never
+ * waited on, so there's no lock ordering to get wrong.
+ *
+ * No port yet starts more than one CPU, so the stealing, and the
+ * locking which makes it safe, have never run on more than one; how
+ * well any of this scales is unmeasured.
  */
 #include <sys/proc.h>
 #include <sys/thread.h>
@@ -19,16 +30,12 @@
 #include "../mach/mutex.h"
 #include "../mach/locore.h"
 
-extern ulong random();
 extern void nudge();
 
-lock_t runq_lock;		/* Mutex for scheduling */
-struct sched
-	sched_rt,		/* Real-time queue */
-	sched_cheated,		/* Low-CPU processes given preference */
-	sched_bg,		/* Background (lowest priority) queue */
-	sched_root;		/* "main" queue */
+struct runq runqs[MAXCPU];	/* Per-CPU run queues */
+struct sched sched_root[MAXCPU];	/* "main" queue, per CPU */
 uint num_run = 0;		/* # SRUN procs waiting */
+uint num_queued = 0;		/*  ...of those, # not on a CPU */
 
 /*
  * queue()
@@ -92,109 +99,293 @@ dequeue(struct sched *up, struct sched *s)
 
 /*
  * preempt()
- *	Go around the list of engines and find best one to preempt
+ *	Ask the CPU a run queue feeds to reschedule, if it's running
+ *	at less than the given priority
+ */
+inline static void
+preempt(struct runq *rq, uint pri)
+{
+	struct percpu *c = rq->rq_cpu;
+
+	if (c->pc_pri < pri) {
+		nudge(c);
+	}
+}
+
+/*
+ * BEFORE()
+ *	Tell if one node's pass comes before another's
+ *
+ * Passes are compared as a difference, so they may wrap.
+ */
+#define BEFORE(a, b) ((long)((a)->s_pass - (b)->s_pass) < 0)
+
+/*
+ * heap_set()
+ *	Put a node in a slot of its parent's heap
+ */
+inline static void
+heap_set(struct sched *up, uint idx, struct sched *s)
+{
+	up->s_heap[idx] = s;
+	s->s_heapidx = idx;
+}
+
+/*
+ * heap_up()
+ *	Move a node toward the top of its parent's heap, as far as it goes
  */
 static void
-preempt(void)
+heap_up(struct sched *up, struct sched *s)
 {
-	struct percpu *c, *lowest;
-	uint pri = 99;
+	uint idx = s->s_heapidx, pidx;
+	struct sched *s2;
 
-	c = nextcpu;
-	do {
-		if (c->pc_flags & CPU_UP) {
-			if (c->pc_pri < pri) {
-				lowest = c;
-				pri = c->pc_pri;
-			}
+	while (idx > 0) {
+		pidx = (idx - 1) / 2;
+		s2 = up->s_heap[pidx];
+		if (!BEFORE(s, s2)) {
+			break;
 		}
-		c = c->pc_next;
-	} while (c != nextcpu);
-	ASSERT_DEBUG(pri != 99, "preempt: no cpus");
-	nextcpu = c->pc_next;
-	nudge(c);
+		heap_set(up, idx, s2);
+		idx = pidx;
+	}
+	heap_set(up, idx, s);
+}
+
+/*
+ * heap_down()
+ *	Move a node toward the bottom of its parent's heap, as far as it goes
+ */
+static void
+heap_down(struct sched *up, struct sched *s)
+{
+	uint idx = s->s_heapidx, cidx, n = up->s_nheap;
+	struct sched *s2;
+
+	while ((cidx = idx * 2 + 1) < n) {
+		s2 = up->s_heap[cidx];
+		if ((cidx + 1 < n) && BEFORE(up->s_heap[cidx + 1], s2)) {
+			cidx += 1;
+			s2 = up->s_heap[cidx];
+		}
+		if (!BEFORE(s2, s)) {
+			break;
+		}
+		heap_set(up, idx, s2);
+		idx = cidx;
+	}
+	heap_set(up, idx, s);
+}
+
+/*
+ * heap_insert()
+ *	A child has become runnable; add it to its parent's heap
+ *
+ * While idle its s_pass held how far it was ahead of its parent's
+ * virtual time.  It comes back at most one stride ahead, so a node
+ * which ran just before it slept waits its turn, and never behind,
+ * so a node which slept a long time can't bank CPU time against
+ * the others.
+ */
+static void
+heap_insert(struct sched *up, struct sched *s)
+{
+	long lag = (long)s->s_pass;
+
+	if (lag < 0) {
+		lag = 0;
+	} else if (lag > STRIDE(s)) {
+		lag = STRIDE(s);
+	}
+	s->s_pass = up->s_vtime + lag;
+	ASSERT_DEBUG(up->s_nheap < up->s_heapmax, "heap_insert: full");
+	s->s_heapidx = up->s_nheap++;
+	heap_up(up, s);
+}
+
+/*
+ * heap_remove()
+ *	A child has nothing left to run; take it out of its parent's heap
+ */
+static void
+heap_remove(struct sched *up, struct sched *s)
+{
+	struct sched *last;
+	uint idx = s->s_heapidx;
+
+	ASSERT_DEBUG(up->s_heap[idx] == s, "heap_remove: lost");
+	last = up->s_heap[--(up->s_nheap)];
+	if (last != s) {
+		heap_set(up, idx, last);
+		heap_down(up, last);
+		if (last->s_heapidx == idx) {
+			heap_up(up, last);
+		}
+	}
+	s->s_pass -= up->s_vtime;
+}
+
+/*
+ * take_leaf()
+ *	Remove a leaf from the tree as its thread goes to run
+ *
+ * Each node from the leaf up is charged a stride, and the nrun counts
+ * are updated.  A node with nothing left to run leaves its parent's
+ * heap; the rest move down it to their new places.
+ */
+static void
+take_leaf(struct sched *s)
+{
+	struct sched *up;
+
+	for ( ; (up = s->s_up); s = up) {
+		s->s_pass += STRIDE(s);
+		if (--(s->s_nrun) == 0) {
+			heap_remove(up, s);
+		} else {
+			heap_down(up, s);
+		}
+	}
+	s->s_nrun -= 1;
 }
 
 /*
  * pick_run()
  *	Pick next runnable process from scheduling tree
  *
- * runq lock is assumed held by caller.
+ * At each level the child with the lowest pass wins.  runq lock is
+ * assumed held by caller.
  */
 inline static struct sched *
 pick_run(struct sched *root)
 {
-	struct sched *s = root, *s2;
+	struct sched *s = root, *pick;
 
 	/*
-	 * Walk our way down the tree
+	 * Walk our way down the tree, noting at each node how far
+	 * its virtual time has come
 	 */
-	for (;;) {
-		struct sched *pick;
-		uint sum, nrun;
-
-		/*
-		 * Scan children.  We do this in two passes (ick?).
-		 * In the first, we sum up all the pending priorities;
-		 * in the second, we pick out the lucky winner to be
-		 * run.
-		 */
-		nrun = sum = 0;
-		s2 = s;
-		do {
-			if (s2->s_nrun) {
-				pick = s2;
-				sum += s2->s_prio;
-				nrun += 1;
-			}
-			s2 = s2->s_hd;
-		} while (s2 != s);
-		ASSERT_DEBUG(nrun > 0, "pick_run: !nrun");
-
-		/*
-		 * If there was only one choice, run with it.  Otherwise,
-		 * roll the dice and pick one statistically.
-		 */
-		if (nrun > 1) {
-			sum = random() % sum;
-			s2 = s;
-			do {
-				if (s2->s_nrun) {
-					pick = s2;
-					if (s2->s_prio >= sum) {
-						break;
-					}
-					sum -= s2->s_prio;
-				}
-				s2 = s2->s_hd;
-			} while (s2 != s);
-		}
-		ASSERT_DEBUG(pick, "pick_run: !pick");
-
-		/*
-		 * Advance down tree to this node.  Done when we find
-		 * a leaf node to run.
-		 */
-		if (pick->s_leaf) {
-			s = pick;
-			break;
-		} else {
-			s = pick->s_down;
-		}
+	while (!s->s_leaf) {
+		ASSERT_DEBUG(s->s_nheap > 0, "pick_run: !nrun");
+		pick = s->s_heap[0];
+		s->s_vtime = pick->s_pass;
+		s = pick;
 	}
 
 	/*
 	 * We have made our choice.  Remove from tree and update
 	 * nrun counts.
 	 */
-	ASSERT_DEBUG(s->s_leaf, "pick_run: !leaf");
-	dequeue(s->s_up, s);
-	for (s2 = s; s2; s2 = s2->s_up) {
-		s2->s_nrun -= 1;
+	take_leaf(s);
+	return(s);
+}
+
+/*
+ * pick_queue()
+ *	Take the best thread waiting on a run queue
+ *
+ * Returns its node, with *prip set to the priority it will run at,
+ * or 0 if nothing's waiting.  The run queue is locked by the caller.
+ */
+static struct sched *
+pick_queue(struct runq *rq, uint *prip)
+{
+	struct sched *s;
+
+	if (rq->rq_rt.s_down) {
+		s = rq->rq_rt.s_down;
+		dequeue(&rq->rq_rt, s);
+		*prip = PRI_RT;
+		ASSERT_DEBUG(s->s_leaf, "pick_queue: rt not leaf");
+	} else if (rq->rq_cheated.s_down) {
+		s = rq->rq_cheated.s_down;
+		dequeue(&rq->rq_cheated, s);
+		*prip = PRI_CHEATED;
+	} else if (rq->rq_root->s_nrun > 0) {
+		s = pick_run(rq->rq_root);
+		*prip = PRI_TIMESHARE;
+	} else if (rq->rq_bg.s_down) {
+		s = rq->rq_bg.s_down;
+		dequeue(&rq->rq_bg, s);
+		*prip = PRI_BG;
+		ASSERT_DEBUG(s->s_leaf, "pick_queue: bg not leaf");
+	} else {
+		return(0);
 	}
+	rq->rq_nrun -= 1;
+	ATOMIC_DEC(&num_queued);
 	return(s);
 }
 
+/*
+ * steal()
+ *	Take a thread waiting on some other CPU's run queue
+ *
+ * Our own run queue is locked.  The thread is moved over to it
+ * before the other is released.  Returns its node, or 0.
+ */
+static struct sched *
+steal(struct runq *rq, uint *prip)
+{
+	struct percpu *c;
+	struct runq *rq2;
+	struct sched *s;
+
+	for (c = cpu.pc_next; c != &cpu; c = c->pc_next) {
+		rq2 = c->pc_runq;
+		if ((rq2 == 0) || (rq2->rq_nrun == 0)) {
+			continue;
+		}
+		if (cp_lock(&rq2->rq_lock, SPLHI) == -1) {
+			continue;
+		}
+		s = pick_queue(rq2, prip);
+		if (s) {
+			s->s_thread->t_eng = &cpu;
+			rq->rq_steals += 1;
+		}
+		v_lock(&rq2->rq_lock, SPLHI_SAME);
+		if (s) {
+			return(s);
+		}
+	}
+	return(0);
+}
+
+/*
+ * unqueue_run()
+ *	Take a runnable thread back off the queue lsetrun() put it on
+ *
+ * lsetrun()'s choice of queue rests only on things which don't change
+ * while a thread waits to run, so we can simply make it again.
+ * Returns the priority the thread would have been picked at.
+ * The thread's run queue is assumed locked by caller.
+ */
+static uint
+unqueue_run(struct thread *t)
+{
+	struct runq *rq = RUNQ(t);
+	struct sched *s = t->t_runq;
+
+	rq->rq_nrun -= 1;
+	ATOMIC_DEC(&num_queued);
+	if (t->t_flags & T_RT) {
+		dequeue(&rq->rq_rt, s);
+		return(PRI_RT);
+	}
+	if (t->t_flags & T_BG) {
+		dequeue(&rq->rq_bg, s);
+		return(PRI_BG);
+	}
+	if ((t->t_runticks > CHEAT_TICKS) && (!t->t_oink)) {
+		dequeue(&rq->rq_cheated, s);
+		return(PRI_CHEATED);
+	}
+	take_leaf(s);
+	return(PRI_TIMESHARE);
+}
+
 /*
  * savestate()
  *	Dump off our state
@@ -228,14 +419,15 @@ savestate(struct thread *t)
  * However, the variables themselves are still accessed.  The idle stack
  * is constructed with some room to make this possible.
  *
- * swtch() is called with runq_lock held.
+ * swtch() is called with this CPU's run queue locked.
  */
 void
 swtch(void)
 {
 	struct sched *s;
-	uint pri;
-	struct thread *t = curthread;
+	uint pri, ticks = 0;
+	struct thread *t = curthread, *t2;
+	struct runq *rq;
 
 	/*
 	 * Now that we're going to reschedule, clear any pending preempt
@@ -249,29 +441,38 @@ swtch(void)
 	do_preempt = 0;
 
 	for (;;) {
+		rq = cpu.pc_runq;
+
 		/*
-		 * See if we can find something to run
+		 * If we're going to sleep having woken a thread to
+		 * work for us, and it's still waiting for a CPU, it
+		 * gets ours--and the rest of our quanta with it.
+		 * Real-time work still comes first.  The hint is
+		 * only good for a sleep; if we're just being
+		 * preempted, it's dropped.  It's also dropped if
+		 * the thread has since moved to another run queue.
 		 */
-		if (sched_rt.s_down) {
-			s = sched_rt.s_down;
-			dequeue(&sched_rt, s);
-			pri = PRI_RT;
-			ASSERT_DEBUG(s->s_leaf, "swtch: rt not leaf");
-			break;
-		} else if (sched_cheated.s_down) {
-			s = sched_cheated.s_down;
-			dequeue(&sched_cheated, s);
-			pri = PRI_CHEATED;
-			break;
-		} else if (sched_root.s_nrun > 0) {
-			s = pick_run(&sched_root);
-			pri = PRI_TIMESHARE;
+		if ((t2 = cpu.pc_handoff)) {
+			cpu.pc_handoff = 0;
+			if (t && (t->t_state == TS_SLEEP) &&
+					(t2->t_state == TS_RUN) &&
+					(RUNQ(t2) == rq) &&
+					(!rq->rq_rt.s_down || (t2->t_flags & T_RT))) {
+				pri = unqueue_run(t2);
+				s = t2->t_runq;
+				ticks = t->t_runticks;
+				break;
+			}
+		}
+
+		/*
+		 * See if we can find something to run, first here
+		 * and then from any other CPU
+		 */
+		if ((s = pick_queue(rq, &pri))) {
 			break;
-		} else if (sched_bg.s_down) {
-			s = sched_bg.s_down;
-			dequeue(&sched_bg, s);
-			pri = PRI_BG;
-			ASSERT_DEBUG(s->s_leaf, "swtch: bg not leaf");
+		}
+		if (num_queued && (s = steal(rq, &pri))) {
 			break;
 		}
 
@@ -293,9 +494,10 @@ swtch(void)
 		 */
 		idle_stack();
 		t = curthread = 0;
-		v_lock(&runq_lock, SPL0);
+		cpu.pc_pri = PRI_IDLE;
+		v_lock(&cpu.pc_runq->rq_lock, SPL0);
 		idle();
-		p_lock_void(&runq_lock, SPLHI);
+		p_lock_void(&cpu.pc_runq->rq_lock, SPLHI);
 	}
 
 	/*
@@ -306,7 +508,8 @@ swtch(void)
 			t->t_runticks = RUN_TICKS;
 		}
 		curthread->t_state = TS_ONPROC;
-		v_lock(&runq_lock, SPL0);
+		cpu.pc_pri = pri;
+		v_lock(&rq->rq_lock, SPL0);
 		return;
 	}
 
@@ -326,7 +529,9 @@ swtch(void)
 	 */
 	cpu.pc_pri = pri;
 	t = curthread = s->s_thread;
-	if (pri != PRI_CHEATED) {
+	if (ticks) {
+		t->t_runticks = ticks;
+	} else if (pri != PRI_CHEATED) {
 		t->t_runticks = RUN_TICKS;
 	}
 
@@ -335,43 +540,48 @@ swtch(void)
 	 */
 	t->t_state = TS_ONPROC;
 	t->t_eng = &cpu;
+	cpu.pc_runq->rq_switches += 1;
 
 	/*
 	 * Prepare to switch to new context.  Move to idle stack and
-	 * release runq lock, but keep interrupts disabled until resume()
-	 * is ready to go on the target thread stack
+	 * release run queue lock, but keep interrupts disabled until
+	 * resume() is ready to go on the target thread stack
 	 */
 	idle_stack();
-	v_lock(&runq_lock, SPLHI_SAME);
+	v_lock(&cpu.pc_runq->rq_lock, SPLHI_SAME);
 	resume();
 	ASSERT_DEBUG(0, "swtch: back from resume");
 }
 
 /*
  * lsetrun()
- *	Version of setrun() where runq lock already held
+ *	Version of setrun() where the thread's run queue is already locked
  */
 void
 lsetrun(struct thread *t)
 {
-	struct sched *s = t->t_runq;
+	struct runq *rq = RUNQ(t);
+	struct sched *s = t->t_runq, *sup;
 
 	ASSERT_DEBUG(t->t_wchan == 0, "lsetrun: wchan");
+	ASSERT_DEBUG(rq->rq_lock.l_lock, "lsetrun: runq not locked");
 	t->t_state = TS_RUN;
 	ATOMIC_INC(&num_run);
+	rq->rq_nrun += 1;
+	ATOMIC_INC(&num_queued);
 	if (t->t_flags & T_RT) {
 
 		/*
 		 * If thread is real-time, queue to FIFO run queue
 		 */
-		queue(&sched_rt, s);
-		preempt();
+		queue(&rq->rq_rt, s);
+		preempt(rq, PRI_RT);
 	} else if (t->t_flags & T_BG) {
 
 		/*
 		 * Similarly for background
 		 */
-		queue(&sched_bg, s);
+		queue(&rq->rq_bg, s);
 	} else if ((t->t_runticks > CHEAT_TICKS) && (!t->t_oink)) {
 
 		/*
@@ -379,24 +589,24 @@ lsetrun(struct thread *t)
 		 * CPU quanta queues preferentially.  Preempt
 		 * if the current guy's lower than this.
 		 */
-		queue(&sched_cheated, s);
-		if (cpu.pc_pri < PRI_CHEATED) {
-			preempt();
-		}
+		queue(&rq->rq_cheated, s);
+		preempt(rq, PRI_CHEATED);
 	} else {
 
 		/*
-		 * Insert our node into the FIFO circular list
+		 * Our node goes under our process' node for this run
+		 * queue's tree.  Bump the nrun count on each node up
+		 * the tree; those which had nothing to run before now
+		 * join their parent's heap.
 		 */
 		ASSERT_DEBUG(s->s_leaf, "lsetrun: !leaf");
-		queue(s->s_up, s);
-
-		/*
-		 * Bump the nrun count on each node up the tree
-		 */
-		for ( ; s; s = s->s_up) {
-			s->s_nrun += 1;
+		s->s_up = t->t_proc->p_runq + (rq - runqs);
+		for ( ; (sup = s->s_up); s = sup) {
+			if ((s->s_nrun)++ == 0) {
+				heap_insert(sup, s);
+			}
 		}
+		s->s_nrun += 1;
 
 		/*
 		 * XXX we don't have classic UNIX priorities, but would it be
@@ -406,6 +616,40 @@ lsetrun(struct thread *t)
 	}
 }
 
+/*
+ * lock_runq()
+ *	Lock the run queue of a thread
+ *
+ * The thread may move while we wait for the lock, in which case we
+ * try again with its new one.  Returns the previous spl; interrupts
+ * are left disabled.
+ */
+spl_t
+lock_runq(struct thread *t)
+{
+	struct runq *rq;
+	spl_t s;
+
+	for (;;) {
+		rq = RUNQ(t);
+		s = p_lock(&rq->rq_lock, SPLHI);
+		if (rq == RUNQ(t)) {
+			return(s);
+		}
+		v_lock(&rq->rq_lock, s);
+	}
+}
+
+/*
+ * unlock_runq()
+ *	Release a thread's run queue
+ */
+void
+unlock_runq(struct thread *t, spl_t s)
+{
+	v_lock(&RUNQ(t)->rq_lock, s);
+}
+
 /*
  * setrun()
  *	Make a thread runnable
@@ -420,9 +664,30 @@ setrun(struct thread *t)
 {
 	spl_t s;
 
-	s = p_lock(&runq_lock, SPLHI);
+	s = lock_runq(t);
 	lsetrun(t);
-	v_lock(&runq_lock, s);
+	unlock_runq(t, s);
+}
+
+/*
+ * cancel_handoff()
+ *	Forget any CPU handoff to a thread which is going away
+ */
+void
+cancel_handoff(struct thread *t)
+{
+	struct percpu *c;
+	spl_t s;
+
+	c = nextcpu;
+	do {
+		s = p_lock(&c->pc_runq->rq_lock, SPLHI);
+		if (c->pc_handoff == t) {
+			c->pc_handoff = 0;
+		}
+		v_lock(&c->pc_runq->rq_lock, s);
+		c = c->pc_next;
+	} while (c != nextcpu);
 }
 
 /*
@@ -437,7 +702,7 @@ timeslice(void)
 	/*
 	 * Nest interrupt handling; hold run queue and disable interrupts
 	 */
-	s = p_lock(&runq_lock, SPLHI);
+	s = p_lock(&cpu.pc_runq->rq_lock, SPLHI);
 
 	/*
 	 * We're off the CPU
@@ -499,32 +764,112 @@ init_sched2(struct sched *s)
 	s->s_leaf = 0;
 	s->s_prio = PRIO_DEFAULT;
 	s->s_nrun = 0;
+	s->s_pass = s->s_vtime = 0;
+	s->s_heap = 0;
+	s->s_nheap = s->s_heapmax = s->s_nkids = 0;
 }
 
 /*
  * init_sched()
  *	One-time setup for scheduler
+ *
+ * Each CPU up by now gets a run queue.
  */
 void
 init_sched(void)
 {
+	struct percpu *c;
+	struct runq *rq;
+	int x;
+
 	/*
-	 * Init the runq lock.
+	 * Set up the run queues
 	 */
-	init_lock(&runq_lock);
+	for (x = 0; x < MAXCPU; ++x) {
+		rq = &runqs[x];
+		init_lock(&rq->rq_lock);
+		init_sched2(&rq->rq_rt);
+		init_sched2(&rq->rq_cheated);
+		init_sched2(&rq->rq_bg);
+		init_sched2(&sched_root[x]);
+		rq->rq_root = &sched_root[x];
+	}
 
 	/*
-	 * Set up the scheduling queues
+	 * And hook them to their CPUs
 	 */
-	init_sched2(&sched_rt);
-	init_sched2(&sched_bg);
-	init_sched2(&sched_root);
-	init_sched2(&sched_cheated);
+	c = nextcpu;
+	do {
+		ASSERT(c->pc_num < MAXCPU, "init_sched: too many CPUs");
+		rq = &runqs[c->pc_num];
+		rq->rq_cpu = c;
+		c->pc_runq = rq;
+		c = c->pc_next;
+	} while (c != nextcpu);
+}
+
+/*
+ * add_kid()
+ *	Note one more child under each CPU's copy of an internal node
+ *
+ * Each copy's heap must have room for every child which might become
+ * runnable under it.  It's grown here, where we may still sleep,
+ * rather than when the child is queued.
+ */
+static void
+add_kid(struct sched *parent)
+{
+	struct sched *s, **h, **oh;
+	uint x, n;
+
+	for (x = 0; x < ncpu; ++x) {
+		s = &parent[x];
+		h = oh = 0;
+		p_lock_void(&runqs[x].rq_lock, SPLHI);
+		while (s->s_nkids >= s->s_heapmax) {
+			/*
+			 * If the heap we got while unlocked is still
+			 * bigger, switch to it
+			 */
+			if (h && (n > s->s_heapmax)) {
+				bcopy(s->s_heap, h,
+					s->s_nheap * sizeof(struct sched *));
+				oh = s->s_heap;
+				s->s_heap = h;
+				s->s_heapmax = n;
+				h = 0;
+				continue;
+			}
+
+			/*
+			 * Get a bigger one
+			 */
+			n = s->s_heapmax ? (s->s_heapmax * 2) : 8;
+			v_lock(&runqs[x].rq_lock, SPL0);
+			if (h) {
+				FREE(h, MT_SCHED);
+			}
+			h = MALLOC(n * sizeof(struct sched *), MT_SCHED);
+			p_lock_void(&runqs[x].rq_lock, SPLHI);
+		}
+		s->s_nkids += 1;
+		v_lock(&runqs[x].rq_lock, SPL0);
+
+		if (h) {
+			FREE(h, MT_SCHED);
+		}
+		if (oh) {
+			FREE(oh, MT_SCHED);
+		}
+	}
 }
 
 /*
  * sched_thread()
  *	Create a new sched node for a thread
+ *
+ * The leaf's s_up is set to the right copy of its parent each
+ * time it's queued.
  */
 struct sched *
 sched_thread(struct sched *parent, struct thread *t)
@@ -532,14 +877,16 @@ sched_thread(struct sched *parent, struct thread *t)
 	struct sched *s;
 
 	s = MALLOC(sizeof(struct sched), MT_SCHED);
-	p_lock_void(&runq_lock, SPLHI);
+	add_kid(parent);
+	p_lock_void(&runqs[0].rq_lock, SPLHI);
 	s->s_up = parent;
 	s->s_thread = t;
 	s->s_prio = PRIO_DEFAULT;
 	s->s_leaf = 1;
 	s->s_nrun = 0;
+	s->s_pass = 0;
 	parent->s_refs += 1;
-	v_lock(&runq_lock, SPL0);
+	v_lock(&runqs[0].rq_lock, SPL0);
 	return(s);
 }
 
@@ -547,25 +894,33 @@ sched_thread(struct sched *parent, struct thread *t)
  * sched_node()
  *	Add a new internal node to the tree
  *
- * Inserts the internal node into the static tree structure; adds
- * a reference to the parent node.
+ * Adds a reference to the parent node, and makes room for the new
+ * node in its heaps.  One copy is made per CPU, each in that CPU's
+ * tree.
  */
 struct sched *
 sched_node(struct sched *parent)
 {
-	struct sched *s;
+	struct sched *s, *s2;
+	int x;
 
-	s = MALLOC(sizeof(struct sched), MT_SCHED);
-	p_lock_void(&runq_lock, SPLHI);
-	s->s_up = parent;
-	s->s_down = 0;
-	s->s_prio = PRIO_DEFAULT;
-	s->s_leaf = 0;
-	s->s_nrun = 0;
-	s->s_refs = 0;
-	queue(parent, s);
-	parent->s_refs += 1;
-	v_lock(&runq_lock, SPL0);
+	s = MALLOC(ncpu * sizeof(struct sched), MT_SCHED);
+	add_kid(parent);
+	for (x = 0; x < ncpu; ++x) {
+		s2 = &s[x];
+		p_lock_void(&runqs[x].rq_lock, SPLHI);
+		s2->s_up = &parent[x];
+		s2->s_down = 0;
+		s2->s_prio = PRIO_DEFAULT;
+		s2->s_leaf = 0;
+		s2->s_nrun = 0;
+		s2->s_refs = 0;
+		s2->s_pass = s2->s_vtime = 0;
+		s2->s_heap = 0;
+		s2->s_nheap = s2->s_heapmax = s2->s_nkids = 0;
+		parent[x].s_refs += 1;
+		v_lock(&runqs[x].rq_lock, SPL0);
+	}
 	return(s);
 }
 
@@ -576,23 +931,42 @@ sched_node(struct sched *parent)
 void
 free_sched_node(struct sched *s)
 {
-	p_lock_void(&runq_lock, SPLHI);
-
-	/*
-	 * De-ref parent
-	 */
-	s->s_up->s_refs -= 1;
+	struct sched *s2, *up;
+	int x;
 
-	/*
-	 * If not a leaf, this node is linked under the parent.  Remove
-	 * it.
-	 */
-	if (s->s_leaf == 0) {
-		dequeue(s->s_up, s);
+	if (s->s_leaf) {
+		/*
+		 * De-ref parent; a leaf isn't linked under it
+		 * once its thread is on its way out.
+		 */
+		up = s->s_thread->t_proc->p_runq;
+		for (x = 0; x < ncpu; ++x) {
+			p_lock_void(&runqs[x].rq_lock, SPLHI);
+			if (x == 0) {
+				up->s_refs -= 1;
+			}
+			up[x].s_nkids -= 1;
+			v_lock(&runqs[x].rq_lock, SPL0);
+		}
+	} else {
+		/*
+		 * Internal nodes have nothing runnable below them
+		 * by now, so aren't in any heap.  Drop each copy's
+		 * place under its parent, and its own heap.
+		 */
+		for (x = 0; x < ncpu; ++x) {
+			s2 = &s[x];
+			p_lock_void(&runqs[x].rq_lock, SPLHI);
+			ASSERT_DEBUG(s2->s_nrun == 0, "free_sched_node: nrun");
+			s2->s_up->s_refs -= 1;
+			s2->s_up->s_nkids -= 1;
+			v_lock(&runqs[x].rq_lock, SPL0);
+			if (s2->s_heap) {
+				FREE(s2->s_heap, MT_SCHED);
+			}
+		}
 	}
 
-	v_lock(&runq_lock, SPL0);
-
 	/*
 	 * Free the node
 	 */
@@ -617,7 +991,7 @@ sched_prichg(uint new_pri)
 		return(-1);
 	}
 
-	s = p_lock(&runq_lock, SPLHI);
+	s = p_lock(&cpu.pc_runq->rq_lock, SPLHI);
 
 	t->t_flags &= ~T_BG;
 	t->t_flags &= ~T_RT;
@@ -635,7 +1009,7 @@ sched_prichg(uint new_pri)
 	}
 
 	cpu.pc_pri = new_pri;
-	v_lock(&runq_lock, s);
+	v_lock(&cpu.pc_runq->rq_lock, s);
 	return(0);
 }
 
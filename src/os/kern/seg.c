@@ -167,6 +167,37 @@ detach_seg(struct seg *s)
 	detach_pview(pv->p_vas, pv->p_vaddr);
 }
 
+/*
+ * share_seg()
+ *	Map a segment of shared memory into a vas, writable, for keeps
+ *
+ * This is how a reply to FS_SHMAP arrives.  The new view is the
+ * client's until it munmap()'s it or exits, and holds its own
+ * reference on the pset, so the segment may be freed as usual.
+ * Only memory its owner has marked shared may be given out this
+ * way.  Returns the address of the segment's first byte, or 0.
+ */
+void *
+share_seg(struct vas *vas, struct seg *s)
+{
+	struct pset *ps = s->s_pview.p_set;
+	struct pview *pv;
+
+	if (!(ps->p_flags & PF_SHARED)) {
+		return(0);
+	}
+	pv = alloc_pview(ps);
+	pv->p_off = s->s_pview.p_off;
+	pv->p_len = s->s_pview.p_len;
+	pv->p_prot = PROT_MMAP;
+	pv->p_vaddr = 0;
+	if (attach_pview(vas, pv) == 0) {
+		free_pview(pv);
+		return(0);
+	}
+	return((char *)pv->p_vaddr + s->s_off);
+}
+
 /*
  * kern_mem()
  *	Create a segment which views a range of kernel memory
@@ -218,17 +249,17 @@ kern_mem(void *vaddr, uint len)
  *	Copy out segments to user address space
  *
  * Copies out to the greater of what's in the sysmsg and what's
- * specified by the user message.  Returns number of bytes actually
- * copied, or -1 on error.
+ * specified by the user message, or its M_SGL list.  Returns number
+ * of bytes actually copied, or -1 on error.
  */
 copyoutsegs(struct sysmsg *sm)
 {
 	uint cnt, total = 0;
 	struct msg *m = &sm->sm_msg;
 	int nsm_segs = sm->sm_nseg, nm_segs = m->m_nseg;
-	struct seg **sm_pp = &(sm->sm_seg[0]),
+	struct seg **sm_pp = SM_SEGV(sm),
 		*sm_segs = *sm_pp++;
-	seg_t *m_segs = m->m_seg;
+	seg_t *m_segs = sm->sm_sgl ? sm->sm_sgl : m->m_seg;
 
 	do {
 		/*
@@ -0,0 +1,242 @@
+/*
+ * umutex.c
+ *	Sleeping and waking on a user address, for user-level mutexes
+ *
+ * User locks and semaphores keep their state in memory of their own,
+ * and take and release it there without help while nobody contends.
+ * When a thread must wait, it calls mutex_wait() with the address of
+ * a word and the value it last saw there; it sleeps unless the word
+ * has changed.  Whoever changes the word then calls mutex_wake() to
+ * rouse sleepers.
+ *
+ * An address is known by the pset under it and the offset within,
+ * so threads in different processes sharing the memory sleep and
+ * wake on the same thing.  Each address with sleepers has a waitaddr
+ * holding a semaphore for them, kept on a hash chain only for as long
+ * as someone's sleeping.  A sequence number per chain, bumped by each
+ * wake, closes the window between checking the word and going to
+ * sleep.
+ */
+#include <sys/types.h>
+#include <sys/vas.h>
+#include <sys/pview.h>
+#include <sys/pset.h>
+#include <sys/percpu.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
+#include <sys/fs.h>
+#include <sys/malloc.h>
+#include <sys/assert.h>
+#include "../mach/mutex.h"
+#include "pset.h"
+
+#define NWAITHASH (32)		/* # hash chains; a power of two */
+#define WAITHASH(ps, off) \
+	((((ulong)(ps) >> 4) ^ ((off) >> 2)) & (NWAITHASH-1))
+
+struct waitaddr {
+	struct waitaddr *w_next;	/* Hash chain */
+	struct pset *w_pset;	/* Address is this pset... */
+	ulong w_off;		/*  ...at this byte offset */
+	sema_t w_sema;		/* Sleepers */
+	uint w_nwait;		/* # threads using this */
+};
+
+static struct waitbucket {
+	lock_t b_lock;		/* Spinlock for this chain */
+	ulong b_seq;		/* Bumped on each wake */
+	struct waitaddr *b_list;
+} waithash[NWAITHASH];
+
+/*
+ * find_addr()
+ *	Get pset and offset for a user address
+ *
+ * Returns the pset, or 0 if nothing's mapped there.  No reference is
+ * taken; the caller must do so if it needs the pset to stay around.
+ */
+static struct pset *
+find_addr(void *vaddr, ulong *offp)
+{
+	struct pview *pv;
+	struct pset *ps;
+
+	pv = find_pview(&curthread->t_proc->p_vas, vaddr);
+	if (pv == 0) {
+		return(0);
+	}
+	ps = pv->p_set;
+	*offp = ptob(pv->p_off) + ((char *)vaddr - (char *)pv->p_vaddr);
+	return(ps);
+}
+
+/*
+ * find_wait()
+ *	Look up the waitaddr for an address, with its chain locked
+ */
+static struct waitaddr *
+find_wait(struct waitbucket *b, struct pset *ps, ulong off)
+{
+	struct waitaddr *w;
+
+	for (w = b->b_list; w; w = w->w_next) {
+		if ((w->w_pset == ps) && (w->w_off == off)) {
+			break;
+		}
+	}
+	return(w);
+}
+
+/*
+ * mutex_wait()
+ *	Sleep on an address, if it still holds the given value
+ *
+ * Returns 0 on being woken, or at once if the value differs.  A
+ * thread may also be woken for no reason it can see, so callers
+ * always look at their word again.
+ */
+int
+mutex_wait(void *vaddr, int val)
+{
+	struct pset *ps;
+	struct waitbucket *b;
+	struct waitaddr *w, *nw, **wp;
+	ulong off, seq;
+	int cur, intr;
+
+	if ((ulong)vaddr & (sizeof(int)-1)) {
+		return(err(EINVAL));
+	}
+	ps = find_addr(vaddr, &off);
+	if (ps == 0) {
+		return(err(EFAULT));
+	}
+	ref_pset(ps);
+	v_lock(&ps->p_lock, SPL0_SAME);
+	b = &waithash[WAITHASH(ps, off)];
+
+	/*
+	 * Note where the chain stands, then look at the word.  If a
+	 * wake comes along after we've looked, the sequence number
+	 * will tell us.
+	 */
+	p_lock_void(&b->b_lock, SPL0);
+	seq = b->b_seq;
+	v_lock(&b->b_lock, SPL0_SAME);
+	if (copyin(vaddr, &cur, sizeof(cur))) {
+		deref_pset(ps);
+		return(err(EFAULT));
+	}
+	if (cur != val) {
+		deref_pset(ps);
+		return(0);
+	}
+
+	/*
+	 * Find or create the waitaddr.  We can't allocate under the
+	 * spinlock, so on a miss get one and look again.
+	 */
+	nw = 0;
+	for (;;) {
+		p_lock_void(&b->b_lock, SPL0);
+		if (b->b_seq != seq) {
+			v_lock(&b->b_lock, SPL0_SAME);
+			if (nw) {
+				FREE(nw, MT_WAITADDR);
+			}
+			deref_pset(ps);
+			return(0);
+		}
+		w = find_wait(b, ps, off);
+		if (w || nw) {
+			break;
+		}
+		v_lock(&b->b_lock, SPL0_SAME);
+		nw = MALLOC(sizeof(struct waitaddr), MT_WAITADDR);
+		nw->w_pset = ps;
+		nw->w_off = off;
+		init_sema(&nw->w_sema);
+		set_sema(&nw->w_sema, 0);
+		nw->w_nwait = 0;
+	}
+	if (w == 0) {
+		w = nw;
+		w->w_next = b->b_list;
+		b->b_list = w;
+		nw = 0;
+	}
+	w->w_nwait += 1;
+
+	/*
+	 * Sleep until woken
+	 */
+	intr = p_sema_v_lock(&w->w_sema, PRICATCH, &b->b_lock);
+
+	/*
+	 * Off the waitaddr, and free it when we're the last
+	 */
+	p_lock_void(&b->b_lock, SPL0);
+	w->w_nwait -= 1;
+	if (w->w_nwait == 0) {
+		for (wp = &b->b_list; *wp != w; wp = &(*wp)->w_next) {
+			ASSERT_DEBUG(*wp, "mutex_wait: lost waitaddr");
+		}
+		*wp = w->w_next;
+	} else {
+		w = 0;
+	}
+	v_lock(&b->b_lock, SPL0_SAME);
+	if (w) {
+		FREE(w, MT_WAITADDR);
+	}
+	if (nw) {
+		FREE(nw, MT_WAITADDR);
+	}
+	deref_pset(ps);
+	if (intr) {
+		return(err(EINTR));
+	}
+	return(0);
+}
+
+/*
+ * mutex_wake()
+ *	Wake up to "count" threads sleeping on an address
+ *
+ * Returns the number woken.
+ */
+int
+mutex_wake(void *vaddr, int count)
+{
+	struct pset *ps;
+	struct waitbucket *b;
+	struct waitaddr *w;
+	ulong off;
+	int x;
+
+	if ((ulong)vaddr & (sizeof(int)-1)) {
+		return(err(EINVAL));
+	}
+	ps = find_addr(vaddr, &off);
+	if (ps == 0) {
+		return(err(EFAULT));
+	}
+	v_lock(&ps->p_lock, SPL0_SAME);
+
+	/*
+	 * Sleepers hold a reference on the pset, so if there are any,
+	 * "ps" can't have been freed and reused for another.
+	 */
+	b = &waithash[WAITHASH(ps, off)];
+	p_lock_void(&b->b_lock, SPL0);
+	b->b_seq += 1;
+	x = 0;
+	if ((w = find_wait(b, ps, off))) {
+		while ((x < count) && blocked_sema(&w->w_sema)) {
+			v_sema(&w->w_sema);
+			x += 1;
+		}
+	}
+	v_lock(&b->b_lock, SPL0_SAME);
+	return(x);
+}
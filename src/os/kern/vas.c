@@ -258,6 +258,91 @@ alloc_zfod(struct vas *vas, uint pages, uint prot)
 	return(vaddr);
 }
 
+/*
+ * fork_cow()
+ *	Share the anonymous memory under a view copy-on-write
+ *
+ * The pset under our view "opv" becomes the master of two new COW
+ * psets, one for us and one for the child's view, which is returned.
+ * Nothing writes the master after this; each side gets its own copy
+ * of a page only when it first writes it.  Our translations into the
+ * master are torn down so our next touch of each page faults on the
+ * COW set.  "pv2" is the copy of "opv" fork_vas() took.
+ *
+ * The caller must be the only thread in its process, so nobody can
+ * fault on the view, or remove it, while it changes sets.  Returns 0
+ * if the view isn't suitable, or there's no swap for the new sets;
+ * the view must then be copied.
+ */
+static struct pview *
+fork_cow(struct vas *ovas, struct pview *opv, struct pview *pv2)
+{
+	struct pset *ps = pv2->p_set, *ps1, *ps2;
+	struct pview *pv;
+	struct perpage *pp;
+	uint x, idx;
+	char *va;
+
+	/*
+	 * Only plain zero-fill memory, seen through this view alone
+	 * (it and fork_vas() hold the only references), and which
+	 * may be paged
+	 */
+	if ((ps->p_type != PT_ZERO) || (ps->p_refs != 2) ||
+			ps->p_cowsets || (ovas->v_flags & VF_MEMLOCK)) {
+		return(0);
+	}
+
+	/*
+	 * Get the two COW sets
+	 */
+	if ((ps1 = alloc_pset_cow(ps, 0, ps->p_len)) == 0) {
+		return(0);
+	}
+	ref_pset(ps1);
+	if ((ps2 = alloc_pset_cow(ps, 0, ps->p_len)) == 0) {
+		deref_pset(ps1);
+		return(0);
+	}
+
+	/*
+	 * Tear down our translations, as in detach_pview().  Pages
+	 * left with only their initial contents are freed; written
+	 * ones are kept under cache references.
+	 */
+	p_lock_void(&ps->p_lock, SPL0);
+	for (x = 0; x < opv->p_len; ++x) {
+		if (!opv->p_valid[x]) {
+			continue;
+		}
+		idx = opv->p_off + x;
+		pp = find_pp(ps, idx);
+		lock_slot(ps, pp);
+		ASSERT(delete_atl(pp, opv, x) == 0,
+			"fork_cow: p_valid but not ATL");
+		va = (char *)opv->p_vaddr + ptob(x);
+		hat_deletetrans(opv, va, pp->pp_pfn);
+		pp->pp_flags |= hat_getbits(opv, va);
+		opv->p_valid[x] = 0;
+		deref_slot(ps, pp, idx);
+		unlock_slot(ps, pp);
+		p_lock_void(&ps->p_lock, SPL0_SAME);
+	}
+	v_lock(&ps->p_lock, SPL0_SAME);
+
+	/*
+	 * Move our view onto its COW set, and build the child's
+	 * view on the other
+	 */
+	opv->p_set = ps1;
+	deref_pset(ps);
+	pv = dup_pview(pv2);
+	deref_pset(ps);
+	pv->p_set = ps2;
+	ref_pset(ps2);
+	return(pv);
+}
+
 /*
  * fork_vas()
  *	Create new vas for thread given existing one
@@ -266,9 +351,21 @@ alloc_zfod(struct vas *vas, uint pages, uint prot)
  * psets which are PF_SHARED.  Others are copied.  This is odious
  * enough for in-core dirty pages, but we must also bring in
  * pages on swap in order to make a copy.
+ *
+ * So where the caller is the only thread in its process ("alone"),
+ * zero-fill memory is shared copy-on-write instead (fork_cow()),
+ * and a page is only copied by whichever side first writes it.  The
+ * COW set our view is left on can't itself be the master of another,
+ * so a later fork() copies the pages we've written since; the rest
+ * are still shared.
+ *
+ * No translations are added for the new views; the child maps each
+ * page when it first touches it.  A child which goes on to exec()
+ * touches few, so this is most of the page table work saved.  See
+ * also vfork(), which avoids the copy too.
  */
 void
-fork_vas(struct vas *ovas, struct vas *vas)
+fork_vas(struct vas *ovas, struct vas *vas, int alone)
 {
 	char *vaddr = 0;
 	struct pview *closest;
@@ -338,12 +435,14 @@ fork_vas(struct vas *ovas, struct vas *vas)
 		v_lock(&ovas->v_lock, SPL0_SAME);
 
 		/*
-		 * If read-only or shared, dup the view
+		 * If read-only or shared, dup the view.  Otherwise
+		 * share it copy-on-write if we can, else copy it.
 		 */
 		if ((pv2.p_prot & PROT_RO) ||
 				(ps->p_flags & PF_SHARED)) {
 			pv = dup_pview(&pv2);
-		} else {
+		} else if (!alone ||
+				((pv = fork_cow(ovas, closest, &pv2)) == 0)) {
 			pv = copy_pview(&pv2);
 		}
 
@@ -352,12 +451,7 @@ fork_vas(struct vas *ovas, struct vas *vas)
 		 */
 		pv->p_prot |= PROT_FORK;
 		(void)attach_pview(vas, pv);
-		pv->p_prot &= ~PROT_FORK;
-
-		/*
-		 * Connect to all the valid pages under the view
-		 */
-		attach_valid_slots(pv);
+		pv->p_prot &= ~(PROT_FORK|PROT_LENT);
 
 		/*
 		 * Release our "safety" reference on the underlying pset
@@ -371,6 +465,108 @@ fork_vas(struct vas *ovas, struct vas *vas)
 	hat_fork(ovas, vas);
 }
 
+/*
+ * lend_vas()
+ *	Hand the contents of a vas over to a vfork() child's
+ *
+ * The child's vas takes all our views, and the HAT state holding
+ * their translations; ours is left empty until return_vas().  Our
+ * views are marked, so the child's own can be told from them.
+ * The new vas is assumed bzero()'ed.
+ */
+void
+lend_vas(struct vas *ovas, struct vas *vas)
+{
+	struct pview *pv;
+	struct vas tmp;
+
+	/*
+	 * Get the empty HAT state we'll be left with first, as it
+	 * may sleep.  The swap itself mustn't.
+	 */
+	init_lock(&vas->v_lock);
+	hat_initvas(&tmp);
+	p_lock_void(&ovas->v_lock, SPL0);
+	vas->v_views = ovas->v_views;
+	vas->v_flags = ovas->v_flags;
+	vas->v_hat = ovas->v_hat;
+	ovas->v_views = 0;
+	ovas->v_hat = tmp.v_hat;
+	for (pv = vas->v_views; pv; pv = pv->p_next) {
+		pv->p_vas = vas;
+		pv->p_prot |= PROT_LENT;
+	}
+	v_lock(&ovas->v_lock, SPL0_SAME);
+}
+
+/*
+ * return_vas()
+ *	Give a vas lent by lend_vas() back
+ *
+ * Views the child made for itself are removed.  Those "keep"
+ * approves of are moved to the child's new, otherwise empty, vas
+ * at the same address.  The caller must hat_switch() if it's to
+ * go on running in the child's vas.
+ */
+void
+return_vas(struct vas *vas, struct vas *ovas, int (*keep)(struct pview *))
+{
+	struct pview *pv, *pvn, *kept = 0;
+	struct hatvas hat;
+	struct vas tmp;
+
+	/*
+	 * Pull out the child's own views
+	 */
+	for (pv = vas->v_views; pv; pv = pvn) {
+		pvn = pv->p_next;
+		if (pv->p_prot & PROT_LENT) {
+			continue;
+		}
+		ASSERT(detach_pview(vas, pv->p_vaddr) == pv,
+			"return_vas: detach failed");
+		if (keep && (*keep)(pv)) {
+			pv->p_next = kept;
+			kept = pv;
+		} else {
+			free_pview(pv);
+		}
+	}
+
+	/*
+	 * Move the rest back, and give the child empty HAT state of
+	 * its own.  Then free what the lender was left with.
+	 */
+	hat_initvas(&tmp);
+	p_lock_void(&ovas->v_lock, SPL0);
+	for (pv = vas->v_views; pv; pv = pv->p_next) {
+		pv->p_vas = ovas;
+		pv->p_prot &= ~PROT_LENT;
+	}
+	ovas->v_views = vas->v_views;
+	ovas->v_flags = vas->v_flags;
+	vas->v_views = 0;
+	hat = ovas->v_hat;
+	ovas->v_hat = vas->v_hat;
+	vas->v_hat = tmp.v_hat;
+	v_lock(&ovas->v_lock, SPL0_SAME);
+	tmp.v_hat = hat;
+	hat_freevas(&tmp);
+
+	/*
+	 * Put the ones we kept in the child's vas
+	 */
+	for (pv = kept; pv; pv = pvn) {
+		pvn = pv->p_next;
+		pv->p_prot |= PROT_FORK;
+		if (attach_pview(vas, pv) == 0) {
+			free_pview(pv);
+			continue;
+		}
+		pv->p_prot &= ~PROT_FORK;
+	}
+}
+
 /*
  * alloc_zfod_vaddr()
  *	Create a demand-fill zero view
@@ -27,7 +27,9 @@
  * A copy-on-write (COW) set which references a file may transfer from
  * the file's image to a private copy on write, but shares access to
  * the page until the write occurs (if ever).  COW sets are linked off
- * the master fill-on-demand pset mapping the file.  The perpage slot
+ * the master fill-on-demand pset mapping the file.  fork() makes the
+ * same use of a zero-fill set, which both processes then share as a
+ * master through COW sets of their own.  The perpage slot
  * under the COW set counts as a single reference, even though there is
  * no atl and the COW's perpage has a reference count of 0.
  *
@@ -38,6 +40,24 @@
  * this cow slot filling, the slot of the master set is locked, and a
  * further psop_fillslot is invoked.
  *
+ * Faults on views of files pay a round trip to a server for each page
+ * read, so we try to make fewer of them.  When faults march through a
+ * view in order, the fill is asked to read ahead, over a window which
+ * opens up as the pattern holds (fault_ahead()).  And once a fault is
+ * resolved, neighbouring pages already in memory are mapped too
+ * (fault_around()), so they don't each cost a fault of their own.
+ * madvise() can ask for either more or none of this.
+ *
+ * Where the HAT can map a large page (H_LARGE pages) with a single
+ * translation, the first touch of an aligned run of a view of
+ * physical memory maps the whole run at once (fault_large()).  So
+ * does that of fresh anonymous memory, but only if madvise() has
+ * said all of it will be used (MADV_WILLNEED); otherwise a single
+ * touch would commit, and zero, H_LARGE pages.  Each page still has
+ * its slot, atl and p_valid entry just as if faulted alone, so the
+ * rest of the VM system needn't know; the HAT goes back to small
+ * pages whenever one of them is dealt with alone.
+ *
  * XXX move some of this discussion to where it belongs--pset.c maybe?
  * XXX yeah, well, maybe, but at least it's a little bit correct now.
  */
@@ -50,9 +70,233 @@
 #include <sys/thread.h>
 #include <sys/assert.h>
 #include <sys/core.h>
+#include <sys/mman.h>
+#include <sys/hat.h>
+#include <sys/vm.h>
 #include "../mach/mutex.h"
 #include "pset.h"
 
+#define FAULTAROUND (PAGECLUSTER)	/* Pages mapped around a fault */
+
+extern uint freemem, desfree;
+
+/*
+ * fault_ahead()
+ *	Decide how many slots past this one a fill should read
+ *
+ * A fault at or just past where the last read-ahead ended is taken
+ * as sequential, and doubles the window, up to PAGECLUSTER pages;
+ * any other closes it.  Called with the pset locked.
+ */
+static uint
+fault_ahead(struct pview *pv, uint pvidx)
+{
+	uint ra;
+
+	switch (pv->p_advice) {
+	case MADV_RANDOM:
+		return(0);
+	case MADV_SEQUENTIAL:
+	case MADV_WILLNEED:
+		ra = PAGECLUSTER - 1;
+		break;
+	default:
+		if ((pvidx >= pv->p_ranext) &&
+				(pvidx < (pv->p_ranext + FAULTAROUND))) {
+			if (pv->p_rawin == 0) {
+				pv->p_rawin = 2;
+			} else if (pv->p_rawin < PAGECLUSTER) {
+				pv->p_rawin *= 2;
+			}
+		} else {
+			pv->p_rawin = 1;
+		}
+		ra = pv->p_rawin - 1;
+		break;
+	}
+	pv->p_ranext = pvidx + 1 + ra;
+	return(ra);
+}
+
+/*
+ * fault_around()
+ *	Map resident neighbours of a slot just faulted in
+ *
+ * The window is the aligned run of FAULTAROUND pages holding the
+ * fault, stretched to cover any read-ahead.  Called with the faulting
+ * slot locked; busy slots are skipped, as we never wait.  A slot of
+ * a COW set not yet touched is filled from its master, but only if
+ * the master's page is already in memory.
+ */
+static void
+fault_around(struct pview *pv, uint pvidx, uint ra)
+{
+	struct pset *ps = pv->p_set, *ps2;
+	struct perpage *pp;
+	uint x, lo, hi, idx;
+
+	lo = pvidx - (pvidx % FAULTAROUND);
+	hi = lo + FAULTAROUND;
+	if (hi < (pvidx + 1 + ra)) {
+		hi = pvidx + 1 + ra;
+	}
+	if (hi > pv->p_len) {
+		hi = pv->p_len;
+	}
+	for (x = lo; x < hi; ++x) {
+		if ((x == pvidx) || pv->p_valid[x]) {
+			continue;
+		}
+		idx = x + pv->p_off;
+		pp = find_pp(ps, idx);
+		p_lock_void(&ps->p_lock, SPL0);
+		if (clock_slot(ps, pp)) {
+			v_lock(&ps->p_lock, SPL0_SAME);
+			continue;
+		}
+		if (pv->p_valid[x] || (pp->pp_flags & PP_BAD)) {
+			unlock_slot(ps, pp);
+			continue;
+		}
+
+		/*
+		 * Take a reference, filling from a COW master if
+		 * that's cheap
+		 */
+		if (pp->pp_flags & PP_V) {
+			ref_slot(ps, pp, idx);
+		} else {
+			ps2 = ps->p_data;
+			if ((ps->p_type != PT_COW) ||
+				    (pp->pp_flags & PP_SWAPPED) ||
+				    !(find_pp(ps2, idx + ps->p_off)->pp_flags &
+					PP_V) ||
+				    (*(ps->p_ops->psop_fillslot))
+					(ps, pp, idx, 0)) {
+				unlock_slot(ps, pp);
+				continue;
+			}
+		}
+
+		/*
+		 * Map it just as vas_fault() would for a read
+		 */
+		add_atl(pp, pv, x, 0);
+		hat_addtrans(pv, (char *)pv->p_vaddr + ptob(x), pp->pp_pfn,
+			pv->p_prot | ((pp->pp_flags & PP_COW) ? PROT_RO : 0));
+		pv->p_valid[x] = 1;
+		unlock_slot(ps, pp);
+	}
+}
+
+/*
+ * fault_large()
+ *	Try to map all of the large page holding a fault at once
+ *
+ * Fresh anonymous memory which madvise() says will all be used gets
+ * H_LARGE pages of contiguous memory; a view of physical memory
+ * already has them, if it's aligned.  All of the large page must
+ * lie in the view, and none of it be in use yet.  Called with the pset locked.  Returns 0 if it was mapped,
+ * with the pset unlocked; otherwise 1, with the pset still locked.
+ */
+static int
+fault_large(struct pview *pv, uint pvidx)
+{
+	struct pset *ps = pv->p_set;
+	struct perpage *pp;
+	uint x, lo, off, pfn;
+	ulong va;
+
+	if (ps->p_type == PT_ZERO) {
+		if ((pv->p_advice != MADV_WILLNEED) ||
+				(freemem <= (desfree + H_LARGE))) {
+			return(1);
+		}
+	} else if (ps->p_type != PT_MEM) {
+		return(1);
+	}
+	va = ((ulong)pv->p_vaddr + ptob(pvidx)) & ~(ptob(H_LARGE) - 1);
+	if (va < (ulong)pv->p_vaddr) {
+		return(1);
+	}
+	lo = btop(va - (ulong)pv->p_vaddr);
+	if ((lo + H_LARGE) > pv->p_len) {
+		return(1);
+	}
+	off = lo + pv->p_off;
+	pfn = find_pp(ps, off)->pp_pfn;
+	if ((ps->p_type == PT_MEM) && (pfn & (H_LARGE - 1))) {
+		return(1);
+	}
+	for (x = 0; x < H_LARGE; ++x) {
+		pp = find_pp(ps, off + x);
+		if (pv->p_valid[lo + x] || (pp->pp_lock & PP_LOCK)) {
+			return(1);
+		}
+		if (ps->p_type == PT_MEM) {
+			if (pp->pp_pfn != (pfn + x)) {
+				return(1);
+			}
+		} else if (pp->pp_flags & (PP_V|PP_SWAPPED|PP_BAD)) {
+			return(1);
+		}
+	}
+
+	/*
+	 * None are busy, so we can take all the slots as they stand
+	 */
+	for (x = 0; x < H_LARGE; ++x) {
+		find_pp(ps, off + x)->pp_lock |= PP_LOCK;
+	}
+	ps->p_locks += H_LARGE;
+	v_lock(&ps->p_lock, SPL0_SAME);
+
+	/*
+	 * Fill anonymous slots, or reference the physical ones
+	 */
+	if (ps->p_type == PT_ZERO) {
+		if (alloc_contig(H_LARGE, Z_NORMAL, &pfn)) {
+			for (x = 0; x < H_LARGE; ++x) {
+				unlock_slot(ps, find_pp(ps, off + x));
+			}
+			p_lock_void(&ps->p_lock, SPL0);
+			return(1);
+		}
+		bzero(ptov(ptob(pfn)), ptob(H_LARGE));
+		for (x = 0; x < H_LARGE; ++x) {
+			pp = find_pp(ps, off + x);
+			set_core(pfn + x, ps, off + x);
+			pp->pp_flags |= PP_V;
+			pp->pp_flags &= ~(PP_M|PP_R);
+			pp->pp_pfn = pfn + x;
+			pp->pp_refs = 1;
+		}
+	} else {
+		for (x = 0; x < H_LARGE; ++x) {
+			ref_slot(ps, find_pp(ps, off + x), off + x);
+		}
+	}
+
+	/*
+	 * Account for each mapping as vas_fault() would, then have
+	 * the HAT map them all in one go if it still can
+	 */
+	for (x = 0; x < H_LARGE; ++x) {
+		add_atl(find_pp(ps, off + x), pv, lo + x, 0);
+		pv->p_valid[lo + x] = 1;
+	}
+	if (hat_addlarge(pv, (void *)va, pfn, pv->p_prot)) {
+		for (x = 0; x < H_LARGE; ++x) {
+			hat_addtrans(pv, (char *)va + ptob(x), pfn + x,
+				pv->p_prot);
+		}
+	}
+	for (x = 0; x < H_LARGE; ++x) {
+		unlock_slot(ps, find_pp(ps, off + x));
+	}
+	return(0);
+}
+
 /*
  * vas_fault()
  *	Process a fault within the given address space
@@ -67,7 +311,7 @@ vas_fault(void *vas, void *vaddr, int write)
 	struct pview *pv;
 	struct pset *ps;
 	struct perpage *pp;
-	uint idx, pvidx;
+	uint idx, pvidx, ra;
 	int error = 0;
 	int wasvalid;
 
@@ -89,11 +333,22 @@ vas_fault(void *vas, void *vaddr, int write)
 	}
 
 	/*
-	 * Transfer from pset lock to page slot lock
+	 * The first fault on a large page's worth may map it all
 	 */
 	pvidx = btop((char *)vaddr - (char *)pv->p_vaddr);
+	if (hat_large && (fault_large(pv, pvidx) == 0)) {
+		return(0);
+	}
+
+	/*
+	 * Transfer from pset lock to page slot lock
+	 */
 	idx = pvidx + pv->p_off;
 	pp = find_pp(ps, idx);
+	ra = 0;
+	if ((ps->p_type == PT_FILE) || (ps->p_type == PT_COW)) {
+		ra = fault_ahead(pv, pvidx);
+	}
 	lock_slot(ps, pp);
 
 	/*
@@ -110,7 +365,7 @@ vas_fault(void *vas, void *vaddr, int write)
 	 */
 	if (!(pp->pp_flags & PP_V)) {
 		wasvalid = 0;
-		if ((*(ps->p_ops->psop_fillslot))(ps, pp, idx)) {
+		if ((*(ps->p_ops->psop_fillslot))(ps, pp, idx, ra)) {
 			error = 1;
 			goto out;
 		}
@@ -159,6 +414,14 @@ vas_fault(void *vas, void *vaddr, int write)
 	ASSERT_DEBUG(pv->p_valid[pvidx] == 0, "vas_fault: p_valid went on");
 	pv->p_valid[pvidx] = 1;
 
+	/*
+	 * Bring in the neighbours, unless told not to
+	 */
+	if (((ps->p_type == PT_FILE) || (ps->p_type == PT_COW)) &&
+			(pv->p_advice != MADV_RANDOM)) {
+		fault_around(pv, pvidx, ra);
+	}
+
 	/*
 	 * Free the various things we hold and return
 	 */
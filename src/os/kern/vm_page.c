@@ -1,6 +1,23 @@
 /*
  * vm_page.c
  *	Routines for organizing pages of memory
+ *
+ * Free memory is kept by a buddy allocator.  Each zone of memory has
+ * a list of free blocks for each size 2^N pages, 0 <= N <= MAXORDER,
+ * each block aligned to its size.  A request takes the first block
+ * of the smallest size big enough, splitting off halves as needed;
+ * a freed block joins with its "buddy"--the other half of the block
+ * twice its size--for as long as that buddy is free too.
+ *
+ * Single pages come and go most often, so each CPU keeps a few in a
+ * cache of its own, which it can get at without the lock.  Pages in
+ * these caches aren't counted in freemem.
+ *
+ * Pages which will be handed out zero-filled can come instead from a
+ * pool cleared ahead of time.  A background thread (zero_pages())
+ * keeps it topped up with CPU time nobody else wants, so a fault on
+ * fresh memory needn't stop to clear the page itself.  Pooled pages
+ * aren't counted in freemem either.
  */
 #include <sys/types.h>
 #include <sys/pset.h>
@@ -9,24 +26,59 @@
 #include <sys/core.h>
 #include <sys/percpu.h>
 #include <sys/param.h>
+#include <sys/pstat.h>
+#include <sys/fs.h>
+#include <sys/misc.h>
 #include <rmap.h>
 #include "../mach/mutex.h"
 #include "../mach/vminline.h"
 
 extern char *heap;
 extern int bootpgs;
+extern uint desfree;
+extern struct pstat_vm vmstat;
+
+#define MAXORDER (10)		/* Biggest block is 2^MAXORDER pages */
+#define PCACHE (16)		/* Pages cached per CPU */
+#define PCBATCH (PCACHE / 2)	/*  ...moved to/from zone at a time */
+#define PCLOW (256)		/* Don't fill caches below this freemem */
+#define ZPOOL (64)		/* Most pre-zeroed pages kept */
+#define ZLOW (ZPOOL / 4)	/*  ...refilled when down to this */
+
+/*
+ * A zone of physical memory, and its free blocks
+ */
+struct zone {
+	uint z_lo, z_hi;	/* Range of PFNs, [lo..hi) */
+	struct core		/* Free blocks of each order */
+		*z_free[MAXORDER+1];
+	uint z_nfree;		/* # free pages in zone */
+};
 
 /*
- * Free list rooted here.  Since a free page can't be attached to
- * a pset, we abuse the attach list field for a different kind of
- * list.
+ * Per-CPU cache of free single pages, from Z_NORMAL
  */
+struct pagecache {
+	uint pc_count;		/* # in pc_pfn[] */
+	uint pc_pfn[PCACHE];
+};
+
 uint freemem, totalmem;
-static struct core *freelist = 0;
-static lock_t mem_lock;		/* Spinlock for freelist */
+static struct zone zones[NZONE];
+static struct pagecache boot_pages;
+static lock_t mem_lock;		/* Spinlock for zones */
 static sema_t mem_sema;		/* Semaphore to wait for memory */
 struct core *core, *coreNCORE;	/* Base and end of core info */
 
+/*
+ * Pool of free pages already zeroed
+ */
+uint zeromem;			/* # pages in zpool[] */
+static uint zpool[ZPOOL];
+static lock_t zero_lock;	/* Spinlock for zpool */
+static sema_t zero_sema;	/* Where zero_pages() waits for room */
+static int zeroing;		/* zero_pages() is running */
+
 /*
  * Virtual address pool and its mutexes
  */
@@ -43,54 +95,265 @@ static sema_t vmap_sema;	/* How to sleep on it when need more */
 static sema_t core_semas[NC_SEMA];
 
 /*
- * alloc_page_fn()
- *	Pick some particular page from the freelist
+ * ZONE()
+ *	Zone a page belongs to
+ */
+#define ZONE(pfn) (((pfn) < btop(DMA_LIM)) ? &zones[Z_DMA] : \
+	&zones[Z_NORMAL])
+
+/*
+ * buddy_link()
+ *	Put a free block on its zone's list
+ */
+static void
+buddy_link(struct zone *z, struct core *c, uint order)
+{
+	c->c_flags = C_FREE;
+	c->c_order = order;
+	c->c_prev = 0;
+	c->c_free = z->z_free[order];
+	if (c->c_free) {
+		c->c_free->c_prev = c;
+	}
+	z->z_free[order] = c;
+}
+
+/*
+ * buddy_unlink()
+ *	Take a free block off its zone's list
+ */
+static void
+buddy_unlink(struct zone *z, struct core *c)
+{
+	if (c->c_prev) {
+		c->c_prev->c_free = c->c_free;
+	} else {
+		z->z_free[c->c_order] = c->c_free;
+	}
+	if (c->c_free) {
+		c->c_free->c_prev = c->c_prev;
+	}
+	c->c_flags = 0;
+}
+
+/*
+ * buddy_alloc()
+ *	Take a block of 2^order pages from a zone
  *
- * Returns 0 on success, and *pfnp is filled in.  Otherwise non-zero.
- * "fn" is called on each possible page, and the scan stops when this
- * function returns non-zero.
+ * Returns its first page's core entry, or 0.  mem_lock is held.
  */
-int
-alloc_page_fn(intfun fn, uint *pfnp)
+static struct core *
+buddy_alloc(struct zone *z, uint order)
 {
-	struct core *c, **cp;
-	uint pfn;
+	struct core *c;
+	uint o;
+
+	for (o = order; o <= MAXORDER; ++o) {
+		if (z->z_free[o]) {
+			break;
+		}
+	}
+	if (o > MAXORDER) {
+		return(0);
+	}
+	c = z->z_free[o];
+	buddy_unlink(z, c);
 
 	/*
-	 * Walk the list, checking each entry
+	 * Give back the upper halves until it's the size asked for
 	 */
-	p_lock_void(&mem_lock, SPL0_SAME);
-	cp = &freelist;
-	c = *cp;
-	while (c) {
-		/*
-		 * If it's OK, pull it from the freelist
-		 */
-		pfn = c - core;
-		if (fn(pfn)) {
-			/*
-			 * And give it to them
-			 */
-			*cp = c->c_free;
-			c->c_flags = C_ALLOC;
-			c->c_free = 0;
-			freemem -= 1;
-			*pfnp = pfn;
+	while (o > order) {
+		o -= 1;
+		buddy_link(z, c + (1 << o), o);
+	}
+	z->z_nfree -= (1 << order);
+	freemem -= (1 << order);
+	return(c);
+}
+
+/*
+ * buddy_free()
+ *	Return a block of 2^order pages, aligned to its size
+ *
+ * mem_lock is held.
+ */
+static void
+buddy_free(uint pfn, uint order)
+{
+	struct zone *z = ZONE(pfn);
+	struct core *b;
+	uint bpfn;
+
+	z->z_nfree += (1 << order);
+	freemem += (1 << order);
+
+	/*
+	 * Join with our buddy as long as it's free and whole
+	 */
+	while (order < MAXORDER) {
+		bpfn = pfn ^ (1 << order);
+		if ((bpfn < z->z_lo) || (bpfn >= z->z_hi)) {
+			break;
+		}
+		b = &core[bpfn];
+		if (!(b->c_flags & C_FREE) || (b->c_order != order)) {
 			break;
 		}
+		buddy_unlink(z, b);
+		pfn &= ~(1 << order);
+		order += 1;
+	}
+	buddy_link(z, &core[pfn], order);
+}
 
-		/*
-		 * Advance to next
-		 */
-		cp = &c->c_free;
-		c = *cp;
+/*
+ * free_run()
+ *	Return a run of pages, not necessarily aligned, to the zones
+ *
+ * It's split into the biggest aligned blocks it holds.  mem_lock
+ * is held.
+ */
+static void
+free_run(uint pfn, uint npg)
+{
+	uint order;
+
+	while (npg > 0) {
+		for (order = 0; order < MAXORDER; ++order) {
+			if ((pfn & (1 << order)) || ((2 << order) > npg)) {
+				break;
+			}
+		}
+		buddy_free(pfn, order);
+		pfn += (1 << order);
+		npg -= (1 << order);
+	}
+}
+
+/*
+ * zone_alloc()
+ *	Take a block of 2^order pages from a zone, or any below it
+ */
+static struct core *
+zone_alloc(uint zone, uint order)
+{
+	struct core *c;
+	int x;
+
+	for (x = zone; x >= 0; --x) {
+		if ((c = buddy_alloc(&zones[x], order))) {
+			return(c);
+		}
 	}
+	return(0);
+}
+
+/*
+ * wake_mem()
+ *	Let those waiting for memory at it
+ *
+ * mem_lock is held.
+ */
+inline static void
+wake_mem(void)
+{
+	if (blocked_sema(&mem_sema)) {
+		v_sema(&mem_sema);
+	}
+}
+
+/*
+ * alloc_contig()
+ *	Allocate physically contiguous pages
+ *
+ * The pages come from the named zone, or one below it.  We don't
+ * sleep; returns 0 on success with *pfnp filled in, otherwise
+ * non-zero.
+ */
+int
+alloc_contig(uint npg, uint zone, uint *pfnp)
+{
+	struct core *c;
+	uint order, pfn, x;
+
+	ASSERT_DEBUG(npg > 0, "alloc_contig: 0 pages");
+	for (order = 0; (1 << order) < npg; ++order)
+		;
+	if (order > MAXORDER) {
+		return(1);
+	}
+	p_lock_void(&mem_lock, SPL0);
+	c = zone_alloc(zone, order);
+	if (c == 0) {
+		v_lock(&mem_lock, SPL0_SAME);
+		return(1);
+	}
+	pfn = c - core;
 
 	/*
-	 * Release memory lock, and return result
+	 * Give back any tail beyond what was asked for
 	 */
+	if (npg < (1 << order)) {
+		free_run(pfn + npg, (1 << order) - npg);
+	}
 	v_lock(&mem_lock, SPL0_SAME);
-	return(c == 0);
+
+	for (x = 0; x < npg; ++x) {
+		c[x].c_flags = C_ALLOC;
+		c[x].c_free = 0;
+	}
+	*pfnp = pfn;
+	return(0);
+}
+
+/*
+ * free_contig()
+ *	Free pages from alloc_contig()
+ */
+void
+free_contig(uint pfn, uint npg)
+{
+	uint x;
+
+	for (x = 0; x < npg; ++x) {
+		ASSERT_DEBUG(!(core[pfn + x].c_flags & (C_BAD|C_FREE)),
+			"free_contig: bad page");
+		core[pfn + x].c_flags = 0;
+	}
+	p_lock_void(&mem_lock, SPL0);
+	free_run(pfn, npg);
+	wake_mem();
+	v_lock(&mem_lock, SPL0_SAME);
+}
+
+/*
+ * take_zpage()
+ *	Take a page from the zeroed pool
+ *
+ * Returns 1 with *pfnp filled in, or 0 if the pool's empty.  We
+ * wake zero_pages() once it's drawn down.
+ */
+static int
+take_zpage(uint *pfnp)
+{
+	uint pfn;
+
+	if (zeromem == 0) {
+		return(0);
+	}
+	p_lock_void(&zero_lock, SPL0);
+	if (zeromem == 0) {
+		v_lock(&zero_lock, SPL0_SAME);
+		return(0);
+	}
+	pfn = zpool[--zeromem];
+	if ((zeromem <= ZLOW) && blocked_sema(&zero_sema)) {
+		v_sema(&zero_sema);
+	}
+	v_lock(&zero_lock, SPL0_SAME);
+	core[pfn].c_flags = C_ALLOC;
+	*pfnp = pfn;
+	return(1);
 }
 
 /*
@@ -100,62 +363,187 @@ alloc_page_fn(intfun fn, uint *pfnp)
 uint
 alloc_page(void)
 {
+	struct pagecache *pc;
 	struct core *c;
+	uint pfn;
+
+	/*
+	 * Take one from our CPU's cache if we can
+	 */
+	NO_PREEMPT();
+	pc = cpu.pc_pages;
+	if (pc->pc_count > 0) {
+		pfn = pc->pc_pfn[--(pc->pc_count)];
+		PREEMPT_OK();
+		c = &core[pfn];
+		goto out;
+	}
+	PREEMPT_OK();
 
 	p_lock_void(&mem_lock, SPL0);
 	/*
 	 * This is a classic "sleeping for memory"
 	 * scenario.  Because our allocate and free primitives
 	 * are in units of a page, this becomes a simple FIFO
-	 * semaphore queue for memory.
+	 * semaphore queue for memory.  Before sleeping, raid
+	 * the zeroed pool; memory's worth more than the time
+	 * spent clearing it.
 	 */
 	while (freemem == 0) {
+		if (zeromem) {
+			v_lock(&mem_lock, SPL0_SAME);
+			if (take_zpage(&pfn)) {
+				return(pfn);
+			}
+			p_lock_void(&mem_lock, SPL0);
+			continue;
+		}
 		p_sema_v_lock(&mem_sema, PRIHI, &mem_lock);
 		p_lock_void(&mem_lock, SPL0_SAME);
 	}
-	freemem -= 1;
 
 	/*
-	 * We have our page.  Take it from the free list, initialize
-	 * its fields, and return it.
+	 * We have our page.  While memory's plentiful, refill our
+	 * cache as well; holding the lock, we can't move to another
+	 * CPU while we do.
 	 */
-	c = freelist;
-	freelist = c->c_free;
+	c = zone_alloc(Z_NORMAL, 0);
+	ASSERT_DEBUG(c, "alloc_page: freemem but no page");
+	pc = cpu.pc_pages;
+	while ((freemem > PCLOW) && (pc->pc_count < PCBATCH)) {
+		struct core *c2 = buddy_alloc(&zones[Z_NORMAL], 0);
+
+		if (c2 == 0) {
+			break;
+		}
+		pc->pc_pfn[pc->pc_count++] = c2 - core;
+	}
 	v_lock(&mem_lock, SPL0_SAME);
+
+out:
 	c->c_flags = C_ALLOC;
 	c->c_free = 0;
 	return(c-core);
 }
 
+/*
+ * alloc_zpage()
+ *	Allocate a single page filled with zeroes, return its pfn
+ *
+ * It comes from the pool zero_pages() keeps if there's one there;
+ * otherwise we clear it ourselves.
+ */
+uint
+alloc_zpage(void)
+{
+	uint pfn;
+
+	if (take_zpage(&pfn)) {
+		vmstat.psv_zerohits += 1;
+		return(pfn);
+	}
+	vmstat.psv_zeromisses += 1;
+	pfn = alloc_page();
+	bzero(ptov(ptob(pfn)), NBPG);
+	return(pfn);
+}
+
+/*
+ * zero_pages()
+ *	Endless routine to keep the zeroed pool filled
+ *
+ * Run by a thread of swapd, which puts itself at background priority
+ * first, so pages are only cleared on CPU time nobody else wants.
+ * We stop short while memory is scarce, leaving it for pageout().
+ */
+int
+zero_pages(void)
+{
+	uint pfn;
+
+	/*
+	 * Only one of us
+	 */
+	if (zeroing) {
+		return(err(EBUSY));
+	}
+	zeroing = 1;
+
+	for (;;) {
+		/*
+		 * Fill the pool while memory's plentiful.  Pooled
+		 * pages are marked C_SYS, so pageout leaves them be.
+		 */
+		while ((zeromem < ZPOOL) && (freemem > desfree + ZPOOL)) {
+			pfn = alloc_page();
+			core[pfn].c_flags |= C_SYS;
+			bzero(ptov(ptob(pfn)), NBPG);
+			p_lock_void(&zero_lock, SPL0);
+			zpool[zeromem++] = pfn;
+			v_lock(&zero_lock, SPL0_SAME);
+
+			/*
+			 * Give way to anybody else who wants the CPU
+			 */
+			CHECK_PREEMPT();
+		}
+
+		/*
+		 * With a good supply, wait until it's drawn down.
+		 * Otherwise memory's short; look again in a while.
+		 */
+		p_lock_void(&zero_lock, SPL0);
+		if (zeromem > ZLOW) {
+			p_sema_v_lock(&zero_sema, PRIHI, &zero_lock);
+		} else {
+			v_lock(&zero_lock, SPL0_SAME);
+			if (freemem <= desfree + ZPOOL) {
+				interval_sleep(1);
+			}
+		}
+	}
+}
+
 /*
  * free_page()
- *	Free a page to the freelist
+ *	Free a page
+ *
+ * Pages above the DMA zone go to our CPU's cache when there's room
+ * and nobody's waiting for memory.  Otherwise it's back to the
+ * zone, with half the cache if it's full.
  */
 void
 free_page(uint pfn)
 {
+	struct pagecache *pc;
 	struct core *c;
 
 	c = core+pfn;
 	ASSERT_DEBUG((c >= core) && (c < coreNCORE),
 		"free_page: bad page");
-	c->c_flags &= ~C_ALLOC;
-#ifdef DEBUG
-	/* XXX only works for uniprocessor without preemption */
-	{ struct core *c2;
-	  for (c2 = freelist; c2; c2 = c2->c_free) {
-	    ASSERT(c2 != c, "free_page: already free");
-	  }
-	}
-#endif
+	ASSERT_DEBUG(!(c->c_flags & C_FREE), "free_page: already free");
 	ASSERT_DEBUG(!(c->c_flags & C_BAD), "free_page: C_BAD");
+	c->c_flags = 0;
+	if (pfn >= btop(DMA_LIM)) {
+		NO_PREEMPT();
+		pc = cpu.pc_pages;
+		if ((pc->pc_count < PCACHE) && !blocked_sema(&mem_sema)) {
+			pc->pc_pfn[pc->pc_count++] = pfn;
+			PREEMPT_OK();
+			return;
+		}
+		PREEMPT_OK();
+	}
+
 	p_lock_void(&mem_lock, SPL0);
-	c->c_free = freelist;
-	freelist = c;
-	freemem += 1;
-	if (blocked_sema(&mem_sema)) {
-		v_sema(&mem_sema);
+	buddy_free(pfn, 0);
+	pc = cpu.pc_pages;
+	if (pc->pc_count == PCACHE) {
+		while (pc->pc_count > PCBATCH) {
+			buddy_free(pc->pc_pfn[--(pc->pc_count)], 0);
+		}
 	}
+	wake_mem();
 	v_lock(&mem_lock, SPL0_SAME);
 }
 
@@ -217,18 +605,28 @@ init_page(void)
 	}
 
 	/*
-	 * Now walk all memory, and put free pages onto free list
+	 * Set up the zones
+	 */
+	zones[Z_DMA].z_lo = 0;
+	zones[Z_DMA].z_hi = zones[Z_NORMAL].z_lo = btop(DMA_LIM);
+	zones[Z_NORMAL].z_hi = bootpgs;
+	if (zones[Z_DMA].z_hi > bootpgs) {
+		zones[Z_DMA].z_hi = zones[Z_NORMAL].z_lo = bootpgs;
+	}
+
+	/*
+	 * Now walk all memory, and free each page we can use;
+	 * they'll join up into blocks as they go.
 	 */
 	freemem = 0;
 	for (c = core; c < coreNCORE; ++c) {
 		if (c->c_flags & (C_SYS|C_BAD)) {
 			continue;
 		}
-		c->c_free = freelist;
-		freelist = c;
-		freemem += 1;
+		buddy_free(c - core, 0);
 	}
 	totalmem = freemem;
+	cpu.pc_pages = &boot_pages;
 
 	/*
 	 * The virtual map itself is filled in by machine-dependent
@@ -239,6 +637,8 @@ init_page(void)
 	init_sema(&vmap_sema); set_sema(&vmap_sema, 0);
 	init_sema(&mem_sema);
 	init_lock(&mem_lock);
+	init_sema(&zero_sema); set_sema(&zero_sema, 0);
+	init_lock(&zero_lock);
 
 	/*
 	 * Initialize each of the core_semas to allow one person through
@@ -283,6 +683,10 @@ free_vmap(uint idx, uint npg)
 /*
  * alloc_pages()
  *	Allocate some virtually contiguous kernel memory
+ *
+ * If the pages can be had physically contiguous, they're used
+ * through the P->V mapping of all memory.  Otherwise we map them
+ * one by one into space from the vmap.
  */
 void *
 alloc_pages(uint npg)
@@ -291,6 +695,18 @@ alloc_pages(uint npg)
 	int x;
 	uint pg;
 
+	if (npg == 1) {
+		pg = alloc_page();
+		core[pg].c_flags |= C_SYS;
+		return(ptov(ptob(pg)));
+	}
+	if (alloc_contig(npg, Z_NORMAL, &pg) == 0) {
+		for (x = 0; x < npg; ++x) {
+			core[pg + x].c_flags |= C_SYS;
+		}
+		return(ptov(ptob(pg)));
+	}
+
 	vaddr = (char *)ptob(alloc_vmap(npg));
 	for (x = 0; x < npg; ++x) {
 		pg = alloc_page();
@@ -311,6 +727,19 @@ free_pages(void *vaddr, uint npg)
 	uint pg;
 	void *addr;
 
+	/*
+	 * Physically contiguous, under the P->V mapping
+	 */
+	if ((char *)vaddr >= mem_map_base) {
+		pg = btop((char *)vaddr - mem_map_base);
+		if (npg == 1) {
+			free_page(pg);
+		} else {
+			free_contig(pg, npg);
+		}
+		return;
+	}
+
 	for (x = 0; x < npg; ++x) {
 		addr = (char *)vaddr + ptob(x);
 		pg = btop(vtop(addr));
@@ -367,6 +796,8 @@ unlock_page(uint pfn)
 /*
  * set_core()
  *	Set pset/index information on a core entry
+ *
+ * The page is newly in use, so it starts out active.
  */
 void
 set_core(uint pfn, struct pset *ps, uint idx)
@@ -378,5 +809,7 @@ set_core(uint pfn, struct pset *ps, uint idx)
 	c = &core[pfn];
 	c->c_pset = ps;
 	c->c_psidx = idx;
+	c->c_flags |= C_ACTIVE;
+	c->c_age = (ps->p_flags & PF_HOT) ? AGE_HOT : AGE_INIT;
 	unlock_page(pfn);
 }
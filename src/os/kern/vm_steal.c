@@ -4,18 +4,28 @@
  *
  * There is no such thing as swapping in VSTa.  Just page stealing.
  *
- * The basic mechanism is a two-handed clock algorithm.  This technique
- * provides a smooth mechanism for reaping pages across a wide range
- * of configurations.  However, in a multi-CPU environment it certainly
- * presents some challenges.
+ * Pages in use are either active or inactive (C_ACTIVE in the core
+ * entry).  A page starts out active, with an age.  Two clock hands
+ * sweep memory.  The first looks only at active pages, aging them: a
+ * page found referenced grows older, one not referenced decays, and
+ * one which decays to nothing becomes inactive.  The second, trailing
+ * it, looks only at inactive pages, and only when memory is short.
+ * A referenced one goes back to being active; the rest are stolen.
+ * So a page is only lost once it has gone unreferenced long enough
+ * to age out, and then again long enough for the second hand to
+ * come round.
+ *
+ * Pages of a pset marked PF_HOT--program text and shared libraries--
+ * start older, gain age faster, and decay only slowly while memory
+ * is short, where other pages' ages halve.  How much memory is swept
+ * each time pageout wakes grows with how far short of desfree we are.
  *
  * The per-page information includes an attach list data structure.
  * This is used by the basic pageout algorithm to enumerate the
  * current users of a given page.  The pageout daemon enumerates
  * each page set for a page, updating the central page's notion
- * of its modifed and referenced bits.  For the forward hand, it
- * clears the referenced bit.  For the back hand, it reaps the page
- * if the referenced bit is still clear.
+ * of its modifed and referenced bits, and clearing the referenced
+ * bit once it's been counted.
  *
  * Locking is tricky.  The attach list uses the page lock.  Because it
  * is taken before the slot locks in the page sets, page sets which
@@ -33,6 +43,8 @@
 #include <sys/malloc.h>
 #include <sys/misc.h>
 #include <sys/assert.h>
+#include <sys/pstat.h>
+#include <sys/mman.h>
 #include "../mach/mutex.h"
 #include "pset.h"
 
@@ -50,12 +62,12 @@
 #define SPREAD 8		/* Distance between hands */
 #define DESFREE 8		/* When less than this, start stealing */
 #define MINFREE 16		/* When less than this, synch pushes */
-				/* AT MOST: */
 #define SMALLSCAN 32		/* Scan this much when free > DESFREE */
-#define MEDSCAN 16		/*  ... when free > MINFREE */
-#define LARGESCAN 4		/*  ... when free < MINFREE */
+#define LARGESCAN 4		/* Most to scan in one pass */
 
+#define SCANRATE 4		/* Extra pages scanned per page short */
 #define PAGEOUT_SECS (5)	/* Interval to run pageout() */
+#define MAPTRIM (4)		/* Cached files dropped per pass when short */
 
 extern uint freemem, totalmem;	/* Free and total pages in system */
 				/*  total does not include C_SYS */
@@ -63,6 +75,7 @@ static uint pageout_secs = 0;	/* Set to PAGEOUT_SECS when ready */
 uint desfree, minfree;		/* Initial values calculated on boot */
 extern struct portref
 	*swapdev;		/* To tell when it's been enabled */
+struct pstat_vm vmstat;		/* Paging statistics */
 
 /*
  * getbits()
@@ -232,8 +245,15 @@ walk_master(intfun fn, struct pset *ps, struct perpage *pp, uint idx)
 /*
  * steal_master()
  *	Handle stealing of pages from master copy of COW
+ *
+ * Nothing writes through a COW set to its master, but the master of
+ * anonymous memory shared by fork() holds whatever was written before
+ * then, so its page may have to go to swap before it can be freed.
+ * Returns 1 if the slot was released for that push, 0 if it's still
+ * held.
  */
-steal_master(struct pset *ps, struct perpage *pp, uint idx,
+static int
+steal_master(struct core *c, struct pset *ps, struct perpage *pp, uint idx,
 		int trouble, intfun steal)
 {
 	/*
@@ -244,34 +264,42 @@ steal_master(struct pset *ps, struct perpage *pp, uint idx,
 	walk_master(getbits, ps, pp, idx);
 
 	/*
-	 * If we don't want to steal it yet, just clear ref bit (COW master
-	 * can't be modified!)
+	 * If we don't want to steal it yet, just clear ref bit
 	 */
-	ASSERT_DEBUG((pp->pp_flags & PP_M) == 0, "steal_master: modified");
-	if (!(*steal)(pp->pp_flags, trouble)) {
+	if (!(*steal)(c, ps, pp->pp_flags, trouble)) {
 		pp->pp_flags &= ~(PP_R);
-		return;
+		return(0);
 	}
 
 	/*
-	 * If we can successfully steal all translations, free the memory
+	 * If we can successfully steal all translations, free the
+	 * memory, cleaning it first if need be
 	 */
 	walk_master(vm_unvirt, ps, pp, idx);
-	ASSERT_DEBUG((pp->pp_flags & PP_M) == 0, "steal_master: modified");
-	if (pp->pp_refs == 0) {
-		free_page(pp->pp_pfn);
-		pp->pp_flags &= ~(PP_R|PP_V);
+	if (pp->pp_refs > 0) {
+		return(0);
+	}
+	vmstat.psv_steals += 1;
+	if (pp->pp_flags & PP_M) {
+		ASSERT_DEBUG(swapdev, "steal_master: !swapdev");
+		(*(ps->p_ops->psop_writeslot))(ps, pp, idx, iodone_free);
+		vmstat.psv_pushes += 1;
+		return(1);
 	}
+	free_page(pp->pp_pfn);
+	pp->pp_flags &= ~(PP_R|PP_V);
+	return(0);
 }
 
 /*
  * do_hand()
  *	Do hand algorithm
  *
- * Steal pages as appropriate, do all the fancy locking.
+ * Look at a page if it's on the list ("active" or not) this hand
+ * works.  Steal it as appropriate, doing all the fancy locking.
  */
 static void
-do_hand(struct core *c, int trouble, intfun steal)
+do_hand(struct core *c, int trouble, int active, intfun steal)
 {
 	struct pset *ps;
 	struct perpage *pp;
@@ -279,11 +307,15 @@ do_hand(struct core *c, int trouble, intfun steal)
 	int slot_held;
 
 	/*
-	 * No point fussing over inactive pages, eh?
+	 * No point fussing over free pages, eh?  Nor those this
+	 * hand doesn't handle.
 	 */
 	if ((c->c_flags & C_ALLOC) == 0) {
 		return;
 	}
+	if (!(c->c_flags & C_ACTIVE) != !active) {
+		return;
+	}
 
 	/*
 	 * Lock physical page
@@ -340,8 +372,11 @@ do_hand(struct core *c, int trouble, intfun steal)
 	 * If this is the target for COW psets, several assumptions
 	 * can be made, so handle in its own routine.
 	 */
+	vmstat.psv_scans += 1;
 	if ((ps->p_type != PT_COW) && ps->p_cowsets) {
-		steal_master(ps, pp, idx, trouble, steal);
+		if (steal_master(c, ps, pp, idx, trouble, steal)) {
+			slot_held = 0;	/* Released in iodone_free */
+		}
 		goto out;
 	}
 
@@ -355,16 +390,19 @@ do_hand(struct core *c, int trouble, intfun steal)
 	/*
 	 * See if we'd like to take a shot at stealing this page
 	 */
-	if (!(*steal)(pp->pp_flags, trouble)) {
+	if (!(*steal)(c, ps, pp->pp_flags, trouble)) {
 		/*
 		 * Nope, we don't want it yet.  If trouble's brewing,
-		 * schedule an async flush of the dirty page.
+		 * schedule an async flush of a dirty inactive page,
+		 * so it can be had cheaply later.
 		 */
-		if (trouble && (pp->pp_flags & PP_M) && swapdev) {
+		if (trouble && (pp->pp_flags & PP_M) && swapdev &&
+				!(c->c_flags & C_ACTIVE)) {
 			(*(ps->p_ops->psop_writeslot))(ps,
 				pp, idx, iodone_unlock);
 			pp->pp_flags &= ~(PP_M);
 			slot_held = 0;	/* Released in iodone_unlock */
+			vmstat.psv_pushes += 1;
 		}
 
 		/*
@@ -406,7 +444,9 @@ do_hand(struct core *c, int trouble, intfun steal)
 		ASSERT_DEBUG(swapdev, "do_hand: !swapdev");
 		(*(ps->p_ops->psop_writeslot))(ps, pp, idx, iodone_free);
 		slot_held = 0;	/* Released in iodone_free */
+		vmstat.psv_pushes += 1;
 	}
+	vmstat.psv_steals += 1;
 out:
 	if (slot_held) {
 		unlock_slot(ps, pp);
@@ -415,25 +455,53 @@ out:
 }
 
 /*
- * steal1()
- *	Steal algorithm for hand #1
+ * age_page()
+ *	Aging for the active hand
+ *
+ * Never steals; a page which ages out just becomes inactive.
  */
 static int
-steal1(int flags, int trouble)
+age_page(struct core *c, struct pset *ps, int flags, int trouble)
 {
-	if ((flags & PP_M) && !swapdev)
-		return(0);
-	return (trouble > 1);
+	int hot = (ps->p_flags & PF_HOT), age = c->c_age;
+
+	if (flags & PP_R) {
+		age += hot ? (2 * AGE_ADV) : AGE_ADV;
+		if (age > AGE_MAX) {
+			age = AGE_MAX;
+		}
+	} else if (trouble && !hot) {
+		age /= 2;
+	} else if (age > 0) {
+		age -= 1;
+	}
+	c->c_age = age;
+	if (age == 0) {
+		c->c_flags &= ~C_ACTIVE;
+		vmstat.psv_deactivated += 1;
+	}
+	return(0);
 }
 
 /*
- * steal2()
- *	Steal algorithm for hand #2
+ * reclaim_page()
+ *	Steal algorithm for the inactive hand
+ *
+ * A page referenced since it went inactive is active again.
  */
 static int
-steal2(int flags, int trouble)
+reclaim_page(struct core *c, struct pset *ps, int flags, int trouble)
 {
-	return (trouble && !(flags & (PP_R|PP_M)));
+	if (flags & PP_R) {
+		c->c_flags |= C_ACTIVE;
+		c->c_age = (ps->p_flags & PF_HOT) ? AGE_HOT : AGE_INIT;
+		vmstat.psv_reactivated += 1;
+		return(0);
+	}
+	if ((flags & PP_M) && !swapdev) {
+		return(0);
+	}
+	return(trouble > 0);
 }
 
 /*
@@ -443,8 +511,8 @@ steal2(int flags, int trouble)
 pageout(void)
 {
 	struct core *base, *top, *hand1, *hand2;
-	int trouble, npg;
-	int troub_cnt[3];
+	int trouble, npg, scan;
+	ulong nactive, ninactive;
 
 /*
  * Not sure if these need to be macros; have to move "top" and "base"
@@ -468,9 +536,11 @@ pageout(void)
 	pageout_secs = PAGEOUT_SECS;
 
 	/*
-	 * Skip to first usable page, also record top
+	 * Skip to first usable page, also record top.  (This once
+	 * read !BAD(), stopping at the first page it should skip;
+	 * the hands then started on kernel pages.)
 	 */
-	for (base = core; !BAD(base); ++base)
+	for (base = core; BAD(base); ++base)
 		;
 	top = coreNCORE;
 
@@ -482,13 +552,7 @@ pageout(void)
 		ADVANCE(hand1);
 	}
 	npg = 0;
-
-	/*
-	 * Calculate scan counts for each situation
-	 */
-	troub_cnt[0] = totalmem/SMALLSCAN;
-	troub_cnt[1] = totalmem/MEDSCAN;
-	troub_cnt[2] = totalmem/LARGESCAN;
+	nactive = ninactive = 0;
 	minfree = totalmem/MINFREE;
 	desfree = totalmem/DESFREE;
 
@@ -497,7 +561,8 @@ pageout(void)
 	 */
 	for (;;) {
 		/*
-		 * Categorize the current memory situation
+		 * Categorize the current memory situation, and scan
+		 * more the further short of memory we are
 		 */
 		if (freemem < minfree) {
 			trouble = 2;
@@ -506,12 +571,21 @@ pageout(void)
 		} else {
 			trouble = 0;
 		}
+		scan = totalmem/SMALLSCAN;
+		if (trouble) {
+			scan += (desfree - freemem) * SCANRATE;
+			if (scan > totalmem/LARGESCAN) {
+				scan = totalmem/LARGESCAN;
+			}
+		}
 
 		/*
-		 * Sleep after the appropriate number of iterations
+		 * Sleep after the appropriate number of iterations.
+		 * When short, come back sooner.
 		 */
-		if (npg > troub_cnt[trouble]) {
+		if (npg > scan) {
 			npg = 0;
+			vmstat.psv_scanrate = scan;
 #ifdef WATCHMEM
 			{
 				ulong ofree, odes, omin, otroub;
@@ -532,18 +606,47 @@ pageout(void)
 			}
 #endif
 
+			/*
+			 * Short of memory, let go of some cached files
+			 * nobody's using; their pages go with them.
+			 */
+			if (trouble) {
+				(void)trim_maps(trouble * MAPTRIM);
+			}
+
 			/*
 			 * Suspend until the next interval
 			 */
-			interval_sleep(pageout_secs);
+			interval_sleep(trouble ? 1 : pageout_secs);
+			vmstat.psv_passes += 1;
+		}
+
+		/*
+		 * Tally the lists as the first hand passes, and
+		 * publish the counts each time round
+		 */
+		if ((hand1->c_flags & C_ALLOC) && hand1->c_pset) {
+			if (hand1->c_flags & C_ACTIVE) {
+				nactive += 1;
+			} else {
+				ninactive += 1;
+			}
 		}
 
 		/*
-		 * Do the two hand algorithms
+		 * Age the active pages, and reclaim from the
+		 * inactive ones if we need memory
 		 */
-		do_hand(hand1, trouble, steal1);
+		do_hand(hand1, trouble, 1, age_page);
 		ADVANCE(hand1);
-		do_hand(hand2, trouble, steal2);
+		if (hand1 <= base) {
+			vmstat.psv_active = nactive;
+			vmstat.psv_inactive = ninactive;
+			nactive = ninactive = 0;
+		}
+		if (trouble) {
+			do_hand(hand2, trouble, 0, reclaim_page);
+		}
 		ADVANCE(hand2);
 		npg += 1;
 	}
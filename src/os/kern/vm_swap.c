@@ -37,84 +37,95 @@ ulong swap_leaked = 0L;		/* Pages lost before swap manager up */
 
 /*
  * seg_physcopy()
- *	Copy out returned segments to a physical page
+ *	Copy out returned segments to a list of physical pages
+ *
+ * Returns the number of bytes copied, or -1 on error.
  */
-static
-seg_physcopy(struct sysmsg *sm, uint pfn)
+static int
+seg_physcopy(struct sysmsg *sm, uint *pfns, uint npg)
 {
-	uint x, y, nbyte, cnt;
+	uint x, y, cnt, off, left, pg, total;
 	char *p;
 	struct seg *s;
 	struct vas *vas = &curthread->t_proc->p_vas;
 
-	p = (char *)ptov(ptob(pfn));
-	nbyte = NBPG;
-	for (x = 0; nbyte && (x < sm->sm_nseg); ++x) {
-		s = sm->sm_seg[x];
-
-		/*
-		 * Calculate amount to copy next
-		 */
-		if (s->s_len > nbyte) {
-			cnt = nbyte;
-		} else {
-			cnt = s->s_len;
-		}
+	pg = total = 0;
+	p = (char *)ptov(ptob(pfns[0]));
+	left = NBPG;
+	for (x = 0; (pg < npg) && (x < sm->sm_nseg); ++x) {
+		s = SM_SEGV(sm)[x];
 
 		/*
 		 * Attach the memory
 		 */
 		if (attach_seg(vas, s)) {
-			return(1);
+			return(-1);
 		}
 
 		/*
-		 * Copy the indicated amount
+		 * Copy it, a page at a time
 		 */
-		y = copyin((char *)(s->s_pview.p_vaddr)+s->s_off, p, cnt);
-
-		/*
-		 * Detach and return error if copyin() failed
-		 */
-		detach_seg(s);
-		if (y) {
-			return(1);
+		off = 0;
+		while ((off < s->s_len) && (pg < npg)) {
+			cnt = s->s_len - off;
+			if (cnt > left) {
+				cnt = left;
+			}
+			y = copyin((char *)(s->s_pview.p_vaddr) + s->s_off + off,
+				p, cnt);
+
+			/*
+			 * Detach and return error if copyin() failed
+			 */
+			if (y) {
+				detach_seg(s);
+				return(-1);
+			}
+
+			/*
+			 * Advance counters, onto the next page when
+			 * this one's full
+			 */
+			off += cnt;
+			p += cnt;
+			left -= cnt;
+			total += cnt;
+			if ((left == 0) && (++pg < npg)) {
+				p = (char *)ptov(ptob(pfns[pg]));
+				left = NBPG;
+			}
 		}
-
-		/*
-		 * Advance counters
-		 */
-		p += cnt;
-		nbyte -= cnt;
+		detach_seg(s);
 	}
-	return(0);
+	return(total);
 }
 
 /*
- * pageio()
- *	Set up a synchronous page I/O
+ * do_pageio()
+ *	Send a page I/O message, wait for its completion
  *
- * This isn't used strictly for swap, though swapdev is probably
- * the most common destination for pageios.
+ * The segments are already in "sm"; the pages they describe are
+ * listed in "pfns", for any data which comes back in a reply.  On
+ * success, *cntp is updated to the number of bytes which came back;
+ * data placed directly in our own segments is taken to be all of it.
  */
-pageio(uint pfn, struct portref *pr, uint off, uint cnt, int op)
+static int
+do_pageio(struct sysmsg *sm, uint *pfns, uint npg, struct portref *pr,
+	ulong off, uint *cntp, int op)
 {
-	struct sysmsg sm;
-	int error = 0;
+	int x, error = 0;
 
 	ASSERT_DEBUG((op == FS_ABSREAD) || (op == FS_ABSWRITE),
 		"pageio: illegal op");
 	ASSERT(pr, "pageio: null portref");
 
 	/*
-	 * Construct a system message
+	 * Finish the system message
 	 */
-	sm.sm_sender = pr;
-	sm.sm_op = op;
-	sm.sm_nseg = 1;
-	sm.sm_arg = cnt;
-	sm.sm_arg1 = off;
-	sm.sm_seg[0] = kern_mem(ptov(ptob(pfn)), cnt);
+	sm->sm_sender = pr;
+	sm->sm_op = op;
+	sm->sm_arg = *cntp;
+	sm->sm_arg1 = off;
 
 	/*
 	 * One at a time through the portref
@@ -127,6 +138,7 @@ pageio(uint pfn, struct portref *pr, uint off, uint cnt, int op)
 	 */
 	if (pr->p_port == 0) {
 		v_lock(&pr->p_lock, SPL0_SAME);
+		freesegs(sm);
 		error = 1;
 		goto out;
 	}
@@ -140,7 +152,7 @@ pageio(uint pfn, struct portref *pr, uint off, uint cnt, int op)
 	/*
 	 * Put message on queue
 	 */
-	queue_msg(pr->p_port, &sm, SPL0);
+	queue_msg(pr->p_port, sm, SPL0);
 
 	/*
 	 * Now wait for the I/O to finish or be interrupted
@@ -150,16 +162,21 @@ pageio(uint pfn, struct portref *pr, uint off, uint cnt, int op)
 	/*
 	 * If the server indicates error, set it and leave
 	 */
-	if (sm.sm_arg == -1) {
+	if (sm->sm_arg == -1) {
 		error = 1;
 	} else {
 		/*
 		 * If we got segments back, copy them out and let
 		 * them go.
 		 */
-		if (sm.sm_nseg > 0) {
-			error = seg_physcopy(&sm, pfn);
-			freesegs(&sm);
+		if (sm->sm_nseg > 0) {
+			x = seg_physcopy(sm, pfns, npg);
+			if (x < 0) {
+				error = 1;
+			} else {
+				*cntp = x;
+			}
+			freesegs(sm);
 		}
 	}
 
@@ -176,6 +193,84 @@ out:
 	return(error);
 }
 
+/*
+ * pageio()
+ *	Set up a synchronous page I/O
+ *
+ * This isn't used strictly for swap, though swapdev is probably
+ * the most common destination for pageios.
+ */
+pageio(uint pfn, struct portref *pr, uint off, uint cnt, int op)
+{
+	struct sysmsg sm;
+
+	sm.sm_nseg = 1;
+	sm.sm_seg[0] = kern_mem(ptov(ptob(pfn)), cnt);
+	return(do_pageio(&sm, &pfn, 1, pr, off, &cnt, op));
+}
+
+/*
+ * pageio_run()
+ *	Read a run of physically contiguous pages
+ *
+ * They go as a single segment, so any server which can answer a
+ * pageio() can answer this.  The server may send back less than we
+ * asked for; returns the number of pages which came in whole--though
+ * the first counts even if short, as for pageio()--or -1 on error.
+ */
+int
+pageio_run(uint pfn, struct portref *pr, ulong off, uint npg)
+{
+	struct sysmsg sm;
+	uint x, cnt, pfns[PAGECLUSTER];
+
+	ASSERT_DEBUG((npg > 0) && (npg <= PAGECLUSTER),
+		"pageio_run: bad count");
+	for (x = 0; x < npg; ++x) {
+		pfns[x] = pfn + x;
+	}
+	cnt = ptob(npg);
+	sm.sm_nseg = 1;
+	sm.sm_seg[0] = kern_mem(ptov(ptob(pfn)), cnt);
+	if (do_pageio(&sm, pfns, npg, pr, off, &cnt, FS_ABSREAD)) {
+		return(-1);
+	}
+	x = btop(cnt);
+	return(x ? x : 1);
+}
+
+/*
+ * pageio_cluster()
+ *	Synchronous I/O of a run of pages
+ *
+ * The pages need not be physically contiguous; each goes as its own
+ * segment of a single message, covering "npg" pages at byte offset
+ * "off" of the portref.  Past MSGSEGS pages, the segments go in a
+ * vector of their own, which the receiver takes over.
+ */
+int
+pageio_cluster(uint *pfns, uint npg, struct portref *pr, ulong off, int op)
+{
+	struct sysmsg sm;
+	struct seg **segv;
+	uint x, cnt;
+
+	ASSERT_DEBUG((npg > 0) && (npg <= MSGSEGS_SGL),
+		"pageio_cluster: bad count");
+	if (npg > MSGSEGS) {
+		segv = MALLOC(npg * sizeof(struct seg *), MT_MSG);
+		sm.sm_xseg = segv;
+	} else {
+		segv = sm.sm_seg;
+	}
+	for (x = 0; x < npg; ++x) {
+		segv[x] = kern_mem(ptov(ptob(pfns[x])), NBPG);
+	}
+	sm.sm_nseg = npg;
+	cnt = ptob(npg);
+	return(do_pageio(&sm, pfns, npg, pr, off, &cnt, op));
+}
+
 /*
  * set_swapdev()
  *	System call to set swap manager
@@ -205,11 +300,18 @@ set_swapdev(port_t arg_port)
 	/*
 	 * Steal away his port
 	 */
-	pr = delete_portref(curthread->t_proc, arg_port, 0);
+	pr = delete_portref(curthread->t_proc, arg_port, 1);
 	if (!pr) {
 		return(-1);
 	}
 
+	/*
+	 * Paging talks to swap one message at a time, so drop any
+	 * tagged mode.  delete_portref() drained it for us.
+	 */
+	pr->p_flags &= ~PF_TAGGED;
+	v_sema(&pr->p_sema);
+
 	/*
 	 * It becomes swapdev
 	 */
@@ -221,9 +323,12 @@ set_swapdev(port_t arg_port)
 /*
  * alloc_swap()
  *	Request a chunk of swap from the swap manager
+ *
+ * "hint", if non-zero, is a swap block the new chunk would best be
+ * near; the swap manager starts its search there.
  */
 ulong
-alloc_swap(uint pages)
+alloc_swap(uint pages, ulong hint)
 {
 	long args[3];
 
@@ -249,7 +354,7 @@ alloc_swap(uint pages)
 	 * block numbers to the "pending" swap.
 	 */
 	if (args[0]) {
-		ASSERT(alloc_swap(args[0]) == 1,
+		ASSERT(alloc_swap(args[0], 0) == 1,
 			"alloc_swap: pend != 1");
 	}
 
@@ -272,7 +377,7 @@ alloc_swap(uint pages)
 	 */
 	for (;;) {
 		ASSERT(swapdev, "alloc_swap: manager not ready");
-		args[0] = pages; args[1] = 0;
+		args[0] = pages; args[1] = hint;
 		p_sema(&swapdev->p_sema, PRIHI);
 		ASSERT(kernmsg_send(swapdev, SWAP_ALLOC, args) == 0,
 			"alloc_swap: failed send");
@@ -2,14 +2,38 @@
  * xclock.c
  *	Handling of clock ticks and such
  *
- * The assumption in VSTa is that each CPU has a regular clock tick.
- * Each CPU keeps its own count of time; in systems where the CPUs
- * run off a common bus clock there will be no time drift.  For
- * others, additional code to correct drift would have to be added.
+ * One count of time is kept for the system, under time_lock.  It's
+ * the time at which the current clock interval began, to which the
+ * PIT's count since then is added to tell the time to the microsecond.
+ * Each clock interrupt, and each change of the PIT's programming,
+ * starts a new interval.
  *
  * In order to simplify things we actually only keep track of the time
  * since VSTa was booted - if our system time is changed we simply adjust
  * our boot time and keep the number of seconds of uptime consistent.
+ *
+ * Sleepers are kept on a timer wheel, filed by the clock tick (1/HZ of
+ * a second) in which they're due.  Level 0 has a slot for each of the
+ * next WHEEL_SIZE ticks; each slot of level 1 covers WHEEL_SIZE ticks,
+ * and so on up.  As the wheel turns past the end of a slot in one
+ * level, the slot above is emptied down into it.  So a sleeper is
+ * filed and pulled in constant time, and each tick looks only at the
+ * sleepers due in it.
+ *
+ * The PIT normally ticks HZ times a second.  When a sleeper falls due
+ * before the next tick, the PIT is set to interrupt once at just that
+ * time; it's put back to ticking at the next tick with nobody due
+ * sooner.
+ *
+ * Ticks are only needed while threads wait for a CPU, to take turns.
+ * With none waiting--all CPUs idle, or each running its one thread--
+ * the clock may go tickless: the PIT is set to interrupt once, when
+ * the next sleeper is due, and ticks which go by meanwhile are billed
+ * all at once at the next interrupt.  Reprogramming the PIT costs a
+ * little accuracy each time, so this is only done when a whole tick
+ * can be skipped.  The PIT counts at most PIT_MAX, so at HZ of 20
+ * that's never, and the clock simply keeps ticking; at rates above
+ * about 35 a tick can be skipped.
  */
 #include <sys/percpu.h>
 #include <sys/thread.h>
@@ -24,61 +48,336 @@
 #include "../mach/timer.h"
 
 /*
- * CVT_TIME()
- *	Convert from internal hz/sec format into "struct time"
+ * Shape of the timer wheel
+ */
+#define WHEEL_BITS (6)
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define NWHEEL (4)
+#define WHEEL_SPAN(l) (1L << (WHEEL_BITS * (l)))	/* Ticks per slot */
+
+/*
+ * How close after a tick a one-shot may end and still go back
+ * to regular ticks
+ */
+#define TICK_SLOP (TICK_USEC / 8)
+
+/*
+ * TICKNO()
+ *	Clock tick since boot for a boot-relative time
+ */
+#define TICKNO(t) ((t)->t_sec * HZ + (t)->t_usec / TICK_USEC)
+
+/*
+ * TIME_LE()
+ *	Tell if one time is at or before another
  */
-#define CVT_TIME(tim, t) { \
-	(t)->t_sec = (tim)[1]; \
-	(t)->t_usec = (tim)[0] * (1000000/HZ); }
+#define TIME_LE(t1, t2) (((t1)->t_sec < (t2)->t_sec) || \
+	(((t1)->t_sec == (t2)->t_sec) && ((t1)->t_usec <= (t2)->t_usec)))
 
-static struct eventq		/* List of sleepers pending */
-	*eventq = 0;
-static lock_t time_lock;	/* Mutex on eventq */
+static struct eventq		/* Sleepers pending */
+	*wheel[NWHEEL][WHEEL_SIZE];
+static ulong wheel_tick;	/* Tick the wheel has turned to */
+static lock_t time_lock;	/* Mutex on wheel and time */
+
+static struct time		/* Uptime as of start of clock interval */
+	clk_time = {0, 0};
+static ulong clk_rem;		/*  ...and fraction of a usec */
 
 static struct time		/* Time that the system booted */
 	boot_time = {0, 0};
 
+ulong ticks_taken,		/* Ticks with a clock interrupt */
+	ticks_skipped;		/*  ...and without */
+
 /*
- * alarm_wakeup()
- *	Wake up all those whose time interval has passed
+ * clock_add()
+ *	Advance the time by some PIT counts
+ */
+static void
+clock_add(ulong counts)
+{
+	clk_time.t_usec += pit_usec(counts, &clk_rem);
+	while (clk_time.t_usec >= 1000000) {
+		clk_time.t_sec += 1;
+		clk_time.t_usec -= 1000000;
+	}
+}
+
+/*
+ * get_now()
+ *	Get the uptime, to the microsecond
+ *
+ * Called with time_lock held.
  */
 static void
-alarm_wakeup(struct time *t)
+get_now(struct time *t)
 {
-	long l = t->t_sec, l2 = t->t_usec;
-	struct eventq *e, **ep;
+	*t = clk_time;
+	t->t_usec += get_itime();
+	while (t->t_usec >= 1000000) {
+		t->t_sec += 1;
+		t->t_usec -= 1000000;
+	}
+}
 
-	ep = &eventq;
+/*
+ * uptime()
+ *	Return the uptime of the system
+ */
+void
+uptime(struct time *t)
+{
 	p_lock_void(&time_lock, SPLHI);
-	for (e = eventq; e; e = e->e_next) {
-		/*
-		 * Our list is ordered to the second, so we can bail
-		 * when we've come this far.
-		 */
-		if (e->e_time.t_sec > l) {
+	get_now(t);
+	v_lock(&time_lock, SPL0);
+}
+
+/*
+ * time_left()
+ *	Microseconds from one time until another
+ *
+ * Returns 0 if it's already passed, and ~0 if it's a long way off.
+ */
+static ulong
+time_left(struct time *t, struct time *now)
+{
+	if (TIME_LE(t, now)) {
+		return(0);
+	}
+	if ((t->t_sec - now->t_sec) > 2) {
+		return(~0);
+	}
+	return((t->t_sec - now->t_sec) * 1000000 +
+		(t->t_usec - now->t_usec));
+}
+
+/*
+ * clock_left()
+ *	Microseconds until the clock next interrupts
+ *
+ * Called with time_lock held.
+ */
+static ulong
+clock_left(void)
+{
+	ulong n = get_icount();
+
+	if (n >= latch_ticks) {
+		return(0);
+	}
+	return(pit_usec(latch_ticks - n, 0));
+}
+
+/*
+ * wheel_insert()
+ *	File a sleeper in the timer wheel
+ *
+ * Called with time_lock held.
+ */
+static void
+wheel_insert(struct eventq *e)
+{
+	ulong tick = e->e_tick, delta;
+	struct eventq **ep;
+	int l;
+
+	/*
+	 * Anything already past goes in the current slot.  Anything
+	 * further off than the wheel reaches is filed at its far
+	 * end, and filed again as it comes down.
+	 */
+	delta = tick - wheel_tick;
+	if ((long)delta < 0) {
+		tick = wheel_tick;
+		delta = 0;
+	} else if (delta >= WHEEL_SPAN(NWHEEL)) {
+		tick = wheel_tick + WHEEL_SPAN(NWHEEL) - 1;
+		delta = WHEEL_SPAN(NWHEEL) - 1;
+	}
+	for (l = 0; l < NWHEEL-1; ++l) {
+		if (delta < WHEEL_SPAN(l+1)) {
 			break;
 		}
+	}
+	ep = &wheel[l][(tick >> (WHEEL_BITS * l)) & WHEEL_MASK];
+	e->e_next = *ep;
+	if (e->e_next) {
+		e->e_next->e_prev = &e->e_next;
+	}
+	e->e_prev = ep;
+	*ep = e;
+}
+
+/*
+ * wheel_remove()
+ *	Pull a sleeper from the timer wheel
+ */
+static void
+wheel_remove(struct eventq *e)
+{
+	*e->e_prev = e->e_next;
+	if (e->e_next) {
+		e->e_next->e_prev = e->e_prev;
+	}
+}
+
+/*
+ * cascade()
+ *	Empty slots from upper levels down, as the wheel reaches a tick
+ */
+static void
+cascade(ulong tick)
+{
+	struct eventq *e, *en;
+	int l, idx;
+
+	for (l = 1; l < NWHEEL; ++l) {
+		if (tick & (WHEEL_SPAN(l) - 1)) {
+			break;
+		}
+		idx = (tick >> (WHEEL_BITS * l)) & WHEEL_MASK;
+		e = wheel[l][idx];
+		wheel[l][idx] = 0;
+		for ( ; e; e = en) {
+			en = e->e_next;
+			wheel_insert(e);
+		}
+	}
+}
+
+/*
+ * alarm_wakeup()
+ *	Wake up all those whose time interval has passed
+ *
+ * Turns the wheel up to the current tick.  Called with time_lock held.
+ */
+static void
+alarm_wakeup(struct time *now)
+{
+	ulong tick = TICKNO(now);
+	struct eventq *e, *en;
+
+	for (;;) {
+		for (e = wheel[0][wheel_tick & WHEEL_MASK]; e; e = en) {
+			en = e->e_next;
+			if (!TIME_LE(&e->e_time, now)) {
+				continue;
+			}
 
-		/*
-		 * If this is a "hit", wake him and pull him from the list
-		 */
-		if (((e->e_time.t_sec == l) && (e->e_time.t_usec <= l2)) ||
-				(e->e_time.t_sec < l)) {
 			/*
 			 * Note he can't free this until he takes time_lock,
 			 * so we can't race on the use of these fields.
 			 */
+			wheel_remove(e);
 			e->e_onlist = 0;
-			*ep = e->e_next;
 			v_sema(&e->e_sema);
-		} else {
-			/*
-			 * Keep looking
-			 */
-			ep = &e->e_next;
 		}
+		if ((long)(tick - wheel_tick) <= 0) {
+			break;
+		}
+		wheel_tick += 1;
+		cascade(wheel_tick);
+	}
+}
+
+/*
+ * next_event()
+ *	Microseconds until the next sleeper in the current tick
+ *
+ * Returns ~0 if there's none.  Called after alarm_wakeup(), with
+ * time_lock held.
+ */
+static ulong
+next_event(struct time *now)
+{
+	struct eventq *e;
+	ulong usec, best = ~0;
+
+	for (e = wheel[0][wheel_tick & WHEEL_MASK]; e; e = e->e_next) {
+		usec = time_left(&e->e_time, now);
+		if (usec < best) {
+			best = usec;
+		}
+	}
+	return(best);
+}
+
+/*
+ * idle_next()
+ *	Microseconds until the clock must interrupt, with no ticks
+ *
+ * We look at the sleepers in this tick and the next, so the clock may
+ * run no later than the end of the next tick.  If the next starts a
+ * new turn of level 0, its sleepers may still be up in level 1, so
+ * then we may only run to the end of this one.  Called after
+ * alarm_wakeup(), with time_lock held.
+ */
+static ulong
+idle_next(struct time *now)
+{
+	struct eventq *e;
+	ulong next, left, usec;
+
+	next = next_event(now);
+	left = TICK_USEC - (now->t_usec % TICK_USEC);
+	if ((wheel_tick + 1) & WHEEL_MASK) {
+		left += TICK_USEC;
+		for (e = wheel[0][(wheel_tick + 1) & WHEEL_MASK]; e;
+				e = e->e_next) {
+			usec = time_left(&e->e_time, now);
+			if (usec < next) {
+				next = usec;
+			}
+		}
+	}
+	if (next < left) {
+		return(next);
+	}
+	return(left);
+}
+
+/*
+ * set_next()
+ *	Program the clock for its next interrupt
+ *
+ * A one-shot must always be followed by another interrupt of some
+ * sort; the PIT only goes back to ticking just after a tick, so its
+ * ticks stay in step with ours.  Called with time_lock held.
+ */
+static void
+set_next(struct time *now)
+{
+	ulong next, left, counts;
+
+	/*
+	 * With nobody waiting for a CPU, no ticks are needed; go
+	 * tickless.  Each change to the PIT's programming loses a
+	 * little time, so only when it saves at least a whole tick:
+	 * the next deadline must be about a tick past the next tick,
+	 * and the PIT able to count that far.
+	 */
+	left = TICK_USEC - (now->t_usec % TICK_USEC);
+	if (num_queued == 0) {
+		counts = usec_pit(idle_next(now));
+		if (pit_usec(counts, 0) >= (left + TICK_USEC - TICK_SLOP)) {
+			clock_add(set_clock(counts));
+			return;
+		}
+	}
+
+	next = next_event(now);
+	if (clock_oneshot) {
+		if (next < left) {
+			left = next;
+		} else if (left > (TICK_USEC - TICK_SLOP)) {
+			clock_add(set_clock(0));
+			return;
+		}
+		clock_add(set_clock(usec_pit(left)));
+	} else if (next < clock_left()) {
+		clock_add(set_clock(usec_pit(next)));
 	}
-	v_lock(&time_lock, SPLHI_SAME);
 }
 
 /*
@@ -93,44 +392,64 @@ hardclock(struct trapframe *f)
 {
 	struct percpu *c = &cpu;
 	struct thread *t;
-	struct time tm;
+	struct time now;
+	ulong ticks;
 
 	/*
 	 * If we re-entered, just log a tick and get out.  Otherwise
-	 * flag us as being in clock handling.  Further interrupts are
-	 * now allowed.
+	 * flag us as being in clock handling.
 	 */
 	if (c->pc_flags & CPU_CLOCK) {
 		ATOMIC_INCL(&c->pc_ticks);
 		return;
 	}
 	c->pc_flags |= CPU_CLOCK;
-	c->pc_time[0] += c->pc_ticks;
-	c->pc_ticks = 0;
 	NO_PREEMPT();
-	sti();
 
 	/*
-	 * Bump time for our local CPU.  Lower slot counts up until HZ;
-	 * upper bits then are in units of seconds.
+	 * Bring time up to date.  When ticking, the interrupt started
+	 * a new interval by itself, along with any we missed; a
+	 * one-shot runs on until set_next() ends it.
+	 */
+	p_lock_void(&time_lock, SPLHI);
+	if (!clock_oneshot) {
+		clock_add(latch_ticks * (1 + c->pc_ticks));
+	}
+	c->pc_ticks = 0;
+	get_now(&now);
+
+	/*
+	 * Wake anyone whose time has come, and set up the next
+	 * interrupt
+	 */
+	alarm_wakeup(&now);
+	set_next(&now);
+	v_lock(&time_lock, SPLHI_SAME);
+
+	/*
+	 * See how many ticks have gone by since we last billed.  An
+	 * interrupt for a one-shot may come with none.  Further
+	 * interrupts are now allowed.
 	 */
-	c->pc_time[0] += 1;
-	while (c->pc_time[0] >= HZ) {
-		c->pc_time[1] += 1;
-		c->pc_time[0] -= HZ;
+	ticks = TICKNO(&now) - c->pc_tick;
+	c->pc_tick += ticks;
+	if (ticks) {
+		ticks_taken += 1;
+		ticks_skipped += ticks - 1;
 	}
+	sti();
 
 	/*
 	 * If there's a current thread...
 	 */
-	if ((t = c->pc_thread)) {
+	if (ticks && (t = c->pc_thread)) {
 		/*
 		 * Bill time to it
 		 */
 		if (USERMODE(f)) {
-			t->t_usrcpu += 1L;
+			t->t_usrcpu += ticks;
 		} else {
-			t->t_syscpu += 1L;
+			t->t_syscpu += ticks;
 		}
 
 		/*
@@ -145,10 +464,14 @@ hardclock(struct trapframe *f)
 		/*
 		 * If current thread's allocated amount of CPU is
 		 * complete and there are others waiting to run,
-		 * timeslice.
+		 * timeslice.  Its slice ends with the tick in which
+		 * its last one ran out, however many went by since
+		 * the last interrupt.
 		 */
-		if (t->t_runticks > 0) {
-			t->t_runticks -= 1;
+		if (t->t_runticks > ticks) {
+			t->t_runticks -= ticks;
+		} else {
+			t->t_runticks = 0;
 		}
 		if (t->t_runticks == 0) {
 			if (t->t_oink < T_MAX_OINK) {
@@ -158,15 +481,6 @@ hardclock(struct trapframe *f)
 		}
 	}
 
-	/*
-	 * Wake anyone waiting to run.  Can't race on pc_time[]
-	 * because we hold the CPU_CLOCK bit.
-	 */
-	if (eventq) {
-		CVT_TIME(c->pc_time, &tm);
-		alarm_wakeup(&tm);
-	}
-
 	/*
 	 * Clear flag & done
 	 */
@@ -190,28 +504,19 @@ time_set(struct time *arg_time)
 	}
 
 	/*
-	 * Reference the new time to our CPU time and determine when
+	 * Reference the new time to our uptime and determine when
 	 * our boot-time really was
 	 */
-	cli();
-	CVT_TIME(cpu.pc_time, &ct);
-	ct.t_usec += get_itime();
-	sti();
-	
+	p_lock_void(&time_lock, SPLHI);
+	get_now(&ct);
 	t.t_sec -= ct.t_sec;
 	t.t_usec -= ct.t_usec;
 	if (t.t_usec < 0) {
 		t.t_sec -= 1;
 		t.t_usec += 1000000;
-	} else if (t.t_usec >= 1000000) {
-		t.t_sec += 1;
-		t.t_usec -= 1000000;
 	}
-
-	cli();
-	boot_time.t_usec = t.t_usec;
-	boot_time.t_sec = t.t_sec;
-	sti();
+	boot_time = t;
+	v_lock(&time_lock, SPL0);
 	return(0);
 }
 
@@ -226,13 +531,12 @@ time_get(struct time *arg_time)
 	/*
 	 * Get time in desired format, hand to user
 	 */
-	cli();
-	CVT_TIME(cpu.pc_time, &t);
+	p_lock_void(&time_lock, SPLHI);
+	get_now(&t);
 	t.t_sec += boot_time.t_sec;
 	t.t_usec += boot_time.t_usec;
-	t.t_usec += get_itime();
-	sti();
-	while (t.t_usec >= 1000000) {
+	v_lock(&time_lock, SPL0);
+	if (t.t_usec >= 1000000) {
 		t.t_sec += 1;
 		t.t_usec -= 1000000;
 	}
@@ -245,41 +549,47 @@ time_get(struct time *arg_time)
 
 /*
  * timed_sleep()
- *	Suspend for the indicated interval
+ *	Suspend until the indicated uptime
  *
  * Permit interruptions if "intr" is non-zero.
  */
 static int
 timed_sleep(struct time *t, int intr)
 {
-	ulong l = t->t_sec;
-	struct eventq *ev, *e, **ep;
+	struct eventq *ev;
+	struct time now;
+	ulong left;
 
 	/*
 	 * Get an event element, fill it in
 	 */
 	ev = MALLOC(sizeof(struct eventq), MT_EVENTQ);
 	ev->e_time = *t;
+	ev->e_tick = TICKNO(t);
 	ev->e_tid = curthread->t_pid;
 	init_sema(&ev->e_sema); set_sema(&ev->e_sema, 0);
-	ev->e_onlist = 1;
 
 	/*
-	 * Lock the list, find our place, insert.  We only sort in
-	 * granularity of the second; this keeps our loop simpler,
-	 * and hopefully there won't be too many events scheduled
-	 * for the same second.
+	 * Lock, and see if it's even worth going to sleep
 	 */
-	ep = &eventq;
 	p_lock_void(&time_lock, SPLHI);
-	for (e = eventq; e; e = e->e_next) {
-		if (l <= e->e_time.t_sec) {
-			break;
-		}
-		ep = &e->e_next;
+	get_now(&now);
+	left = time_left(t, &now);
+	if (left == 0) {
+		v_lock(&time_lock, SPL0);
+		FREE(ev, MT_EVENTQ);
+		return(0);
+	}
+
+	/*
+	 * Into the wheel.  If we're due before the clock would next
+	 * interrupt, have it interrupt for us.
+	 */
+	wheel_insert(ev);
+	ev->e_onlist = 1;
+	if (left < clock_left()) {
+		clock_add(set_clock(usec_pit(left)));
 	}
-	ev->e_next = e;
-	*ep = ev;
 
 	/*
 	 * Atomically switch to the semaphore.  We will either return
@@ -291,22 +601,11 @@ timed_sleep(struct time *t, int intr)
 		ASSERT_DEBUG(intr, "interval_sleep: intr");
 
 		/*
-		 * Regain lock, and see if we're still on the list.
+		 * Regain lock, and see if we're still in the wheel
 		 */
 		p_lock_void(&time_lock, SPLHI);
 		if (ev->e_onlist) {
-			/*
-			 * Hunt ourselves down and remove from the list
-			 */
-			ep = &eventq;
-			for (e = eventq; e; e = e->e_next) {
-				if (e == ev) {
-					*ep = ev->e_next;
-					break;
-				}
-				ep = &e->e_next;
-			}
-			ASSERT(e, "alarm_set: lost event");
+			wheel_remove(ev);
 		}
 		v_lock(&time_lock, SPL0);
 		FREE(ev, MT_EVENTQ);
@@ -326,7 +625,7 @@ interval_sleep(int secs)
 {
 	struct time tm;
 
-	CVT_TIME(cpu.pc_time, &tm);
+	uptime(&tm);
 	tm.t_sec += secs;
 	(void)timed_sleep(&tm, 0);
 }
@@ -334,6 +633,9 @@ interval_sleep(int secs)
 /*
  * time_sleep()
  *	Sleep for the indicated amount of time
+ *
+ * The time is given to the microsecond, and that's about when we
+ * wake.
  */
 int
 time_sleep(struct time *arg_time)
@@ -346,33 +648,17 @@ time_sleep(struct time *arg_time)
 	if (copyin(arg_time, &t, sizeof(t))) {
 		return(-1);
 	}
-	
+
 	/*
 	 * Convert the time to a boot time referenced value
 	 */
-	cli();
+	p_lock_void(&time_lock, SPLHI);
 	t.t_sec -= boot_time.t_sec;
 	t.t_usec -= boot_time.t_usec;
-	sti();
+	v_lock(&time_lock, SPL0);
 	if (t.t_usec < 0) {
 		t.t_sec -= 1;
 		t.t_usec += 1000000;
 	}
 	return(timed_sleep(&t, 1));
 }
-
-/*
- * uptime()
- *	Return the uptime of the system
- */
-void uptime(struct time *t)
-{
-	cli();
-	CVT_TIME(cpu.pc_time, t);
-	t->t_usec += get_itime();
-	sti();
-	if (t->t_usec >= 1000000) {
-		t->t_sec += 1;
-		t->t_usec -= 1000000;
-	}
-}
@@ -11,6 +11,7 @@
 #include <sys/vm.h>
 #define MALLOC_INTERNAL
 #include <sys/malloc.h>
+#include <sys/percpu.h>
 #include "../mach/locore.h"
 #include "../mach/vminline.h"
 
@@ -64,6 +65,9 @@ dbg_vtop(ulong addr)
  		printf("Error: L1PT invalid on 0x%x\n", addr);
  		longjmp(dbg_errjmp, 1);
 	}
+	if (l & PT_PS) {
+		return((l & PT_PSPFN) | (addr & ~PT_PSPFN));
+	}
 
  	/*
  	 * Get just page number part, add in offset from vaddr,
@@ -148,28 +152,113 @@ maploc(ulong off, uint size, int phys)
 }
 
 /*
- * dump_buck()
- *	Dump out change from old to new bucket state
+ * cache_live()
+ *	Tell how many of a cache's objects are really in use
+ *
+ * Those sitting in a CPU's magazine are free, but count as in use
+ * to the slabs.
+ */
+static uint
+cache_live(struct cache *c)
+{
+	struct percpu *pc;
+	uint n;
+
+	n = c->c_inuse;
+	pc = nextcpu;
+	do {
+		if (pc->pc_mags) {
+			n -= pc->pc_mags[c - caches].m_rounds;
+		}
+		pc = pc->pc_next;
+	} while (pc != nextcpu);
+	return(n);
+}
+
+/*
+ * cache_name()
+ *	Print name of a cache
+ */
+static void
+cache_name(struct cache *c)
+{
+	if (c->c_name) {
+		printf("%s", c->c_name);
+	} else {
+		printf("%d byte", c->c_size);
+	}
+}
+
+/*
+ * dump_cache()
+ *	Dump out change from old to new cache state
  */
 static void
-dump_buck(struct bucket *n, struct bucket *o)
+dump_cache(struct cache *n, struct cache *o, uint nlive, uint olive)
 {
-	printf("%d byte pool: ", n->b_size);
-	if (n->b_elems < o->b_elems) {
-		printf("lost %d elems", o->b_elems - n->b_elems);
+	cache_name(n);
+	printf(" pool: ");
+	if (nlive < olive) {
+		printf("lost %d elems", olive - nlive);
 	} else {
-		printf("gained %d elems", n->b_elems - o->b_elems);
+		printf("gained %d elems", nlive - olive);
 	}
-	if (n->b_pages != o->b_pages) {
-		if (n->b_pages < o->b_pages) {
-			printf(", lost %d pages", o->b_pages - n->b_pages);
+	if (n->c_slabs != o->c_slabs) {
+		if (n->c_slabs < o->c_slabs) {
+			printf(", lost %d pages",
+				(o->c_slabs - n->c_slabs) * n->c_slabpgs);
 		} else {
-			printf(", gained %d pages", n->b_pages - o->b_pages);
+			printf(", gained %d pages",
+				(n->c_slabs - o->c_slabs) * n->c_slabpgs);
 		}
 	}
 	printf("\n");
 }
 
+/*
+ * dump_malloc()
+ *	Show each malloc() cache, and how much of its memory is wasted
+ *
+ * Waste is the part of a cache's slabs not holding live objects:
+ * free objects, whether in slabs or magazines, and the tail of each
+ * slab which no object fits.  Types with their own cache are shown
+ * by name; under DEBUG, the bytes held by each type follow.
+ */
+void
+dump_malloc(void)
+{
+	struct cache *c;
+	uint live, bytes;
+	int x;
+
+	for (x = 0, c = caches; x < NCACHE; ++x, ++c) {
+		if (c->c_slabs == 0) {
+			continue;
+		}
+		live = cache_live(c);
+		bytes = ptob(c->c_slabs * c->c_slabpgs);
+		cache_name(c);
+		printf(": %d slabs, %d pages, %d live, %d free, %d%% waste\n",
+			c->c_slabs, c->c_slabs * c->c_slabpgs, live,
+			c->c_slabs * c->c_perslab - live,
+			((bytes - live * c->c_size) * 100) / bytes);
+	}
+#ifdef DEBUG
+	{
+		extern ulong n_alloc[], n_bytes[];
+		extern char *n_allocname[];
+
+		for (x = 0; x < MALLOCTYPES; ++x) {
+			if (n_alloc[x] == 0) {
+				continue;
+			}
+			printf("%s: %d allocated, %d bytes\n", n_allocname[x],
+				n_alloc[x], n_bytes[x]);
+		}
+	}
+#endif
+}
+
 #ifdef DEBUG
 /*
  * dump_usage()
@@ -207,8 +296,10 @@ dump_usage(void)
 void
 memleaks(void)
 {
-	static struct bucket obuckets[PGSHIFT];
-	struct bucket *b, *b2;
+	static struct cache ocaches[NCACHE];
+	static uint olive[NCACHE];
+	struct cache *c, *c2;
+	uint live;
 	static ulong ofreemem;
 	int x;
 	extern ulong freemem;
@@ -226,17 +317,18 @@ memleaks(void)
 	}
 
 	/*
-	 * malloc() pools
+	 * malloc() caches
 	 */
-	b = buckets;
-	b2 = obuckets;
-	for (x = 0; x < PGSHIFT; ++x,++b,++b2) {
-		if ((b->b_elems != b2->b_elems) ||
-				(b->b_pages != b2->b_pages)) {
-			dump_buck(b, b2);
+	c = caches;
+	c2 = ocaches;
+	for (x = 0; x < NCACHE; ++x,++c,++c2) {
+		live = cache_live(c);
+		if ((live != olive[x]) || (c->c_slabs != c2->c_slabs)) {
+			dump_cache(c, c2, live, olive[x]);
 		}
+		olive[x] = live;
 	}
-	bcopy(buckets, obuckets, sizeof(obuckets));
+	bcopy(caches, ocaches, sizeof(ocaches));
 
 #ifdef DEBUG
 	/*
@@ -21,6 +21,16 @@
  *
  * Some of these techniques would work for multiprocessor i386; I
  * have not added any locking, so it still wouldn't be trivial.
+ *
+ * On CPUs with the page size extension, an L1 PTE may instead map
+ * 4 Mb of contiguous memory itself (PT_PS).  hat_addlarge() makes
+ * such mappings for the upper layers, which still account for each
+ * page on its own.  So that we can go back to small pages at any
+ * time--when one page of the 4 Mb is unmapped, or the pageout
+ * daemon needs to see the pages' bits one at a time--we still fill
+ * in an L2PT for each large page, and keep it in h_large[] rather
+ * than in the root.  Going back is then just a matter of putting
+ * it in place; we never need memory to do it.
  */
 #include <sys/proc.h>
 #include <sys/param.h>
@@ -31,12 +41,18 @@
 #include <sys/thread.h>
 #include <sys/percpu.h>
 #include <sys/malloc.h>
+#include <sys/pstat.h>
 #include "../mach/locore.h"
 #include "../mach/vminline.h"
+#include "../kern/pset.h"
 
 #define NRMAPSLOT (20)		/* # slots for our vaddr map */
 
 extern void rmap_init();
+extern uint freemem, desfree;
+extern struct pstat_vm vmstat;
+
+int hat_large;			/* CPU can do 4 Mb pages; see init.c */
 
 /*
  * hat_initvas()
@@ -61,6 +77,7 @@ hat_initvas(struct vas *vas)
 	bzero(c, NBPG);
 	bcopy(cr3, c, freel1pt * sizeof(pte_t));
 	vas->v_hat.h_l1segs = 0L;
+	vas->v_hat.h_large = 0;
 
 	/*
 	 * Get an address map for doing on-demand virtual address
@@ -106,7 +123,11 @@ hat_freevas(struct vas *vas)
 			 * page tables.
 			 */
 			for (x = 0; x < NPTPG/H_L1SEGS; ++x,++pt) {
-				if (*pt & PT_V) {
+				if (*pt & PT_PS) {
+					free_page(vas->v_hat.h_large[
+						pt - vas->v_hat.h_vcr3] >>
+						PT_PFNSHIFT);
+				} else if (*pt & PT_V) {
 					free_page(*pt >> PT_PFNSHIFT);
 				}
 			}
@@ -128,6 +149,67 @@ hat_freevas(struct vas *vas)
 	 */
 	FREE(vas->v_hat.h_vcr3, MT_L1PT);
 	FREE(vas->v_hat.h_map, MT_RMAP);
+	if (vas->v_hat.h_large) {
+		FREE(vas->v_hat.h_large, MT_L1PT);
+	}
+}
+
+/*
+ * zero_page()
+ *	Tell if a page holds nothing but zeroes
+ */
+static int
+zero_page(uint pfn)
+{
+	ulong *p = ptov(ptob(pfn)), *end = p + (NBPG / sizeof(ulong));
+
+	while (p < end) {
+		if (*p++) {
+			return(0);
+		}
+	}
+	return(1);
+}
+
+/*
+ * hat_demote()
+ *	Turn a large page mapping back into small ones
+ *
+ * The ref bit of the large page is handed down to each of its small
+ * pages, and so is the mod bit, but it only says some page was
+ * written.  Anonymous memory started out zeroed, so those of its
+ * pages which still are needn't be taken as modified; pageout can
+ * let them go, to be zero-filled again if touched.  Physical memory
+ * isn't paged, and may not be safe to read, so it's left alone.
+ */
+static void
+hat_demote(struct pview *pv, pte_t *root, void *va)
+{
+	struct vas *vas = pv->p_vas;
+	pte_t *pt, bits;
+	uint x, idx = root - vas->v_hat.h_vcr3;
+
+	bits = *root & (PT_R|PT_M);
+	pt = ptov(vas->v_hat.h_large[idx] & PT_PFN);
+	if (bits) {
+		for (x = 0; x < NPTPG; ++x) {
+			if (!(pt[x] & PT_V)) {
+				continue;
+			}
+			if ((bits & PT_M) && (pv->p_set->p_type == PT_ZERO) &&
+					zero_page(pt[x] >> PT_PFNSHIFT)) {
+				pt[x] |= (bits & ~PT_M);
+			} else {
+				pt[x] |= bits;
+			}
+		}
+	}
+	*root = vas->v_hat.h_large[idx];
+	vas->v_hat.h_large[idx] = 0;
+	vmstat.psv_demoted += 1;
+	if (vas == &curthread->t_proc->p_vas) {
+		flush_tlb(va);
+	}
 }
 
 /*
@@ -150,12 +232,14 @@ hat_addtrans(struct pview *pv, void *va, uint pfn, int prot)
 	 * If there isn't a L2PT page yet, allocate one
 	 */
 	root = (pv->p_vas->v_hat.h_vcr3)+L1IDX(va);
+	if (*root & PT_PS) {
+		hat_demote(pv, root, va);
+	}
 	if (!(*root & PT_V)) {
 		uint pg;
 
-		pg = alloc_page();
+		pg = alloc_zpage();
 		pt = (pte_t *)ptov(ptob(pg));
-		bzero(pt, NBPG);
 		*root = (pg << PT_PFNSHIFT) | PT_V|PT_W|PT_U;
 		pv->p_vas->v_hat.h_l1segs |=
 			(1L << (L1IDX(va)*H_L1SEGS / NPTPG));
@@ -171,6 +255,70 @@ hat_addtrans(struct pview *pv, void *va, uint pfn, int prot)
 		((prot & PROT_RO) ? 0 : PT_W);
 }
 
+/*
+ * hat_addlarge()
+ *	Add a translation for a large page given a view
+ *
+ * va and pfn must both be aligned to H_LARGE pages, and no page in
+ * the range may be mapped yet.  Returns 0 on success, 1 if the
+ * CPU can't do it; the caller must then map the pages one by one.
+ *
+ * May sleep waiting for memory
+ */
+int
+hat_addlarge(struct pview *pv, void *va, uint pfn, int prot)
+{
+	struct hatvas *h = &pv->p_vas->v_hat;
+	pte_t *root, *pt, bits;
+	uint x;
+
+	if (!hat_large) {
+		return(1);
+	}
+	ASSERT_DEBUG(((ulong)va & (BYTES_L1PT-1)) == 0,
+		"hat_addlarge: vaddr unaligned");
+	ASSERT_DEBUG((pfn & (H_LARGE-1)) == 0, "hat_addlarge: pfn unaligned");
+	if (h->h_large == 0) {
+		h->h_large = MALLOC(NBPG, MT_L1PT);
+		bzero(h->h_large, NBPG);
+	}
+
+	/*
+	 * Virtual address is in upper two gigs
+	 */
+	va = (void *)((ulong)va | 0x80000000);
+
+	/*
+	 * Fill in an L2PT just as hat_addtrans() would have.  Use
+	 * the one already here, if there is one.
+	 */
+	root = h->h_vcr3 + L1IDX(va);
+	ASSERT_DEBUG(!(*root & PT_PS), "hat_addlarge: already large");
+	if (!(*root & PT_V)) {
+		uint pg;
+
+		pg = alloc_page();
+		*root = (pg << PT_PFNSHIFT) | PT_V|PT_W|PT_U;
+		h->h_l1segs |= (1L << (L1IDX(va)*H_L1SEGS / NPTPG));
+	}
+	pt = ptov(*root & PT_PFN);
+	bits = PT_V | PT_U | ((prot & PROT_RO) ? 0 : PT_W);
+	for (x = 0; x < NPTPG; ++x) {
+		pt[x] = ((pfn + x) << PT_PFNSHIFT) | bits;
+	}
+
+	/*
+	 * Put it aside, and point the root straight at the memory
+	 */
+	h->h_large[L1IDX(va)] = *root;
+	*root = (pfn << PT_PFNSHIFT) | bits | PT_PS;
+	if (pv->p_vas == &curthread->t_proc->p_vas) {
+		flush_tlb(va);
+	}
+	vmstat.psv_large += 1;
+	return(0);
+}
+
 /*
  * hat_deletetrans()
  *	Delete a translation
@@ -191,6 +339,9 @@ hat_deletetrans(struct pview *pv, void *va, uint pfn)
 	if (!(*root & PT_V)) {
 		return;
 	}
+	if (*root & PT_PS) {
+		hat_demote(pv, root, va);
+	}
 	pt = ptov(*root & PT_PFN);
 	pt += L2IDX(va);
 	if (!(*pt & PT_V)) {
@@ -205,6 +356,11 @@ hat_deletetrans(struct pview *pv, void *va, uint pfn)
 /*
  * hat_getbits()
  *	Atomically get and clear the ref/mod bits on a translation
+ *
+ * A large page has just the one set of bits for all its pages.
+ * While memory is plentiful we report them without clearing,
+ * so its pages all look busy and it stays together.  Once memory
+ * is short, it's broken up so each page can be judged alone.
  */
 uchar
 hat_getbits(struct pview *pv, void *vaddr)
@@ -217,6 +373,13 @@ hat_getbits(struct pview *pv, void *vaddr)
 	if (!(*pt & PT_V)) {
 		return(0);
 	}
+	if (*pt & PT_PS) {
+		if (freemem > desfree) {
+			return(((*pt & PT_R) ? PP_R : 0) |
+				((*pt & PT_M) ? PP_M : 0));
+		}
+		hat_demote(pv, pt, vaddr);
+	}
 	pt = ptov(*pt & PT_PFN);
 	pt += L2IDX(vaddr);
 	x = ((*pt & PT_R) ? PP_R : 0) |
@@ -240,8 +403,10 @@ hat_getbits(struct pview *pv, void *vaddr)
 int
 hat_attach(struct pview *pv)
 {
-	uint pg;
+	uint pg, phase;
 	ulong vaddr = (ulong)pv->p_vaddr;
+	struct pset *ps = pv->p_set;
+	struct rmap *map = pv->p_vas->v_hat.h_map;
 
 	/*
 	 * Don't let them scribble on the kernel's part of the
@@ -257,11 +422,18 @@ hat_attach(struct pview *pv)
 	if (vaddr) {
 		/*
 		 * This bit indicates that this is a duplication of
-		 * the address space, so using our vaddrs is OK.  This
-		 * also assumes that a hat_fork() will follow to bring the
-		 * map up to date.
+		 * the address space, so using our vaddrs is OK.  A
+		 * hat_fork() will generally follow to bring the map up
+		 * to date; when one doesn't (a view moved from a vas
+		 * lent to a vfork() child), taking the space here
+		 * keeps the map right.
 		 */
 		if (pv->p_prot & PROT_FORK) {
+			if ((vaddr >= VMAP_BASE) &&
+					(vaddr < (VMAP_BASE+VMAP_SIZE))) {
+				(void)rmap_grab(map, btop(vaddr),
+					pv->p_len);
+			}
 			return(0);
 		}
 
@@ -275,11 +447,35 @@ hat_attach(struct pview *pv)
 		return(0);
 	}
 
+	/*
+	 * A view which could hold large pages is placed so that they
+	 * line up: anonymous memory on a large page boundary, physical
+	 * memory so that its vaddr and paddr agree within one.  We
+	 * take enough to be sure of such a spot inside, give it all
+	 * back, and then grab just the part we want.
+	 */
+	if (hat_large && (pv->p_len >= H_LARGE) &&
+			((ps->p_type == PT_ZERO) || (ps->p_type == PT_MEM))) {
+		phase = 0;
+		if (ps->p_type == PT_MEM) {
+			phase = find_pp(ps, pv->p_off)->pp_pfn & (H_LARGE-1);
+		}
+		pg = rmap_alloc(map, pv->p_len + H_LARGE - 1);
+		if (pg) {
+			rmap_free(map, pg, pv->p_len + H_LARGE - 1);
+			pg += (phase - pg) & (H_LARGE-1);
+			if (rmap_grab(map, pg, pv->p_len) == 0) {
+				pv->p_vaddr = (void *)ptob(pg);
+				return(0);
+			}
+		}
+	}
+
 	/*
 	 * Otherwise try to get some space from the map, and put the
 	 * new view there.
 	 */
-	pg = rmap_alloc(pv->p_vas->v_hat.h_map, pv->p_len);
+	pg = rmap_alloc(map, pv->p_len);
 	if (pg == 0) {
 		return(1);
 	}
@@ -301,6 +497,19 @@ hat_detach(struct pview *pv)
 	}
 }
 
+/*
+ * hat_switch()
+ *	Start using a vas's root page table on this CPU
+ *
+ * For when the vas of the running process has been given new
+ * translations wholesale (see return_vas()).
+ */
+void
+hat_switch(struct vas *vas)
+{
+	set_cr3(vas->v_hat.h_cr3);
+}
+
 /*
  * hat_fork()
  *	vas is being duplicated, copy over rmap state
@@ -23,6 +23,7 @@
 #define K (1024)
 
 extern void init_trap();
+extern int hat_large;
 
 char *mem_map_base;	/* Base of P->V mapping area */
 char *heap;		/* Physical heap used during bootup */
@@ -370,12 +371,26 @@ init_machdep(void)
 	 * and use as many as it takes.  Note that the base
 	 * 640K counts as 1 M for purposes of the global
 	 * 1:1 map.
+	 *
+	 * If the CPU can map 4 Mb straight from an L1PTE, each
+	 * whole 4 Mb of memory is mapped that way; it saves the
+	 * L2PTs, and the kernel touching memory all over then
+	 * needs a TLB entry per 4 Mb rather than per page.  Any
+	 * odd part at the top still gets L2PTEs.
 	 */
-	pt = (pte_t *)heap;
 	y = L1PT_FREE;
 	bootpgs = pgs =
 		btop(memsegs[1].m_base) + btop(memsegs[1].m_len);
-	for (x = 0; x < pgs; ++x) {
+	x = 0;
+	if (cpu_features() & CPUID_PSE) {
+		set_cr4(get_cr4() | CR4_PSE);
+		hat_large = 1;
+		for ( ; (x + NPTPG) <= pgs; x += NPTPG) {
+			cr3[y++] = (x << PT_PFNSHIFT) | PT_V|PT_W|PT_PS;
+		}
+	}
+	pt = (pte_t *)heap - x;
+	for ( ; x < pgs; ++x) {
 		if ((x % NPTPG) == 0) {
 			cr3[y++] = (((ulong)(&pt[x])) & PT_PFN) |
 				PT_V|PT_W;
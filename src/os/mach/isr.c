@@ -16,6 +16,7 @@
 #include "locore.h"
 #include "mutex.h"
 #include "../kern/msg.h"
+#include "timer.h"
 
 
 /*
@@ -35,6 +36,12 @@ ulong strayintr = 0L, dupintr = 0L;
  */
 ushort intr_mask = 0xFFFF;
 
+/*
+ * Set while the PIT is counting down a one-shot, rather than
+ * ticking HZ times a second
+ */
+int clock_oneshot = 0;
+
 /*
  * Count of users of IRQ vectors in the slave PIC.  We enable
  * the slave vector when this goes non-zero, and disable it when
@@ -259,6 +266,10 @@ deliver_isr(int isr)
 /*
  * start_clock()
  *	Enable clock ticks now that we're ready
+ *
+ * The PIT starts out ticking HZ times a second.  From the first
+ * interrupt on, hardclock() decides what comes next--more ticks, or
+ * one interrupt at the next deadline--and sets it with set_clock().
  */
 void
 start_clock(void)
@@ -268,3 +279,38 @@ start_clock(void)
 	setmask(intr_mask);
 	sti();
 }
+
+/*
+ * set_clock()
+ *	Start a new clock interval
+ *
+ * With "counts" non-zero, the PIT is set to interrupt once, after that
+ * many counts; with zero, it goes back to interrupting HZ times a
+ * second.  The interval under way ends here, and the counts it ran are
+ * returned so the caller can keep time.  Interrupts must be disabled,
+ * and the caller must hold off others who'd do the same.
+ */
+ulong
+set_clock(ulong counts)
+{
+	ulong elapsed;
+
+	elapsed = get_icount();
+	if (counts == 0) {
+		counts = PIT_LATCH;
+		outportb(PIT_CTRL, CMD_SQR_WAVE);
+		clock_oneshot = 0;
+	} else {
+		if (counts < PIT_MIN) {
+			counts = PIT_MIN;
+		} else if (counts > PIT_MAX) {
+			counts = PIT_MAX;
+		}
+		outportb(PIT_CTRL, CMD_ONESHOT);
+		clock_oneshot = 1;
+	}
+	outportb(PIT_CH0, counts & 0x00ff);
+	outportb(PIT_CH0, (counts & 0xff00) >> 8);
+	latch_ticks = counts;
+	return(elapsed + PIT_GAP);
+}
@@ -95,6 +95,71 @@ get_cr3(void)
 	return(res);
 }
 
+/*
+ * get_cr4()
+ *	Get the value of the processor config register cr4
+ */
+inline extern ulong
+get_cr4(void)
+{
+	register ulong res;
+
+	__asm__ __volatile__(
+		"movl %%cr4, %0\n\t"
+		: "=r" (res)
+		: /* No input */);
+	return(res);
+}
+
+/*
+ * set_cr4()
+ *	Set the value of the processor config register cr4
+ */
+inline extern void
+set_cr4(ulong val)
+{
+	__asm__ __volatile__(
+		"movl %0, %%cr4\n\t"
+		: /* No output */
+		: "r" (val));
+}
+
+/*
+ * cpu_features()
+ *	Return the CPUID feature flags, or 0 if there's no CPUID
+ *
+ * A CPU has CPUID if it lets us flip the ID bit in EFLAGS; i386
+ * and early i486 parts, which don't, have no CR4 either.
+ */
+inline extern ulong
+cpu_features(void)
+{
+	register ulong f1, f2;
+
+	__asm__ __volatile__(
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"movl %0,%1\n\t"
+		"xorl $0x200000,%0\n\t"
+		"pushl %0\n\t"
+		"popfl\n\t"
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"pushl %1\n\t"
+		"popfl\n\t"
+		: "=&r" (f1), "=&r" (f2)
+		: /* No input */);
+	if (((f1 ^ f2) & 0x200000) == 0) {
+		return(0);
+	}
+	__asm__ __volatile__(
+		"cpuid\n\t"
+		: "=d" (f1)
+		: "a" (1)
+		: "bx", "cx");
+	return(f1);
+}
+
 /*
  * flush_tlb()
  *	Flush the processor page table "translation lookaside buffer"
@@ -281,15 +346,16 @@ on_idle_stack(void)
  * idle()
  *	Run idle - do nothing except wait for something to happen :-)
  *
- * We watch for num_run to go non-zero; we use sti/halt to atomically
- * enable interrupts and halt the CPU--this saves a fair amount of power
- * and heat.
+ * We watch for num_queued to go non-zero, meaning some run queue has
+ * a thread waiting--our own, or one we might take work from.  We use
+ * sti/halt to atomically enable interrupts and halt the CPU--this
+ * saves a fair amount of power and heat.
  */
 inline extern void
 idle(void)
 {
 	__asm__ __volatile__ (
-		"movl $_num_run,%%eax\n\t"
+		"movl $_num_queued,%%eax\n\t"
 		"movl $0,%%edx\n"
 		"1:\t"
 		"cmpl %%edx,(%%eax)\n\t"
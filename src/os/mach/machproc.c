@@ -182,6 +182,67 @@ boot_regs(struct thread *t, struct boot_task *b)
 	t->t_kregs->esp = (t->t_kregs->ebp) - sizeof(ulong);
 }
 
+/*
+ * spawn_start()
+ *	First code run by a spawn()'ed process
+ *
+ * Its argument can't be pushed onto its user stack until its own
+ * address space is the one in use, which it now is.  spawn_regs()
+ * left the argument in the EAX slot of the user frame, and our
+ * return address pointing at retuser, which takes us to user mode.
+ */
+static void
+spawn_start(void)
+{
+	struct thread *t = curthread;
+	struct trapframe *u = (struct trapframe *)
+		((t->t_kstack + KSTACK_SIZE) - sizeof(struct trapframe));
+
+	sti();
+	u->esp -= sizeof(ulong);
+	(void)copyout((void *)u->esp, &u->eax, sizeof(ulong));
+	u->eax = 0;
+}
+
+/*
+ * spawn_regs()
+ *	Set up registers for a process created by spawn()
+ *
+ * Much as boot_regs(), but the thread starts at "entry" with "arg"
+ * on its stack, just as after an exec().
+ */
+void
+spawn_regs(struct thread *t, void *entry, void *arg)
+{
+	struct trapframe *u;
+	ulong *sp;
+
+	t->t_uregs = 0;
+	u = (struct trapframe *)
+		((t->t_kstack + KSTACK_SIZE) - sizeof(struct trapframe));
+	bzero(u, sizeof(struct trapframe));
+	u->ecs = GDT_UTEXT|PRIV_USER;
+	u->eip = (ulong)entry;
+	u->esds = ((GDT_UDATA|PRIV_USER) << 16) | GDT_UDATA|PRIV_USER;
+	u->ess = GDT_UDATA|PRIV_USER;
+	u->ebp =
+	u->esp = (USTACKADDR+UMAXSTACK) - sizeof(ulong);
+	u->eflags = F_IF;
+	u->eax = (ulong)arg;
+
+	/*
+	 * Enter spawn_start() as if it had been called from just
+	 * before retuser, so that its return leaves the stack
+	 * pointing at the trapframe.
+	 */
+	sp = (ulong *)u;
+	sp[-1] = (ulong)retuser;
+	bzero(t->t_kregs, sizeof(t->t_kregs));
+	t->t_kregs->eip = (ulong)spawn_start;
+	t->t_kregs->ebp = (ulong)u;
+	t->t_kregs->esp = (ulong)(sp - 2);
+}
+
 /*
  * set_execarg()
  *	Pass an argument back to a newly-exec()'ed process
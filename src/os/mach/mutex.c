@@ -1,8 +1,12 @@
 /*
  * mutex.c
- *	Uniprocessor i386 implementation of mutual exclusion
+ *	i386 implementation of mutual exclusion
  *
- * Mutual exclusion's not very hard on a uniprocessor, eh?
+ * Semaphores are built on the spinlocks in mutex.h, which spin for
+ * real when built for SMP.  A thread going to sleep holds its own
+ * CPU's run queue across the switch, and one waking it locks the
+ * run queue it sleeps under, so a sleeper can't be picked up to run
+ * elsewhere until it's off its CPU.
  */
 #include <sys/assert.h>
 #include <sys/thread.h>
@@ -11,7 +15,6 @@
 #include "../mach/mutex.h"
 #include "../mach/locore.h"
 
-extern lock_t runq_lock;
 extern void lsetrun(), swtch();
 #ifdef DEBUG
 char msg_deadlock[] = "deadlock", msg_notheld[] = "not held";
@@ -98,7 +101,7 @@ p_sema(sema_t *s, pri_t p)
 	t->t_nointr = (p == PRIHI);
 	t->t_intr = 0;	/* XXX this can race with notify */
 	q_sema(s, t);
-	p_lock_void(&runq_lock, SPLHI_SAME);
+	p_lock_void(&cpu.pc_runq->rq_lock, SPLHI_SAME);
 	v_lock(&s->s_lock, SPLHI_SAME);
 	t->t_state = TS_SLEEP;
 	ATOMIC_DEC(&num_run);
@@ -147,11 +150,11 @@ cp_sema(sema_t *s)
 }
 
 /*
- * v_sema()
- *	Release a semaphore
+ * do_v_sema()
+ *	Release a semaphore, perhaps asking that the woken thread run next
  */
-void
-v_sema(sema_t *s)
+inline static void
+do_v_sema(sema_t *s, int handoff)
 {
 	struct thread *t;
 	spl_t spl;
@@ -163,9 +166,12 @@ v_sema(sema_t *s)
 		ASSERT_DEBUG(t->t_wchan == s, "v_sema: mismatch");
 		dq_sema(s, t);
 		t->t_wchan = 0;
-		p_lock_void(&runq_lock, SPLHI_SAME);
+		(void)lock_runq(t);
 		lsetrun(t);
-		v_lock(&runq_lock, SPLHI_SAME);
+		if (handoff && (RUNQ(t) == cpu.pc_runq)) {
+			cpu.pc_handoff = t;
+		}
+		unlock_runq(t, SPLHI_SAME);
 	} else {
 		/* dq_sema() does it otherwise */
 		s->s_count += 1;
@@ -173,6 +179,29 @@ v_sema(sema_t *s)
 	v_lock(&s->s_lock, spl);
 }
 
+/*
+ * v_sema()
+ *	Release a semaphore
+ */
+void
+v_sema(sema_t *s)
+{
+	do_v_sema(s, 0);
+}
+
+/*
+ * v_sema_handoff()
+ *	Release a semaphore, handing over our CPU when we next sleep
+ *
+ * For synchronous IPC, where the thread we wake is about to do work
+ * on our behalf and we're about to wait for it.  See swtch().
+ */
+void
+v_sema_handoff(sema_t *s)
+{
+	do_v_sema(s, 1);
+}
+
 /*
  * vall_sema()
  *	Kick everyone loose who's sleeping on the semaphore
@@ -219,7 +248,7 @@ p_sema_v_lock(sema_t *s, pri_t p, lock_t *l)
 	t->t_intr = 0;
 	t->t_nointr = (p == PRIHI);
 	q_sema(s, t);
-	p_lock_void(&runq_lock, SPLHI_SAME);
+	p_lock_void(&cpu.pc_runq->rq_lock, SPLHI_SAME);
 	v_lock(&s->s_lock, SPLHI_SAME);
 	v_lock(l, SPLHI_SAME);
 	t->t_state = TS_SLEEP;
@@ -13,6 +13,9 @@
  * parameters.  As these parameters are usually constants it makes it
  * easy for the compiler's optimiser to remove the unwanted path and
  * actually end up with more compact code :-)
+ *
+ * With SMP defined, spinlocks are taken with an atomic exchange and
+ * spun on; otherwise a held lock can only mean deadlock.
  */
 #include <sys/percpu.h>
 #include <sys/mutex.h>
@@ -107,6 +110,86 @@ ATOMIC_DECL_CPU_LOCKS(void)
 		: "m" (cpu.pc_locks));
 }
 
+#ifdef SMP
+/*
+ * try_lock()
+ *	Atomically set a spinlock, returning true if it was free
+ */
+inline extern int
+try_lock(lock_t *l)
+{
+	uchar old = 1;
+
+	__asm__ __volatile__(
+		"xchgb %0,%1\n\t"
+		: "=q" (old), "=m" (l->l_lock)
+		: "0" (old)
+		: "memory");
+	return(old == 0);
+}
+
+/*
+ * take_lock()
+ *	Spin until we hold a spinlock
+ *
+ * While it's held we only read it, so the cache line isn't dragged
+ * back and forth between the CPUs waiting for it.
+ */
+inline extern void
+take_lock(lock_t *l)
+{
+	while (!try_lock(l)) {
+		while (*(volatile uchar *)&l->l_lock) {
+			__asm__ __volatile__("rep; nop");
+		}
+	}
+}
+
+/*
+ * drop_lock()
+ *	Release a spinlock
+ *
+ * A plain store will do on i386, but the compiler mustn't move
+ * anything from inside the lock past it.
+ */
+inline extern void
+drop_lock(lock_t *l)
+{
+	__asm__ __volatile__("" : : : "memory");
+	l->l_lock = 0;
+}
+
+#else /* !SMP */
+
+/*
+ * On a uniprocessor, nobody else can be holding a lock we're after;
+ * if someone is, it's a deadlock.
+ */
+inline extern int
+try_lock(lock_t *l)
+{
+	if (l->l_lock) {
+		return(0);
+	}
+	l->l_lock = 1;
+	return(1);
+}
+
+inline extern void
+take_lock(lock_t *l)
+{
+	ASSERT_DEBUG(l->l_lock == 0, msg_deadlock);
+	l->l_lock = 1;
+}
+
+inline extern void
+drop_lock(lock_t *l)
+{
+	l->l_lock = 0;
+}
+
+#endif /* SMP */
+
 /*
  * p_lock()
  *	Take spinlock
@@ -114,19 +197,17 @@ ATOMIC_DECL_CPU_LOCKS(void)
 inline extern spl_t
 p_lock(lock_t *l, spl_t s)
 {
-	ASSERT_DEBUG(l->l_lock == 0, msg_deadlock);
-
 	if (s == SPLHI) {
 		spl_t x;
 
 		x = geti();
 		cli();
 		ATOMIC_INCL_CPU_LOCKS();
-		l->l_lock = 1;
+		take_lock(l);
 		return(x);
 	} else {
 		ATOMIC_INCL_CPU_LOCKS();
-		l->l_lock = 1;
+		take_lock(l);
 		return(SPL0);
 	}
 }
@@ -138,13 +219,11 @@ p_lock(lock_t *l, spl_t s)
 inline extern void
 p_lock_void(lock_t *l, spl_t s)
 {
-	ASSERT_DEBUG(l->l_lock == 0, msg_deadlock);
-
 	if (s == SPLHI) {
 		cli();
 	}
 	ATOMIC_INCL_CPU_LOCKS();
-	l->l_lock = 1;
+	take_lock(l);
 }
 
 /*
@@ -155,25 +234,24 @@ inline extern spl_t
 cp_lock(lock_t *l, spl_t s)
 {
 	if (s == SPLHI) {
-		if (!l->l_lock) {
-			spl_t x;
+		spl_t x;
 
-			x = geti();
-			cli();
+		x = geti();
+		cli();
+		if (try_lock(l)) {
 			ATOMIC_INCL_CPU_LOCKS();
-			l->l_lock = 1;
 			return(x);
-		} else {
-			return(-1);
-		} 
+		}
+		if (x == SPL0) {
+			sti();
+		}
+		return(-1);
 	} else {
-		if (!l->l_lock) {
+		if (try_lock(l)) {
 			ATOMIC_INCL_CPU_LOCKS();
-			l->l_lock = 1;
 			return(SPL0);
-		} else {
-			return(-1);
 		}
+		return(-1);
 	}
 }
 
@@ -185,7 +263,7 @@ inline extern void
 v_lock(lock_t *l, spl_t s)
 {
 	ASSERT_DEBUG(l->l_lock, msg_notheld);
-	l->l_lock = 0;
+	drop_lock(l);
 	if (s == SPL0) {
 		sti();
 	}
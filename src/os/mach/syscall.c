@@ -31,6 +31,10 @@ extern int page_wire(), page_release(), enable_dma(), time_get(),
 	set_cmd(), pageout(), unhash(),
 	time_set(), ptrace(), nop(), msg_portname(), pstat();
 extern int notify_handler(), sched_op(), setsid(), mutex_thread();
+extern int msg_tagged(), msg_send_async(), msg_reap(),
+	msg_receive_batch(), msg_reply_batch(), msg_reply_recv(),
+	madvise(), vfork(), spawn(), zero_pages(),
+	mutex_wait(), mutex_wake();
 extern void check_events();
 
 struct syscall {
@@ -86,6 +90,18 @@ struct syscall {
 	{sched_op, 2},				/* 38 */
 	{setsid, 0},				/* 39 */
 	{mutex_thread, 1},			/* 40 */
+	{msg_tagged, 2},			/* 41 */
+	{msg_send_async, 2},			/* 42 */
+	{msg_reap, 3},				/* 43 */
+	{msg_receive_batch, 3},			/* 44 */
+	{msg_reply_batch, 2},			/* 45 */
+	{msg_reply_recv, 3},			/* 46 */
+	{madvise, 3},				/* 47 */
+	{vfork, 0},				/* 48 */
+	{spawn, 5},				/* 49 */
+	{zero_pages, 0},			/* 50 */
+	{mutex_wait, 2},			/* 51 */
+	{mutex_wake, 2},			/* 52 */
 };
 #define NSYSCALL (sizeof(syscalls) / sizeof(struct syscall))
 #define MAXARGS (6)
@@ -9,9 +9,17 @@
 #include "../mach/locore.h"
 
 /*
- * get_itime()
- *	Get the time in microseconds between what we run our system clock
- *	interrupt rate as and the real elapsed time
+ * Microseconds in each clock tick
+ */
+#define TICK_USEC (1000000L / HZ)
+
+extern ulong latch_ticks;	/* Counts in the current interval */
+extern int clock_oneshot;	/*  ...which is a one-shot */
+extern ulong set_clock(ulong);
+
+/*
+ * get_icount()
+ *	Get the number of PIT counts since the current clock interval began
  *
  * Only call this with interrupts disabled!  BTW for code spotters I hold
  * my hands up now and admit this is basically lifted from Linux :-)
@@ -19,15 +27,19 @@
  *
  * When we latch the data in from the timer we must have the interrupts
  * disabled so that we can look to see if a timer interrupt is pending.
- * If one is pending we add an additional HZ value's worth of ticks into
- * the result from here to compensate
+ * If one is pending we add an additional interval's worth of counts
+ * into the result from here to compensate.
+ *
+ * In one-shot mode the counter runs on past zero and wraps to 0xFFFF,
+ * so a count above the latch value means the interval's over and the
+ * interrupt hasn't been taken yet.  This is only good for the first
+ * 0x10000 - latch_ticks counts after that, but nobody keeps interrupts
+ * off for so long.
  */
 inline extern ulong
-get_itime(void)
+get_icount(void)
 {
-	extern ulong latch_ticks;
 	ulong count;
-	ulong offset = 0;
 
 	/*
 	 * Latch the interval timer count
@@ -36,6 +48,13 @@ get_itime(void)
 	count = (ulong)inportb(PIT_CH0);
 	count |= (ulong)inportb(PIT_CH0) << 8;
 
+	if (clock_oneshot) {
+		if (count > latch_ticks) {
+			return(latch_ticks + (0x10000 - count));
+		}
+		return(latch_ticks - count);
+	}
+
 	/*
 	 * Unhandled interrupts will only really occur if we're within
 	 * 1% of the rollover point - only look if this is the case.
@@ -48,13 +67,71 @@ get_itime(void)
 		 */
 		outportb(ICU0, 0x0a);
 		if (inportb(ICU0) & 0x01) {
-			offset = (1000000L / HZ);
+			return((latch_ticks - 1) - count + latch_ticks);
+		}
+	}
+	return((latch_ticks - 1) - count);
+}
+
+/*
+ * pit_usec()
+ *	Convert PIT counts to microseconds
+ *
+ * If "remp" is non-zero, it carries what's left over from one call to
+ * the next, so a running total of counts loses nothing.
+ */
+inline extern ulong
+pit_usec(ulong counts, ulong *remp)
+{
+	ulong usec = 0, n;
+
+	while (counts >= PIT_LATCH) {
+		usec += TICK_USEC;
+		counts -= PIT_LATCH;
+	}
+	n = counts * TICK_USEC;
+	if (remp) {
+		n += *remp;
+		*remp = n % PIT_LATCH;
+	}
+	return(usec + n / PIT_LATCH);
+}
+
+/*
+ * usec_pit()
+ *	Convert microseconds to PIT counts, rounding up
+ *
+ * The result is held to what a one-shot can count.
+ */
+inline extern ulong
+usec_pit(ulong usec)
+{
+	ulong counts = 0;
+
+	while (usec >= TICK_USEC) {
+		counts += PIT_LATCH;
+		if (counts >= PIT_MAX) {
+			return(PIT_MAX);
 		}
+		usec -= TICK_USEC;
 	}
-	count = ((latch_ticks - 1) - count) * (1000000L / HZ);
-	count = (count + (latch_ticks / 2)) / latch_ticks;
-	
-	return(count + offset);
+	counts += (usec * PIT_LATCH + TICK_USEC - 1) / TICK_USEC;
+	if (counts > PIT_MAX) {
+		return(PIT_MAX);
+	}
+	return(counts);
+}
+
+/*
+ * get_itime()
+ *	Get the time in microseconds since the current clock interval began
+ *
+ * Interrupts disabled, as for get_icount().
+ */
+inline extern ulong
+get_itime(void)
+{
+	return(pit_usec(get_icount(), 0));
 }
 
 #endif /* _MACH_TIMER_H */
@@ -72,13 +72,14 @@ eoi(void)
  * nudge()
  *	Tell CPU to preempt
  *
- * Of course, pretty simple on uP.  Just set flag; it will be seen on
- * way back from kernel mode.
+ * Just set its flag; it will be seen on the way back from kernel
+ * mode.  For another CPU this waits for its next trip through the
+ * kernel, or its next clock tick.
  */
 void
 nudge(struct percpu *c)
 {
-	do_preempt = 1;
+	c->pc_preempt = 1;
 }
 
 /*
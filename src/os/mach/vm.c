@@ -9,21 +9,6 @@
 #include <sys/vm.h>
 #include <sys/assert.h>
 
-/*
- * Limit of ISA RAM which can be addressed
- */
-#define LIM (16 * 1024 * 1024)	/* The low 24 bits */
-
-/*
- * check_low()
- *	Tell if a given PFN is OK for ISA DMA purposes
- */
-static int
-check_low(uint pfn)
-{
-	return(pfn < btop(LIM));
-}
-
 /*
  * mach_page_wire()
  *	Hooks for handling page wiring & DMA
@@ -51,14 +36,14 @@ mach_page_wire(uint flags, struct pview *pv,
 	/*
 	 * No problem.
 	 */
-	if (pp->pp_pfn < btop(LIM)) {
+	if (pp->pp_pfn < btop(DMA_LIM)) {
 		return(0);
 	}
 
 	/*
 	 * Try to grab a low page
 	 */
-	if (alloc_page_fn(check_low, &newpfn)) {
+	if (alloc_contig(1, Z_DMA, &newpfn)) {
 		return(ENOMEM);
 	}
 
@@ -50,7 +50,15 @@ vtop(void *vaddr)
 	ASSERT_DEBUG(*pt & PT_V, "vtop: invalid L1");
 
 	/*
-	 * If it is, walk down to second level
+	 * A 4 Mb page (as in the 1:1 map) has no second level
+	 */
+	if (*pt & PT_PS) {
+		return (void *)((*pt & PT_PSPFN) |
+			((ulong)vaddr & ~PT_PSPFN));
+	}
+
+	/*
+	 * Otherwise walk down to second level
 	 */
 	pt = L2PTMAP + ((ulong)vaddr >> PT_PFNSHIFT);
 	ASSERT_DEBUG(*pt & PT_V, "vtop: invalid L2");
@@ -206,6 +206,7 @@ void
 dos_fid(struct msg *m, struct file *f)
 {
 	struct node *n = f->f_node;
+	struct directory d;
 
 	/*
 	 * Only *files* get an ID (and thus can be mapped shared)
@@ -221,10 +222,13 @@ dos_fid(struct msg *m, struct file *f)
 	n->n_flags |= N_FID;
 
 	/*
-	 * arg is the inode value; arg1 is the size in pages
+	 * arg is the inode value; arg1 is the size in pages.  The
+	 * modification time stamps it, so a rewrite is noticed.
 	 */
+	(void)dir_copy(n->n_dir, n->n_slot, &d);
 	m->m_arg = inum(n);
 	m->m_arg1 = btorp(isize(n));
+	m->m_op = FID_STAMP(cvt_time(d.date, d.time));
 	m->m_nseg = 0;
 	msg_reply(m->m_sender, m);
 }
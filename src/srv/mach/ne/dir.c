@@ -133,6 +133,9 @@ freeup(struct attach *o)
 	if (o->a_entry) {
 		ll_delete(o->a_entry);
 	}
+	if (o->a_chan) {
+		chan_free(o->a_chan);
+	}
 	free(o);
 }
 
@@ -202,6 +202,9 @@ loop:
 	case FS_WRITE:		/* Write the disk */
 		ne_write(&msg, f);
 		break;
+	case FS_SHMAP:		/* Get receive channel */
+		ne_shmap(&msg, f);
+		break;
 	case FS_STAT:		/* Get stat of file */
 		ne_stat(&msg, f);
 		break;
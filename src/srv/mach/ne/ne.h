@@ -7,12 +7,14 @@
 #include <sys/types.h>
 #include <sys/perm.h>
 #include <llist.h>
+#include <chan.h>
 #include "if_ether.h"
 
 #define NE_RANGE	0x1f	/* range of addresses used be adapter */
 
 #define NNE		1	/* Max # NE2000 units supported */
 #define NCONNECTS	16	/* Max # connections supported */
+#define NCHSLOTS	32	/* Packets in a receive channel */
 
 #define ne_data		0x10	/* Data Transfer port */
 #define ne_reset	0x1f	/* Card Reset port */
@@ -145,6 +147,7 @@ struct attach {
 	uint a_owner;		/* Owner UID */
 	ushort a_type;		/* ethernet type desired */
 	ushort a_typeset;	/* 1 when type is set; incoming pkts ok */
+	struct chan *a_chan;	/* Receive channel, if client asked */
 };
 
 /*
@@ -196,6 +199,7 @@ extern void ne_rw(struct msg *, struct file *),
 	ne_read(struct msg *, struct file *),
 	ne_write(struct msg *, struct file *),
 	ne_open(struct msg *, struct file *),
+	ne_shmap(struct msg *, struct file *),
 	ne_close(struct file *),
 	rw_init(void),
 	ne_start(struct adapter *, struct file *),
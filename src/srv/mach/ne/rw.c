@@ -156,6 +156,15 @@ ne_read(struct msg *m, struct file *f)
 		return;
 	}
 
+	/*
+	 * Packets for a file with a channel go there, never to a
+	 * read, so one would wait forever
+	 */
+	if (o->a_chan) {
+		msg_err(m->m_sender, EBUSY);
+		return;
+	}
+
 	/*
 	 * Queue as a reader
 	 */
@@ -198,13 +207,47 @@ ne_read(struct msg *m, struct file *f)
 	}
 }
 
+/*
+ * ne_shmap()
+ *	Give the client a channel to receive packets through
+ *
+ * Packets of the file's type go into the channel as they arrive, so
+ * a client reading a stream of them needn't send a message for each.
+ * There's one channel per file, for one client to read.
+ */
+void
+ne_shmap(struct msg *m, struct file *f)
+{
+	struct attach *o = f->f_file;
+
+	if (!o || !(f->f_perm & ACC_READ)) {
+		msg_err(m->m_sender, EPERM);
+		return;
+	}
+	if (o->a_chan) {
+		msg_err(m->m_sender, EBUSY);
+		return;
+	}
+	o->a_chan = chan_alloc(NCHSLOTS, PKT_BUFSIZE);
+	if (o->a_chan == 0) {
+		msg_err(m->m_sender, strerror());
+		return;
+	}
+	if (chan_reply(o->a_chan, m->m_sender) < 0) {
+		chan_free(o->a_chan);
+		o->a_chan = 0;
+	}
+}
+
 /*
  * ne_send_up()
  *	Send received packet to requestor(s)
  *
  * Given a buffer containing a received packet, walk the list of pending
  * readers and return packet if a matching type is found.  If none is
- * found, the packet is dropped.
+ * found, the packet is queued for a later read if some file without
+ * a channel could want it, and dropped if not.  Files with a channel
+ * get their copy first, without waiting for a read.
  * len is length of packet data, excluding header, type and checksum.
  *
  * Returns 0 if buffer may be reused; 1 if a it will be held and
@@ -216,7 +259,7 @@ ne_send_up(char *buf, int len, int retrans)
 	struct llist *l, *ln;
 	struct ether_header *eh;
 	ushort etype;
-	int sent;
+	int sent, chans, wanted;
 	struct bufq *q;
 
 	/*
@@ -226,12 +269,38 @@ ne_send_up(char *buf, int len, int retrans)
 		return(0);
 	}
 
+	eh = (struct ether_header *)buf;
+	etype = ntohs(eh->ether_type);
+	sent = chans = wanted = 0;
+
+	/*
+	 * Put in channels.  A packet we're sending again from our
+	 * queue has already been offered to them.  Note whether
+	 * any file without a channel takes this type; only then
+	 * is it worth queueing for a read.
+	 */
+	if (!retrans) {
+		for (l = LL_NEXT(&files); l != &files; l = LL_NEXT(l)) {
+			struct attach *o = l->l_data;
+
+			if (o->a_type && (o->a_type != etype)) {
+				continue;
+			}
+			if (!o->a_chan) {
+				wanted = 1;
+				continue;
+			}
+			if (chan_put(o->a_chan, buf, len) == 0) {
+				chans += 1;
+			} else {
+				dropped += 1;
+			}
+		}
+	}
+
 	/*
 	 * Walk pending reader list
 	 */
-	eh = (struct ether_header *)buf;
-	etype = ntohs(eh->ether_type);
-	sent = 0;
 	for (l = LL_NEXT(&readers); l != &readers; l = ln) {
 		struct file *f;
 		ushort t2;
@@ -248,6 +317,13 @@ ne_send_up(char *buf, int len, int retrans)
 		f = l->l_data;
 		ASSERT_DEBUG(f->f_file, "ne_send_up: dir");
 
+		/*
+		 * A file with a channel got its copy there
+		 */
+		if (f->f_file->a_chan) {
+			continue;
+		}
+
 		/*
 		 * Give him the packet if he wants all (type 0) or
 		 * has the right type open.
@@ -299,11 +375,14 @@ ne_send_up(char *buf, int len, int retrans)
 	}
 
 	/*
-	 * Nobody consumed it; make a copy unless we're too far
-	 * ahead.
+	 * Nobody consumed it; make a copy unless nobody could
+	 * read it, or we're too far ahead.  It's only lost if no
+	 * channel took it either.
 	 */
-	if (nrxqueue > MAXQUEUE) {
-		dropped += 1;
+	if (!wanted || (nrxqueue > MAXQUEUE)) {
+		if (!chans) {
+			dropped += 1;
+		}
 		return(0);
 	}
 
@@ -13,6 +13,7 @@
 #include <sys/namer.h>
 #include <hash.h>
 #include <sys/fs.h>
+#include <server.h>
 #include <sys/ports.h>
 #include <sys/types.h>
 #include <stdio.h>
@@ -48,12 +49,12 @@ static void
 namer_seek(struct msg *m, struct file *f)
 {
 	if (m->m_arg < 0) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 	f->f_pos = m->m_arg;
 	m->m_buflen = m->m_arg = m->m_arg1 = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -86,7 +87,7 @@ new_client(struct msg *m)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -102,7 +103,7 @@ new_client(struct msg *m)
 	f->f_nperm = m->m_buflen/sizeof(struct perm);
 	bcopy(m->m_buf, &f->f_perms, f->f_nperm*sizeof(struct perm));
 	if (can_access(f, m->m_arg, &namer_prot)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		free(f);
 		return;
 	}
@@ -114,7 +115,7 @@ new_client(struct msg *m)
 	 */
         if (hash_insert(filehash, m->m_sender, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -152,7 +153,7 @@ dup_client(struct msg *m, struct file *fold)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -166,7 +167,7 @@ dup_client(struct msg *m, struct file *fold)
 	 */
         if (hash_insert(filehash, m->m_arg, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -179,7 +180,7 @@ dup_client(struct msg *m, struct file *fold)
 	 * Return acceptance
 	 */
 	m->m_arg = m->m_arg1 = m->m_buflen = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -219,7 +220,7 @@ loop:
 	/*
 	 * Receive a message, log an error and then keep going
 	 */
-	x = msg_receive(namerport, &msg);
+	x = srv_receive(namerport, &msg);
 	if (x < 0) {
 		perror("namer: msg_receive");
 		goto loop;
@@ -229,7 +230,7 @@ loop:
 	 * All requests should fit in one buffer
 	 */
 	if (msg.m_nseg > 1) {
-		msg_err(msg.m_sender, EINVAL);
+		srv_err(msg.m_sender, EINVAL);
 		goto loop;
 	}
 
@@ -252,11 +253,11 @@ loop:
 		 * We're synchronous, so presumably the operation
 		 * is all done and this abort is old news.
 		 */
-		msg_reply(msg.m_sender, &msg);
+		srv_reply(msg.m_sender, &msg);
 		break;
 	case FS_OPEN:		/* Look up file from directory */
 		if (!valid_fname(msg.m_buf, x)) {
-			msg_err(msg.m_sender, ESRCH);
+			srv_err(msg.m_sender, ESRCH);
 			break;
 		}
 		namer_open(&msg, f);
@@ -280,7 +281,7 @@ loop:
 		namer_wstat(&msg, f);
 		break;
 	default:		/* Unknown */
-		msg_err(msg.m_sender, EINVAL);
+		srv_err(msg.m_sender, EINVAL);
 		break;
 	}
 	goto loop;
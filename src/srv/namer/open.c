@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <sys/namer.h>
 #include <sys/fs.h>
+#include <server.h>
 #include <sys/assert.h>
 #include <llist.h>
 #include <std.h>
@@ -45,7 +46,7 @@ namer_open(struct msg *m, struct file *f)
 	 */
 	nparent = f->f_node;
 	if (!nparent->n_internal) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 
@@ -59,7 +60,7 @@ namer_open(struct msg *m, struct file *f)
 	 */
 	if (n) {
 		if (can_access(f, m->m_arg, &n->n_prot)) {
-			msg_err(m->m_sender, EPERM);
+			srv_err(m->m_sender, EPERM);
 			return;
 		}
 
@@ -71,7 +72,7 @@ namer_open(struct msg *m, struct file *f)
 		n->n_refs += 1;
 		f->f_pos = 0L;
 		m->m_buflen = m->m_nseg = m->m_arg = m->m_arg1 = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		return;
 	}
 
@@ -79,7 +80,7 @@ namer_open(struct msg *m, struct file *f)
 	 * If not intending to create, error
 	 */
 	if (!(m->m_arg & ACC_CREATE)) {
-		msg_err(m->m_sender, ESRCH);
+		srv_err(m->m_sender, ESRCH);
 		return;
 	}
 
@@ -88,7 +89,7 @@ namer_open(struct msg *m, struct file *f)
 	 * error.
 	 */
 	if (!(f->f_mode & ACC_WRITE)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -96,7 +97,7 @@ namer_open(struct msg *m, struct file *f)
 	 * malloc the new node
 	 */
 	if ((n = malloc(sizeof(struct node))) == 0) {
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 	bzero(n, sizeof(struct node));
@@ -106,7 +107,7 @@ namer_open(struct msg *m, struct file *f)
 	 */
 	if (!(n->n_list = ll_insert(&f->f_node->n_elems, n))) {
 		free(n);
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -136,7 +137,7 @@ namer_open(struct msg *m, struct file *f)
 	f->f_node = n;
 
 	m->m_buflen = m->m_nseg = m->m_arg = m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -165,7 +166,7 @@ namer_remove(struct msg *m, struct file *f)
 	 * Make sure it's a "directory"
 	 */
 	if (!n->n_internal) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 
@@ -173,7 +174,7 @@ namer_remove(struct msg *m, struct file *f)
 	 * See if we have write access
 	 */
 	if (!(f->f_mode & ACC_WRITE)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -186,7 +187,7 @@ namer_remove(struct msg *m, struct file *f)
 	 * If not found, forget it
 	 */
 	if (!n2) {
-		msg_err(m->m_sender, ESRCH);
+		srv_err(m->m_sender, ESRCH);
 		return;
 	}
 
@@ -205,5 +206,5 @@ namer_remove(struct msg *m, struct file *f)
 		delete_node(n2);
 	}
 	m->m_buflen = m->m_nseg = m->m_arg = m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
@@ -9,6 +9,7 @@
 #include <llist.h>
 #include <sys/namer.h>
 #include <sys/fs.h>
+#include <server.h>
 #include <stdio.h>
 #include <std.h>
 #include <string.h>
@@ -27,7 +28,7 @@ namer_write(struct msg *m, struct file *f)
 	 * Can only write to a true file, and only if open for writing.
 	 */
 	if ((n->n_internal) || !(f->f_mode & ACC_WRITE)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -35,7 +36,7 @@ namer_write(struct msg *m, struct file *f)
 	 * Have to have buffer, make sure it's null-terminated
 	 */
 	if (m->m_buflen > (sizeof(buf)-1)) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 	bcopy(m->m_buf, buf, m->m_buflen);
@@ -47,7 +48,7 @@ namer_write(struct msg *m, struct file *f)
 	n->n_port = (port_name)atoi(buf);
 
 	m->m_buflen = m->m_arg = m->m_arg1 = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -71,7 +72,7 @@ namer_readdir(struct msg *m, struct file *f)
 		len = 256;
 	}
 	if ((buf = malloc(len+1)) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -137,7 +138,7 @@ namer_readdir(struct msg *m, struct file *f)
 	m->m_arg = m->m_buflen = x;
 	m->m_nseg = (x ? 1 : 0);
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 	free(buf);
 }
 
@@ -179,7 +180,7 @@ namer_read(struct msg *m, struct file *f)
 	 */
 	if (cnt <= 0) {
 		m->m_arg = m->m_arg1 = m->m_buflen = m->m_nseg = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		return;
 	}
 
@@ -190,6 +191,6 @@ namer_read(struct msg *m, struct file *f)
 	m->m_arg = m->m_buflen = cnt;
 	m->m_nseg = 1;
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 	f->f_pos += cnt;
 }
@@ -9,6 +9,7 @@
 #include <sys/param.h>
 #include <sys/perm.h>
 #include <sys/fs.h>
+#include <server.h>
 #include <llist.h>
 #include <string.h>
 #include <stdio.h>
@@ -32,7 +33,7 @@ namer_stat(struct msg *m, struct file *f)
 	 * Verify access
 	 */
 	if (!(f->f_mode & ACC_READ)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -57,7 +58,7 @@ namer_stat(struct msg *m, struct file *f)
 	m->m_arg = m->m_buflen = strlen(buf);
 	m->m_nseg = 1;
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -82,12 +83,12 @@ namer_wstat(struct msg *m, struct file *f)
 	if (!strcmp(field, "deleted")) {
 		n->n_deleted = (val && val[0] && (val[0] != '0'));
 		m->m_arg = m->m_arg1 = m->m_nseg = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		return;
 	}
 
 	/*
 	 * Not a field we support...
 	 */
-	msg_err(m->m_sender, EINVAL);
+	srv_err(m->m_sender, EINVAL);
 }
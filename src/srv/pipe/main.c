@@ -43,10 +43,11 @@ new_client(struct msg *m)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		msg_errtag(m->m_sender, m->m_op, strerror());
 		return;
 	}
 	bzero(f, sizeof(struct file));
+	ll_init(&f->f_reqs);
 
 	/*
 	 * Fill in fields
@@ -60,7 +61,7 @@ new_client(struct msg *m)
 	 */
         if (hash_insert(filehash, m->m_sender, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		msg_errtag(m->m_sender, m->m_op, ENOMEM);
 		return;
 	}
 
@@ -84,7 +85,7 @@ dup_client(struct msg *m, struct file *fold)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		msg_errtag(m->m_sender, m->m_op, strerror());
 		return;
 	}
 
@@ -92,13 +93,14 @@ dup_client(struct msg *m, struct file *fold)
 	 * Fill in fields
 	 */
 	*f = *fold;
+	ll_init(&f->f_reqs);
 
 	/*
 	 * Hash under the sender's handle
 	 */
         if (hash_insert(filehash, m->m_arg, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		msg_errtag(m->m_sender, m->m_op, ENOMEM);
 		return;
 	}
 
@@ -177,7 +179,7 @@ loop:
 	case FS_OPEN:		/* Look up file from directory */
 		if ((msg.m_nseg != 1) || !valid_fname(msg.m_buf,
 				msg.m_buflen)) {
-			msg_err(msg.m_sender, EINVAL);
+			msg_errtag(msg.m_sender, msg.m_op, EINVAL);
 			break;
 		}
 		pipe_open(&msg, f);
@@ -195,7 +197,7 @@ loop:
 		pipe_wstat(&msg, f);
 		break;
 	default:		/* Unknown */
-		msg_err(msg.m_sender, EINVAL);
+		msg_errtag(msg.m_sender, msg.m_op, EINVAL);
 		break;
 	}
 	goto loop;
@@ -229,6 +231,12 @@ main()
 		exit(1);
 	}
 
+	/*
+	 * Several threads of a client may wait on the same open
+	 * pipe; we tell their requests apart by tag
+	 */
+	(void)msg_tagged(rootport, 1);
+
 	/*
 	 * Register port name
 	 */
@@ -11,6 +11,7 @@
 #include <sys/assert.h>
 
 extern struct llist files;	/* All files in FS */
+extern void free_req(struct req *);
 
 /*
  * dir_lookup()
@@ -48,6 +49,9 @@ freeup(struct pipe *o)
 	if (o->p_entry) {
 		ll_delete(o->p_entry);
 	}
+	if (o->p_buf) {
+		free(o->p_buf);
+	}
 	free(o);
 }
 
@@ -108,7 +112,7 @@ pipe_open(struct msg *m, struct file *f)
 	 * Have to be in root dir to open down into a file
 	 */
 	if (f->f_file) {
-		msg_err(m->m_sender, ENOTDIR);
+		msg_errtag(m->m_sender, m->m_op, ENOTDIR);
 		return;
 	}
 
@@ -116,7 +120,7 @@ pipe_open(struct msg *m, struct file *f)
 	 * No subdirs in a pipe filesystem
 	 */
 	if (m->m_arg & ACC_DIR) {
-		msg_err(m->m_sender, EINVAL);
+		msg_errtag(m->m_sender, m->m_op, EINVAL);
 		return;
 	}
 
@@ -126,7 +130,7 @@ pipe_open(struct msg *m, struct file *f)
 	if ((m->m_buflen != 2) || (((char *)(m->m_buf))[0] != '#')) {
 		o = dir_lookup(m->m_buf);
 		if (!o) {
-			msg_err(m->m_sender, ESRCH);
+			msg_errtag(m->m_sender, m->m_op, ESRCH);
 			return;
 		}
 	} else {
@@ -137,7 +141,7 @@ pipe_open(struct msg *m, struct file *f)
 	 * No such file--do they want to create?
 	 */
 	if (!o && !(m->m_arg & ACC_CREATE)) {
-		msg_err(m->m_sender, ESRCH);
+		msg_errtag(m->m_sender, m->m_op, ESRCH);
 		return;
 	}
 
@@ -149,7 +153,7 @@ pipe_open(struct msg *m, struct file *f)
 		 * Failure?
 		 */
 		if ((o = dir_newfile(f, m->m_buf)) == 0) {
-			msg_err(m->m_sender, ENOMEM);
+			msg_errtag(m->m_sender, m->m_op, ENOMEM);
 			return;
 		}
 
@@ -171,7 +175,7 @@ pipe_open(struct msg *m, struct file *f)
 	 * a writer to purge it's buffers
 	 */
 	if (o->p_nread == PIPE_CLOSED_FOR_READS) {
-		msg_err(m->m_sender, EPIPE);
+		msg_errtag(m->m_sender, m->m_op, EPIPE);
 		return;
 	}
 
@@ -180,7 +184,7 @@ pipe_open(struct msg *m, struct file *f)
 	 */
 	x = perm_calc(f->f_perms, f->f_nperm, &o->p_prot);
 	if ((m->m_arg & x) != m->m_arg) {
-		msg_err(m->m_sender, EPERM);
+		msg_errtag(m->m_sender, m->m_op, EPERM);
 		return;
 	}
 
@@ -218,6 +222,13 @@ pipe_close(struct file *f)
 		return;
 	}
 
+	/*
+	 * Anything of ours still queued goes with us
+	 */
+	while (!LL_EMPTY(&f->f_reqs)) {
+		free_req(LL_NEXT(&f->f_reqs)->l_data);
+	}
+
 	/*
 	 * Free a ref.  No more clients--free node.
 	 */
@@ -246,15 +257,11 @@ pipe_close(struct file *f)
 		}
 		o->p_nread = PIPE_CLOSED_FOR_READS;
 		while (!LL_EMPTY(&o->p_writers)) {
-			struct msg *m;
-			struct file *f2;
+			struct req *r;
 
-			f2 = LL_NEXT(&o->p_writers)->l_data;
-			ASSERT_DEBUG(f2->f_q, "pipe_close: !busy writers");
-			ll_delete(f2->f_q);
-			f2->f_q = 0;
-			m = &f2->f_msg;
-			msg_err(m->m_sender, EPIPE);
+			r = LL_NEXT(&o->p_writers)->l_data;
+			msg_errtag(r->r_msg.m_sender, r->r_msg.m_op, EPIPE);
+			free_req(r);
 		}
 	} else {
 		/*
@@ -268,15 +275,14 @@ pipe_close(struct file *f)
 		}
 		while (!LL_EMPTY(&o->p_readers)) {
 			struct msg *m;
-			struct file *f2;
+			struct req *r;
 
-			f2 = LL_NEXT(&o->p_readers)->l_data;
-			ASSERT_DEBUG(f2->f_q, "pipe_close: !busy readers");
-			ll_delete(f2->f_q);
-			f2->f_q = 0;
-			m = &f2->f_msg;
+			r = LL_NEXT(&o->p_readers)->l_data;
+			m = &r->r_msg;
+			m->m_op &= M_TAG;
 			m->m_arg = m->m_arg1 = m->m_nseg = 0;
 			msg_reply(m->m_sender, m);
+			free_req(r);
 		}
 	}
 }
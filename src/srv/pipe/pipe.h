@@ -16,6 +16,13 @@
 #include <sys/perm.h>
 #include <llist.h>
 
+/*
+ * Writes this small or smaller are copied into the pipe's buffer,
+ * if there's room, and answered at once
+ */
+#define PIPEBUF (8192)		/* Bytes buffered in a pipe */
+#define SMALLWRITE (1024)	/* Largest write buffered */
+
 /*
  * Structure of a pipe
  */
@@ -28,6 +35,8 @@ struct pipe {
 		p_writers;	/*  ...writers */
 	int p_nwrite;		/* # clients open for writing */
 	int p_nread;		/* # clients open for reading */
+	char *p_buf;		/* Buffered small writes, or 0 */
+	uint p_bufcnt;		/*  ...# bytes in it */
 };
 
 /*
@@ -40,13 +49,23 @@ struct file {
 		f_perms[PROCPERMS];
 	uint f_nperm;
 	uint f_perm;	/*  ...for the current f_file */
-	struct msg	/* For writes, segments of data */
-		f_msg;	/*  for reads, just reply addr & count */
-	struct llist	/* When request active, queue we're in */
-		*f_q;
+	struct llist	/* Our requests waiting in the pipe */
+		f_reqs;
 	uint f_pos;	/* Only for directory reads */
 };
 
+/*
+ * A read or write waiting its turn.  A tagged client may have
+ * several at once through the same open file.
+ */
+struct req {
+	struct file *r_file;	/* File it came through */
+	struct msg r_msg;	/* For writes, segments of data */
+				/*  for reads, reply addr, count & op */
+	struct llist *r_q,	/* Queue in the pipe we're in */
+		*r_entry;	/*  ...and our place in r_file's list */
+};
+
 #define PIPE_CLOSED_FOR_READS -1
 
 #endif /* _PIPE_H */
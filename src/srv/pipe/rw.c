@@ -15,6 +15,19 @@
  * size and buffering, plus the additional copying to an intermediate
  * buffer.  So we'll try this, and come back and do it the other way
  * if it stinks.
+ *
+ * It did, for small writes: a program writing a line at a time paid
+ * a round trip through the reader for each.  So those are copied
+ * into a buffer in the pipe, and the writer answered at once, as
+ * long as there's room and no writers already waiting ahead of it.
+ * A reader takes as much of the buffer as it asks for in one reply.
+ * Big writes still go straight across, copied once, into the reader,
+ * by the kernel.  Lending the writer's pages to the reader instead
+ * would need a page shared between psets, which the VM system doesn't
+ * allow.
+ *
+ * Every reply carries the tag of the request it answers in its m_op
+ * (see msg_tagged()); it's all a reply's m_op need hold.
  */
 #include "pipe.h"
 #include <hash.h>
@@ -23,24 +36,73 @@
 
 extern struct llist files;
 
+/*
+ * new_req()
+ *	Queue a request from "f" on "q"
+ *
+ * Returns the request, or 0 if memory's short.
+ */
+static struct req *
+new_req(struct file *f, struct llist *q, struct msg *m)
+{
+	struct req *r;
+
+	if ((r = malloc(sizeof(struct req))) == 0) {
+		return(0);
+	}
+	if ((r->r_q = ll_insert(q, r)) == 0) {
+		free(r);
+		return(0);
+	}
+	if ((r->r_entry = ll_insert(&f->f_reqs, r)) == 0) {
+		ll_delete(r->r_q);
+		free(r);
+		return(0);
+	}
+	r->r_file = f;
+	r->r_msg = *m;
+	return(r);
+}
+
+/*
+ * free_req()
+ *	Take a request off its queues and free it
+ */
+void
+free_req(struct req *r)
+{
+	ll_delete(r->r_q);
+	ll_delete(r->r_entry);
+	free(r);
+}
+
 /*
  * pipe_abort()
  *	Caller has requested abort of operation
+ *
+ * The M_ABORT carries the tag of the request it's for, or none,
+ * like the request, if the client isn't tagged.
  */
 void
 pipe_abort(struct msg *m, struct file *f)
 {
+	struct llist *l;
+	struct req *r;
+
 	/*
 	 * Always answer a zero-length message
 	 */
 	m->m_nseg = m->m_arg = m->m_arg1 = 0;
 
 	/*
-	 * Remove any pending I/O
+	 * Remove the pending I/O, if it's still here
 	 */
-	if (f->f_q) {
-		ll_delete(f->f_q);
-		f->f_q = 0;
+	for (l = LL_NEXT(&f->f_reqs); l != &f->f_reqs; l = LL_NEXT(l)) {
+		r = l->l_data;
+		if ((r->r_msg.m_op & M_TAG) == (m->m_op & M_TAG)) {
+			free_req(r);
+			break;
+		}
 	}
 
 	/*
@@ -52,17 +114,20 @@ pipe_abort(struct msg *m, struct file *f)
 /*
  * sendseg()
  *	Send data off to requestor, update message segments
+ *
+ * "rm" is the read being answered.
  */
 static uint
-sendseg(long retaddr, struct msg *m, uint nbyte)
+sendseg(struct msg *rm, struct msg *m)
 {
 	struct msg m2;
-	uint oseg, total = 0;
+	uint oseg, total = 0, nbyte = rm->m_arg;
 	seg_t *s;
 
 	/*
 	 * Set up our reply message
 	 */
+	m2.m_op = rm->m_op & M_TAG;
 	m2.m_arg = m2.m_arg1 = 0;
 	m2.m_nseg = 0;
 
@@ -113,7 +178,7 @@ sendseg(long retaddr, struct msg *m, uint nbyte)
 	 * Send reply
 	 */
 	m2.m_nseg = oseg;
-	msg_reply(retaddr, &m2);
+	msg_reply(rm->m_sender, &m2);
 
 	/*
 	 * Return amount of data taken from queue
@@ -121,41 +186,119 @@ sendseg(long retaddr, struct msg *m, uint nbyte)
 	return(total);
 }
 
+/*
+ * sendbuf()
+ *	Send buffered data to a reader
+ */
+static void
+sendbuf(struct pipe *o, struct msg *rm)
+{
+	struct msg m;
+	uint cnt;
+
+	cnt = rm->m_arg;
+	if (cnt > o->p_bufcnt) {
+		cnt = o->p_bufcnt;
+	}
+	m.m_op = rm->m_op & M_TAG;
+	m.m_buf = o->p_buf;
+	m.m_arg = m.m_buflen = cnt;
+	m.m_nseg = ((cnt > 0) ? 1 : 0);
+	m.m_arg1 = 0;
+	msg_reply(rm->m_sender, &m);
+
+	/*
+	 * Slide down what's left
+	 */
+	o->p_bufcnt -= cnt;
+	if (o->p_bufcnt > 0) {
+		bcopy(o->p_buf + cnt, o->p_buf, o->p_bufcnt);
+	}
+}
+
+/*
+ * bufwrite()
+ *	Take a small write into the pipe's buffer, if we can
+ *
+ * Returns 1 if the data's been taken and the writer answered, 0 if
+ * the write must be queued as usual.
+ */
+static int
+bufwrite(struct pipe *o, struct msg *m, uint nbyte)
+{
+	char *p;
+	uint x;
+
+	if ((nbyte > SMALLWRITE) || (m->m_op & M_SGL) ||
+			!LL_EMPTY(&o->p_writers) ||
+			((o->p_bufcnt + nbyte) > PIPEBUF)) {
+		return(0);
+	}
+	if (!o->p_buf && ((o->p_buf = malloc(PIPEBUF)) == 0)) {
+		return(0);
+	}
+
+	/*
+	 * Gather it in, and tell the writer it's done
+	 */
+	p = o->p_buf + o->p_bufcnt;
+	for (x = 0; x < m->m_nseg; ++x) {
+		bcopy(m->m_seg[x].s_buf, p, m->m_seg[x].s_buflen);
+		p += m->m_seg[x].s_buflen;
+	}
+	ASSERT_DEBUG(p == o->p_buf + o->p_bufcnt + nbyte,
+		"bufwrite: count");
+	o->p_bufcnt += nbyte;
+	m->m_arg = nbyte;
+	m->m_nseg = m->m_arg1 = 0;
+	msg_reply(m->m_sender, m);
+	return(1);
+}
+
 /*
  * run_readers()
- *	Move data from next queued writer to next queued reader
+ *	Move data from buffer or next queued writer to next queued reader
  */
 static void
 run_readers(struct pipe *o)
 {
-	struct file *r, *w;
+	struct req *r, *w;
 
-	while (!LL_EMPTY(&o->p_readers) && !LL_EMPTY(&o->p_writers)) {
+	while (!LL_EMPTY(&o->p_readers) &&
+			(o->p_bufcnt || !LL_EMPTY(&o->p_writers))) {
 
 		/*
 		 * Point to next reader and writer.  Reader always completes
-		 * here, so remove him from the list immediately.  If we
-		 * consume all the writer data, we'll remove him later.
+		 * here; we free him once answered.  If we consume all the
+		 * writer data, we'll complete him as well.
 		 */
 		r = LL_NEXT(&o->p_readers)->l_data;
-		ll_delete(r->f_q);
-		r->f_q = 0;
+
+		/*
+		 * Buffered data was written first
+		 */
+		if (o->p_bufcnt) {
+			sendbuf(o, &r->r_msg);
+			free_req(r);
+			continue;
+		}
 		w = LL_NEXT(&o->p_writers)->l_data;
 
 		/*
 		 * Copy segments
 		 */
-		sendseg(r->f_msg.m_sender, &w->f_msg, r->f_msg.m_arg);
+		sendseg(&r->r_msg, &w->r_msg);
+		free_req(r);
 
 		/*
 		 * If writer completely finished, dequeue and complete
 		 * him as well.
 		 */
-		if (w->f_msg.m_nseg == 0) {
-			ll_delete(w->f_q);
-			w->f_q = 0;
-			w->f_msg.m_arg1 = 0;
-			msg_reply(w->f_msg.m_sender, &w->f_msg);
+		if (w->r_msg.m_nseg == 0) {
+			w->r_msg.m_op &= M_TAG;
+			w->r_msg.m_arg1 = 0;
+			msg_reply(w->r_msg.m_sender, &w->r_msg);
+			free_req(w);
 		}
 	}
 }
@@ -168,12 +311,13 @@ void
 pipe_write(struct msg *m, struct file *f, uint nbyte)
 {
 	struct pipe *o = f->f_file;
+	struct req *r;
 
 	/*
 	 * Can only write to a true file, and only if open for writing.
 	 */
 	if (!o || !(f->f_perm & ACC_WRITE)) {
-		msg_err(m->m_sender, EPERM);
+		msg_errtag(m->m_sender, m->m_op, EPERM);
 		return;
 	}
 
@@ -182,7 +326,15 @@ pipe_write(struct msg *m, struct file *f, uint nbyte)
 	 * with no listeners (it's broken)?
 	 */
 	if (o->p_nread == PIPE_CLOSED_FOR_READS) {
-		msg_err(m->m_sender, EPIPE);
+		msg_errtag(m->m_sender, m->m_op, EPIPE);
+		return;
+	}
+
+	/*
+	 * Small writes go in our buffer, unless a reader's already
+	 * waiting to take them directly
+	 */
+	if (LL_EMPTY(&o->p_readers) && bufwrite(o, m, nbyte)) {
 		return;
 	}
 
@@ -190,13 +342,11 @@ pipe_write(struct msg *m, struct file *f, uint nbyte)
 	 * Queue write, fail if we can't insert list element (VM
 	 * exhausted?)
 	 */
-	ASSERT_DEBUG(f->f_q == 0, "pipe_write: busy");
-	if ((f->f_q = ll_insert(&o->p_writers, f)) == 0) {
-		msg_err(m->m_sender, strerror());
+	if ((r = new_req(f, &o->p_writers, m)) == 0) {
+		msg_errtag(m->m_sender, m->m_op, strerror());
 		return;
 	}
-	f->f_msg = *m;
-	f->f_msg.m_arg = 0;
+	r->r_msg.m_arg = 0;
 
 	/*
 	 * Now move to pending read requests
@@ -226,7 +376,7 @@ pipe_readdir(struct msg *m, struct file *f)
 		len = 256;
 	}
 	if ((buf = malloc(len+1)) == 0) {
-		msg_err(m->m_sender, strerror());
+		msg_errtag(m->m_sender, m->m_op, strerror());
 		return;
 	}
 	buf[0] = '\0';
@@ -312,14 +462,15 @@ pipe_read(struct msg *m, struct file *f)
 	 * Access?
 	 */
 	if (!(f->f_perm & ACC_READ)) {
-		msg_err(m->m_sender, EPERM);
+		msg_errtag(m->m_sender, m->m_op, EPERM);
 		return;
 	}
 
 	/*
-	 * If all writers have gone, continue to return EOF
+	 * If all writers have gone, continue to return EOF once
+	 * what they left is read
 	 */
-	if (o->p_nwrite == 0) {
+	if ((o->p_nwrite == 0) && (o->p_bufcnt == 0)) {
 		m->m_arg = m->m_arg1 = m->m_nseg = 0;
 		msg_reply(m->m_sender, m);
 		return;
@@ -328,18 +479,15 @@ pipe_read(struct msg *m, struct file *f)
 	/*
 	 * Queue as a reader
 	 */
-	ASSERT_DEBUG(f->f_q == 0, "pipe_read: busy");
-	if ((f->f_q = ll_insert(&o->p_readers, f)) == 0) {
-		msg_err(m->m_sender, strerror());
+	if (new_req(f, &o->p_readers, m) == 0) {
+		msg_errtag(m->m_sender, m->m_op, strerror());
 		return;
 	}
-	f->f_msg.m_sender = m->m_sender;
-	f->f_msg.m_arg = m->m_arg;
 
 	/*
 	 * If there's stuff waiting, get it now
 	 */
-	if (!LL_EMPTY(&o->p_writers)) {
+	if (o->p_bufcnt || !LL_EMPTY(&o->p_writers)) {
 		run_readers(o);
 	}
 }
@@ -25,7 +25,7 @@ pipe_stat(struct msg *m, struct file *f)
 	 * Verify access
 	 */
 	if (!(f->f_perm & ACC_READ)) {
-		msg_err(m->m_sender, EPERM);
+		msg_errtag(m->m_sender, m->m_op, EPERM);
 		return;
 	}
 
@@ -46,15 +46,16 @@ pipe_stat(struct msg *m, struct file *f)
 		owner = 0;
 	} else {
 		/*
-		 * File--its byte length
+		 * File--its byte length, buffered and still with
+		 * its writers
 		 */
-		len = 0;
+		len = o->p_bufcnt;
 		for (l = LL_NEXT(&o->p_writers); l != &o->p_writers;
 				l = LL_NEXT(l)) {
 			uint y;
 			struct msg *m2;
 
-			m2 = l->l_data;
+			m2 = &((struct req *)l->l_data)->r_msg;
 			for (y = 0; y < m2->m_nseg; ++y) {
 				len += m2->m_seg[y].s_buflen;
 			}
@@ -89,7 +90,7 @@ pipe_wstat(struct msg *m, struct file *f)
 	 * Can't fiddle the root dir
 	 */
 	if (f->f_file == 0) {
-		msg_err(m->m_sender, EINVAL);
+		msg_errtag(m->m_sender, m->m_op, EINVAL);
 	}
 
 	/*
@@ -101,5 +102,5 @@ pipe_wstat(struct msg *m, struct file *f)
 	/*
 	 * Not a field we support...
 	 */
-	msg_err(m->m_sender, EINVAL);
+	msg_errtag(m->m_sender, m->m_op, EINVAL);
 }
@@ -160,15 +160,20 @@ static void
 swap_main()
 {
 	struct msg msg;
-	int x;
+	seg_t segs[MSGSEGS_SGL];
+	int x, op;
 	struct file *f;
 
 loop:
 	/*
 	 * Receive a message, log an error and then keep going.  Note
 	 * that since there's no buffer, we will get all data in
-	 * terms of handles.
+	 * terms of handles.  The kernel's clustered page I/O can
+	 * bring more than MSGSEGS segments, so take them in a list.
 	 */
+	msg.m_op = M_SGL;
+	msg.m_seg[0].s_buf = segs;
+	msg.m_nseg = MSGSEGS_SGL;
 	x = msg_receive(rootport, &msg);
 	if (x < 0) {
 		syslog(LOG_ERR, "msg_receive");
@@ -176,9 +181,12 @@ loop:
 	}
 
 	/*
-	 * Has to fit in one buf
+	 * Only reads and writes may come in pieces; all else
+	 * has to fit in one buf
 	 */
-	if (msg.m_nseg > 1) {
+	op = msg.m_op & MSG_MASK;
+	if ((msg.m_nseg > 1) && (op != FS_ABSREAD) && (op != FS_ABSWRITE) &&
+			(op != FS_READ) && (op != FS_WRITE)) {
 		msg_err(msg.m_sender, EINVAL);
 		goto loop;
 	}
@@ -187,7 +195,7 @@ loop:
 	 * Categorize by basic message operation
 	 */
 	f = hash_lookup(filehash, msg.m_sender);
-	switch (msg.m_op & MSG_MASK) {
+	switch (op) {
 	case M_CONNECT:		/* New client */
 		new_client(&msg, x);
 		break;
@@ -8,17 +8,26 @@
 #include <sys/swap.h>
 #include <std.h>
 
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
 extern struct swapmap *swapent();
 
 /*
  * swap_rw()
  *	Look up underlying swap device, forward operation
+ *
+ * The kernel sends a cluster of pages as one message, a segment for
+ * each page.  We pass it on to the device MSGSEGS segments at a time,
+ * so it sees only messages of the usual shape.
  */
 void
 swap_rw(struct msg *m, struct file *f, uint bytes)
 {
 	struct swapmap *s;
-	uint blk, op = m->m_op & MSG_MASK;
+	struct msg m2;
+	seg_t *segs;
+	uint blk, x, y, nseg, len, op = m->m_op & MSG_MASK;
+	ulong off;
 
 	/*
 	 * Check for permission, page alignment
@@ -28,7 +37,7 @@ swap_rw(struct msg *m, struct file *f, uint bytes)
 		msg_err(m->m_sender, EPERM);
 		return;
 	}
-	if ((m->m_nseg != 1) || (bytes & (NBPG-1)) ||
+	if ((m->m_nseg < 1) || (bytes == 0) || (bytes & (NBPG-1)) ||
 			(f->f_pos & (NBPG-1))) {
 		msg_err(m->m_sender, EINVAL);
 		return;
@@ -36,25 +45,44 @@ swap_rw(struct msg *m, struct file *f, uint bytes)
 	blk = btop(f->f_pos);
 
 	/*
-	 * Find entry for next part of I/O
+	 * Find entry for the I/O; it may not run off its end
 	 */
-	if ((s = swapent(blk)) == 0) {
+	s = swapent(blk);
+	if ((s == 0) || ((blk + btop(bytes)) > (s->s_block + s->s_len))) {
 		msg_err(m->m_sender, EINVAL);
 		return;
 	}
+	if (m->m_op & M_SGL) {
+		segs = m->m_seg[0].s_buf;
+	} else {
+		segs = m->m_seg;
+	}
 
 	/*
 	 * Convert offset relative to beginning of this chunk of
 	 * swap space.
 	 */
-	m->m_arg1 = ptob(blk - s->s_block + s->s_off);
+	off = ptob(blk - s->s_block + s->s_off);
 
 	/*
 	 * Send off the I/O
 	 */
-	if (msg_send(s->s_port, m) < 0) {
-		msg_err(m->m_sender, strerror());
-		return;
+	for (x = 0; x < m->m_nseg; x += nseg) {
+		nseg = MIN(m->m_nseg - x, MSGSEGS);
+		len = 0;
+		for (y = 0; y < nseg; ++y) {
+			m2.m_seg[y] = segs[x + y];
+			len += segs[x + y].s_buflen;
+		}
+		m2.m_op = m->m_op & ~M_SGL;
+		m2.m_nseg = nseg;
+		m2.m_arg = len;
+		m2.m_arg1 = off;
+		if (msg_send(s->s_port, &m2) < 0) {
+			msg_err(m->m_sender, strerror());
+			return;
+		}
+		off += len;
 	}
 	m->m_buflen = m->m_arg = m->m_arg1 = m->m_nseg = 0;
 	msg_reply(m->m_sender, m);
@@ -6,22 +6,41 @@
 #include <sys/swap.h>
 
 extern ulong total_swap, free_swap;
+extern struct swapmap *swapmap, *swapend;
+extern void swap_frag(ulong *, ulong *);
 
 /*
  * swap_stat()
  *	Build stat string for file, send back
+ *
+ * Besides the usual, we tell how broken up the free space is--how
+ * many runs it lies in, and the longest--and how full each device
+ * is, as "swapN=free/size", for as many as fit.
  */
 void
 swap_stat(struct msg *m, struct file *f)
 {
-	char result[MAXSTAT];
+	char result[MAXSTAT], *p;
+	struct swapmap *s;
+	ulong nfree, largest;
 
 	/*
 	 * Root is hard-coded
 	 */
+	swap_frag(&nfree, &largest);
 	sprintf(result,
-	 "perm=1/1\nacc=0/4/2\nsize=%ld\ntype=f\nowner=0\nfree=%ld\n",
-		total_swap, free_swap);
+	 "perm=1/1\nacc=0/4/2\nsize=%ld\ntype=f\nowner=0\nfree=%ld\n"
+	 "freeruns=%ld\nlargest=%ld\n",
+		total_swap, free_swap, nfree, largest);
+	p = result + strlen(result);
+	for (s = swapmap; s < swapend; ++s) {
+		if ((p - result) > (MAXSTAT - 40)) {
+			break;
+		}
+		sprintf(p, "swap%d=%ld/%ld\n", (int)(s - swapmap),
+			s->s_free, s->s_len);
+		p += strlen(p);
+	}
 	m->m_buf = result;
 	m->m_arg = m->m_buflen = strlen(result);
 	m->m_nseg = 1;
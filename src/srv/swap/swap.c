@@ -3,17 +3,24 @@
  *	Routines for tabulating swap space
  *
  * We use two tricks to simplify the organization of swap.  First,
- * we start swap blocks at 1, not 0, so that we may simply enter
- * swap block numbers in to the resource map (0 is the error value
- * for an rmap).
+ * we start swap blocks at 1, not 0, so that 0 may serve as the error
+ * value for an allocation.
  *
  * Second, we always leave an unused block number between each chunk
  * of swap space added.  This means that the swap space for any given
  * virtual object will always reside on a single device.  This simplifies
  * the setup for I/O.
+ *
+ * Free space on each device is kept as a bitmap, a bit per block, set
+ * when the block is free.  Above it sits a summary bitmap with a bit
+ * per word of the map, set when that word has any free blocks at all,
+ * so a search can step over full stretches of swap a summary word
+ * (1024 blocks) at a time.  Searches for a run of blocks start from
+ * a hint, or failing that from where the device's last allocation
+ * left off, which keeps swap for objects created together close on
+ * disk.  Frees just set bits, a word at a time where they can.
  */
 #include <sys/swap.h>
-#include <rmap.h>
 #include <sys/assert.h>
 #include <sys/msg.h>
 #include <sys/seg.h>
@@ -22,12 +29,15 @@
 #include <mnttab.h>
 #include <fcntl.h>
 
-#define NMAPELEM (200)		/* # slots in resource map */
+#define LBITS (sizeof(ulong) * 8)	/* Bits in a map word */
+#define BIT(n) ((ulong)1 << ((n) % LBITS))
+#define ALLFREE (~(ulong)0)		/* Map word with all blocks free */
+#define ISFREE(s, b) ((s)->s_map[(b) / LBITS] & BIT(b))
+#define NWORDS(n) (((n) + LBITS - 1) / LBITS)
 
 struct swapmap *swapmap = 0;	/* The map of swap */
 int nswap = 0;
 struct swapmap *swapend = 0;
-struct rmap *smap;		/* Map of swap currently free */
 ulong total_swap = 0L,		/* Counts of swap blocks */
 	free_swap = 0L;
 ulong swap_pending = 0L;	/* Blocks alloc'ed before first swap */
@@ -36,20 +46,26 @@ ulong swap_pending = 0L;	/* Blocks alloc'ed before first swap */
 /*
  * swapent()
  *	Given swap block, return pointer to swap entry
+ *
+ * Entries are added in ascending order of block, so we can search
+ * them by halves.
  */
 struct swapmap *
 swapent(uint block)
 {
-	struct swapmap *s, *send;
+	struct swapmap *s;
+	int lo, hi, mid;
 
-	if (!swapmap) {
-		return(0);
-	}
-	for (s = swapmap; s < swapend; ++s) {
-		if (block < (s->s_block + s->s_len)) {
-			if (block < s->s_block) {
-				return(0);
-			}
+	lo = 0;
+	hi = nswap - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		s = &swapmap[mid];
+		if (block < s->s_block) {
+			hi = mid - 1;
+		} else if (block >= (s->s_block + s->s_len)) {
+			lo = mid + 1;
+		} else {
 			return(s);
 		}
 	}
@@ -62,8 +78,182 @@ swapent(uint block)
 void
 swapinit(void)
 {
-	smap = malloc(NMAPELEM*sizeof(struct rmap));
-	rmap_init(smap, NMAPELEM);
+	/* Nothing until a device is added */
+}
+
+/*
+ * mark()
+ *	Mark a run of blocks on a device as free or in use
+ *
+ * "b" is relative to the start of the device.  The summary bits are
+ * kept up to date as we go.
+ */
+static void
+mark(struct swapmap *s, ulong b, ulong n, int isfree)
+{
+	ulong w, bits;
+
+	while (n > 0) {
+		/*
+		 * A whole word at once where we can, otherwise
+		 * a bit at a time
+		 */
+		w = b / LBITS;
+		if (((b % LBITS) == 0) && (n >= LBITS)) {
+			bits = ALLFREE;
+		} else {
+			bits = BIT(b);
+		}
+		if (isfree) {
+			s->s_map[w] |= bits;
+		} else {
+			s->s_map[w] &= ~bits;
+		}
+		if (s->s_map[w]) {
+			s->s_sum[w / LBITS] |= BIT(w);
+		} else {
+			s->s_sum[w / LBITS] &= ~BIT(w);
+		}
+		if (bits == ALLFREE) {
+			b += LBITS;
+			n -= LBITS;
+		} else {
+			b += 1;
+			n -= 1;
+		}
+	}
+}
+
+/*
+ * find_run()
+ *	Find "n" free blocks in a row, all within [from, to)
+ *
+ * Returns the first block of the run, relative to the device, or -1.
+ */
+static long
+find_run(struct swapmap *s, ulong n, ulong from, ulong to)
+{
+	ulong b, w, run;
+
+	run = 0;
+	b = from;
+	while (b < to) {
+		/*
+		 * On a word boundary, see what we can skip or take
+		 * whole
+		 */
+		if ((b % LBITS) == 0) {
+			w = b / LBITS;
+			if (((w % LBITS) == 0) && (s->s_sum[w / LBITS] == 0)) {
+				run = 0;
+				b += LBITS * LBITS;
+				continue;
+			}
+			if (s->s_map[w] == 0) {
+				run = 0;
+				b += LBITS;
+				continue;
+			}
+			if (s->s_map[w] == ALLFREE) {
+				run += LBITS;
+				b += LBITS;
+				if (run >= n) {
+					return(b - run);
+				}
+				continue;
+			}
+		}
+
+		/*
+		 * Otherwise bit by bit
+		 */
+		if (ISFREE(s, b)) {
+			if (++run == n) {
+				return(b + 1 - run);
+			}
+		} else {
+			run = 0;
+		}
+		b += 1;
+	}
+	return(-1);
+}
+
+/*
+ * dev_alloc()
+ *	Allocate "n" blocks on a device, near "hint"
+ *
+ * "hint" is relative to the device.  Returns the swap block # of
+ * the first, or 0.
+ */
+static ulong
+dev_alloc(struct swapmap *s, ulong n, ulong hint)
+{
+	long b;
+	ulong to;
+
+	if ((s->s_port == 0) || (s->s_free < n)) {
+		return(0);
+	}
+
+	/*
+	 * Search from the hint to the end, then wrap around.  The
+	 * second search may run up to n-1 blocks past the hint, to
+	 * catch a run which straddles it.
+	 */
+	if (hint >= s->s_len) {
+		hint = 0;
+	}
+	b = find_run(s, n, hint, s->s_len);
+	if ((b < 0) && hint) {
+		to = hint + n - 1;
+		if (to > s->s_len) {
+			to = s->s_len;
+		}
+		b = find_run(s, n, 0, to);
+	}
+	if (b < 0) {
+		return(0);
+	}
+
+	/*
+	 * Take it, and start next time just past it
+	 */
+	mark(s, b, n, 0);
+	s->s_free -= n;
+	s->s_rotor = b + n;
+	return(s->s_block + b);
+}
+
+/*
+ * dev_extents()
+ *	Count a device's runs of free blocks, and find its longest
+ */
+static void
+dev_extents(struct swapmap *s, ulong *nextp, ulong *largestp)
+{
+	ulong b, run, next, largest;
+
+	next = largest = run = 0;
+	for (b = 0; b < s->s_len; ++b) {
+		if (((b % LBITS) == 0) && (s->s_map[b / LBITS] == 0) &&
+				(run == 0)) {
+			b += LBITS - 1;
+			continue;
+		}
+		if (ISFREE(s, b)) {
+			if (run++ == 0) {
+				next += 1;
+			}
+			if (run > largest) {
+				largest = run;
+			}
+		} else {
+			run = 0;
+		}
+	}
+	*nextp = next;
+	*largestp = largest;
 }
 
 /*
@@ -104,17 +294,25 @@ swapadd(port_t port, ulong len, ulong off)
 	s->s_len = len;
 	s->s_port = port;
 	s->s_off = off;
+	s->s_free = 0;
+	s->s_rotor = 0;
+	s->s_map = calloc(NWORDS(len), sizeof(ulong));
+	s->s_sum = calloc(NWORDS(NWORDS(len)), sizeof(ulong));
+	ASSERT(s->s_map && s->s_sum, "swapadd: out of core for map");
 
 	/*
-	 * Add it to our resource map, too
+	 * Mark its blocks free, less any handed out before it came
 	 */
 	if (swap_pending) {
-		rmap_free(smap, low + swap_pending, len - swap_pending);
+		mark(s, swap_pending, len - swap_pending, 1);
+		s->s_free = len - swap_pending;
+		s->s_rotor = swap_pending;
 		swap_pending = 0L;
 	} else {
-		rmap_free(smap, low, len);
+		mark(s, 0, len, 1);
+		s->s_free = len;
 	}
-	free_swap += len;
+	free_swap += s->s_free;
 	total_swap += len;
 }
 
@@ -165,7 +363,7 @@ swap_add(struct msg *m, struct file *f, uint len)
 		slen = btop(atoi(rstat(p, "size")));
 		slen -= sa->s_off;
 	} else {
-		slen = 0;
+		slen = sa->s_len;
 	}
 
 	/*
@@ -187,11 +385,16 @@ swap_add(struct msg *m, struct file *f, uint len)
 /*
  * swap_alloc()
  *	Allocate some swap space
+ *
+ * m_arg is the number of blocks; m_arg1, if non-zero, a block they'd
+ * best be near.  Failing that, we go first to the device with the
+ * most room, then to any other.
  */
 void
 swap_alloc(struct msg *m, struct file *f)
 {
-	ulong blocks, blkno;
+	ulong blocks, blkno, hint;
+	struct swapmap *s, *best;
 
 	/*
 	 * Need write access to consume swap
@@ -206,30 +409,49 @@ swap_alloc(struct msg *m, struct file *f)
 	 * tally.
 	 */
 	blocks = m->m_arg;
+	hint = m->m_arg1;
+	blkno = 0;
 	if (!swapmap) {
-		m->m_arg = swap_pending + 1L;
+		blkno = swap_pending + 1L;
 		swap_pending += blocks;
-	}
-
-	/*
-	 * Else pull blocks from resource map
-	 */
-	else if ((blkno = rmap_alloc(smap, blocks)) == 0) {
+	} else if (blocks > 0) {
 		/*
-		 * Failure
+		 * Near the hint, if there is one
 		 */
-		m->m_arg = 0;
-	} else {
+		best = 0;
+		if (hint && (s = swapent(hint))) {
+			blkno = dev_alloc(s, blocks, hint - s->s_block);
+			best = s;
+		}
+
 		/*
-		 * Success--update count, return block #
+		 * Else roomiest device first, then the rest
 		 */
-		free_swap -= blocks;
-		m->m_arg = blkno;
+		if (blkno == 0) {
+			s = 0;
+			for (best = swapmap; best < swapend; ++best) {
+				if (!s || (best->s_free > s->s_free)) {
+					s = best;
+				}
+			}
+			blkno = dev_alloc(s, blocks, s->s_rotor);
+			for (best = swapmap; !blkno && (best < swapend);
+					++best) {
+				if (best != s) {
+					blkno = dev_alloc(best, blocks,
+						best->s_rotor);
+				}
+			}
+		}
+		if (blkno) {
+			free_swap -= blocks;
+		}
 	}
 
 	/*
-	 * Send back block # allocated, or failure
+	 * Send back block # allocated, or 0 for failure
 	 */
+	m->m_arg = blkno;
 	m->m_arg1 = m->m_buflen = m->m_nseg = 0;
 	msg_reply(m->m_sender, m);
 }
@@ -241,11 +463,45 @@ swap_alloc(struct msg *m, struct file *f)
 void
 swap_free(struct msg *m, struct file *f)
 {
+	struct swapmap *s;
+	ulong blkno = m->m_arg, blocks = m->m_arg1;
+
 	if (!(f->f_perms & ACC_WRITE)) {
 		msg_err(m->m_sender, EPERM);
+		return;
+	}
+
+	/*
+	 * It all has to lie within one device
+	 */
+	s = swapent(blkno);
+	if (!s || ((blkno + blocks) > (s->s_block + s->s_len))) {
+		msg_err(m->m_sender, EINVAL);
+		return;
 	}
-	free_swap += m->m_arg1;
-	rmap_free(smap, m->m_arg, m->m_arg1);
+	mark(s, blkno - s->s_block, blocks, 1);
+	s->s_free += blocks;
+	free_swap += blocks;
 	m->m_arg = m->m_buflen = m->m_nseg = m->m_arg1 = 0;
 	msg_reply(m->m_sender, m);
 }
+
+/*
+ * swap_frag()
+ *	Tell the number of free runs and longest, over all of swap
+ */
+void
+swap_frag(ulong *nextp, ulong *largestp)
+{
+	struct swapmap *s;
+	ulong next, largest;
+
+	*nextp = *largestp = 0;
+	for (s = swapmap; s < swapend; ++s) {
+		dev_extents(s, &next, &largest);
+		*nextp += next;
+		if (largest > *largestp) {
+			*largestp = largest;
+		}
+	}
+}
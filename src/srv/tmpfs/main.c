@@ -28,12 +28,12 @@ static void
 tmpfs_seek(struct msg *m, struct file *f)
 {
 	if (m->m_arg < 0) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 	f->f_pos = m->m_arg;
 	m->m_buflen = m->m_arg = m->m_arg1 = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -57,7 +57,7 @@ new_client(struct msg *m)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -75,7 +75,7 @@ new_client(struct msg *m)
 	 */
         if (hash_insert(filehash, m->m_sender, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -107,7 +107,7 @@ dup_client(struct msg *m, struct file *fold)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -121,7 +121,7 @@ dup_client(struct msg *m, struct file *fold)
 	 */
         if (hash_insert(filehash, m->m_arg, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -136,7 +136,7 @@ dup_client(struct msg *m, struct file *fold)
 	 * Return acceptance
 	 */
 	m->m_arg = m->m_arg1 = m->m_buflen = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -167,7 +167,7 @@ loop:
 	/*
 	 * Receive a message, log an error and then keep going
 	 */
-	x = msg_receive(rootport, &msg);
+	x = srv_receive(rootport, &msg);
 	if (x < 0) {
 		syslog(LOG_ERR, "msg_receive");
 		goto loop;
@@ -192,12 +192,12 @@ loop:
 		 * We're synchronous, so presumably the operation
 		 * is all done and this abort is old news.
 		 */
-		msg_reply(msg.m_sender, &msg);
+		srv_reply(msg.m_sender, &msg);
 		break;
 	case FS_OPEN:		/* Look up file from directory */
 		if ((msg.m_nseg != 1) || !valid_fname(msg.m_buf,
 				msg.m_buflen)) {
-			msg_err(msg.m_sender, EINVAL);
+			srv_err(msg.m_sender, EINVAL);
 			break;
 		}
 		tmpfs_open(&msg, f);
@@ -205,7 +205,7 @@ loop:
 
 	case FS_ABSREAD:	/* Set position, then read */
 		if (msg.m_arg1 < 0) {
-			msg_err(msg.m_sender, EINVAL);
+			srv_err(msg.m_sender, EINVAL);
 			break;
 		}
 		f->f_pos = msg.m_arg1;
@@ -216,7 +216,7 @@ loop:
 
 	case FS_ABSWRITE:	/* Set position, then write */
 		if (msg.m_arg1 < 0) {
-			msg_err(msg.m_sender, EINVAL);
+			srv_err(msg.m_sender, EINVAL);
 			break;
 		}
 		f->f_pos = msg.m_arg1;
@@ -231,7 +231,7 @@ loop:
 	case FS_REMOVE:		/* Get rid of a file */
 		if ((msg.m_nseg != 1) || !valid_fname(msg.m_buf,
 				msg.m_buflen)) {
-			msg_err(msg.m_sender, EINVAL);
+			srv_err(msg.m_sender, EINVAL);
 			break;
 		}
 		tmpfs_remove(&msg, f);
@@ -248,7 +248,7 @@ loop:
 		break;
 
 	default:		/* Unknown */
-		msg_err(msg.m_sender, EINVAL);
+		srv_err(msg.m_sender, EINVAL);
 		break;
 	}
 	goto loop;
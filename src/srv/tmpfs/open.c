@@ -153,7 +153,7 @@ tmpfs_open(struct msg *m, struct file *f)
 	 * Have to be in root dir to open down into a file
 	 */
 	if (f->f_file) {
-		msg_err(m->m_sender, ENOTDIR);
+		srv_err(m->m_sender, ENOTDIR);
 		return;
 	}
 
@@ -161,7 +161,7 @@ tmpfs_open(struct msg *m, struct file *f)
 	 * No subdirs in a tmpfs filesystem
 	 */
 	if (m->m_arg & ACC_DIR) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 
@@ -174,7 +174,7 @@ tmpfs_open(struct msg *m, struct file *f)
 	 * No such file--do they want to create?
 	 */
 	if (!o && !(m->m_arg & ACC_CREATE)) {
-		msg_err(m->m_sender, ESRCH);
+		srv_err(m->m_sender, ESRCH);
 		return;
 	}
 
@@ -186,7 +186,7 @@ tmpfs_open(struct msg *m, struct file *f)
 		 * Failure?
 		 */
 		if ((o = dir_newfile(f, m->m_buf)) == 0) {
-			msg_err(m->m_sender, ENOMEM);
+			srv_err(m->m_sender, ENOMEM);
 			return;
 		}
 
@@ -196,7 +196,7 @@ tmpfs_open(struct msg *m, struct file *f)
 		f->f_file = o; o->o_refs += 1;
 		f->f_perm = ACC_READ|ACC_WRITE|ACC_CHMOD;
 		m->m_nseg = m->m_arg = m->m_arg1 = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		return;
 	}
 
@@ -206,7 +206,7 @@ tmpfs_open(struct msg *m, struct file *f)
 	x = perm_calc(f->f_perms, f->f_nperm, &o->o_prot);
 	want = m->m_arg & (ACC_READ|ACC_WRITE|ACC_CHMOD);
 	if ((want & x) != want) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -223,7 +223,7 @@ tmpfs_open(struct msg *m, struct file *f)
 	f->f_file = o; o->o_refs += 1;
 	f->f_perm = want | (x & ACC_CHMOD);
 	m->m_nseg = m->m_arg = m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -275,7 +275,7 @@ tmpfs_remove(struct msg *m, struct file *f)
 	 * Have to be in root dir
 	 */
 	if (f->f_file) {
-		msg_err(m->m_sender, ENOTDIR);
+		srv_err(m->m_sender, ENOTDIR);
 		return;
 	}
 
@@ -284,7 +284,7 @@ tmpfs_remove(struct msg *m, struct file *f)
 	 */
 	o = dir_lookup(m->m_buf);
 	if (o == 0) {
-		msg_err(m->m_sender, ESRCH);
+		srv_err(m->m_sender, ESRCH);
 		return;
 	}
 
@@ -293,7 +293,7 @@ tmpfs_remove(struct msg *m, struct file *f)
 	 */
 	x = perm_calc(f->f_perms, f->f_nperm, &o->o_prot);
 	if ((x & (ACC_WRITE|ACC_CHMOD)) == 0) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -311,5 +311,5 @@ tmpfs_remove(struct msg *m, struct file *f)
 	 * Return success
 	 */
 	m->m_buflen = m->m_arg = m->m_arg1 = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
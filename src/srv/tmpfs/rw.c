@@ -110,7 +110,7 @@ tmpfs_write(struct msg *m, struct file *f)
 	 * Can only write to a true file, and only if open for writing.
 	 */
 	if (!o || !(f->f_perm & ACC_WRITE)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -149,11 +149,11 @@ tmpfs_write(struct msg *m, struct file *f)
 	 * Done.  Return count of stuff written.
 	 */
 	if ((cnt == 0) && err) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 	} else {
 		m->m_arg = cnt;
 		m->m_arg1 = m->m_nseg = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 	}
 }
 
@@ -179,7 +179,7 @@ tmpfs_readdir(struct msg *m, struct file *f)
 		len = 256;
 	}
 	if ((buf = malloc(len+1)) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 	buf[0] = '\0';
@@ -236,7 +236,7 @@ tmpfs_readdir(struct msg *m, struct file *f)
 	m->m_arg = m->m_buflen = bufcnt;
 	m->m_nseg = ((bufcnt > 0) ? 1 : 0);
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 	free(buf);
 	f->f_pos = pos;
 }
@@ -267,7 +267,7 @@ tmpfs_read(struct msg *m, struct file *f)
 	 * Access?
 	 */
 	if (!(f->f_perm & ACC_READ)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -276,7 +276,7 @@ tmpfs_read(struct msg *m, struct file *f)
 	 */
 	if (f->f_pos >= o->o_len) {
 		m->m_arg = m->m_arg1 = m->m_buflen = m->m_nseg = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		return;
 	}
 
@@ -410,7 +410,7 @@ retshort:
 	m->m_arg = cnt;
 	m->m_nseg = nseg;
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 
 	/*
 	 * Free our extra buffer if it's been used
@@ -60,7 +60,7 @@ tmpfs_stat(struct msg *m, struct file *f)
 	m->m_arg = m->m_buflen = strlen(buf);
 	m->m_nseg = 1;
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -76,7 +76,7 @@ tmpfs_wstat(struct msg *m, struct file *f)
 	 * Can't fiddle the root dir
 	 */
 	if (f->f_file == 0) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 	}
 
 	/*
@@ -88,7 +88,7 @@ tmpfs_wstat(struct msg *m, struct file *f)
 	/*
 	 * Not a field we support...
 	 */
-	msg_err(m->m_sender, EINVAL);
+	srv_err(m->m_sender, EINVAL);
 }
 
 /*
@@ -104,11 +104,11 @@ tmpfs_fid(struct msg *m, struct file *f)
 	 * Only files get an ID
 	 */
 	if (o == 0) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 	m->m_arg = (ulong)o;
 	m->m_arg1 = o->o_len;
 	m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
@@ -15,6 +15,7 @@
 #include <sys/types.h>
 #include <sys/fs.h>
 #include <sys/perm.h>
+#include <server.h>
 
 /*
  * Block sizes.  We allocate BLOCKSIZE for all blocks except the first
@@ -45,12 +45,12 @@ static void
 vfs_seek(struct msg *m, struct file *f)
 {
 	if (m->m_arg < 0) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 	f->f_pos = m->m_arg+OFF_DATA;
 	m->m_buflen = m->m_arg = m->m_arg1 = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -70,7 +70,7 @@ new_client(struct msg *m)
 	 */
 	fs = getfs(rootdir, 0);
 	if (!fs) {
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -78,7 +78,7 @@ new_client(struct msg *m)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -103,7 +103,7 @@ new_client(struct msg *m)
 	 */
         if (hash_insert(filehash, m->m_sender, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -131,7 +131,7 @@ dup_client(struct msg *m, struct file *fold)
 	 * Get data structure
 	 */
 	if ((f = malloc(sizeof(struct file))) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -148,7 +148,7 @@ dup_client(struct msg *m, struct file *fold)
 	 */
         if (hash_insert(filehash, m->m_arg, f)) {
 		free(f);
-		msg_err(m->m_sender, ENOMEM);
+		srv_err(m->m_sender, ENOMEM);
 		return;
 	}
 
@@ -157,7 +157,7 @@ dup_client(struct msg *m, struct file *fold)
 	 */
 	ref_node(f->f_file);
 	m->m_arg = m->m_arg1 = m->m_buflen = m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -193,7 +193,7 @@ loop:
 	/*
 	 * Receive a message, log an error and then keep going
 	 */
-	x = msg_receive(rootport, &msg);
+	x = srv_receive(rootport, &msg);
 	if (x < 0) {
 		syslog(LOG_ERR, "msg_receive");
 		goto loop;
@@ -218,11 +218,11 @@ loop:
 		 * We're synchronous, so presumably the operation
 		 * is all done and this abort is old news.
 		 */
-		msg_reply(msg.m_sender, &msg);
+		srv_reply(msg.m_sender, &msg);
 		break;
 	case FS_OPEN:		/* Look up file from directory */
 		if (!valid_fname(msg.m_buf, msg.m_buflen)) {
-			msg_err(msg.m_sender, EINVAL);
+			srv_err(msg.m_sender, EINVAL);
 			break;
 		}
 		vfs_open(&msg, f);
@@ -230,7 +230,7 @@ loop:
 
 	case FS_ABSREAD:	/* Set position, then read */
 		if (msg.m_arg1 < 0) {
-			msg_err(msg.m_sender, EINVAL);
+			srv_err(msg.m_sender, EINVAL);
 			break;
 		}
 		f->f_pos = msg.m_arg1+OFF_DATA;
@@ -241,7 +241,7 @@ loop:
 
 	case FS_ABSWRITE:	/* Set position, then write */
 		if (msg.m_arg1 < 0) {
-			msg_err(msg.m_sender, EINVAL);
+			srv_err(msg.m_sender, EINVAL);
 			break;
 		}
 		f->f_pos = msg.m_arg1+OFF_DATA;
@@ -269,7 +269,7 @@ loop:
 		vfs_rename(&msg, f);
 		break;
 	default:		/* Unknown */
-		msg_err(msg.m_sender, EINVAL);
+		srv_err(msg.m_sender, EINVAL);
 		break;
 	}
 	goto loop;
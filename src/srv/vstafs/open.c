@@ -740,7 +740,7 @@ vfs_open(struct msg *m, struct file *f)
 	 */
 	fs = getfs(f->f_file, &b);
 	if (!fs) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 
@@ -748,7 +748,7 @@ vfs_open(struct msg *m, struct file *f)
 	 * Have to be in dir to open down into a file
 	 */
 	if (fs->fs_type != FT_DIR) {
-		msg_err(m->m_sender, ENOTDIR);
+		srv_err(m->m_sender, ENOTDIR);
 		return;
 	}
 
@@ -767,7 +767,7 @@ vfs_open(struct msg *m, struct file *f)
 	 */
 	nm = parse_name(m->m_buf, &rev);
 	if (rev && (m->m_arg & ACC_CREATE)) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 
@@ -788,7 +788,7 @@ vfs_open(struct msg *m, struct file *f)
 	 * No such file--do they want to create?
 	 */
 	if (!o && !(m->m_arg & ACC_CREATE)) {
-		msg_err(m->m_sender, ESRCH);
+		srv_err(m->m_sender, ESRCH);
 		goto out;
 	}
 
@@ -800,7 +800,7 @@ vfs_open(struct msg *m, struct file *f)
 		 * Allowed?
 		 */
 		if ((f->f_perm & (ACC_WRITE|ACC_CHMOD)) == 0) {
-			msg_err(m->m_sender, EPERM);
+			srv_err(m->m_sender, EPERM);
 			goto out;
 		}
 
@@ -808,7 +808,7 @@ vfs_open(struct msg *m, struct file *f)
 		 * Read-only?
 		 */
 		if (roflag) {
-			msg_err(m->m_sender, EROFS);
+			srv_err(m->m_sender, EROFS);
 			goto out;
 		}
 
@@ -818,7 +818,7 @@ vfs_open(struct msg *m, struct file *f)
 		o = dir_newfile(f, m->m_buf, (m->m_arg & ACC_DIR) ?
 				FT_DIR : FT_FILE);
 		if (o == 0) {
-			msg_err(m->m_sender, ENOMEM);
+			srv_err(m->m_sender, ENOMEM);
 			goto out;
 		}
 
@@ -829,7 +829,7 @@ vfs_open(struct msg *m, struct file *f)
 		f->f_file = o;
 		f->f_perm = ACC_READ|ACC_WRITE|ACC_CHMOD;
 		m->m_nseg = m->m_arg = m->m_arg1 = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		goto out;
 	}
 
@@ -849,12 +849,12 @@ vfs_open(struct msg *m, struct file *f)
 	}
 	if ((want & x) != want) {
 		deref_node(o);
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		goto out;
 	}
 	if (roflag && (want & (ACC_WRITE | ACC_CREATE | ACC_CHMOD))) {
 		deref_node(o);
-		msg_err(m->m_sender, EROFS);
+		srv_err(m->m_sender, EROFS);
 		goto out;
 	}
 
@@ -874,7 +874,7 @@ vfs_open(struct msg *m, struct file *f)
 		if (((x & ACC_WRITE) == 0) ||
 				(fs->fs_type != FT_FILE)) {
 			deref_node(o);
-			msg_err(m->m_sender, EPERM);
+			srv_err(m->m_sender, EPERM);
 			goto out;
 		}
 
@@ -922,7 +922,7 @@ vfs_open(struct msg *m, struct file *f)
 	f->f_file = o;
 	f->f_perm = m->m_arg | (x & ACC_CHMOD);
 	m->m_nseg = m->m_arg = m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 out:
 	unlock_buf(b);
 	if (nm && rev) {
@@ -1097,7 +1097,7 @@ vfs_remove(struct msg *m, struct file *f)
 	 */
 	fsdir = getfs(f->f_file, &bdir);
 	if (fsdir == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 	lock_buf(bdir);
@@ -1283,10 +1283,10 @@ out:
 	 * Return success/error
 	 */
 	if (err) {
-		msg_err(m->m_sender, err);
+		srv_err(m->m_sender, err);
 	} else {
 		m->m_buflen = m->m_arg = m->m_arg1 = m->m_nseg = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 	}
 }
 
@@ -1458,7 +1458,7 @@ vfs_rename(struct msg *m, struct file *f)
 	 * Sanity
 	 */
 	if ((m->m_arg1 == 0) || !valid_fname(m->m_buf, m->m_buflen)) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 
@@ -1466,7 +1466,7 @@ vfs_rename(struct msg *m, struct file *f)
 	 * Read-only filesystem
 	 */
 	if (roflag) {
-		msg_err(m->m_sender, EROFS);
+		srv_err(m->m_sender, EROFS);
 		return;
 	}
 
@@ -1476,7 +1476,7 @@ vfs_rename(struct msg *m, struct file *f)
 	if (rename_pending == 0) {
 		rename_pending = hash_alloc(16);
 		if (rename_pending == 0) {
-			msg_err(m->m_sender, strerror());
+			srv_err(m->m_sender, strerror());
 			return;
 		}
 	}
@@ -1489,7 +1489,7 @@ vfs_rename(struct msg *m, struct file *f)
 		 * Transaction ID collision?
 		 */
 		if (hash_lookup(rename_pending, m->m_arg1)) {
-			msg_err(m->m_sender, EBUSY);
+			srv_err(m->m_sender, EBUSY);
 			return;
 		}
 
@@ -1497,7 +1497,7 @@ vfs_rename(struct msg *m, struct file *f)
 		 * Insert in hash
 		 */
 		if (hash_insert(rename_pending, m->m_arg1, f)) {
-			msg_err(m->m_sender, strerror());
+			srv_err(m->m_sender, strerror());
 			return;
 		}
 
@@ -1515,7 +1515,7 @@ vfs_rename(struct msg *m, struct file *f)
 	 */
 	f2 = hash_lookup(rename_pending, m->m_arg1);
 	if (f2 == 0) {
-		msg_err(m->m_sender, ESRCH);
+		srv_err(m->m_sender, ESRCH);
 		return;
 	}
 	(void)hash_delete(rename_pending, m->m_arg1);
@@ -1525,12 +1525,12 @@ vfs_rename(struct msg *m, struct file *f)
 	 */
 	errstr = do_rename(f2, f2->f_rename_msg.m_buf, f, m->m_buf);
 	if (errstr) {
-		msg_err(m->m_sender, errstr);
-		msg_err(f2->f_rename_msg.m_sender, errstr);
+		srv_err(m->m_sender, errstr);
+		srv_err(f2->f_rename_msg.m_sender, errstr);
 	} else {
 		m->m_nseg = m->m_arg = m->m_arg1 = 0;
-		msg_reply(m->m_sender, m);
-		msg_reply(f2->f_rename_msg.m_sender, m);
+		srv_reply(m->m_sender, m);
+		srv_reply(f2->f_rename_msg.m_sender, m);
 	}
 
 	/*
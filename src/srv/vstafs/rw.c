@@ -302,7 +302,7 @@ vfs_write(struct msg *m, struct file *f)
 	 * Can only write to a true file, and only if open for writing.
 	 */
 	if (!o || !(f->f_perm & ACC_WRITE)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -336,11 +336,11 @@ vfs_write(struct msg *m, struct file *f)
 	 * Done.  Return count of stuff written.
 	 */
 	if ((cnt == 0) && err) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 	} else {
 		m->m_arg = cnt;
 		m->m_arg1 = m->m_nseg = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 	}
 }
 
@@ -364,7 +364,7 @@ vfs_readdir(struct msg *m, struct file *f)
 	 */
 	len = MIN(m->m_arg, 256);
 	if ((buf = malloc(len+1)) == 0) {
-		msg_err(m->m_sender, strerror());
+		srv_err(m->m_sender, strerror());
 		return;
 	}
 	buf[0] = '\0';
@@ -374,7 +374,7 @@ vfs_readdir(struct msg *m, struct file *f)
 	 */
 	fs = getfs(f->f_file, &b);
 	if (!fs) {
-		msg_err(m->m_sender, EIO);
+		srv_err(m->m_sender, EIO);
 		return;
 	}
 	lock_buf(b);
@@ -454,7 +454,7 @@ vfs_readdir(struct msg *m, struct file *f)
 	m->m_arg = m->m_buflen = bufcnt;
 	m->m_nseg = ((bufcnt > 0) ? 1 : 0);
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 	free(buf);
 }
 
@@ -476,7 +476,7 @@ vfs_read(struct msg *m, struct file *f)
 	 */
 	fs = getfs(f->f_file, &b);
 	if (!fs) {
-		msg_err(m->m_sender, EIO);
+		srv_err(m->m_sender, EIO);
 		return;
 	}
 
@@ -484,7 +484,7 @@ vfs_read(struct msg *m, struct file *f)
 	 * Access?
 	 */
 	if (!(f->f_perm & ACC_READ)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -501,7 +501,7 @@ vfs_read(struct msg *m, struct file *f)
 	 */
 	if (f->f_pos >= fs->fs_len) {
 		m->m_arg = m->m_arg1 = m->m_buflen = m->m_nseg = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		return;
 	}
 
@@ -557,7 +557,7 @@ vfs_read(struct msg *m, struct file *f)
 	m->m_arg = cnt;
 	m->m_nseg = nseg;
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 
 	/*
 	 * Free up bufs
@@ -47,7 +47,7 @@ vfs_stat(struct msg *m, struct file *f)
 	fs = getfs(f->f_file, &b);
 	if (!(f->f_perm & (ACC_READ | ACC_CHMOD)) &&
 			(f->f_perms[0].perm_uid != fs->fs_owner)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -111,7 +111,7 @@ vfs_stat(struct msg *m, struct file *f)
 	m->m_arg = m->m_buflen = strlen(buf);
 	m->m_nseg = 1;
 	m->m_arg1 = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 }
 
 /*
@@ -131,7 +131,7 @@ vfs_wstat(struct msg *m, struct file *f)
 	fs = getfs(f->f_file, &b);
 	if (!(f->f_perm & (ACC_CHMOD)) &&
 			(f->f_perms[0].perm_uid != fs->fs_owner)) {
-		msg_err(m->m_sender, EPERM);
+		srv_err(m->m_sender, EPERM);
 		return;
 	}
 
@@ -139,7 +139,7 @@ vfs_wstat(struct msg *m, struct file *f)
 	 * Read-only filesystem?
 	 */
 	if (roflag) {
-		msg_err(m->m_sender, EROFS);
+		srv_err(m->m_sender, EROFS);
 		return;
 	}
 
@@ -161,14 +161,14 @@ vfs_wstat(struct msg *m, struct file *f)
 		fs->fs_mtime = atoi(val);
 		dirty_buf(b, 0);
 		m->m_nseg = m->m_arg = m->m_arg1 = 0;
-		msg_reply(m->m_sender, m);
+		srv_reply(m->m_sender, m);
 		return;
 	}
 
 	/*
 	 * Not a field we support...
 	 */
-	msg_err(m->m_sender, EINVAL);
+	srv_err(m->m_sender, EINVAL);
 }
 
 /*
@@ -187,17 +187,19 @@ vfs_fid(struct msg *m, struct file *f)
 	o = f->f_file;
 	fs = getfs(o, 0);
 	if (fs->fs_type == FT_DIR) {
-		msg_err(m->m_sender, EINVAL);
+		srv_err(m->m_sender, EINVAL);
 		return;
 	}
 
 	/*
-	 * arg is the inode value; arg1 is the size in pages
+	 * arg is the inode value; arg1 is the size in pages.  The
+	 * modification time stamps it, so a rewrite is noticed.
 	 */
 	m->m_arg = fs->fs_blks[0].a_start;
 	m->m_arg1 = btop(fs->fs_len);
+	m->m_op = FID_STAMP(fs->fs_mtime);
 	m->m_nseg = 0;
-	msg_reply(m->m_sender, m);
+	srv_reply(m->m_sender, m);
 
 	/*
 	 * Flag that this file may be hashed
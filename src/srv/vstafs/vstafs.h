@@ -13,6 +13,7 @@
  */
 #include <sys/perm.h>
 #include <sys/fs.h>
+#include <server.h>
 #include <abc.h>
 
 #define SECSZ (512)		/* Basic size of allocation units */